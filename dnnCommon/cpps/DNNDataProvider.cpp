@@ -10,6 +10,7 @@
 
 #include "DNNUtil.h"
 #include "DNNDataProvider.h"
+#include "DNNTracer.h"
 #include "conv_endian.h"
 #include "stats_info.h"
 
@@ -25,8 +26,13 @@ DNNDataProvider::DNNDataProvider()
 	for (int i=0; i< DNN_BATCH_RING_SIZE; i++) {
 	     this->features[i] = NULL;
 	     this->labels[i] = NULL;
+	     this->csrRowPtrs[i] = NULL;
+	     this->csrColIndices[i] = NULL;
+	     this->csrValues[i] = NULL;
 	};
 
+	this->sparseFeatures = false;
+
 	this->use_stats = false; 
 	this->meanvalues = NULL; 
 	this->stddevs = NULL; 
@@ -56,6 +62,12 @@ void DNNDataProvider::create_transfer_buffers(int batchSize)
 		     this->labels[i] = new float[batchSize*this->m_dataLabelSize*sizeof(float)];
 	    else
 		     this->labels[i] = NULL;
+
+	    if ( this->sparseFeatures ) {
+		     this->csrRowPtrs[i] = new int[batchSize+1];
+		     this->csrColIndices[i] = new int[batchSize*this->m_dataFeatureSize];
+		     this->csrValues[i] = new float[batchSize*this->m_dataFeatureSize];
+	    };
 	};
 
 	this->m_batchSize = batchSize;
@@ -83,6 +95,12 @@ void DNNDataProvider::release_transfer_buffers()
 
 	     if ( this->haveLabel )
 		      delete [] this->labels[i];
+
+	     if ( this->sparseFeatures ) {
+		      delete [] this->csrRowPtrs[i];
+		      delete [] this->csrColIndices[i];
+		      delete [] this->csrValues[i];
+	     };
 	};
 };
 
@@ -114,6 +132,7 @@ void DNNDataProvider::create_io_buffers()
 	     this->permutations[k] = k;
 
 	this->batches_loaded  = 0;
+	this->frames_loaded  = 0;
 };
 
 void DNNDataProvider::release_io_buffers()
@@ -127,6 +146,7 @@ void DNNDataProvider::release_io_buffers()
 void DNNDataProvider::reset_io_buffers()
 {
 	this->batches_loaded = 0;
+	this->frames_loaded = 0;
 
     for (int k=0; k < this->m_batchSize * this->m_shuffleBatches; k++)
 	     this->permutations[k] = k;
@@ -466,6 +486,27 @@ void DNNDataProvider::load_feature_batch(float *srcp, int *indexBase, int indexO
      for(int i = 0; i < this->m_batchSize; i++)
 		for(int j = 0; j < this->m_dataFeatureSize; j++)
 			this->features[this->wbuf_index][i*this->m_dataFeatureSize+j] = srcp[indexBase[indexOffset+i]*this->m_dataFeatureSize+j];
+
+     if ( !this->sparseFeatures )
+		  return;
+
+     // the CSR format of the same batch, built by the worker thread so the neural network side need not scan the dense frames
+     int *rowPtrs = this->csrRowPtrs[this->wbuf_index];
+     int *colIndices = this->csrColIndices[this->wbuf_index];
+     float *values = this->csrValues[this->wbuf_index];
+     float *framep = this->features[this->wbuf_index];
+     int nnz = 0;
+
+     for(int i = 0; i < this->m_batchSize; i++) {
+		rowPtrs[i] = nnz;
+		for(int j = 0; j < this->m_dataFeatureSize; j++, framep++)
+			if ( *framep != 0.0f ) {
+				 colIndices[nnz] = j;
+				 values[nnz] = *framep;
+				 nnz++;
+			};
+     };
+     rowPtrs[this->m_batchSize] = nnz;
 };
 
 // load one batch of labels data from source to data buffer
@@ -479,10 +520,15 @@ void DNNDataProvider::load_label_batch(float *srcp, int *indexBase, int indexOff
 
 void DNNDataProvider::prepare_batch_data_top_half()
 {
+	DNNTraceSpan span(DNN_TRACE_DATA, "gather");
+
 	// get one batch from the io buffer to the transfer buffer
 	this->load_feature_batch(this->featureData,this->permutations,this->m_batchSize*(this->stageBatchNo % this->m_shuffleBatches));
 	if ( this->haveLabel )
 	     this->load_label_batch(this->labelData,this->permutations,this->m_batchSize*(this->stageBatchNo % this->m_shuffleBatches));
+
+	// only the valid frames are shuffled, so the padding frames are always at the end of the last loaded batch
+	this->validFrames[this->wbuf_index] = min(this->m_batchSize, this->frames_loaded - this->m_batchSize*(this->stageBatchNo % this->m_shuffleBatches));
 };
 
 void DNNDataProvider::prepare_batch_data_bottom_half()
@@ -496,15 +542,18 @@ void DNNDataProvider::prepare_batch_data_bottom_half()
 
 		  this->batches_loaded = 0;
 
-		  if ( !this->endOfDataSource )
+		  if ( !this->endOfDataSource ) {
+			    DNNTraceSpan span(DNN_TRACE_DATA, "setup_cont_data_batches");
+
 		        this->setup_cont_data_batches();
+		  };
 
 		  if ( this->batches_loaded ) {
 			  	// initial permutations, permutated each round
 	            for (int k=0; k < this->m_batchSize * this->m_shuffleBatches; k++)
 		             this->permutations[k] = k;
 
-		        this->shuffle_data(this->permutations, this->m_batchSize * this->batches_loaded );
+		        this->shuffle_data(this->permutations, this->frames_loaded );
 		        // cout << "Load new data from files and shuffling the frame sequences" << endl;
 		  };
 
@@ -610,6 +659,41 @@ int DNNDataProvider::getBatchSize()
     return(this->m_batchSize);
 };
 
+// should be called after getBatchData() and before nextBatch() for the same batch
+int DNNDataProvider::getValidFrames()
+{
+    return(this->validFrames[this->rbuf_index]);
+};
+
+void DNNDataProvider::setSparseFeatures(bool enable)
+{
+ 	if ( this->initialized ) {
+		 dnn_log("DNNDataProvider", "The CSR format of the feature frames should be enabled before the DataProvider is set up");
+		 DNN_Exception("");
+	};
+
+    this->sparseFeatures = enable;
+};
+
+bool DNNDataProvider::haveSparseFeatures()
+{
+    return(this->sparseFeatures);
+};
+
+// should be called after getBatchData() and before nextBatch() for the same batch, the padding frames of the last batch are included
+int DNNDataProvider::getSparseBatchData(int * & pRowPtrs, int * & pColIndices, float * & pValues, int & nnz)
+{
+	if ( !this->sparseFeatures )
+		 return(-1);
+
+	pRowPtrs = this->csrRowPtrs[this->rbuf_index];
+	pColIndices = this->csrColIndices[this->rbuf_index];
+	pValues = this->csrValues[this->rbuf_index];
+	nnz = pRowPtrs[this->m_batchSize];
+
+	return(0);
+};
+
 DNN_DATA_MODE DNNDataProvider::getDataMode()
 {
     return(this->dataMode);
@@ -60,7 +60,7 @@ void DNNSimpleDataProvider::setup_first_data_batches()
 	this->setup_cont_data_batches();
 
     if ( this->batches_loaded ) {
-	     this->shuffle_data(this->permutations, this->m_batchSize * this->batches_loaded );
+	     this->shuffle_data(this->permutations, this->frames_loaded );
     };
 };
 
@@ -96,6 +96,7 @@ void DNNSimpleDataProvider::setup_cont_data_batches()
 	};
 
 	this->batches_loaded = this->m_shuffleBatches;
+	this->frames_loaded = this->batches_loaded * this->m_batchSize;
 	this->batchNo += this->batches_loaded;
 
 	if ( this->batchNo == this->total_batches )
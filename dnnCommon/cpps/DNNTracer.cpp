@@ -0,0 +1,155 @@
+/*
+ *  COPYRIGHT:  Copyright (c) 2014 Advanced Micro Devices, Inc.  All rights reserved
+ *
+ *   Records the time spans of the host threads (trainer, data provider worker, checkpointing) and the device commands into one
+ *   timeline, which is saved in the Chrome trace JSON format and can be viewed by chrome://tracing or Perfetto
+ */
+
+#include <vector>
+#include <string>
+#include <cstring>
+
+#include "DNNUtil.h"
+#include "DNNTracer.h"
+
+struct trace_event {
+	const char *thread;
+	const char *name;
+	int layer;
+	long long start;           // micro-seconds since the tracing was started
+	long long duration;
+};
+
+static volatile bool traceEnabled = false;
+static bool traceLockInited = false;
+static struct dnn_tv traceBase;
+static std::vector<struct trace_event> traceEvents;
+static long long traceDropped = 0;
+
+#ifdef _WIN32
+static CRITICAL_SECTION traceLock;
+#else
+static pthread_mutex_t traceLock;
+#endif
+
+void dnn_trace_start()
+{
+	if ( ! traceLockInited ) {
+		 DNN_LOCK_INIT(&traceLock);
+		 traceLockInited = true;
+	};
+
+	DNN_LOCK(&traceLock);
+	traceEvents.clear();
+	traceDropped = 0;
+	getCurrentTime(&traceBase);
+	DNN_UNLOCK(&traceLock);
+
+	traceEnabled = true;
+};
+
+void dnn_trace_stop()
+{
+	traceEnabled = false;
+};
+
+bool dnn_trace_enabled()
+{
+	return(traceEnabled);
+};
+
+long long dnn_trace_now()
+{
+	struct dnn_tv now;
+
+	getCurrentTime(&now);
+
+	return( (long long)(now.tv_sec - traceBase.tv_sec)*1000000 + (now.tv_usec - traceBase.tv_usec) );
+};
+
+void dnn_trace_record(const char *thread, const char *name, int layer, long long start, long long duration)
+{
+	if ( ! traceEnabled )
+		 return;
+
+	struct trace_event te;
+
+	te.thread = thread;
+	te.name = name;
+	te.layer = layer;
+	te.start = start;
+	te.duration = (duration > 0)? duration : 0;
+
+	DNN_LOCK(&traceLock);
+	if ( traceEvents.size() < DNN_TRACE_MAX_EVENTS )
+		 traceEvents.push_back(te);
+	else
+		 traceDropped++;
+	DNN_UNLOCK(&traceLock);
+};
+
+// the names are literals chosen by the code, only the characters breaking a JSON string are escaped
+static void write_json_string(ostringstream &out, const char *str)
+{
+	out << '"';
+	for (const char *p = str; *p; p++) {
+		 if ( (*p == '"') || (*p == '\\') )
+			  out << '\\';
+		 out << *p;
+	};
+	out << '"';
+};
+
+// each thread name becomes one row (tid) of the process, numbered in the order of the names first seen
+int dnn_trace_save(const char *filename)
+{
+	if ( ! traceLockInited )
+		 return(-1);
+
+	std::vector<const char *> threads;
+	ostringstream out;
+
+	out << "{\"traceEvents\":[" << endl;
+	out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"DNN\"}}";
+
+	DNN_LOCK(&traceLock);
+
+	for (size_t k=0; k < traceEvents.size(); k++) {
+		 struct trace_event &te = traceEvents[k];
+		 size_t tid;
+
+		 for (tid=0; tid < threads.size(); tid++)
+			  if ( strcmp(threads[tid], te.thread) == 0 )
+				   break;
+
+		 if ( tid == threads.size() ) {
+			  threads.push_back(te.thread);
+
+			  out << "," << endl << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid+1 << ",\"args\":{\"name\":";
+			  write_json_string(out, te.thread);
+			  out << "}}";
+			  out << "," << endl << "{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid+1 << ",\"args\":{\"sort_index\":" << tid+1 << "}}";
+		 };
+
+		 out << "," << endl << "{\"name\":";
+		 if ( te.layer >= 0 ) {
+			  ostringstream tmpName;
+
+			  tmpName << te.name << "[" << te.layer << "]";
+			  write_json_string(out, tmpName.str().c_str());
+		 }
+		 else
+			  write_json_string(out, te.name);
+		 out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid+1 << ",\"ts\":" << te.start << ",\"dur\":" << te.duration << "}";
+	};
+
+	long long dropped = traceDropped;
+
+	DNN_UNLOCK(&traceLock);
+
+	out << endl << "],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":" << dropped << "}}" << endl;
+
+	std::string json = out.str();
+
+	return( write_file_atomic(filename, json.c_str(), json.size()) );
+};
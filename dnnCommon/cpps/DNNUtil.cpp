@@ -8,8 +8,13 @@
 #ifdef _WIN32
 #include <time.h>
 #include <Windows.h>
+#include <io.h>
 #else
 #include <sys/time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <unistd.h>
 #endif
 
@@ -17,6 +22,8 @@
 
 #include <iostream>
 #include <fstream>
+#include <string>
+#include <cstdio>
 
 #ifdef _WIN32
 #define  DELTA_EPOCH_IN_MICROSECS  11644473600000000ULL
@@ -96,6 +103,131 @@ int read_srcfile(const char *filename, char * &src_str)
 	 return(0);
 };
 
+// write the whole data to a temporary file with one write, flush it to the disk and then rename it to the
+// target file, so that readers either see the old complete file or the new complete file
+int write_file_atomic(const char *filename, const char *data, size_t len)
+{
+     string tmpName(filename);
+     FILE *fp;
+
+     tmpName.append(".tmp");
+
+     if ( (fp = fopen(tmpName.c_str(), "wb")) == NULL )
+          return(-1);
+
+     if ( (fwrite(data, 1, len, fp) != len) || (fflush(fp) != 0) ) {
+          fclose(fp);
+          remove(tmpName.c_str());
+          return(-1);
+     };
+
+#ifdef _WIN32
+     FlushFileBuffers((HANDLE)_get_osfhandle(_fileno(fp)));
+#else
+     fsync(fileno(fp));
+#endif
+     fclose(fp);
+
+#ifdef _WIN32
+     if ( ! MoveFileExA(tmpName.c_str(), filename, MOVEFILE_REPLACE_EXISTING|MOVEFILE_WRITE_THROUGH) ) {
+#else
+     if ( rename(tmpName.c_str(), filename) != 0 ) {
+#endif
+          remove(tmpName.c_str());
+          return(-1);
+     };
+
+     return(0);
+};
+
+// map the whole file into the memory, the pages are loaded on demand and any modification to them
+// is private to the process and never written back to the file
+#ifdef _WIN32
+int map_file_private(const char *filename, struct dnn_file_map *fmap)
+{
+     LARGE_INTEGER fsize;
+
+     fmap->base = NULL;
+     fmap->len = 0;
+
+     fmap->hFile = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+     if ( fmap->hFile == INVALID_HANDLE_VALUE )
+          return(-1);
+
+     if ( ! GetFileSizeEx(fmap->hFile, &fsize) || fsize.QuadPart == 0 ) {
+          CloseHandle(fmap->hFile);
+          return(-1);
+     };
+
+     fmap->hMapping = CreateFileMappingA(fmap->hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+     if ( fmap->hMapping == NULL ) {
+          CloseHandle(fmap->hFile);
+          return(-1);
+     };
+
+     fmap->base = (char *)MapViewOfFile(fmap->hMapping, FILE_MAP_COPY, 0, 0, 0);
+     if ( fmap->base == NULL ) {
+          CloseHandle(fmap->hMapping);
+          CloseHandle(fmap->hFile);
+          return(-1);
+     };
+     fmap->len = (size_t)fsize.QuadPart;
+
+     return(0);
+};
+
+void unmap_file(struct dnn_file_map *fmap)
+{
+     if ( fmap->base ) {
+          UnmapViewOfFile(fmap->base);
+          CloseHandle(fmap->hMapping);
+          CloseHandle(fmap->hFile);
+          fmap->base = NULL;
+          fmap->len = 0;
+     };
+};
+#else
+int map_file_private(const char *filename, struct dnn_file_map *fmap)
+{
+     struct stat st;
+     int fd;
+     void *addr;
+
+     fmap->base = NULL;
+     fmap->len = 0;
+
+     if ( (fd = open(filename, O_RDONLY)) < 0 )
+          return(-1);
+
+     if ( fstat(fd, &st) != 0 || st.st_size == 0 ) {
+          close(fd);
+          return(-1);
+     };
+
+     addr = mmap(NULL, (size_t)st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+     close(fd);                // the mapping keeps its own reference to the file
+
+     if ( addr == MAP_FAILED )
+          return(-1);
+
+     (void) madvise(addr, (size_t)st.st_size, MADV_WILLNEED);
+
+     fmap->base = (char *)addr;
+     fmap->len = (size_t)st.st_size;
+
+     return(0);
+};
+
+void unmap_file(struct dnn_file_map *fmap)
+{
+     if ( fmap->base ) {
+          munmap(fmap->base, fmap->len);
+          fmap->base = NULL;
+          fmap->len = 0;
+     };
+};
+#endif
+
 #ifdef _WIN32             // Windows
 int getLogicCoreNum()
 {
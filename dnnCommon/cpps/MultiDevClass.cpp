@@ -0,0 +1,68 @@
+/*
+ *  COPYRIGHT:  Copyright (c) 2014 Advanced Micro Devices, Inc.  All rights reserved
+ *
+ *   One OpenCL context over several devices of the same platform, with one command queue for each device
+ */
+
+#include "DNNUtil.h"
+#include "oclUtil.h"
+#include "MultiDevClass.h"
+
+MultiDevClass::MultiDevClass(DNN_OCL_DEVTYPE type, int num)
+{
+	int result=-1;
+	cl_int status;
+
+	this->numDevices = 0;
+
+	if ( (num < 1) || (num > DNN_MAX_DEVICES) ) {
+		  dnn_log("MLP", "Incorrect number of OpenCL devices as parameter");
+		  DNN_Exception("");
+	};
+
+	switch (type) {
+        case DNN_OCL_DGPU:
+            result = choose_ocl_dgpu_devices(this->m_devices, num);
+			break;
+        case DNN_OCL_CPU:
+            result = choose_ocl_cpu_subdevices(this->m_devices, num);
+			break;
+        default:
+            dnn_log("MLP", "Only discrete GPU devices or CPU sub-devices can be used as multiple OpenCL devices");
+            DNN_Exception("");
+	};
+
+    if ( result < num ) {
+		  dnn_log("MLP", "Failed to choose the required number of OpenCL devices for the application\n");
+		  dnn_log_retval("MLP", result);
+		  DNN_Exception("");
+	};
+
+	this->m_context = clCreateContext(NULL, num, this->m_devices, NULL, NULL, &status);
+	if ( status != CL_SUCCESS ) {
+		  dnn_log("MLP", "Failed to setup OpenCL context on the selected devices\n");
+		  dnn_log_retval("MLP", status);
+		  DNN_Exception("");
+	};
+
+	for (int i=0; i < num; i++) {
+		 this->m_queues[i] = clCreateCommandQueue(this->m_context, this->m_devices[i], get_ocl_queue_properties(), &status);
+		 CL_CHECK( status );
+	};
+
+	this->numDevices = num;
+	this->devtype = type;
+};
+
+
+// the release failures are only logged, since the destructor should not throw
+MultiDevClass::~MultiDevClass()
+{
+	for (int i=0; i < this->numDevices; i++)
+		 CL_CHECK_NOTHROW( clReleaseCommandQueue(this->m_queues[i]) );
+
+ 	CL_CHECK_NOTHROW( clReleaseContext(this->m_context) );
+
+	for (int i=0; i < this->numDevices; i++)
+		 CL_CHECK_NOTHROW( clReleaseDevice(this->m_devices[i]) );
+};
@@ -9,6 +9,7 @@
 #include <sstream>
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 
 #include <CL/cl.h>
 
@@ -26,6 +27,23 @@ static int measure_device(cl_device_id &theDevice, int &capability);
 
 static const char *getProcessorVendor();
 
+static bool queueProfiling = false;
+
+void set_ocl_queue_profiling(bool enable)
+{
+	queueProfiling = enable;
+};
+
+bool get_ocl_queue_profiling()
+{
+	return(queueProfiling);
+};
+
+cl_command_queue_properties get_ocl_queue_properties()
+{
+	return( queueProfiling? CL_QUEUE_PROFILING_ENABLE : 0 );
+};
+
 // setup a context with only one queue on the device, it is up to the application itself to set up more complex context
 int setup_simple_ocl_context(cl_device_id &theDevice, cl_context &theContext, int numQueue, cl_command_queue *theQueues)
 {
@@ -47,14 +65,14 @@ int setup_simple_ocl_context(cl_device_id &theDevice, cl_context &theContext, in
 	if ( status != CL_SUCCESS )
 		return(-2);
 
-    queue = clCreateCommandQueue(context, theDevice, 0, &status);
+    queue = clCreateCommandQueue(context, theDevice, get_ocl_queue_properties(), &status);
     if ( status != CL_SUCCESS)
 	    return(-3);
 
 	theQueues[0] = queue;
 
 	if ( numQueue == 2 ) {
-         queue = clCreateCommandQueue(context, theDevice, 0, &status);
+         queue = clCreateCommandQueue(context, theDevice, get_ocl_queue_properties(), &status);
          if ( status != CL_SUCCESS)
 	          return(-3);
 
@@ -172,11 +190,92 @@ int choose_ocl_dgpu_device(cl_device_id &theDevice)
 }
 
 
-// choose the required number of GPU devices for Opencl application
+// choose the required number of discrete GPU devices for OpenCL application, all from the platform having the most of them so that
+// they can share one context. Returns the number of devices chosen, which could be less than num
 int choose_ocl_dgpu_devices(cl_device_id theDevices[], int num)
 {
-	// to be implementd
-	return(0);
+    cl_platform_id platform_ids[4];
+	cl_device_id device_ids[16];
+	cl_int num_platforms=4;
+	cl_uint num_devices;
+	cl_int status;
+	int best_num;
+
+	status = clGetPlatformIDs(4, &platform_ids[0], (cl_uint*)&num_platforms);
+	if ( status != CL_SUCCESS ) {
+		return(-1);
+	}
+
+	best_num = 0;
+
+	for (int i=0; i< num_platforms; i++ ) {
+	     int curr_num = 0;
+
+	     status = clGetDeviceIDs(platform_ids[i], CL_DEVICE_TYPE_GPU, 16, device_ids, &num_devices);
+ 	     if ( status != CL_SUCCESS )
+			  continue;
+
+	     for (int j=0; j< (int)num_devices && j < 16; j++) {
+			  cl_bool unified_memory=false;
+			  int capability;
+
+			  (void) clGetDeviceInfo(device_ids[j], CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(cl_bool), &unified_memory, NULL );
+			  if ( unified_memory )  // skip the integrated GPU
+				   continue;
+
+		      if ( measure_device(device_ids[j], capability) == 0 )
+				   device_ids[curr_num++] = device_ids[j];
+		 }
+
+		 if ( curr_num > best_num ) {
+			  best_num = std::min<int>(curr_num, num);
+			  for (int j=0; j < best_num; j++)
+				   theDevices[j] = device_ids[j];
+		 };
+
+		 if ( best_num == num )
+			  break;
+	}
+
+	if ( best_num == 0 )
+		 return(-2);
+
+    return(best_num);
+};
+
+// split the CPU device into num sub-devices of the same number of compute units, so that the codes using multiple devices can be
+// run on one machine without GPUs. Returns the number of sub-devices created, they should be released by clReleaseDevice()
+int choose_ocl_cpu_subdevices(cl_device_id theDevices[], int num)
+{
+	cl_device_id cpu_device;
+	cl_uint num_units;
+	cl_uint num_created;
+
+	if ( (num < 1) || (choose_ocl_cpu_device(cpu_device) < 0) )
+		 return(-1);
+
+	if ( clGetDeviceInfo(cpu_device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &num_units, NULL) != CL_SUCCESS )
+		 return(-2);
+
+	if ( (int)num_units < num )
+		 return(-3);
+
+	cl_device_partition_property *props = new cl_device_partition_property[num+3];
+
+	props[0] = CL_DEVICE_PARTITION_BY_COUNTS;
+	for (int i=0; i < num; i++)
+		 props[i+1] = (cl_device_partition_property)(num_units/num);
+	props[num+1] = CL_DEVICE_PARTITION_BY_COUNTS_LIST_END;
+	props[num+2] = 0;
+
+	cl_int status = clCreateSubDevices(cpu_device, props, num, theDevices, &num_created);
+
+	delete [] props;
+
+	if ( status != CL_SUCCESS )
+		 return(-4);
+
+	return((int)num_created);
 };
 
 bool isAMDAPU(cl_device_id theDevice )
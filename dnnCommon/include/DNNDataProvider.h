@@ -46,6 +46,13 @@ protected:
 
 	float *features[DNN_BATCH_RING_SIZE];      // ring buffer for feature frames batches, which will be directly delivered to the neural network
 	float *labels[DNN_BATCH_RING_SIZE];        // ring buffer for label frames batches, which will be directly delivered to the neural network
+	int validFrames[DNN_BATCH_RING_SIZE];      // number of frames in each batch of the ring buffer which are not padding
+
+	// with sparseFeatures, each batch of feature frames is also provided in the CSR format, for the neural network to skip the zero inputs
+	bool sparseFeatures;
+	int *csrRowPtrs[DNN_BATCH_RING_SIZE];      // m_batchSize+1 offsets of the first non-zero input of each frame in csrColIndices and csrValues
+	int *csrColIndices[DNN_BATCH_RING_SIZE];   // indexes of the non-zero inputs
+	float *csrValues[DNN_BATCH_RING_SIZE];     // values of the non-zero inputs
 	int rbuf_index,wbuf_index;
 
 	int rbuf_count;              // Used to implement a producer-consumer like synchronization between the neural network side and the data provider side
@@ -79,6 +86,7 @@ protected:
 
 	int stageBatchNo;          // batch number inside each loaded batches (eg. inside each [m_shufflebatches * rounds] batches
     int batches_loaded;        // the number of batches that were just loaded from the file to the io buffers
+	int frames_loaded;         // the number of frames read from the file to the io buffers, the frames after them in the last loaded batch are padding
 
 	bool endOfDataSource;      // indicates the end of the data source, updated by the backend data provider codes
 
@@ -128,6 +136,11 @@ public:
 	LIBDNNAPI int getBatchData(int batchSize, float * & pFeatures, bool blocking);
 	LIBDNNAPI int getBatchData(int batchSize, float * & pFeatures, float * & pLabels, bool blocking);
 	LIBDNNAPI int nextBatch();
+	LIBDNNAPI int getValidFrames();               // get the number of frames of the current batch which are not padding, only the last batch of the data source is padded
+
+	LIBDNNAPI void setSparseFeatures(bool enable);  // provide the feature frames also in the CSR format, should be called before setupDataProvider()
+	LIBDNNAPI bool haveSparseFeatures();
+	LIBDNNAPI int getSparseBatchData(int * & pRowPtrs, int * & pColIndices, float * & pValues, int & nnz);   // the CSR format of the current batch
 
 	LIBDNNAPI int getFeatureSize();               // get the size of the feature frame in basic type units (eg. float) of the DNN
 	LIBDNNAPI int getLabelSize();                 // get the size of the label frame in basic type units (eg. float) of the DNN
@@ -0,0 +1,77 @@
+/*
+ *  COPYRIGHT:  Copyright (c) 2014 Advanced Micro Devices, Inc.  All rights reserved
+ *
+ *   Records the time spans of the host threads (trainer, data provider worker, checkpointing) and the device commands into one
+ *   timeline, which is saved in the Chrome trace JSON format and can be viewed by chrome://tracing or Perfetto
+ */
+
+
+#ifndef _DNN_TRACER_H_
+#define _DNN_TRACER_H_
+
+#include "DNNApiExport.h"
+
+#define DNN_TRACE_MAX_EVENTS 1000000   // the spans recorded after this many are dropped
+
+// the names of the timeline rows, one for each thread recording spans
+#define DNN_TRACE_TRAINER      "trainer"
+#define DNN_TRACE_TESTER       "tester"
+#define DNN_TRACE_DATA         "data provider"
+#define DNN_TRACE_CHKPOINTING  "checkpointing"
+#define DNN_TRACE_DEVICE       "device"
+
+// should be called before the engines and data providers are set up, since the spans are recorded without checking the lock
+// being initialized, the spans recorded by an earlier tracing are discarded
+LIBDNNAPI extern void dnn_trace_start();
+LIBDNNAPI extern void dnn_trace_stop();
+LIBDNNAPI extern int dnn_trace_save(const char *filename);         // returns -1 if the file could not be written
+
+extern bool dnn_trace_enabled();
+extern long long dnn_trace_now();                                   // micro-seconds since the tracing was started
+
+// thread and name are kept as pointers, so should be string literals. layer is shown after the name if not being -1
+extern void dnn_trace_record(const char *thread, const char *name, int layer, long long start, long long duration);
+
+// a span of the calling thread, from being created to end() or being destroyed, next() ends it and starts the following
+// span of the same thread at the same time, so the sequential phases of a loop can be traced with one object
+class DNNTraceSpan
+{
+private:
+	const char *thread;
+	const char *name;
+	long long start;
+
+public:
+	DNNTraceSpan(const char *_thread, const char *_name)
+	{
+		this->thread = _thread;
+		this->name = dnn_trace_enabled()? _name : 0;
+		this->start = this->name? dnn_trace_now() : 0;
+	};
+
+	~DNNTraceSpan()
+	{
+		this->end();
+	};
+
+	void next(const char *_name)
+	{
+		if ( this->name ) {
+			 long long now = dnn_trace_now();
+
+			 dnn_trace_record(this->thread, this->name, -1, this->start, now - this->start);
+			 this->name = _name;
+			 this->start = now;
+		};
+	};
+
+	void end()
+	{
+		if ( this->name ) {
+			 dnn_trace_record(this->thread, this->name, -1, this->start, dnn_trace_now() - this->start);
+			 this->name = 0;
+		};
+	};
+};
+
+#endif
@@ -34,9 +34,23 @@ LIBDNNAPI extern void getCurrentTime(struct dnn_tv *tv);
 LIBDNNAPI extern long diff_msec(struct dnn_tv *stv, struct dnn_tv *etv);
 LIBDNNAPI extern long diff_usec(struct dnn_tv *stv, struct dnn_tv *etv);
 
-extern int getLogicCoreNum();
+LIBDNNAPI extern int getLogicCoreNum();
 
 LIBDNNAPI extern int read_srcfile(const char *filename, char * &src_str);
+LIBDNNAPI extern int write_file_atomic(const char *filename, const char *data, size_t len);
+
+// a private (copy-on-write) memory mapping of a whole file
+struct dnn_file_map {
+   char *base;
+   size_t len;
+#ifdef _WIN32
+   HANDLE hFile;
+   HANDLE hMapping;
+#endif
+};
+
+LIBDNNAPI extern int map_file_private(const char *filename, struct dnn_file_map *fmap);
+LIBDNNAPI extern void unmap_file(struct dnn_file_map *fmap);
 
 LIBDNNAPI extern void dnn_log(const char *header, const char *content);
 LIBDNNAPI extern void dnn_log_retval(const char *header, int retVal);
@@ -69,6 +83,18 @@ LIBDNNAPI extern void dnn_log_retval(const char *header, int retVal);
 	}                                                                                                             \
     while (0)
 
+// only logs the failure, used by the destructors, which should not throw
+#define CL_CHECK_NOTHROW(flag)                                                                                    \
+	do  {                                                                                                         \
+	    int _tmpVal;                                                                                              \
+	    if ( (_tmpVal = flag) != 0) {                                                                             \
+	        ostringstream mystream;                                                                               \
+		    mystream << "OpenCL Function Failed (" << __FILE__ << "," << __LINE__ << "), Error Code:" << _tmpVal; \
+		    dnn_log("MLP", mystream.str().c_str());                                                               \
+	    }                                                                                                         \
+	}                                                                                                             \
+    while (0)
+
 #define AMDBLAS_CHECK(flag)                                                                                         \
 	do  {                                                                                                           \
 	    int _tmpVal;                                                                                                \
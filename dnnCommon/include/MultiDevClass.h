@@ -0,0 +1,33 @@
+/*
+ *  COPYRIGHT:  Copyright (c) 2014 Advanced Micro Devices, Inc.  All rights reserved
+ *
+ *   One OpenCL context over several devices of the same platform, with one command queue for each device
+ */
+
+
+#ifndef _MULTI_DEV_CLASS_H_
+#define _MULTI_DEV_CLASS_H_
+
+#include <CL/cl.h>
+
+#include "DNNApiExport.h"
+#include "SingleDevClass.h"
+
+#define DNN_MAX_DEVICES 8
+
+class MultiDevClass
+{
+public:
+	cl_device_id m_devices[DNN_MAX_DEVICES];
+	cl_context m_context;
+	cl_command_queue m_queues[DNN_MAX_DEVICES];     // m_queues[i] is for m_devices[i]
+	int numDevices;
+	cl_program m_program;
+    DNN_OCL_DEVTYPE devtype;
+public:
+	// DNN_OCL_DGPU for num discrete GPUs, DNN_OCL_CPU for num sub-devices of the CPU device
+	LIBDNNAPI MultiDevClass(DNN_OCL_DEVTYPE type, int num);
+	LIBDNNAPI ~MultiDevClass();
+};
+
+#endif
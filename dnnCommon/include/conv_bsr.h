@@ -0,0 +1,117 @@
+/*
+ *  COPYRIGHT:  Copyright (c) 2014 Advanced Micro Devices, Inc.  All rights reserved
+ *
+ *   Block compressed sparse row (BSR) encoding of a weights matrix, the matrix is divided into DNN_BSR_BLOCK x DNN_BSR_BLOCK
+ *   blocks and only the blocks having non-zero values are kept, the blocks on the right and bottom edges are padded with zeroes.
+ *   rowPtrs[br] .. rowPtrs[br+1]-1 index the blocks of block row br, colIndices gives the block column of each block, and the
+ *   values of each block are stored row by row
+ */
+
+#ifndef _CONV_BSR_H_
+#define _CONV_BSR_H_
+
+#include <cstddef>
+
+#define DNN_BSR_BLOCK 4
+
+static inline int BSRBlocks(int n)
+{
+    return( (n + DNN_BSR_BLOCK - 1) / DNN_BSR_BLOCK );
+};
+
+static inline bool BSRBlockIsZero(const float *src, int rows, int cols, int br, int bc)
+{
+    for (int r=br*DNN_BSR_BLOCK; (r < rows) && (r < (br+1)*DNN_BSR_BLOCK); r++)
+         for (int c=bc*DNN_BSR_BLOCK; (c < cols) && (c < (bc+1)*DNN_BSR_BLOCK); c++)
+              if ( src[(size_t)r*cols+c] != 0.0f )
+                   return(false);
+
+    return(true);
+};
+
+// the number of the non-zero blocks of a matrix of "rows" x "cols" floats
+static inline size_t FloatMatrixBSRBlocks(const float *src, int rows, int cols)
+{
+    size_t nnzBlocks = 0;
+
+    for (int br=0; br < BSRBlocks(rows); br++)
+         for (int bc=0; bc < BSRBlocks(cols); bc++)
+              if ( ! BSRBlockIsZero(src, rows, cols, br, bc) )
+                   nnzBlocks++;
+
+    return(nnzBlocks);
+};
+
+// rowPtrs has BSRBlocks(rows)+1 entries, colIndices and values have the space for FloatMatrixBSRBlocks() blocks
+static inline void FloatMatrixToBSR(const float *src, int rows, int cols, unsigned int *rowPtrs, unsigned int *colIndices, float *values)
+{
+    unsigned int nnzBlocks = 0;
+
+    for (int br=0; br < BSRBlocks(rows); br++)
+    {
+         rowPtrs[br] = nnzBlocks;
+
+         for (int bc=0; bc < BSRBlocks(cols); bc++)
+         {
+              if ( BSRBlockIsZero(src, rows, cols, br, bc) )
+                   continue;
+
+              float *blockp = values + (size_t)nnzBlocks*DNN_BSR_BLOCK*DNN_BSR_BLOCK;
+
+              for (int r=0; r < DNN_BSR_BLOCK; r++)
+                   for (int c=0; c < DNN_BSR_BLOCK; c++)
+                   {
+                        int row = br*DNN_BSR_BLOCK + r;
+                        int col = bc*DNN_BSR_BLOCK + c;
+
+                        blockp[r*DNN_BSR_BLOCK+c] = ( (row < rows) && (col < cols) )? src[(size_t)row*cols+col] : 0.0f;
+                   };
+
+              colIndices[nnzBlocks++] = (unsigned int)bc;
+         };
+    };
+    rowPtrs[BSRBlocks(rows)] = nnzBlocks;
+};
+
+// check the block indexes read from a file before they are used
+static inline bool CheckBSRIndexes(const unsigned int *rowPtrs, const unsigned int *colIndices, int rows, int cols, size_t nnzBlocks)
+{
+    if ( (rowPtrs[0] != 0) || (rowPtrs[BSRBlocks(rows)] != nnzBlocks) )
+         return(false);
+
+    for (int br=0; br < BSRBlocks(rows); br++)
+         if ( rowPtrs[br] > rowPtrs[br+1] )
+              return(false);
+
+    for (size_t b=0; b < nnzBlocks; b++)
+         if ( colIndices[b] >= (unsigned int)BSRBlocks(cols) )
+              return(false);
+
+    return(true);
+};
+
+// dst is filled with zeroes except for the non-zero blocks
+static inline void BSRToFloatMatrix(const unsigned int *rowPtrs, const unsigned int *colIndices, const float *values, int rows, int cols, float *dst)
+{
+    for (size_t i=0; i < (size_t)rows*cols; i++)
+         dst[i] = 0.0f;
+
+    for (int br=0; br < BSRBlocks(rows); br++)
+         for (unsigned int b=rowPtrs[br]; b < rowPtrs[br+1]; b++)
+         {
+              const float *blockp = values + (size_t)b*DNN_BSR_BLOCK*DNN_BSR_BLOCK;
+              int bc = colIndices[b];
+
+              for (int r=0; r < DNN_BSR_BLOCK; r++)
+                   for (int c=0; c < DNN_BSR_BLOCK; c++)
+                   {
+                        int row = br*DNN_BSR_BLOCK + r;
+                        int col = bc*DNN_BSR_BLOCK + c;
+
+                        if ( (row < rows) && (col < cols) )
+                             dst[(size_t)row*cols+col] = blockp[r*DNN_BSR_BLOCK+c];
+                   };
+         };
+};
+
+#endif
@@ -1,6 +1,19 @@
 #ifndef _CONV_ENDIAN_H_
 #define _CONV_ENDIAN_H_
 
+#include <cstring>
+#include <cstddef>
+
+// DNN_LITTLE_ENDIAN_HOST is defined when the host byte order matches the Little Endian byte order of the data files,
+// so arrays of float can be copied to/from the files without any per-element conversion
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__)
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define DNN_LITTLE_ENDIAN_HOST
+#endif
+#elif defined(_WIN32) || defined(__i386__) || defined(__x86_64__)
+#define DNN_LITTLE_ENDIAN_HOST
+#endif
+
 // conversion of word type data between host and assigned endian
 static inline void LEtoLEHosts(unsigned short &x)
 {
@@ -84,6 +97,23 @@ static inline void LEtoHostl(unsigned int &x)
                          // ToDO: other architecture
 };
 
+// conversion of qword type data between host and Little Endian
+static inline void HostToLEll(unsigned long long &x)
+{
+#ifndef DNN_LITTLE_ENDIAN_HOST
+    unsigned long long y = 0;
+
+    for (int i=0; i < 8; i++)
+         y = (y << 8) | ((x >> (i*8)) & 0xff);
+    x = y;
+#endif
+};
+
+static inline void LEtoHostll(unsigned long long &x)
+{
+    HostToLEll(x);     // byte swapping is symmetric
+};
+
 
 // Don't care what byte order it is on the host side
 static inline void FloatToBytes(float &x)
@@ -122,6 +152,26 @@ static inline void BytesToFloat(float &x)
     *datap = byte0 | byte1 | byte2 | byte3;
 };
 
+// copy an array of host float to generic bytes, the source array is not touched
+static inline void FloatArrayToBytes(const float *src, char *dst, size_t num)
+{
+    memcpy(dst, src, num*sizeof(float));
+#ifndef DNN_LITTLE_ENDIAN_HOST
+    for (size_t i=0; i < num; i++)
+         FloatToBytes(reinterpret_cast<float*>(dst)[i]);
+#endif
+};
+
+// copy an array of generic bytes to host float
+static inline void BytesToFloatArray(const char *src, float *dst, size_t num)
+{
+    memcpy(dst, src, num*sizeof(float));
+#ifndef DNN_LITTLE_ENDIAN_HOST
+    for (size_t i=0; i < num; i++)
+         BytesToFloat(dst[i]);
+#endif
+};
+
 #endif
 
 
@@ -0,0 +1,196 @@
+/*
+ *  COPYRIGHT:  Copyright (c) 2014 Advanced Micro Devices, Inc.  All rights reserved
+ *
+ *   Conversion between host float and the 16-bit float formats (IEEE half and bfloat16)
+ *   used for storing the weights in the nnet data file
+ */
+
+#ifndef _CONV_HALF_H_
+#define _CONV_HALF_H_
+
+#include <cstring>
+#include <cstddef>
+
+#include "conv_endian.h"
+
+#if defined(__F16C__) && defined(DNN_LITTLE_ENDIAN_HOST)
+#include <immintrin.h>
+#define DNN_USE_F16C
+#endif
+
+#if defined(__SSE2__) && defined(DNN_LITTLE_ENDIAN_HOST)
+#include <emmintrin.h>
+#define DNN_USE_SSE2_BF16
+#endif
+
+static inline unsigned int FloatBits(float x)
+{
+    unsigned int bits;
+
+    memcpy(&bits, &x, sizeof(bits));
+    return(bits);
+};
+
+static inline float BitsFloat(unsigned int bits)
+{
+    float x;
+
+    memcpy(&x, &bits, sizeof(x));
+    return(x);
+};
+
+// IEEE 754 half to single precision, subnormals, infinites and NaNs are kept
+static inline float HalfToFloat(unsigned short h)
+{
+    unsigned int sign = (unsigned int)(h & 0x8000) << 16;
+    unsigned int expo = (h >> 10) & 0x1f;
+    unsigned int mant = h & 0x3ff;
+
+    if ( expo == 0x1f )                                  // infinite or NaN
+         return(BitsFloat(sign | 0x7f800000 | (mant << 13)));
+
+    if ( expo == 0 ) {
+         if ( mant == 0 )                                // signed zero
+              return(BitsFloat(sign));
+
+         // subnormal half, normalize it
+         expo = 1;
+         while ( (mant & 0x400) == 0 ) {
+              mant <<= 1;
+              expo--;
+         };
+         mant &= 0x3ff;
+    };
+
+    return(BitsFloat(sign | ((expo + 112) << 23) | (mant << 13)));
+};
+
+// single to IEEE 754 half precision with round-to-nearest-even, overflow goes to infinite
+static inline unsigned short FloatToHalf(float x)
+{
+    unsigned int bits = FloatBits(x);
+    unsigned int sign = (bits >> 16) & 0x8000;
+    unsigned int absb = bits & 0x7fffffff;
+
+    if ( absb >= 0x7f800000 )                            // infinite or NaN
+         return((unsigned short)(sign | 0x7c00 | ((absb > 0x7f800000)? 0x200 : 0)));
+
+    if ( absb >= 0x477ff000 )                            // too large, rounds to infinite
+         return((unsigned short)(sign | 0x7c00));
+
+    if ( absb < 0x38800000 ) {                           // subnormal half or zero
+         if ( absb < 0x33000000 )
+              return((unsigned short)sign);
+
+         unsigned int mant = (absb & 0x007fffff) | 0x00800000;
+         int shift = 126 - (int)(absb >> 23);            // 14..24
+         unsigned int half = mant >> shift;
+         unsigned int rem = mant & ((1u << shift) - 1);
+         unsigned int mid = 1u << (shift - 1);
+
+         if ( rem > mid || (rem == mid && (half & 1)) )
+              half++;
+
+         return((unsigned short)(sign | half));
+    };
+
+    // normal half
+    unsigned int half = ((absb >> 13) - (112 << 10));
+    unsigned int rem = absb & 0x1fff;
+
+    if ( rem > 0x1000 || (rem == 0x1000 && (half & 1)) )
+         half++;                                         // could carry into the exponent, which is still correct
+
+    return((unsigned short)(sign | half));
+};
+
+static inline float BFloat16ToFloat(unsigned short b)
+{
+    return(BitsFloat((unsigned int)b << 16));
+};
+
+// single to bfloat16 with round-to-nearest-even, NaNs stay NaNs
+static inline unsigned short FloatToBFloat16(float x)
+{
+    unsigned int bits = FloatBits(x);
+
+    if ( (bits & 0x7fffffff) > 0x7f800000 )
+         return((unsigned short)((bits >> 16) | 0x0040));
+
+    bits += 0x7fff + ((bits >> 16) & 1);
+
+    return((unsigned short)(bits >> 16));
+};
+
+// read one Little Endian 16-bit value from generic bytes
+static inline unsigned short LEBytesToShort(const char *src)
+{
+    const unsigned char *cp = (const unsigned char *)src;
+
+    return((unsigned short)(cp[0] | (cp[1] << 8)));
+};
+
+static inline void ShortToLEBytes(unsigned short x, char *dst)
+{
+    unsigned char *cp = (unsigned char *)dst;
+
+    cp[0] = (unsigned char)(x & 0xff);
+    cp[1] = (unsigned char)(x >> 8);
+};
+
+// convert an array of Little Endian half values to host float
+static inline void HalfBytesToFloatArray(const char *src, float *dst, size_t num)
+{
+    size_t i=0;
+
+#ifdef DNN_USE_F16C
+    for (; i+8 <= num; i += 8)
+         _mm256_storeu_ps(&dst[i], _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(src+i*2))));
+#endif
+
+    for (; i < num; i++)
+         dst[i] = HalfToFloat(LEBytesToShort(src+i*2));
+};
+
+// convert an array of host float to Little Endian half values
+static inline void FloatArrayToHalfBytes(const float *src, char *dst, size_t num)
+{
+    size_t i=0;
+
+#ifdef DNN_USE_F16C
+    for (; i+8 <= num; i += 8)
+         _mm_storeu_si128((__m128i *)(dst+i*2), _mm256_cvtps_ph(_mm256_loadu_ps(&src[i]), _MM_FROUND_TO_NEAREST_INT));
+#endif
+
+    for (; i < num; i++)
+         ShortToLEBytes(FloatToHalf(src[i]), dst+i*2);
+};
+
+// convert an array of Little Endian bfloat16 values to host float
+static inline void BFloat16BytesToFloatArray(const char *src, float *dst, size_t num)
+{
+    size_t i=0;
+
+#ifdef DNN_USE_SSE2_BF16
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; i+8 <= num; i += 8) {
+         __m128i b8 = _mm_loadu_si128((const __m128i *)(src+i*2));
+
+         _mm_storeu_si128((__m128i *)&dst[i], _mm_unpacklo_epi16(zero, b8));
+         _mm_storeu_si128((__m128i *)&dst[i+4], _mm_unpackhi_epi16(zero, b8));
+    };
+#endif
+
+    for (; i < num; i++)
+         dst[i] = BFloat16ToFloat(LEBytesToShort(src+i*2));
+};
+
+// convert an array of host float to Little Endian bfloat16 values
+static inline void FloatArrayToBFloat16Bytes(const float *src, char *dst, size_t num)
+{
+    for (size_t i=0; i < num; i++)
+         ShortToLEBytes(FloatToBFloat16(src[i]), dst+i*2);
+};
+
+#endif
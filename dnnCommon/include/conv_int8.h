@@ -0,0 +1,71 @@
+/*
+ *  COPYRIGHT:  Copyright (c) 2014 Advanced Micro Devices, Inc.  All rights reserved
+ *
+ *   Symmetric int8 quantization of the weights matrixes with one scale for each output neuron (channel), the
+ *   float value is restored by q * scale
+ */
+
+#ifndef _CONV_INT8_H_
+#define _CONV_INT8_H_
+
+#include <cmath>
+#include <cstddef>
+
+static inline signed char FloatToInt8(float x, float invScale)
+{
+    float v = floorf(x * invScale + 0.5f);
+
+    v = (v > 127.0f)? 127.0f : v;
+    v = (v < -127.0f)? -127.0f : v;
+
+    return((signed char)v);
+};
+
+// Quantize a weights matrix of "rows" x "cols" floats, the output channels are the columns of the matrix, or the rows
+// of the matrix when channelsInRows is true (the transposed weights layout). "scales" gets one value for each channel
+static inline void FloatMatrixToInt8(const float *src, int rows, int cols, bool channelsInRows, signed char *dst, float *scales)
+{
+    int nChannels = channelsInRows? rows : cols;
+
+    for (int c=0; c < nChannels; c++)
+         scales[c] = 0.0f;
+
+    // find the maximum absolute value of each channel
+    for (int r=0; r < rows; r++)
+    {
+         const float *rowp = src + (size_t)r*cols;
+
+         for (int k=0; k < cols; k++)
+         {
+              float *maxp = channelsInRows? &scales[r] : &scales[k];
+              float absv = fabsf(rowp[k]);
+
+              *maxp = (absv > *maxp)? absv : *maxp;
+         };
+    };
+
+    for (int c=0; c < nChannels; c++)
+         scales[c] = scales[c] / 127.0f;
+
+    for (int r=0; r < rows; r++)
+    {
+         const float *rowp = src + (size_t)r*cols;
+         signed char *dstp = dst + (size_t)r*cols;
+
+         for (int k=0; k < cols; k++)
+         {
+              float scale = channelsInRows? scales[r] : scales[k];
+
+              dstp[k] = (scale > 0.0f)? FloatToInt8(rowp[k], 1.0f/scale) : 0;
+         };
+    };
+};
+
+static inline void Int8ToFloatMatrix(const signed char *src, const float *scales, int rows, int cols, bool channelsInRows, float *dst)
+{
+    for (int r=0; r < rows; r++)
+         for (int k=0; k < cols; k++)
+              dst[(size_t)r*cols+k] = src[(size_t)r*cols+k] * (channelsInRows? scales[r] : scales[k]);
+};
+
+#endif
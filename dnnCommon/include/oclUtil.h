@@ -11,14 +11,22 @@
 
 #include <CL/cl.h>
 
+#include "DNNApiExport.h"
+
 extern int choose_ocl_igpu_device(cl_device_id &theDevice);
 extern int choose_ocl_dgpu_device(cl_device_id &theDevice);
 extern int choose_ocl_cpu_device(cl_device_id &theDevice);
 
 extern int choose_ocl_dgpu_devices(cl_device_id theDevices[], int num);
+extern int choose_ocl_cpu_subdevices(cl_device_id theDevices[], int num);
 
 extern int setup_simple_ocl_context(cl_device_id &theDevice, cl_context &theContext, int numQueue, cl_command_queue *theQueues);
 
+// the queues created after enabling have CL_QUEUE_PROFILING_ENABLE set, so should be called before the OpenCL contexts are set up
+LIBDNNAPI extern void set_ocl_queue_profiling(bool enable);
+LIBDNNAPI extern bool get_ocl_queue_profiling();
+extern cl_command_queue_properties get_ocl_queue_properties();
+
 extern bool isAMDAPU(cl_device_id theDevice );
 extern bool isIGPU(cl_device_id theDevice ); 
 extern bool isAMDDevice(cl_device_id theDevice ); 
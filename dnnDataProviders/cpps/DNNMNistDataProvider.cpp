@@ -177,7 +177,7 @@ void DNNMNistDataProvider::setup_first_data_batches()
 	this->setup_cont_data_batches();
 
     if ( this->batches_loaded ) {
-	     this->shuffle_data(this->permutations, this->m_batchSize * this->batches_loaded );
+	     this->shuffle_data(this->permutations, this->frames_loaded );
     };
 };
 
@@ -256,9 +256,11 @@ endf:
 				dst++;
 		  };
 		  this->batches_loaded = batches;
+		  this->frames_loaded = readCount;
 	 }
  	 else {
 		  this->batches_loaded = (readCount == 0)? this->m_shuffleBatches: (readCount/this->m_batchSize);
+		  this->frames_loaded = this->batches_loaded * this->m_batchSize;
 	 };
 
 	 this->batchNo += this->batches_loaded;
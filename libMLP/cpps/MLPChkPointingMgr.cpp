@@ -12,6 +12,7 @@
 #include "MLPUtil.h"
 #include "MLPChkPointingMgr.h"
 #include "conv_endian.h"
+#include "DNNTracer.h"
 
 using namespace std;
 
@@ -253,6 +254,8 @@ void *MLPCheckPointManager::timer_fun(void *argp)
 
 		   DNN_SLEEP(MLP_CHKPOINTING_PERIOD);        // do checkpointing every one hour
 
+		   DNNTraceSpan span(DNN_TRACE_CHKPOINTING, "checkpoint");
+
 		   // Produce the names of the network configuration files
            // Use the checkpoint directory itself to save the network configuration files
 		   len = (int) objp->chkPointPath.copy(objp->chkPointState.netConfPath, 255);
@@ -13,10 +13,14 @@
 #include <functional>
 #include <vector>
 #include <cstring>
+#include <cmath>
 
 #include "MLPUtil.h"
 #include "MLPConfigProvider.h"
 #include "conv_endian.h"
+#include "conv_half.h"
+#include "conv_int8.h"
+#include "conv_bsr.h"
 
 using namespace std;
 
@@ -36,8 +40,20 @@ static COST_FUNC getCostFuncID(string &funcName);
 
 static void lowerCaselize(char *str);
 
+static size_t getDataTypeSize(MLP_DATA_TYPE dataType);
+static MLP_DATA_TYPE getBiasDataType(MLP_DATA_TYPE dataType);
+static void encodeFloatArray(MLP_DATA_TYPE dataType, const float *src, char *dst, size_t num);
+static void decodeFloatArray(MLP_DATA_TYPE dataType, const char *src, float *dst, size_t num);
+
 MLPConfigProvider::MLPConfigProvider()
 {
+    this->nnetMap = NULL;
+    this->actScales = NULL;
+    this->sampledClasses = 0;
+    this->accumulateSteps = 1;
+    this->weightLayout = MLP_WEIGHTS_ROWMAJOR;
+    this->storageType = MLP_DATA_FLOAT32;
+    this->fileDataType = MLP_DATA_FLOAT32;
     this->netType = NETTYPE_MULTI_CLASSIFICATION;
     this->nLayers = DEFAULT_LAYERS;
     this->dimensions = new int[DEFAULT_LAYERS];
@@ -70,6 +86,13 @@ MLPConfigProvider::MLPConfigProvider()
 // this constructor should be used by the MLPTrainer, not the MLPTester and MLPPredictor
 MLPConfigProvider::MLPConfigProvider(MLP_NETTYPE type, int layers, int dimensions_[], float etas_[], float momentum_, ACT_FUNC actFuncs_[], COST_FUNC costFunc_, int epochs_, bool DoInitialize)
 {
+    this->nnetMap = NULL;
+    this->actScales = NULL;
+    this->sampledClasses = 0;
+    this->accumulateSteps = 1;
+    this->weightLayout = MLP_WEIGHTS_ROWMAJOR;
+    this->storageType = MLP_DATA_FLOAT32;
+    this->fileDataType = MLP_DATA_FLOAT32;
     this->netType = type;
     this->nLayers = layers;
     this->dimensions = new int[this->nLayers];
@@ -110,6 +133,13 @@ MLPConfigProvider::MLPConfigProvider(MLP_NETTYPE type, int layers, int dimension
 
 MLPConfigProvider::MLPConfigProvider(int layers, int dimensions_[], bool DoInitialize)
 {
+    this->nnetMap = NULL;
+    this->actScales = NULL;
+    this->sampledClasses = 0;
+    this->accumulateSteps = 1;
+    this->weightLayout = MLP_WEIGHTS_ROWMAJOR;
+    this->storageType = MLP_DATA_FLOAT32;
+    this->fileDataType = MLP_DATA_FLOAT32;
     this->nLayers = layers;
     this->dimensions = new int[this->nLayers];
     this->biases = new float*[this->nLayers];
@@ -159,12 +189,18 @@ MLPConfigProvider::MLPConfigProvider(const char *dir, const char *trainingConfig
 	nnetFileName.append(nnetDataFile);
 
 	ifstream configFile;
-	ifstream nnetFile;
+
+	this->nnetMap = NULL;
+	this->actScales = NULL;
+	this->sampledClasses = 0;
+	this->accumulateSteps = 1;
+	this->weightLayout = MLP_WEIGHTS_ROWMAJOR;
+	this->storageType = MLP_DATA_FLOAT32;
+	this->fileDataType = MLP_DATA_FLOAT32;
 
 	configFile.open(configFileName.c_str(),ios_base::in);
-	nnetFile.open(nnetFileName.c_str(),ios_base::in|ios_base::binary);
 
-	if ( ! configFile.is_open() || ! nnetFile.is_open() ) {
+	if ( ! configFile.is_open() ) {
 		   mlp_log("MLPConfigProvider", "Failed to open MLP net config files for reading");
 		   MLP_Exception("");
 	};
@@ -216,14 +252,12 @@ MLPConfigProvider::MLPConfigProvider(const char *dir, const char *trainingConfig
                 break;
           };
     };
-	if ( (layers < 2) || (layers > 9 )) {
+	if ( layers < 2 ) {
 		  mlp_log("MLPConfigProvider", "The setting for <Layers> from the config file is not correct");
 		  MLP_Exception("");
 	};
 	this->nLayers = layers;
 	this->dimensions = new int[this->nLayers];
-	this->biases = new float*[this->nLayers];
-	this->weights = new float*[this->nLayers];
 	this->etas = new float[this->nLayers];
 	this->actFuncs = new ACT_FUNC[this->nLayers];
 
@@ -341,90 +375,57 @@ MLPConfigProvider::MLPConfigProvider(const char *dir, const char *trainingConfig
 	};
 	this->epochs = nEpoch; 
 
+	// read the optional Sampled Softmax value, the number of output classes used for each batch by the training
+	int nSampled = 0;
+	string key6("Sampled Softmax:");
+    for (vector<string>::iterator it=lines.begin(); it != lines.end(); ++it) {
+          if ( (*it).compare(0,key6.length(),key6) == 0 ) {
+                istringstream mystream((*it).substr(key6.length()));
 
-	// allocate memory for weights and biases data of each layer
-	this->biases[0] = NULL;
-	for (int i=1; i< this->nLayers; i++)
-		this->biases[i] = new float[this->dimensions[i]];
-
-	this->weights[0] = NULL;
-	for (int i=1; i< this->nLayers; i++)
-		this->weights[i] = new float[this->dimensions[i-1]*this->dimensions[i]];
-
-
-    // read information from the neural network data file
-	nnetFile.seekg(16);   // skip the checksum
-
-	string corrMark("NNET");
-	char Mark[5];
-
-	nnetFile.read(&Mark[0], 4);
-	Mark[4] = '\0';
-
-	if ( corrMark != Mark ) {
-		 mlp_log("MLPConfigProvider", "checking the integrity of MLP neural network data file failed, discarded");
-		 MLP_Exception("");
+                mystream >> nSampled;
+                break;
+          };
+    };
+    if ( (nSampled != 0) && ( (nSampled < 2) || (nSampled >= this->dimensions[layers-1]) || (this->actFuncs[layers-1] != AFUNC_SOFTMAX) || (this->costFunc != CFUNC_CE) ) ) {
+		  mlp_log("MLPConfigProvider", "The setting for <Sampled Softmax> should be less than the output classes, and only for the softmax output with the CE cost");
+		  MLP_Exception("");
 	};
+	this->sampledClasses = nSampled;
 
-	nnetFile.seekg(16+4);  // skip the checksum and the tag
-
-	struct mlp_nnet_data_header header;
-
-	nnetFile.read(reinterpret_cast<char*>(&header), sizeof(header));
-
-	// convert the data in the header to host bytes sequence from Little Endian bytes sequence
-	LEtoHostl(header.nLayers);
-	for (int i=0; i < this->nLayers; i++)
-	     LEtoHostl(header.layers[i].dimension);
-	for (int i=1; i < this->nLayers; i++)
-	     LEtoHostl(header.weight_offsets[i]);
-
-    lowerCaselize(header.nnet_type);
-
-    // check whether the information from the config file and the nnet data matches
-    bool match=true;
-
-    match = ( this->nLayers == (int)header.nLayers )? match:false;
-    match = ( this->netType == getNetTypeID(header.nnet_type) )? match:false;
-    if ( match ) {
-         for (int i=0; i < this->nLayers; i++)
-              match = ( this->dimensions[i] == (int)header.layers[i].dimension )? match:false;
-
-         for (int i=1; i < this->nLayers; i++)
-              match = ( this->actFuncs[i] == getActFuncID(header.layers[i].activation) )? match:false;
-    };
+	// read the optional Accumulate Steps value, the number of batches whose variances are summed before updating the weights
+	int nSteps = 1;
+	string key7("Accumulate Steps:");
+    for (vector<string>::iterator it=lines.begin(); it != lines.end(); ++it) {
+          if ( (*it).compare(0,key7.length(),key7) == 0 ) {
+                istringstream mystream((*it).substr(key7.length()));
 
-    if ( ! match ) {
-         mlp_log("MLPConfigProvider", "The infomration from the config file and the neural network data file does not match");
-         MLP_Exception("");
+                mystream >> nSteps;
+                break;
+          };
     };
-
-	for (int i=1; i < this->nLayers; i++) {
-
-	    nnetFile.seekg(header.weight_offsets[i]);
-
-		for (int row=0; row < this->dimensions[i-1]; row++)
-			 nnetFile.read(reinterpret_cast<char*>(&this->weights[i][row*this->dimensions[i]]), sizeof(float)*this->dimensions[i]);
-		nnetFile.read(reinterpret_cast<char*>(&this->biases[i][0]),sizeof(float)*this->dimensions[i]);
-
-		// convert to host float type from generice bytes
-		for (int row=0; row < this->dimensions[i-1]; row++)
-			 for (int col=0; col < this->dimensions[i]; col++)
-                      BytesToFloat(this->weights[i][row*this->dimensions[i]+col]);
-				      // LEtoHostl(*(unsigned int *)&this->weights[i][row*this->dimensions[i]+col]);
-
-		for (int col=0; col < this->dimensions[i]; col++)
-                 BytesToFloat(this->biases[i][col]);
-			     //LEtoHostl(*(unsigned int *)&this->biases[i][col]);
+    if ( (nSteps < 1) || ( (nSteps > 1) && (nSampled > 0) ) ) {
+		  mlp_log("MLPConfigProvider", "The setting for <Accumulate Steps> should be at least 1, and can not be used with <Sampled Softmax>");
+		  MLP_Exception("");
 	};
+	this->accumulateSteps = nSteps;
+
 
     configFile.close();
-    nnetFile.close();
+
+    // read the weights and biases from the neural network data file, which must match the config file
+    this->loadNNetData(nnetFileName.c_str(), true);
 }
 
 // this constuctor is used by the trainer to create a randomly initialized neural network
  MLPConfigProvider::MLPConfigProvider(const char *dir, const char *trainingConfigFile, bool DoInitialize)
 {
+    this->nnetMap = NULL;
+    this->actScales = NULL;
+    this->sampledClasses = 0;
+    this->accumulateSteps = 1;
+    this->weightLayout = MLP_WEIGHTS_ROWMAJOR;
+    this->storageType = MLP_DATA_FLOAT32;
+    this->fileDataType = MLP_DATA_FLOAT32;
 	string configFileName(dir);
 	string nnetFileName(dir);
 
@@ -485,7 +486,7 @@ MLPConfigProvider::MLPConfigProvider(const char *dir, const char *trainingConfig
                 break;
           };
     };
-	if ( (layers < 2) || (layers > 9 )) {
+	if ( layers < 2 ) {
 		  mlp_log("MLPConfigProvider", "The setting for <Layers> from the config file is not correct");
 		  MLP_Exception("");
 	};
@@ -610,6 +611,40 @@ MLPConfigProvider::MLPConfigProvider(const char *dir, const char *trainingConfig
 	};
 	this->epochs = nEpoch; 
 
+	// read the optional Sampled Softmax value, the number of output classes used for each batch by the training
+	int nSampled = 0;
+	string key6("Sampled Softmax:");
+    for (vector<string>::iterator it=lines.begin(); it != lines.end(); ++it) {
+          if ( (*it).compare(0,key6.length(),key6) == 0 ) {
+                istringstream mystream((*it).substr(key6.length()));
+
+                mystream >> nSampled;
+                break;
+          };
+    };
+    if ( (nSampled != 0) && ( (nSampled < 2) || (nSampled >= this->dimensions[layers-1]) || (this->actFuncs[layers-1] != AFUNC_SOFTMAX) || (this->costFunc != CFUNC_CE) ) ) {
+		  mlp_log("MLPConfigProvider", "The setting for <Sampled Softmax> should be less than the output classes, and only for the softmax output with the CE cost");
+		  MLP_Exception("");
+	};
+	this->sampledClasses = nSampled;
+
+	// read the optional Accumulate Steps value, the number of batches whose variances are summed before updating the weights
+	int nSteps = 1;
+	string key7("Accumulate Steps:");
+    for (vector<string>::iterator it=lines.begin(); it != lines.end(); ++it) {
+          if ( (*it).compare(0,key7.length(),key7) == 0 ) {
+                istringstream mystream((*it).substr(key7.length()));
+
+                mystream >> nSteps;
+                break;
+          };
+    };
+    if ( (nSteps < 1) || ( (nSteps > 1) && (nSampled > 0) ) ) {
+		  mlp_log("MLPConfigProvider", "The setting for <Accumulate Steps> should be at least 1, and can not be used with <Sampled Softmax>");
+		  MLP_Exception("");
+	};
+	this->accumulateSteps = nSteps;
+
 	// allocate memory for weights and biases data of each layer
 	this->biases[0] = NULL;
 	for (int i=1; i< this->nLayers; i++)
@@ -636,103 +671,421 @@ MLPConfigProvider::MLPConfigProvider(const char *dir, const char *nnetDataFile)
 
     nnetFileName.append(nnetDataFile);
 
-    ifstream nnetFile;
+    this->nnetMap = NULL;
+    this->actScales = NULL;
+    this->sampledClasses = 0;
+    this->accumulateSteps = 1;
+    this->weightLayout = MLP_WEIGHTS_ROWMAJOR;
+    this->storageType = MLP_DATA_FLOAT32;
+    this->fileDataType = MLP_DATA_FLOAT32;
+
+    // absorb the information of the network and the weights and biases directly from the nnet data file
+    this->loadNNetData(nnetFileName.c_str(), false);
+};
+
+
+// the information of one layer from the header of the nnet data file, independent of the version of the file
+struct nnet_layer_info {
+    unsigned int dimension;
+    char activation[32];
+    unsigned int dataType;
+    unsigned int layout;
+    unsigned long long weightOffset;
+    unsigned long long biasOffset;
+    unsigned long long scaleOffset;
+    float actScale;
+    unsigned int nnzBlocks;
+};
+
+// the header of version 1 file follows the "NNET" tag, all layers share the same data type and weights layout
+static bool readNNetHeaderV1(const char *base, size_t len, char *nnetType, vector<struct nnet_layer_info> &layers)
+{
+    struct mlp_nnet_data_header header;
+
+    if ( len < 16+4+sizeof(header) )
+         return(false);
+
+    memcpy(&header, base+16+4, sizeof(header));
+
+    // convert the data in the header to host bytes sequence from Little Endian bytes sequence
+    LEtoHostl(header.nLayers);
+
+    if ( (header.nLayers < 2) || (header.nLayers > MLP_NNET_MAX_LAYERS) )
+         return(false);
+
+    for (int i=0; i < (int)header.nLayers; i++)
+        LEtoHostl(header.layers[i].dimension);
+    for (int i=1; i < (int)header.nLayers; i++)
+        LEtoHostl(header.weight_offsets[i]);
+    LEtoHostl(header.weight_layout);
+    LEtoHostl(header.data_type);
 
-    nnetFile.open(nnetFileName.c_str(),ios_base::in|ios_base::binary);
+    if ( header.data_type > MLP_DATA_BFLOAT16 )        // int8 only supported by version 2 files
+         return(false);
 
-    if ( ! nnetFile.is_open() )
+    memcpy(nnetType, header.nnet_type, sizeof(header.nnet_type));
+    nnetType[sizeof(header.nnet_type)-1] = '\0';
+
+    layers.resize(header.nLayers);
+    for (int i=0; i < (int)header.nLayers; i++)
     {
-        mlp_log("MLPConfigProvider", "Failed to open MLP neural network data file for reading");
-        MLP_Exception("");
+        memset(layers[i].activation, 0, sizeof(layers[i].activation));
+        memcpy(layers[i].activation, header.layers[i].activation, sizeof(header.layers[i].activation));
+        layers[i].activation[sizeof(header.layers[i].activation)-1] = '\0';
+
+        layers[i].dimension = header.layers[i].dimension;
+        layers[i].dataType = header.data_type;
+        layers[i].layout = header.weight_layout;
+        layers[i].weightOffset = (i > 0)? header.weight_offsets[i] : 0;
+        layers[i].biasOffset = (i > 0)? header.weight_offsets[i] + ((unsigned long long)header.layers[i-1].dimension*header.layers[i].dimension) * getDataTypeSize((MLP_DATA_TYPE)header.data_type) : 0;
+        layers[i].scaleOffset = 0;
+        layers[i].actScale = 0.0f;
+        layers[i].nnzBlocks = 0;
+    };
+
+    return(true);
+};
+
+// the header of version 2 file follows the "NNV2" tag, each layer has its own descriptor with 64-bit offsets
+static bool readNNetHeaderV2(const char *base, size_t len, char *nnetType, vector<struct nnet_layer_info> &layers)
+{
+    struct mlp_nnet_v2_header header;
+
+    if ( len < 16+4+sizeof(header) )
+         return(false);
+
+    memcpy(&header, base+16+4, sizeof(header));
+
+    LEtoHostl(header.version);
+    LEtoHostl(header.header_size);
+    LEtoHostl(header.layer_desc_size);
+    LEtoHostl(header.nLayers);
+    LEtoHostll(header.desc_offset);
+
+    // the descriptors written before the int8 fields were appended are shorter
+    if ( (header.version != MLP_NNET_VERSION) || (header.header_size < sizeof(header)) || (header.layer_desc_size < offsetof(struct mlp_nnet_v2_layer_desc, scale_offset)) )
+         return(false);
+
+    // the descriptors of all layers should be located inside the file
+    if ( (header.nLayers < 2) || (header.desc_offset > len) || ((len - header.desc_offset) / header.layer_desc_size < header.nLayers) )
+         return(false);
+
+    memcpy(nnetType, header.nnet_type, sizeof(header.nnet_type));
+    nnetType[sizeof(header.nnet_type)-1] = '\0';
+
+    layers.resize(header.nLayers);
+    for (int i=0; i < (int)header.nLayers; i++)
+    {
+        struct mlp_nnet_v2_layer_desc desc;
+
+        memset(&desc, 0, sizeof(desc));
+        memcpy(&desc, base + header.desc_offset + (size_t)i*header.layer_desc_size, min((size_t)header.layer_desc_size, sizeof(desc)));
+
+        LEtoHostll(desc.weight_offset);
+        LEtoHostll(desc.bias_offset);
+        LEtoHostl(desc.dimension);
+        LEtoHostl(desc.data_type);
+        LEtoHostl(desc.weight_layout);
+        LEtoHostl(desc.nnz_blocks);
+        LEtoHostll(desc.scale_offset);
+        BytesToFloat(desc.act_scale);
+
+        memcpy(layers[i].activation, desc.activation, sizeof(desc.activation));
+        layers[i].activation[sizeof(desc.activation)-1] = '\0';
+
+        layers[i].dimension = desc.dimension;
+        layers[i].dataType = desc.data_type;
+        layers[i].layout = desc.weight_layout;
+        layers[i].weightOffset = desc.weight_offset;
+        layers[i].biasOffset = desc.bias_offset;
+        layers[i].scaleOffset = desc.scale_offset;
+        layers[i].actScale = desc.act_scale;
+        layers[i].nnzBlocks = desc.nnz_blocks;
     };
 
-    nnetFile.seekg(16);   // skip the checksum
+    return(true);
+};
+
+// check that an array of "num" elements of "elemSize" bytes at "offset" is located inside the file
+static bool checkNNetArray(unsigned long long offset, unsigned long long num, size_t elemSize, size_t len)
+{
+    if ( (offset % elemSize != 0) || (offset > len) )
+         return(false);
+
+    return( num <= (len - offset) / elemSize );
+};
+
+// the block row pointers, the block column indexes and the values of a MLP_DATA_BSR weights matrix of "rows" x "cols" are
+// stored one after another from the weights offset
+static unsigned long long getBSRColIndicesOffset(const struct nnet_layer_info &layer, int rows)
+{
+    return( layer.weightOffset + (unsigned long long)(BSRBlocks(rows)+1)*sizeof(unsigned int) );
+};
+
+static unsigned long long getBSRValuesOffset(const struct nnet_layer_info &layer, int rows)
+{
+    return( getBSRColIndicesOffset(layer, rows) + (unsigned long long)layer.nnzBlocks*sizeof(unsigned int) );
+};
+
+// read the block indexes of a MLP_DATA_BSR weights matrix to host bytes sequence, after checking that all its arrays are located
+// inside the file and the indexes are valid
+static bool readBSRIndexes(const char *base, size_t len, const struct nnet_layer_info &layer, int rows, int cols, vector<unsigned int> &rowPtrs, vector<unsigned int> &colIndices)
+{
+    size_t blockSize = DNN_BSR_BLOCK*DNN_BSR_BLOCK;
+
+    if ( ! checkNNetArray(layer.weightOffset, BSRBlocks(rows)+1, sizeof(unsigned int), len) ||
+         ! checkNNetArray(getBSRColIndicesOffset(layer, rows), layer.nnzBlocks, sizeof(unsigned int), len) ||
+         ! checkNNetArray(getBSRValuesOffset(layer, rows), (unsigned long long)layer.nnzBlocks*blockSize, sizeof(float), len) )
+         return(false);
+
+    rowPtrs.resize(BSRBlocks(rows)+1);
+    colIndices.resize(layer.nnzBlocks+1);
+
+    memcpy(&rowPtrs[0], base + (size_t)layer.weightOffset, rowPtrs.size()*sizeof(unsigned int));
+    memcpy(&colIndices[0], base + (size_t)getBSRColIndicesOffset(layer, rows), layer.nnzBlocks*sizeof(unsigned int));
 
-    string corrMark("NNET");
-    char Mark[5];
+    for (size_t k=0; k < rowPtrs.size(); k++)
+         LEtoHostl(rowPtrs[k]);
+    for (size_t k=0; k < layer.nnzBlocks; k++)
+         LEtoHostl(colIndices[k]);
+
+    return( CheckBSRIndexes(&rowPtrs[0], &colIndices[0], rows, cols, layer.nnzBlocks) );
+};
 
-    nnetFile.read(&Mark[0], 4);
-    Mark[4] = '\0';
+// Map the neural network data file into memory. On Little Endian hosts the weights and biases of each layer
+// point directly into the (copy-on-write) mapping at their 1024-byte aligned offsets, so loading costs no more
+// than paging in the file. On other hosts the data is converted into allocated memory and the file is unmapped.
+//
+// If checkConfig is true, the network description read from the config file must match the header of the
+// data file, otherwise the description is taken from the header.
+void MLPConfigProvider::loadNNetData(const char *fileName, bool checkConfig)
+{
+    struct dnn_file_map *fmap = new struct dnn_file_map;
 
-    if ( corrMark != Mark )
+    if ( map_file_private(fileName, fmap) != 0 )
     {
+        delete fmap;
+        mlp_log("MLPConfigProvider", "Failed to open MLP neural network data file for reading");
+        MLP_Exception("");
+    };
+
+    vector<struct nnet_layer_info> layers;
+    char nnetType[32];
+    bool valid=false;
+
+    // skip the checksum, check the tag
+    if ( fmap->len >= 16+4 ) {
+         if ( memcmp(fmap->base+16, "NNV2", 4) == 0 )
+              valid = readNNetHeaderV2(fmap->base, fmap->len, nnetType, layers);
+         else
+         if ( memcmp(fmap->base+16, "NNET", 4) == 0 )
+              valid = readNNetHeaderV1(fmap->base, fmap->len, nnetType, layers);
+    };
+
+    if ( ! valid )
+    {
+        unmap_file(fmap);
+        delete fmap;
         mlp_log("MLPConfigProvider", "checking the integrity of MLP neural network data file failed, discarded");
         MLP_Exception("");
     };
 
-    nnetFile.seekg(16+4);  // skip the checksum and the tag
+    int nnetLayers = (int)layers.size();
 
-    struct mlp_nnet_data_header header;
+    for (int i=1; i < nnetLayers; i++)
+    {
+        if ( ( (layers[i].layout != MLP_WEIGHTS_ROWMAJOR) && (layers[i].layout != MLP_WEIGHTS_TRANSPOSED) ) ||
+             ( (layers[i].dataType != MLP_DATA_FLOAT32) && (layers[i].dataType != MLP_DATA_FLOAT16) && (layers[i].dataType != MLP_DATA_BFLOAT16) &&
+               (layers[i].dataType != MLP_DATA_INT8) && (layers[i].dataType != MLP_DATA_BSR) ) )
+        {
+            unmap_file(fmap);
+            delete fmap;
+            mlp_log("MLPConfigProvider", "The weights layout or data type of the MLP neural network data file is not supported");
+            MLP_Exception("");
+        };
+    };
 
-    nnetFile.read(reinterpret_cast<char*>(&header), sizeof(header));
+    // check that the data of all layers is located inside the file
+    for (int i=1; i < nnetLayers; i++)
+    {
+        MLP_DATA_TYPE dataType = (MLP_DATA_TYPE)layers[i].dataType;
+        size_t elemSize = getDataTypeSize(dataType);
+        bool weightsValid;
+
+        if ( dataType == MLP_DATA_BSR ) {
+             vector<unsigned int> rowPtrs, colIndices;
+             int rows = (layers[i].layout == MLP_WEIGHTS_TRANSPOSED)? layers[i].dimension : layers[i-1].dimension;
+             int cols = (layers[i].layout == MLP_WEIGHTS_TRANSPOSED)? layers[i-1].dimension : layers[i].dimension;
+
+             weightsValid = (rows > 0) && (cols > 0) && readBSRIndexes(fmap->base, fmap->len, layers[i], rows, cols, rowPtrs, colIndices);
+        }
+        else
+             weightsValid = checkNNetArray(layers[i].weightOffset, (unsigned long long)layers[i-1].dimension*layers[i].dimension, elemSize, fmap->len);
+
+        if ( (layers[i-1].dimension < 1) || (layers[i].dimension < 1) || ! weightsValid ||
+             ! checkNNetArray(layers[i].biasOffset, layers[i].dimension, getDataTypeSize(getBiasDataType(dataType)), fmap->len) ||
+             ( (dataType == MLP_DATA_INT8) && ! checkNNetArray(layers[i].scaleOffset, layers[i].dimension, sizeof(float), fmap->len) ) )
+        {
+             unmap_file(fmap);
+             delete fmap;
+             mlp_log("MLPConfigProvider", "checking the integrity of MLP neural network data file failed, discarded");
+             MLP_Exception("");
+        };
+    };
 
-    // convert the data in the header to host bytes sequence from Little Endian bytes sequence
-    LEtoHostl(header.nLayers);
-    for (int i=0; i < this->nLayers; i++)
-        LEtoHostl(header.layers[i].dimension);
-    for (int i=1; i < this->nLayers; i++)
-        LEtoHostl(header.weight_offsets[i]);
+    lowerCaselize(nnetType);
 
-    lowerCaselize(header.nnet_type);
+    if ( checkConfig ) {
+         // check whether the information from the config file and the nnet data matches
+         bool match=true;
 
-    // allocate data structures for the MLPConfigProvider
-    this->nLayers = header.nLayers;
-    this->netType = getNetTypeID(header.nnet_type);
-    this->dimensions = new int[this->nLayers];
-    this->biases = new float*[this->nLayers];
-    this->weights = new float*[this->nLayers];
-    this->etas = new float[this->nLayers];
-    this->actFuncs = new ACT_FUNC[this->nLayers];
+         match = ( this->nLayers == nnetLayers )? match:false;
+         match = ( this->netType == getNetTypeID(nnetType) )? match:false;
+         if ( match ) {
+              for (int i=0; i < this->nLayers; i++)
+                   match = ( this->dimensions[i] == (int)layers[i].dimension )? match:false;
 
-    // absorb the information directly from the nnet data file header
-    for (int i=0; i< this->nLayers; i++)
-        this->dimensions[i] = header.layers[i].dimension;
-    for (int i=1; i< this->nLayers; i++)
-        this->actFuncs[i] = getActFuncID(header.layers[i].activation);
+              for (int i=1; i < this->nLayers; i++)
+                   match = ( this->actFuncs[i] == getActFuncID(layers[i].activation) )? match:false;
+         };
 
-    // allocate memory for weights and biases data of each layer
-    this->biases[0] = NULL;
-    for (int i=1; i< this->nLayers; i++)
-        this->biases[i] = new float[this->dimensions[i]];
+         if ( ! match ) {
+              unmap_file(fmap);
+              delete fmap;
+              mlp_log("MLPConfigProvider", "The infomration from the config file and the neural network data file does not match");
+              MLP_Exception("");
+         };
+    }
+    else {
+         // allocate data structures for the MLPConfigProvider
+         this->nLayers = nnetLayers;
+         this->netType = getNetTypeID(nnetType);
+         this->dimensions = new int[this->nLayers];
+         this->etas = new float[this->nLayers];
+         this->actFuncs = new ACT_FUNC[this->nLayers];
+
+         for (int i=0; i< this->nLayers; i++)
+             this->dimensions[i] = layers[i].dimension;
+         for (int i=1; i< this->nLayers; i++)
+             this->actFuncs[i] = getActFuncID(layers[i].activation);
+    };
 
+    // the weights layout of the first layer is used for the whole MLPConfigProvider, the weights matrixes of other layers with
+    // different layout are re-arranged when loaded. The weights are decoded to float, so saveConfig() keeps writing float32
+    // unless setStorageType() is called, the data type of the file is only kept for getFileDataType()
+    this->weightLayout = (MLP_WEIGHT_LAYOUT)layers[1].layout;
+    this->fileDataType = (MLP_DATA_TYPE)layers[1].dataType;
+
+    if ( this->fileDataType == MLP_DATA_INT8 ) {
+         this->actScales = new float[this->nLayers];
+
+         this->actScales[0] = 0.0f;
+         for (int i=1; i < this->nLayers; i++)
+             this->actScales[i] = layers[i].actScale;
+    };
+
+    this->biases = new float*[this->nLayers];
+    this->weights = new float*[this->nLayers];
+    this->biases[0] = NULL;
     this->weights[0] = NULL;
-    for (int i=1; i< this->nLayers; i++)
-        this->weights[i] = new float[this->dimensions[i-1]*this->dimensions[i]];
 
-    // read the weights and biases information for all layers from the nnet data file
+#ifdef DNN_LITTLE_ENDIAN_HOST
+    bool inPlace=true;
+
     for (int i=1; i < this->nLayers; i++)
-    {
+        if ( (layers[i].dataType != MLP_DATA_FLOAT32) || (layers[i].layout != (unsigned int)this->weightLayout) )
+             inPlace = false;
 
-        nnetFile.seekg(header.weight_offsets[i]);
+    if ( inPlace ) {
+         // the weights matrix and the bias vector of each layer are used in place in the mapping
+         for (int i=1; i < this->nLayers; i++)
+         {
+             this->weights[i] = reinterpret_cast<float*>(fmap->base + (size_t)layers[i].weightOffset);
+             this->biases[i] = reinterpret_cast<float*>(fmap->base + (size_t)layers[i].biasOffset);
+         };
 
-        for (int row=0; row < this->dimensions[i-1]; row++)
-            nnetFile.read(reinterpret_cast<char*>(&this->weights[i][row*this->dimensions[i]]), sizeof(float)*this->dimensions[i]);
-        nnetFile.read(reinterpret_cast<char*>(&this->biases[i][0]),sizeof(float)*this->dimensions[i]);
+         this->nnetMap = fmap;
+         return;
+    };
+#endif
 
-        // convert to host float type from generic bytes
-        for (int row=0; row < this->dimensions[i-1]; row++)
-            for (int col=0; col < this->dimensions[i]; col++)
-                     BytesToFloat(this->weights[i][row*this->dimensions[i]+col]);
-		             // LEtoHostl(*(unsigned int *)&this->weights[i][row*this->dimensions[i]+col]);
+    // convert to host float type from generic bytes or 16-bit floats
+    for (int i=1; i < this->nLayers; i++)
+    {
+        MLP_DATA_TYPE dataType = (MLP_DATA_TYPE)layers[i].dataType;
+        size_t wSize = (size_t)this->dimensions[i-1]*this->dimensions[i];
 
-        for (int col=0; col < this->dimensions[i]; col++)
-                     BytesToFloat(this->biases[i][col]);
-					// LEtoHostl(*(unsigned int *)&this->biases[i][col]);
+        this->weights[i] = new float[wSize];
+        this->biases[i] = new float[this->dimensions[i]];
+
+        if ( dataType == MLP_DATA_INT8 ) {
+             // restore the float weights from the int8 values and the scales of the output neurons
+             float *scales = new float[this->dimensions[i]];
+
+             BytesToFloatArray(fmap->base + (size_t)layers[i].scaleOffset, scales, this->dimensions[i]);
+             Int8ToFloatMatrix(reinterpret_cast<signed char*>(fmap->base + (size_t)layers[i].weightOffset), scales,
+                               (layers[i].layout == MLP_WEIGHTS_TRANSPOSED)? this->dimensions[i] : this->dimensions[i-1],
+                               (layers[i].layout == MLP_WEIGHTS_TRANSPOSED)? this->dimensions[i-1] : this->dimensions[i],
+                               layers[i].layout == MLP_WEIGHTS_TRANSPOSED, this->weights[i]);
+             delete [] scales;
+        }
+        else
+        if ( dataType == MLP_DATA_BSR ) {
+             // the blocks not stored are all zeroes
+             int rows = (layers[i].layout == MLP_WEIGHTS_TRANSPOSED)? this->dimensions[i] : this->dimensions[i-1];
+             int cols = (layers[i].layout == MLP_WEIGHTS_TRANSPOSED)? this->dimensions[i-1] : this->dimensions[i];
+             vector<unsigned int> rowPtrs, colIndices;
+             size_t nnzValues = (size_t)layers[i].nnzBlocks*DNN_BSR_BLOCK*DNN_BSR_BLOCK;
+             float *values = new float[nnzValues+1];
+
+             readBSRIndexes(fmap->base, fmap->len, layers[i], rows, cols, rowPtrs, colIndices);
+             BytesToFloatArray(fmap->base + (size_t)getBSRValuesOffset(layers[i], rows), values, nnzValues);
+             BSRToFloatMatrix(&rowPtrs[0], &colIndices[0], values, rows, cols, this->weights[i]);
+
+             delete [] values;
+        }
+        else
+             decodeFloatArray(dataType, fmap->base + (size_t)layers[i].weightOffset, this->weights[i], wSize);
+        decodeFloatArray(getBiasDataType(dataType), fmap->base + (size_t)layers[i].biasOffset, this->biases[i], this->dimensions[i]);
+
+        if ( layers[i].layout != (unsigned int)this->weightLayout ) {
+             int rows = (layers[i].layout == MLP_WEIGHTS_TRANSPOSED)? this->dimensions[i] : this->dimensions[i-1];
+             int cols = (layers[i].layout == MLP_WEIGHTS_TRANSPOSED)? this->dimensions[i-1] : this->dimensions[i];
+             float *tmpWeights = new float[wSize];
+
+             for (int r=0; r < rows; r++)
+                  for (int c=0; c < cols; c++)
+                       tmpWeights[(size_t)c*rows+r] = this->weights[i][(size_t)r*cols+c];
+
+             delete [] this->weights[i];
+             this->weights[i] = tmpWeights;
+        };
     };
 
-    nnetFile.close();
+    unmap_file(fmap);
+    delete fmap;
 };
 
 
 MLPConfigProvider::~MLPConfigProvider()
 {
-    for (int i=0; i< this->nLayers; i++)
-        if ( this->biases[i] )
-            delete [] this->biases[i];
+    if ( this->nnetMap ) {
+         // the weights and biases are located in the mapped nnet data file
+         unmap_file(this->nnetMap);
+         delete this->nnetMap;
+    }
+    else {
+         for (int i=0; i< this->nLayers; i++)
+             if ( this->biases[i] )
+                 delete [] this->biases[i];
 
-    for (int i=0; i < this->nLayers; i++)
-        if ( this->weights[i] )
-            delete [] this->weights[i];
+         for (int i=0; i < this->nLayers; i++)
+             if ( this->weights[i] )
+                 delete [] this->weights[i];
+    };
+
+    if ( this->actScales )
+         delete [] this->actScales;
 
     delete [] this->biases;
     delete [] this->weights;
@@ -758,23 +1111,124 @@ void MLPConfigProvider::biasesInitialize()
 
 void MLPConfigProvider::weightsInitialize()
 {
-    float *datap;
-
     struct dnn_tv tv;
 
     getCurrentTime(&tv);
-    srand(tv.tv_usec); // use current time as random seed
 
-    for (int i=1; i< this->nLayers; i++)
-        for (int col=0; col< this->dimensions[i]; col++)              // go through all columns
+    this->initializeWeights(WINIT_UNIFORM_LEGACY, (unsigned int)tv.tv_usec);   // use current time as random seed
+};
+
+// Each weight is generated from a hash of (seed, layer, index), where index is the position of the weight in the row-major
+// weights matrix, so the result does not depend on the number of threads, the order of generating or the weights layout
+
+static inline unsigned long long randomBits(unsigned long long key, unsigned long long index)
+{
+    return( mixBits(key + (index+1)*0x9e3779b97f4a7c15ULL) );
+};
+
+struct weights_init_task {
+    MLP_WEIGHT_INIT scheme;
+    unsigned int seed;
+    int nLayers;
+    int *dimensions;
+    float **weights;
+    bool transposed;
+    int part;         // this task initializes rows part, part+nParts, part+2*nParts ... of the weights matrix of each layer
+    int nParts;
+};
+
+static void *weights_init_fun(void *argp)
+{
+    struct weights_init_task *task = (struct weights_init_task *)argp;
+    const float scale24 = 1.0f/16777216.0f;
+
+    for (int i=1; i < task->nLayers; i++)
+    {
+        unsigned long long key = mixBits( ((unsigned long long)task->seed << 32) | (unsigned int)i );
+        int fanIn = task->dimensions[i-1];
+        int rows = task->transposed? task->dimensions[i] : task->dimensions[i-1];
+        int cols = task->transposed? task->dimensions[i-1] : task->dimensions[i];
+        float range;
+
+        switch (task->scheme) {
+        case WINIT_UNIFORM_FANIN:
+             range = 2.0f*sqrtf(3.0f/fanIn);
+             break;
+        case WINIT_NORMAL_FANIN:
+             range = sqrtf(1.0f/fanIn);
+             break;
+        default:
+             range = 1.0f;
+        };
+
+        for (int row=task->part; row < rows; row += task->nParts)
         {
-            datap = this->weights[i] + col;
-            for (int row=0; row< this->dimensions[i-1]; row++)       // go through all lines
+            float *datap = task->weights[i] + (size_t)row*cols;
+
+            for (int col=0; col < cols; col++)
             {
-                *datap = (float)rand()/((float)RAND_MAX+1.0f)-0.5f;
-                datap += this->dimensions[i];
+                 unsigned long long index;
+                 unsigned long long bits;
+
+                 index = task->transposed? (unsigned long long)col*rows+row : (unsigned long long)row*cols+col;
+                 bits = randomBits(key, index);
+
+                 if ( task->scheme == WINIT_NORMAL_FANIN )
+                      datap[col] = range * normalFromBits(bits);
+                 else
+                      datap[col] = range * ((unsigned int)(bits >> 40) * scale24 - 0.5f);
             };
         };
+    };
+
+    return(NULL);
+};
+
+void MLPConfigProvider::initializeWeights(MLP_WEIGHT_INIT scheme, unsigned int seed)
+{
+    size_t totalSize=0;
+
+    for (int i=1; i< this->nLayers; i++)
+        totalSize += (size_t)this->dimensions[i-1]*this->dimensions[i];
+
+    // small networks are not worth the threads
+    int nParts = ( totalSize < 1024*1024 )? 1 : getLogicCoreNum();
+
+    nParts = (nParts < 1)? 1 : nParts;
+
+    struct weights_init_task *tasks = new struct weights_init_task[nParts];
+
+    for (int k=0; k < nParts; k++)
+    {
+        tasks[k].scheme = scheme;
+        tasks[k].seed = seed;
+        tasks[k].nLayers = this->nLayers;
+        tasks[k].dimensions = this->dimensions;
+        tasks[k].weights = this->weights;
+        tasks[k].transposed = (this->weightLayout == MLP_WEIGHTS_TRANSPOSED);
+        tasks[k].part = k;
+        tasks[k].nParts = nParts;
+    };
+
+    if ( nParts == 1 )
+         weights_init_fun(&tasks[0]);
+    else {
+#ifdef  _WIN32
+         HANDLE *workers = new HANDLE[nParts];
+#else
+         pthread_t *workers = new pthread_t[nParts];
+#endif
+
+         for (int k=0; k < nParts; k++)
+              DNN_CREATE_THREAD(&workers[k], weights_init_fun, &tasks[k]);
+
+         for (int k=0; k < nParts; k++)
+              DNN_JOIN_THREAD(workers[k]);
+
+         delete [] workers;
+    };
+
+    delete [] tasks;
 };
 
 void MLPConfigProvider::etasInitialize()
@@ -822,10 +1276,19 @@ void MLPConfigProvider::setLayerWeights(int layer, int layerSize, int lowerLayer
          MLP_Exception(""); 
 	}; 
 
-	for (int row=0; row < lowerLayerSize; row++) 
-		 for (int col=0; col < layerSize; col++) {
-			  this->weights[layer][row*layerSize+col] = weights_new[row*layerSize+col]; 
-		 }; 
+	// weights_new is always in row-major layout
+	if ( this->weightLayout == MLP_WEIGHTS_TRANSPOSED ) {
+	     for (int row=0; row < lowerLayerSize; row++) 
+		      for (int col=0; col < layerSize; col++) {
+			       this->weights[layer][col*lowerLayerSize+row] = weights_new[row*layerSize+col]; 
+		      }; 
+	}
+	else {
+	     for (int row=0; row < lowerLayerSize; row++) 
+		      for (int col=0; col < layerSize; col++) {
+			       this->weights[layer][row*layerSize+col] = weights_new[row*layerSize+col]; 
+		      }; 
+	};
 }; 
 
 void MLPConfigProvider::setLayerBiases(int layer, int layerSize, float *biases_new)
@@ -843,6 +1306,84 @@ void MLPConfigProvider::setLayerBiases(int layer, int layerSize, float *biases_n
 	     this->biases[layer][col] = biases_new[col]; 
 }; 
 
+MLP_WEIGHT_LAYOUT MLPConfigProvider::getWeightLayout()
+{
+	return(this->weightLayout); 
+}; 
+
+void MLPConfigProvider::setWeightLayout(MLP_WEIGHT_LAYOUT layout)
+{
+	if ( layout == this->weightLayout )
+		 return; 
+
+	for (int i=1; i < this->nLayers; i++) {
+		 int rows, cols; 
+		 float *tmpBuf; 
+
+		 // the current layout of the matrix
+		 rows = ( this->weightLayout == MLP_WEIGHTS_ROWMAJOR )? this->dimensions[i-1] : this->dimensions[i]; 
+		 cols = ( this->weightLayout == MLP_WEIGHTS_ROWMAJOR )? this->dimensions[i] : this->dimensions[i-1]; 
+
+		 tmpBuf = new float[(size_t)rows*cols]; 
+		 memcpy(tmpBuf, this->weights[i], sizeof(float)*rows*cols); 
+
+		 for (int row=0; row < rows; row++) 
+			  for (int col=0; col < cols; col++) 
+				   this->weights[i][(size_t)col*rows+row] = tmpBuf[(size_t)row*cols+col]; 
+
+		 delete [] tmpBuf; 
+	}; 
+
+	this->weightLayout = layout; 
+}; 
+
+MLP_DATA_TYPE MLPConfigProvider::getStorageType()
+{
+	return(this->storageType); 
+}; 
+
+// the data type of the first layer of the loaded nnet data file, MLP_DATA_FLOAT32 if the weights were not loaded from a file
+MLP_DATA_TYPE MLPConfigProvider::getFileDataType()
+{
+	return(this->fileDataType); 
+}; 
+
+// the 16-bit types halve the size of the nnet data file saved by saveConfig(), the weights are still kept as float on the host
+void MLPConfigProvider::setStorageType(MLP_DATA_TYPE dataType)
+{
+	this->storageType = dataType; 
+}; 
+
+void MLPConfigProvider::setAccumulateSteps(int nSteps)
+{
+	if ( (nSteps < 1) || ( (nSteps > 1) && (this->sampledClasses > 0) ) ) {
+		mlp_log("MLPConfigProvider", "The accumulate steps should be at least 1, and can not be used with the sampled softmax");
+		MLP_Exception("");
+	};
+
+	this->accumulateSteps = nSteps; 
+}; 
+
+float MLPConfigProvider::getActivationScale(int layer)
+{
+	if ( (layer < 1) || (layer >= this->nLayers) ) {
+		mlp_log("MLPConfigProvider", "Invalid layer number");
+		MLP_Exception("");
+	};
+
+	return( this->actScales? this->actScales[layer] : 0.0f ); 
+}; 
+
+void MLPConfigProvider::setActivationScales(float *scales)
+{
+	if ( ! this->actScales )
+		this->actScales = new float[this->nLayers]; 
+
+	this->actScales[0] = 0.0f; 
+	for (int i=1; i < this->nLayers; i++)
+		this->actScales[i] = scales[i]; 
+}; 
+
 
 
 void MLPConfigProvider::saveConfig(const char *dir, const char *trainingConfigFile, const char *nnetDataFile)
@@ -853,17 +1394,7 @@ void MLPConfigProvider::saveConfig(const char *dir, const char *trainingConfigFi
     configFileName.append(trainingConfigFile);
     nnetFileName.append(nnetDataFile);
 
-    ofstream configFile;
-    ofstream nnetFile;
-
-    configFile.open(configFileName.c_str(),ios_base::out|ios_base::trunc);
-    nnetFile.open(nnetFileName.c_str(),ios_base::out|ios_base::binary|ios_base::trunc);
-
-    if ( ! configFile.is_open() || ! nnetFile.is_open() )
-    {
-        mlp_log("MLPConfigProvider", "Failed to create MLP net config files");
-        MLP_Exception("");
-    };
+    ostringstream configFile;
 
     configFile.setf(ios_base::showpoint|ios_base::dec|ios_base::fixed);
 
@@ -881,87 +1412,153 @@ void MLPConfigProvider::saveConfig(const char *dir, const char *trainingConfigFi
     configFile.precision(2);
     configFile << endl << "Momentum: " << this->momentum << endl;
     configFile << endl << "Epochs: " << this->epochs << endl;
+    if ( this->sampledClasses > 0 )
+        configFile << endl << "Sampled Softmax: " << this->sampledClasses << endl;
+    if ( this->accumulateSteps > 1 )
+        configFile << endl << "Accumulate Steps: " << this->accumulateSteps << endl;
 
     configFile << endl;
 
-    configFile.flush();
-
-    // Save static network parameters into an binary file
+    // Save static network parameters into an binary file, the whole file is serialized into one contiguous buffer
+    // and written by one write, so readers never see a partially written file
 
-    nnetFile.seekp(16);           // first 16 bytes preserved for checksum-ing
-    nnetFile.write("FAIL", 4);    // 4-bytes used as the tag of the file
-    nnetFile.flush();
+    struct mlp_nnet_v2_header header;
+    vector<struct mlp_nnet_v2_layer_desc> descs(this->nLayers);
 
-    struct mlp_nnet_data_header header;
+    memset(&header, 0, sizeof(header));
+    memset(&descs[0], 0, sizeof(struct mlp_nnet_v2_layer_desc)*this->nLayers);
 
     // set up the header of the neural network data from the information in the MLPConfigProvider
+    header.version = MLP_NNET_VERSION;
+    header.header_size = sizeof(header);
+    header.layer_desc_size = sizeof(struct mlp_nnet_v2_layer_desc);
     header.nLayers = this->nLayers;
+    header.desc_offset = ( (16 + 4 + sizeof(header) + 7 ) / 8 ) * 8;                     // round to 8n
     strcpy(header.nnet_type, getNetTypeName(this->netType));
-    for (int i=0; i < this->nLayers; i++)
-        header.layers[i].dimension = this->dimensions[i];
 
-    for (int i=1; i < this->nLayers; i++)
-        strcpy(header.layers[i].activation, getActFuncName(this->actFuncs[i]));
+    size_t elemSize = getDataTypeSize(this->storageType);
+    size_t biasElemSize = getDataTypeSize(getBiasDataType(this->storageType));
+    size_t fileLen;
 
-    header.weight_offsets[1] = ( (16 + 4 + sizeof(header) + 1023 ) / 1024 ) * 1024;    // round to 1024n
-    for (int i=2; i < this->nLayers; i++)
-    {
-        int bytes;
+    fileLen = header.desc_offset + sizeof(struct mlp_nnet_v2_layer_desc)*this->nLayers;
 
-        bytes = this->dimensions[i-2]*this->dimensions[i-1]*sizeof(float) + this->dimensions[i-1]*sizeof(float);
-        header.weight_offsets[i] = ( (header.weight_offsets[i-1] + bytes + 1023 ) / 1024 ) * 1024;     // round to 1024n
+    for (int i=0; i < this->nLayers; i++)
+    {
+        descs[i].dimension = this->dimensions[i];
+        if ( i == 0 )
+             continue;
+
+        strcpy(descs[i].activation, getActFuncName(this->actFuncs[i]));
+        descs[i].data_type = this->storageType;
+        descs[i].weight_layout = this->weightLayout;
+
+        descs[i].weight_offset = ( (fileLen + 1023 ) / 1024 ) * 1024;                       // round to 1024n
+        if ( this->storageType == MLP_DATA_BSR ) {
+             int rows = (this->weightLayout == MLP_WEIGHTS_TRANSPOSED)? this->dimensions[i] : this->dimensions[i-1];
+             int cols = (this->weightLayout == MLP_WEIGHTS_TRANSPOSED)? this->dimensions[i-1] : this->dimensions[i];
+
+             descs[i].nnz_blocks = (unsigned int)FloatMatrixBSRBlocks(this->weights[i], rows, cols);
+             descs[i].bias_offset = descs[i].weight_offset + (BSRBlocks(rows)+1+descs[i].nnz_blocks)*sizeof(unsigned int) +
+                                    (size_t)descs[i].nnz_blocks*DNN_BSR_BLOCK*DNN_BSR_BLOCK*sizeof(float);
+        }
+        else
+             descs[i].bias_offset = descs[i].weight_offset + (size_t)this->dimensions[i-1]*this->dimensions[i]*elemSize;
+        descs[i].bias_offset = ( (descs[i].bias_offset + biasElemSize-1) / biasElemSize ) * biasElemSize;
+        fileLen = descs[i].bias_offset + this->dimensions[i]*biasElemSize;
+
+        if ( this->storageType == MLP_DATA_INT8 ) {
+             descs[i].scale_offset = fileLen;
+             descs[i].act_scale = this->actScales? this->actScales[i] : 0.0f;
+             fileLen += this->dimensions[i]*sizeof(float);
+        };
     };
 
+    char *fileBuf = new char[fileLen];
+
+    memset(fileBuf, 0, descs[1].weight_offset);    // the checksum is not used right now (TODO)
 
     for (int i=1; i < this->nLayers; i++)
     {
-        // go to the location for writing the weights and biases for this layer
-        nnetFile.seekp(header.weight_offsets[i]);
-
-        // convert to generice bytes from host float type
-        for (int row=0; row < this->dimensions[i-1]; row++)
-            for (int col=0; col < this->dimensions[i]; col++)
-                 FloatToBytes(this->weights[i][row*this->dimensions[i]+col]);
-                 // HostToLEl(*(unsigned int *)&this->weights[i][row*this->dimensions[i]+col]);
-
-        for (int col=0; col < this->dimensions[i]; col++)
-             FloatToBytes(this->biases[i][col]);
-             // HostToLEl(*(unsigned int *)&this->biases[i][col]);
-
-        // write the converted data to file
-        for (int row=0; row < this->dimensions[i-1]; row++)
-            nnetFile.write(reinterpret_cast<char*>(&this->weights[i][row*this->dimensions[i]]), sizeof(float)*this->dimensions[i]);
-
-        nnetFile.write(reinterpret_cast<char*>(&this->biases[i][0]),sizeof(float)*this->dimensions[i]);
-
-        // convert back to host float type from generic bytes 
-        for (int row=0; row < this->dimensions[i-1]; row++)
-            for (int col=0; col < this->dimensions[i]; col++)
-                     BytesToFloat(this->weights[i][row*this->dimensions[i]+col]);
-                     // LEtoHostl(*(unsigned int *)&this->weights[i][row*this->dimensions[i]+col]);
-
-        for (int col=0; col < this->dimensions[i]; col++)
-                 BytesToFloat(this->biases[i][col]);
-                 // LEtoHostl(*(unsigned int *)&this->biases[i][col]);
+        size_t wSize = (size_t)this->dimensions[i-1]*this->dimensions[i];
+        size_t wBytes = (this->storageType == MLP_DATA_BSR)? descs[i].bias_offset - descs[i].weight_offset : wSize*elemSize;
+
+        size_t used = descs[i].bias_offset + this->dimensions[i]*biasElemSize;
+
+        memset(fileBuf + descs[i].weight_offset + wBytes, 0, descs[i].bias_offset - (descs[i].weight_offset + wBytes));
+
+        if ( this->storageType == MLP_DATA_INT8 ) {
+             // quantize the weights with one scale for each output neuron
+             float *scales = new float[this->dimensions[i]];
+             bool transposed = (this->weightLayout == MLP_WEIGHTS_TRANSPOSED);
+
+             FloatMatrixToInt8(this->weights[i], transposed? this->dimensions[i] : this->dimensions[i-1], transposed? this->dimensions[i-1] : this->dimensions[i],
+                               transposed, reinterpret_cast<signed char*>(fileBuf + descs[i].weight_offset), scales);
+             FloatArrayToBytes(scales, fileBuf + descs[i].scale_offset, this->dimensions[i]);
+             used = descs[i].scale_offset + this->dimensions[i]*sizeof(float);
+
+             delete [] scales;
+        }
+        else
+        if ( this->storageType == MLP_DATA_BSR ) {
+             // keep only the blocks having non-zero values, with their indexes in Little Endian bytes sequence
+             int rows = (this->weightLayout == MLP_WEIGHTS_TRANSPOSED)? this->dimensions[i] : this->dimensions[i-1];
+             int cols = (this->weightLayout == MLP_WEIGHTS_TRANSPOSED)? this->dimensions[i-1] : this->dimensions[i];
+             size_t nnzValues = (size_t)descs[i].nnz_blocks*DNN_BSR_BLOCK*DNN_BSR_BLOCK;
+             unsigned int *rowPtrs = reinterpret_cast<unsigned int*>(fileBuf + descs[i].weight_offset);
+             unsigned int *colIndices = rowPtrs + BSRBlocks(rows)+1;
+             float *values = new float[nnzValues+1];
+
+             FloatMatrixToBSR(this->weights[i], rows, cols, rowPtrs, colIndices, values);
+             for (unsigned int k=0; k < BSRBlocks(rows)+1+descs[i].nnz_blocks; k++)
+                  HostToLEl(rowPtrs[k]);
+             FloatArrayToBytes(values, reinterpret_cast<char*>(colIndices + descs[i].nnz_blocks), nnzValues);
+
+             delete [] values;
+        }
+        else
+             // convert to generic bytes or 16-bit floats from host float type
+             encodeFloatArray(this->storageType, this->weights[i], fileBuf + descs[i].weight_offset, wSize);
+        encodeFloatArray(getBiasDataType(this->storageType), this->biases[i], fileBuf + descs[i].bias_offset, this->dimensions[i]);
+
+        // clear the padding bytes before the next layer
+        if ( i < this->nLayers-1 )
+             memset(fileBuf+used, 0, descs[i+1].weight_offset-used);
     };
 
     // convert the data in the header to Little Endian bytes sequence from host bytes sequence
-    HostToLEl(header.nLayers);
     for (int i=0; i < this->nLayers; i++)
-        HostToLEl(header.layers[i].dimension);
-    for (int i=1; i < this->nLayers; i++)
-        HostToLEl(header.weight_offsets[i]);
+    {
+        HostToLEll(descs[i].weight_offset);
+        HostToLEll(descs[i].bias_offset);
+        HostToLEl(descs[i].dimension);
+        HostToLEl(descs[i].data_type);
+        HostToLEl(descs[i].weight_layout);
+        HostToLEl(descs[i].nnz_blocks);
+        HostToLEll(descs[i].scale_offset);
+        FloatToBytes(descs[i].act_scale);
+    };
 
-    nnetFile.seekp(16+4);
+    memcpy(fileBuf+header.desc_offset, &descs[0], sizeof(struct mlp_nnet_v2_layer_desc)*this->nLayers);
 
-    nnetFile.write(reinterpret_cast<char*>(&header), sizeof(header));
+    HostToLEl(header.version);
+    HostToLEl(header.header_size);
+    HostToLEl(header.layer_desc_size);
+    HostToLEl(header.nLayers);
+    HostToLEll(header.desc_offset);
 
-    nnetFile.seekp(16);            // skip the checksum (TODO)
-    nnetFile.write("NNET", 4);     // write the tag of the file
-    nnetFile.flush();
+    memcpy(fileBuf+16, "NNV2", 4);      // the tag of the file
+    memcpy(fileBuf+16+4, &header, sizeof(header));
 
-    configFile.close();
-    nnetFile.close();
+    if ( write_file_atomic(configFileName.c_str(), configFile.str().c_str(), configFile.str().length()) != 0 ||
+         write_file_atomic(nnetFileName.c_str(), fileBuf, fileLen) != 0 )
+    {
+        delete [] fileBuf;
+
+        mlp_log("MLPConfigProvider", "Failed to create MLP net config files");
+        MLP_Exception("");
+    };
+
+    delete [] fileBuf;
 }
 
 
@@ -979,6 +1576,10 @@ void MLPConfigProvider::showConfig()
     cout.precision(2);
     cout << "Momentum: " << this->momentum << endl;
 	cout << "Epochs: " << this->epochs << endl; 
+	if ( this->sampledClasses > 0 )
+		 cout << "Sampled Softmax: " << this->sampledClasses << endl;
+	if ( this->accumulateSteps > 1 )
+		 cout << "Accumulate Steps: " << this->accumulateSteps << endl;
 
     int myprec;
 
@@ -993,7 +1594,10 @@ void MLPConfigProvider::showConfig()
         for (int row=0; row < this->dimensions[i-1]; row++)
         {
             for (int col=0; col < this->dimensions[i]; col++)
-                cout << this->weights[i][row*this->dimensions[i]+col] << " ";
+                if ( this->weightLayout == MLP_WEIGHTS_TRANSPOSED )
+                     cout << this->weights[i][col*this->dimensions[i-1]+row] << " ";
+                else
+                     cout << this->weights[i][row*this->dimensions[i]+col] << " ";
             cout << endl;
         };
         cout << "Biases of layer " << i << endl;
@@ -1036,6 +1640,8 @@ static const char *getActFuncName(ACT_FUNC actFunc)
         return("identity");
     case AFUNC_RELU:
         return("relu");
+    case AFUNC_LEAKY_RELU:
+        return("leakyrelu");
     case AFUNC_TANH:
         return("tanh");
     default:
@@ -1092,10 +1698,12 @@ static ACT_FUNC getActFuncID(string &funcName)
         return(AFUNC_SIGMOID);
     if ( funcName == "softmax" )
         return(AFUNC_SOFTMAX);
-    if ( funcName == "linear" )
+    if ( (funcName == "identity") || (funcName == "linear") )     // "linear" is accepted for the older config files
         return(AFUNC_IDENTITY);
     if ( funcName == "relu" )
         return(AFUNC_RELU);
+    if ( funcName == "leakyrelu" )
+        return(AFUNC_LEAKY_RELU);
     if ( funcName == "tanh" )
         return(AFUNC_TANH);
 
@@ -1111,10 +1719,12 @@ static ACT_FUNC getActFuncID(char *funcName)
         return(AFUNC_SIGMOID);
     if ( sFuncName == "softmax" )
         return(AFUNC_SOFTMAX);
-    if ( sFuncName == "linear" )
+    if ( (sFuncName == "identity") || (sFuncName == "linear") )
         return(AFUNC_IDENTITY);
     if ( sFuncName == "relu" )
         return(AFUNC_RELU);
+    if ( sFuncName == "leakyrelu" )
+        return(AFUNC_LEAKY_RELU);
     if ( sFuncName == "tanh" )
         return(AFUNC_TANH);
 
@@ -1140,3 +1750,53 @@ static void lowerCaselize(char *str)
                    str[i] = (char)tolower(str[i]);
     }
 }
+
+static size_t getDataTypeSize(MLP_DATA_TYPE dataType)
+{
+    switch (dataType)
+    {
+    case MLP_DATA_FLOAT16:
+    case MLP_DATA_BFLOAT16:
+        return(2);
+    case MLP_DATA_INT8:
+        return(1);
+    default:
+        return(sizeof(float));
+    };
+};
+
+// only the weights are quantized to int8 or stored in blocks, the biases are kept in float
+static MLP_DATA_TYPE getBiasDataType(MLP_DATA_TYPE dataType)
+{
+    return( ((dataType == MLP_DATA_INT8) || (dataType == MLP_DATA_BSR))? MLP_DATA_FLOAT32 : dataType );
+};
+
+static void encodeFloatArray(MLP_DATA_TYPE dataType, const float *src, char *dst, size_t num)
+{
+    switch (dataType)
+    {
+    case MLP_DATA_FLOAT16:
+        FloatArrayToHalfBytes(src, dst, num);
+        break;
+    case MLP_DATA_BFLOAT16:
+        FloatArrayToBFloat16Bytes(src, dst, num);
+        break;
+    default:
+        FloatArrayToBytes(src, dst, num);
+    };
+};
+
+static void decodeFloatArray(MLP_DATA_TYPE dataType, const char *src, float *dst, size_t num)
+{
+    switch (dataType)
+    {
+    case MLP_DATA_FLOAT16:
+        HalfBytesToFloatArray(src, dst, num);
+        break;
+    case MLP_DATA_BFLOAT16:
+        BFloat16BytesToFloatArray(src, dst, num);
+        break;
+    default:
+        BytesToFloatArray(src, dst, num);
+    };
+};
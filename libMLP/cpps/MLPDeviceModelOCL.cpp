@@ -0,0 +1,276 @@
+/*
+ *  COPYRIGHT:  Copyright (c) 2014 Advanced Micro Devices, Inc.  All rights reserved
+ *
+ *   The weights and biases of a neural network kept on the OpenCL device, shared read-only by the MLPPredictorOCL instances
+ *   created from each other, and released by the last of them. A model reloaded by MLPPredictorOCL::reloadModel() is chained
+ *   as the successor of the model it replaces, each predictor moves to the successor at its next batch
+ */
+
+#include "MLPUtil.h"
+#include "MLPDeviceModelOCL.h"
+#include "conv_half.h"
+#include "conv_int8.h"
+#include "conv_bsr.h"
+
+
+// the buffer is filled by a blocking transfer on the given queue, so the uploading is finished when the model is created
+static cl_mem create_model_buffer(cl_context context, cl_command_queue queue, size_t size, const void *data)
+{
+    cl_int status;
+	cl_mem buffer;
+
+	buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, size, NULL, &status);
+	CL_CHECK(status);
+
+	CL_CHECK(clEnqueueWriteBuffer(queue, buffer, CL_TRUE, 0, size, data, 0, NULL, NULL));
+
+	return(buffer);
+};
+
+// with _weightType being MLP_DATA_FLOAT16, the weights are kept in half precision on the device, which halves the device memory
+// used by the model. With _weightType being MLP_DATA_INT8, the weights are quantized with one scale for each output neuron. With
+// _weightType being MLP_DATA_BSR, only the non-zero blocks of the weights are kept, in the transposed layout whatever the layout
+// of the provider is, so each block row gives the inputs of DNN_BSR_BLOCK output neurons
+MLPDeviceModelOCL::MLPDeviceModelOCL(MLPConfigProvider &provider, cl_context context, cl_command_queue queue, MLP_DATA_TYPE _weightType)
+{
+	this->refCount = 1;
+	this->successor = NULL;
+	DNN_LOCK_INIT(&this->modelLock);
+
+	this->weightType = _weightType;
+	this->nLayers = provider.nLayers;
+	this->weightLayout = provider.weightLayout;
+
+	this->dimensions = new int[this->nLayers];
+	this->actFuncs = new ACT_FUNC[this->nLayers];
+	for (int i = 0; i < this->nLayers; i++) {
+		this->dimensions[i] = provider.dimensions[i];
+		this->actFuncs[i] = provider.actFuncs[i];
+	};
+
+	this->weights = new cl_mem[this->nLayers];        // weights for connecting the previous layer and current layer
+	this->biases =  new cl_mem[this->nLayers];        // bias for each layer, added to the input of each layer
+	this->zeroBiases = new bool[this->nLayers];
+
+	this->weightScales = NULL;
+	this->actScales = NULL;
+	if ( this->weightType == MLP_DATA_INT8 ) {
+		 this->weightScales = new cl_mem[this->nLayers];
+		 this->actScales = new float[this->nLayers];
+	};
+
+	this->blockRowPtrs = NULL;
+	this->blockColIndices = NULL;
+	this->nnzBlocks = NULL;
+	if ( this->weightType == MLP_DATA_BSR ) {
+		 this->blockRowPtrs = new cl_mem[this->nLayers];
+		 this->blockColIndices = new cl_mem[this->nLayers];
+		 this->nnzBlocks = new size_t[this->nLayers];
+	};
+
+	for (int i = 1; i < this->nLayers; i++ )
+	{
+		if ( this->weightType == MLP_DATA_FLOAT16 ) {
+			 size_t wSize = (size_t)this->dimensions[i-1]*this->dimensions[i];
+			 char *halfBuf = new char[wSize*sizeof(cl_half)];
+
+			 FloatArrayToHalfBytes(provider.weights[i], halfBuf, wSize);
+		     this->weights[i] = create_model_buffer(context, queue, sizeof(cl_half)*wSize, halfBuf);
+		     delete [] halfBuf;
+		}
+		else
+		if ( this->weightType == MLP_DATA_INT8 ) {
+			 size_t wSize = (size_t)this->dimensions[i-1]*this->dimensions[i];
+			 bool transposed = (provider.weightLayout == MLP_WEIGHTS_TRANSPOSED);
+			 signed char *int8Buf = new signed char[wSize];
+			 float *scales = new float[this->dimensions[i]];
+
+			 FloatMatrixToInt8(provider.weights[i], transposed? this->dimensions[i] : this->dimensions[i-1], transposed? this->dimensions[i-1] : this->dimensions[i],
+				               transposed, int8Buf, scales);
+
+		     this->weightScales[i] = create_model_buffer(context, queue, sizeof(cl_float)*this->dimensions[i], scales);
+		     this->weights[i] = create_model_buffer(context, queue, sizeof(cl_char)*wSize, int8Buf);
+
+		     this->actScales[i] = provider.getActivationScale(i);
+
+		     delete [] scales;
+		     delete [] int8Buf;
+		}
+		else
+		if ( this->weightType == MLP_DATA_BSR ) {
+			 int rows = this->dimensions[i];
+			 int cols = this->dimensions[i-1];
+			 const float *src = provider.weights[i];
+			 float *tmpWeights = NULL;
+
+			 if ( provider.weightLayout != MLP_WEIGHTS_TRANSPOSED ) {
+				  tmpWeights = new float[(size_t)rows*cols];
+				  for (int r=0; r < cols; r++)
+					   for (int c=0; c < rows; c++)
+							tmpWeights[(size_t)c*cols+r] = src[(size_t)r*rows+c];
+				  src = tmpWeights;
+			 };
+
+			 // at least one block is allocated, since the buffers could not be empty
+			 size_t nnz = FloatMatrixBSRBlocks(src, rows, cols);
+			 size_t nValues = (nnz > 0)? nnz*DNN_BSR_BLOCK*DNN_BSR_BLOCK : DNN_BSR_BLOCK*DNN_BSR_BLOCK;
+			 cl_uint *rowPtrs = new cl_uint[BSRBlocks(rows)+1];
+			 cl_uint *colIndices = new cl_uint[nnz+1];
+			 float *values = new float[nValues];
+
+			 colIndices[0] = 0;
+			 memset(values, 0, sizeof(float)*nValues);
+			 FloatMatrixToBSR(src, rows, cols, rowPtrs, colIndices, values);
+
+			 this->nnzBlocks[i] = nnz;
+			 this->blockRowPtrs[i] = create_model_buffer(context, queue, sizeof(cl_uint)*(BSRBlocks(rows)+1), rowPtrs);
+			 this->blockColIndices[i] = create_model_buffer(context, queue, sizeof(cl_uint)*(nnz+1), colIndices);
+			 this->weights[i] = create_model_buffer(context, queue, sizeof(cl_float)*nValues, values);
+
+			 delete [] values;
+			 delete [] colIndices;
+			 delete [] rowPtrs;
+			 if ( tmpWeights )
+				  delete [] tmpWeights;
+		}
+		else
+		     this->weights[i] = create_model_buffer(context, queue, sizeof(cl_float)*this->dimensions[i-1]*this->dimensions[i], provider.weights[i]);
+
+		this->biases[i] = create_model_buffer(context, queue, sizeof(cl_float)*this->dimensions[i], provider.biases[i]);
+
+		this->zeroBiases[i] = true;
+		for (int k = 0; k < this->dimensions[i]; k++)
+			if ( provider.biases[i][k] != 0.0f ) {
+				this->zeroBiases[i] = false;
+				break;
+			};
+	}
+};
+
+// the release failures are only logged, since the destructor should not throw
+MLPDeviceModelOCL::~MLPDeviceModelOCL()
+{
+	for (int i = 1; i < this->nLayers; i++ ) {
+		CL_CHECK_NOTHROW( clReleaseMemObject(this->weights[i]) );
+		CL_CHECK_NOTHROW( clReleaseMemObject(this->biases[i]) );
+	}
+
+	if ( this->weightType == MLP_DATA_INT8 ) {
+		for (int i = 1; i < this->nLayers; i++ )
+			CL_CHECK_NOTHROW( clReleaseMemObject(this->weightScales[i]) );
+
+		delete [] this->weightScales;
+		delete [] this->actScales;
+	};
+
+	if ( this->weightType == MLP_DATA_BSR ) {
+		for (int i = 1; i < this->nLayers; i++ ) {
+			CL_CHECK_NOTHROW( clReleaseMemObject(this->blockRowPtrs[i]) );
+			CL_CHECK_NOTHROW( clReleaseMemObject(this->blockColIndices[i]) );
+		}
+
+		delete [] this->blockRowPtrs;
+		delete [] this->blockColIndices;
+		delete [] this->nnzBlocks;
+	};
+
+	delete [] this->weights;
+	delete [] this->biases;
+	delete [] this->zeroBiases;
+	delete [] this->dimensions;
+	delete [] this->actFuncs;
+
+	if ( this->successor )
+		 this->successor->release();
+};
+
+void MLPDeviceModelOCL::retain()
+{
+	DNN_LOCK(&this->modelLock);
+	this->refCount++;
+	DNN_UNLOCK(&this->modelLock);
+};
+
+void MLPDeviceModelOCL::release()
+{
+	int count;
+
+	DNN_LOCK(&this->modelLock);
+	count = --this->refCount;
+	DNN_UNLOCK(&this->modelLock);
+
+	if ( count == 0 )
+		 delete this;
+};
+
+MLPDeviceModelOCL *MLPDeviceModelOCL::getSuccessor()
+{
+	MLPDeviceModelOCL *next;
+
+	DNN_LOCK(&this->modelLock);
+	next = this->successor;
+	DNN_UNLOCK(&this->modelLock);
+
+	return(next);
+};
+
+// the chain holds one reference to newModel
+void MLPDeviceModelOCL::appendSuccessor(MLPDeviceModelOCL *newModel)
+{
+	MLPDeviceModelOCL *last = this;
+
+	newModel->retain();
+
+	while (1) {
+		MLPDeviceModelOCL *next;
+
+		DNN_LOCK(&last->modelLock);
+		next = last->successor;
+		if ( ! next )
+			 last->successor = newModel;
+		DNN_UNLOCK(&last->modelLock);
+
+		if ( ! next )
+			 break;
+
+		last = next;
+	};
+};
+
+bool MLPDeviceModelOCL::sameDimensions(MLPConfigProvider &provider)
+{
+	if ( provider.nLayers != this->nLayers )
+		 return(false);
+
+	for (int i = 0; i < this->nLayers; i++)
+		 if ( provider.dimensions[i] != this->dimensions[i] )
+			  return(false);
+
+	return(true);
+};
+
+MLP_DATA_TYPE MLPDeviceModelOCL::getWeightType()
+{
+	return(this->weightType);
+};
+
+size_t MLPDeviceModelOCL::getDeviceMemSize()
+{
+	size_t elemSize = (this->weightType == MLP_DATA_FLOAT16)? sizeof(cl_half) : (this->weightType == MLP_DATA_INT8)? sizeof(cl_char) : sizeof(cl_float);
+	size_t memSize = 0;
+
+	for (int i = 1; i < this->nLayers; i++ ) {
+		if ( this->weightType == MLP_DATA_BSR ) {
+			memSize += sizeof(cl_uint)*(BSRBlocks(this->dimensions[i])+1) + sizeof(cl_uint)*(this->nnzBlocks[i]+1) +
+				       sizeof(cl_float)*(this->nnzBlocks[i] > 0? this->nnzBlocks[i] : 1)*DNN_BSR_BLOCK*DNN_BSR_BLOCK + sizeof(cl_float)*this->dimensions[i];
+			continue;
+		};
+
+		memSize += elemSize*this->dimensions[i-1]*this->dimensions[i] + sizeof(cl_float)*this->dimensions[i];
+
+		if ( this->weightType == MLP_DATA_INT8 )
+			memSize += sizeof(cl_float)*this->dimensions[i];
+	}
+
+	return(memSize);
+};
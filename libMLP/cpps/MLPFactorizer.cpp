@@ -0,0 +1,419 @@
+/*
+ *  COPYRIGHT:  Copyright (c) 2014 Advanced Micro Devices, Inc.  All rights reserved
+ *
+ *   Factorizes the weights matrixes of the selected layers of a trained neural network into two thinner matrixes by the truncated
+ *   SVD, each factorized layer becomes a bottleneck layer of identity activation without biases followed by the original layer,
+ *   which cuts the computation of the large layers of the neural network
+ */
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <functional>
+#include <cstring>
+#include <cmath>
+
+#include "MLPUtil.h"
+#include "MLPTesterOCL.h"
+#include "MLPFactorizer.h"
+
+using namespace std;
+
+
+MLPFactorizer::MLPFactorizer(MLPConfigProvider &configProvider)
+{
+	this->configProviderp = &configProvider;
+	this->nLayers = configProvider.nLayers;
+
+	this->ranks = new int[this->nLayers];
+	this->errors = new float[this->nLayers];
+	for (int i=0; i < this->nLayers; i++) {
+		 this->ranks[i] = 0;
+		 this->errors[i] = 0.0f;
+	};
+
+	this->factorizedp = NULL;
+};
+
+MLPFactorizer::~MLPFactorizer()
+{
+	if ( this->factorizedp )
+		 delete this->factorizedp;
+
+	delete [] this->ranks;
+	delete [] this->errors;
+};
+
+void MLPFactorizer::checkLayer(int layer)
+{
+	if ( (layer < 1) || (layer >= this->nLayers) ) {
+		 mlp_log("MLPFactorizer", "Invalid layer number");
+		 MLP_Exception("");
+	};
+};
+
+// each frame takes rank*(m+n) multiply-adds by the two factorized layers instead of m*n by the original layer, so only the ranks
+// below m*n/(m+n) save computation, which is always less than the smaller dimension of the weights matrix
+void MLPFactorizer::setRank(int layer, int rank)
+{
+	this->checkLayer(layer);
+
+	int m = this->configProviderp->dimensions[layer-1];
+	int n = this->configProviderp->dimensions[layer];
+
+	if ( (rank < 0) || ((size_t)rank*(m+n) >= (size_t)m*n) ) {
+		 mlp_log("MLPFactorizer", "The rank should be less than m*n/(m+n) for the weights matrix of m x n to save computation");
+		 MLP_Exception("");
+	};
+
+	this->ranks[layer] = rank;
+
+	if ( this->factorizedp ) {
+		 delete this->factorizedp;
+		 this->factorizedp = NULL;
+	};
+};
+
+// the weights matrix of the layer as dimensions[layer-1] rows of dimensions[layer] values, whatever the layout of the provider is
+float *MLPFactorizer::getRowMajorWeights(int layer)
+{
+	MLPConfigProvider *provider = this->configProviderp;
+	int m = provider->dimensions[layer-1];
+	int n = provider->dimensions[layer];
+	float *W = new float[(size_t)m*n];
+
+	if ( provider->weightLayout == MLP_WEIGHTS_TRANSPOSED ) {
+		 for (int r=0; r < n; r++)
+			  for (int c=0; c < m; c++)
+				   W[(size_t)c*n+r] = provider->weights[layer][(size_t)r*m+c];
+	}
+	else
+		 memcpy(W, provider->weights[layer], sizeof(float)*m*n);
+
+	return(W);
+};
+
+// C = A * B, A being m x k, B being k x n
+static void matMul(const float *A, const float *B, float *C, int m, int k, int n)
+{
+	for (size_t i=0; i < (size_t)m*n; i++)
+		 C[i] = 0.0f;
+
+	for (int r=0; r < m; r++)
+		 for (int j=0; j < k; j++) {
+			  float a = A[(size_t)r*k+j];
+			  const float *bp = B + (size_t)j*n;
+			  float *cp = C + (size_t)r*n;
+
+			  if ( a == 0.0f )
+				   continue;
+
+			  for (int c=0; c < n; c++)
+				   cp[c] += a * bp[c];
+		 };
+};
+
+// C = transpose(A) * B, A being k x m, B being k x n
+static void matMulTransA(const float *A, const float *B, float *C, int m, int k, int n)
+{
+	for (size_t i=0; i < (size_t)m*n; i++)
+		 C[i] = 0.0f;
+
+	for (int j=0; j < k; j++)
+		 for (int r=0; r < m; r++) {
+			  float a = A[(size_t)j*m+r];
+			  const float *bp = B + (size_t)j*n;
+			  float *cp = C + (size_t)r*n;
+
+			  if ( a == 0.0f )
+				   continue;
+
+			  for (int c=0; c < n; c++)
+				   cp[c] += a * bp[c];
+		 };
+};
+
+// orthonormalize the l columns of the m x l matrix Q by the modified Gram-Schmidt, columns depending on the previous ones are zeroed
+static void orthonormalize(float *Q, int m, int l)
+{
+	vector<double> col(m);
+
+	for (int k=0; k < l; k++) {
+		 for (int r=0; r < m; r++)
+			  col[r] = Q[(size_t)r*l+k];
+
+		 for (int j=0; j < k; j++) {
+			  double dot = 0.0;
+
+			  for (int r=0; r < m; r++)
+				   dot += col[r] * Q[(size_t)r*l+j];
+			  for (int r=0; r < m; r++)
+				   col[r] -= dot * Q[(size_t)r*l+j];
+		 };
+
+		 double norm = 0.0;
+
+		 for (int r=0; r < m; r++)
+			  norm += col[r] * col[r];
+		 norm = sqrt(norm);
+
+		 for (int r=0; r < m; r++)
+			  Q[(size_t)r*l+k] = (norm > 1.0e-20)? (float)(col[r]/norm) : 0.0f;
+	};
+};
+
+// eigenvalues and eigenvectors of the symmetric l x l matrix S by the cyclic Jacobi rotations, the eigenvalues are left on the
+// diagonal of S and the eigenvectors are the columns of V
+static void symmetricEigen(double *S, int l, double *V)
+{
+	for (int i=0; i < l; i++)
+		 for (int j=0; j < l; j++)
+			  V[i*l+j] = (i == j)? 1.0 : 0.0;
+
+	for (int sweep=0; sweep < 50; sweep++) {
+		 double off = 0.0, total = 0.0;
+
+		 for (int i=0; i < l; i++)
+			  for (int j=0; j < l; j++) {
+				   total += S[i*l+j] * S[i*l+j];
+				   if ( i != j )
+						off += S[i*l+j] * S[i*l+j];
+			  };
+
+		 if ( off <= 1.0e-24 * total )
+			  break;
+
+		 for (int p=0; p < l-1; p++)
+			  for (int q=p+1; q < l; q++) {
+				   if ( S[p*l+q] == 0.0 )
+						continue;
+
+				   double theta = (S[q*l+q] - S[p*l+p]) / (2.0 * S[p*l+q]);
+				   double t = ((theta >= 0.0)? 1.0 : -1.0) / (fabs(theta) + sqrt(theta*theta + 1.0));
+				   double c = 1.0 / sqrt(t*t + 1.0);
+				   double s = t * c;
+
+				   for (int k=0; k < l; k++) {
+						double skp = S[k*l+p], skq = S[k*l+q];
+
+						S[k*l+p] = c*skp - s*skq;
+						S[k*l+q] = s*skp + c*skq;
+				   };
+				   for (int k=0; k < l; k++) {
+						double spk = S[p*l+k], sqk = S[q*l+k];
+
+						S[p*l+k] = c*spk - s*sqk;
+						S[q*l+k] = s*spk + c*sqk;
+				   };
+				   for (int k=0; k < l; k++) {
+						double vkp = V[k*l+p], vkq = V[k*l+q];
+
+						V[k*l+p] = c*vkp - s*vkq;
+						V[k*l+q] = s*vkp + c*vkq;
+				   };
+			  };
+	};
+};
+
+// W (m x n) is approximated by A (m x rank) * B (rank x n) by the randomized SVD: the range of W is found by multiplying W with a
+// random matrix, and the SVD of the small projection of W onto that range gives the leading singular vectors. The singular values
+// are split evenly between A and B. Returns the relative Frobenius norm of the error
+float MLPFactorizer::factorizeMatrix(const float *W, int m, int n, int rank, float *A, float *B)
+{
+	int l = min(rank + MLP_SVD_OVERSAMPLES, min(m, n));
+
+	float *Omega = new float[(size_t)n*l];
+	float *Q = new float[(size_t)m*l];
+	float *Z = new float[(size_t)n*l];
+	float *P = new float[(size_t)l*n];       // projection of W onto the range found, P = transpose(Q) * W
+
+	for (size_t i=0; i < (size_t)n*l; i++)
+		 Omega[i] = normalFromBits( mixBits( (i+1)*0x9e3779b97f4a7c15ULL ) );
+
+	matMul(W, Omega, Q, m, n, l);
+	orthonormalize(Q, m, l);
+
+	for (int iter=0; iter < MLP_SVD_POWER_ITERS; iter++) {
+		 matMulTransA(W, Q, Z, n, m, l);
+		 orthonormalize(Z, n, l);
+		 matMul(W, Z, Q, m, n, l);
+		 orthonormalize(Q, m, l);
+	};
+
+	matMulTransA(Q, W, P, l, m, n);
+
+	// the left singular vectors of P are the eigenvectors of P * transpose(P)
+	vector<double> S((size_t)l*l, 0.0);
+	vector<double> V((size_t)l*l);
+
+	for (int i=0; i < l; i++)
+		 for (int j=i; j < l; j++) {
+			  double dot = 0.0;
+
+			  for (int c=0; c < n; c++)
+				   dot += (double)P[(size_t)i*n+c] * P[(size_t)j*n+c];
+			  S[i*l+j] = S[j*l+i] = dot;
+		 };
+
+	symmetricEigen(&S[0], l, &V[0]);
+
+	vector< pair<double,int> > eigens(l);
+
+	for (int k=0; k < l; k++)
+		 eigens[k] = make_pair(max(S[k*l+k], 0.0), k);
+	sort(eigens.begin(), eigens.end(), greater< pair<double,int> >());
+
+	// A = Q * U * sqrt(Sigma),  B = inverse(sqrt(Sigma)) * transpose(U) * P,  with U being the leading "rank" eigenvectors
+	double captured = 0.0;
+
+	for (int k=0; k < rank; k++) {
+		 int idx = eigens[k].second;
+		 double sigma = sqrt(eigens[k].first);
+		 float aScale = (float)sqrt(sigma);
+		 float bScale = (sigma > 0.0)? (float)(1.0/sqrt(sigma)) : 0.0f;
+
+		 captured += eigens[k].first;
+
+		 for (int r=0; r < m; r++) {
+			  double sum = 0.0;
+
+			  for (int j=0; j < l; j++)
+				   sum += Q[(size_t)r*l+j] * V[j*l+idx];
+			  A[(size_t)r*rank+k] = (float)sum * aScale;
+		 };
+
+		 float *bp = B + (size_t)k*n;
+
+		 for (int c=0; c < n; c++)
+			  bp[c] = 0.0f;
+		 for (int j=0; j < l; j++) {
+			  float u = (float)V[j*l+idx] * bScale;
+
+			  for (int c=0; c < n; c++)
+				   bp[c] += u * P[(size_t)j*n+c];
+		 };
+	};
+
+	double normW = 0.0;
+
+	for (size_t i=0; i < (size_t)m*n; i++)
+		 normW += (double)W[i] * W[i];
+
+	delete [] Omega;
+	delete [] Q;
+	delete [] Z;
+	delete [] P;
+
+	return( (normW > 0.0)? (float)sqrt(max(normW - captured, 0.0) / normW) : 0.0f );
+};
+
+// each layer with a rank set is replaced by a bottleneck layer of "rank" neurons and the layer itself, the bottleneck layer
+// uses the learning rate of the replaced layer
+MLPConfigProvider *MLPFactorizer::factorize()
+{
+	if ( this->factorizedp )
+		 return(this->factorizedp);
+
+	MLPConfigProvider *provider = this->configProviderp;
+	int newLayers = this->nLayers;
+
+	for (int i=1; i < this->nLayers; i++)
+		 if ( this->ranks[i] > 0 )
+			  newLayers++;
+
+	int *dimensions = new int[newLayers];
+	float *etas = new float[newLayers];
+	ACT_FUNC *actFuncs = new ACT_FUNC[newLayers];
+	int *newIndexes = new int[this->nLayers];        // index of each original layer in the factorized neural network
+
+	dimensions[0] = provider->dimensions[0];
+	etas[0] = 0.0f;
+	actFuncs[0] = ANOFUNC;
+	newIndexes[0] = 0;
+
+	int k = 1;
+	for (int i=1; i < this->nLayers; i++) {
+		 if ( this->ranks[i] > 0 ) {
+			  dimensions[k] = this->ranks[i];
+			  etas[k] = provider->etas[i];
+			  actFuncs[k] = AFUNC_IDENTITY;
+			  k++;
+		 };
+
+		 dimensions[k] = provider->dimensions[i];
+		 etas[k] = provider->etas[i];
+		 actFuncs[k] = provider->actFuncs[i];
+		 newIndexes[i] = k++;
+	};
+
+	MLPConfigProvider *newp = new MLPConfigProvider(provider->netType, newLayers, dimensions, etas, provider->momentum, actFuncs,
+		                                            provider->costFunc, provider->epochs, false);
+
+	newp->sampledClasses = provider->sampledClasses;
+	newp->accumulateSteps = provider->accumulateSteps;
+	newp->weightLayout = provider->weightLayout;      // the weights are not initialized yet, so need not be re-arranged
+
+	for (int i=1; i < this->nLayers; i++) {
+		 int m = provider->dimensions[i-1];
+		 int n = provider->dimensions[i];
+		 float *W = this->getRowMajorWeights(i);
+
+		 if ( this->ranks[i] > 0 ) {
+			  int rank = this->ranks[i];
+			  float *A = new float[(size_t)m*rank];
+			  float *B = new float[(size_t)rank*n];
+			  float *zeroBiases = new float[rank];
+
+			  this->errors[i] = this->factorizeMatrix(W, m, n, rank, A, B);
+
+			  memset(zeroBiases, 0, sizeof(float)*rank);
+			  newp->setLayerWeights(newIndexes[i]-1, rank, m, A);
+			  newp->setLayerBiases(newIndexes[i]-1, rank, zeroBiases);
+			  newp->setLayerWeights(newIndexes[i], n, rank, B);
+
+			  delete [] A;
+			  delete [] B;
+			  delete [] zeroBiases;
+		 }
+		 else {
+			  this->errors[i] = 0.0f;
+			  newp->setLayerWeights(newIndexes[i], n, m, W);
+		 };
+
+		 newp->setLayerBiases(newIndexes[i], n, provider->biases[i]);
+
+		 delete [] W;
+	};
+
+	delete [] dimensions;
+	delete [] etas;
+	delete [] actFuncs;
+	delete [] newIndexes;
+
+	this->factorizedp = newp;
+
+	return(newp);
+};
+
+float MLPFactorizer::getError(int layer)
+{
+	this->checkLayer(layer);
+
+	return(this->errors[layer]);
+};
+
+float MLPFactorizer::testFactorized(DNNDataProvider &dataProvider, DNN_OCL_DEVTYPE devType, int batchSize)
+{
+	MLPTesterOCL tester(*this->factorize(), dataProvider, devType, batchSize);
+	int totalFrames, succFrames;
+
+	tester.batchTesting(0);
+	tester.getTestingStats(totalFrames, succFrames);
+
+	return( (totalFrames > 0)? (float)succFrames/totalFrames : 0.0f );
+};
+
+void MLPFactorizer::saveFactorizedConfig(const char *dir, const char *trainingConfigFile, const char *nnetDataFile)
+{
+	this->factorize()->saveConfig(dir, trainingConfigFile, nnetDataFile);
+};
@@ -8,6 +8,7 @@
 #include "DNNConstants.h"
 #include "MLPUtil.h"
 #include "MLPOclCommon.h"
+#include "MLPOclProfiler.h"
 
 #include <iostream>
 #include <fstream>
@@ -30,7 +31,7 @@ void cmn_transpose_matrix_simple(cl_command_queue &cmdQueue, MLP_Kerns &kerns, c
 	globals[0]= width;
 	globals[1]= ROUNDK(height,256);
 
-	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue, kerns.transpose_sim_kernel, 2, NULL, globals,locals, 0, NULL, NULL) );
+	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue, kerns.transpose_sim_kernel, 2, NULL, globals,locals, 0, NULL, MLP_PROF_EVENT(kerns,"transpose_simple",-1)) );
 };
 
 // do the matrix transposition by dividing the matrix into 32x32 size blocks, with each local group handles one block
@@ -50,7 +51,7 @@ void cmn_transpose_matrix_32x32(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl
 	globals[0]= width/4;
 	globals[1]= height;
 
-	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue, kerns.transpose_kernel32, 2, NULL, globals,locals, 0, NULL, NULL) );
+	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue, kerns.transpose_kernel32, 2, NULL, globals,locals, 0, NULL, MLP_PROF_EVENT(kerns,"transpose_32x32",-1)) );
 };
 
 // do the matrix transposition by dividing the matrix row into 4-unit segments, with each thread handles 4 units of one row
@@ -70,7 +71,7 @@ void cmn_transpose_matrix_f4(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_me
 	globals[0]= width/4;
 	globals[1]= ROUNDK(height,256);
 
-	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue, kerns.transpose_kernel4, 2, NULL, globals,locals, 0, NULL, NULL) );
+	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue, kerns.transpose_kernel4, 2, NULL, globals,locals, 0, NULL, MLP_PROF_EVENT(kerns,"transpose_f4",-1)) );
 };
 
 
@@ -91,7 +92,7 @@ void cmn_expandFloatVectorToMatrix(cl_command_queue &cmdQueue, MLP_Kerns &kerns,
 	globals[0]= ROUNDK(DIVUPK(width,4),16);
 	globals[1]= ROUNDK(height,16);
 
-	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue, kerns.expandMatrix_kernel, 2, NULL, globals,locals, 0, NULL, NULL) );
+	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue, kerns.expandMatrix_kernel, 2, NULL, globals,locals, 0, NULL, MLP_PROF_EVENT(kerns,"expand_matrix",-1)) );
 
 	// CL_CHECK(clWaitForEvents(1, &event));
 };
@@ -124,7 +125,7 @@ void cmn_activate_sigmoid(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &
 	    globals[1] = ROUNDK(height,16);
 	};
 
-	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.activate_sigmoid_kernel,2,NULL,globals,locals,0,NULL,NULL) );
+	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.activate_sigmoid_kernel,2,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"activate_sigmoid",-1)) );
 }
 
 void cmn_activate_tanh(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &x, cl_mem &y, int width, int height )
@@ -155,7 +156,7 @@ void cmn_activate_tanh(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &x,
 	    globals[1] = ROUNDK(height,16);
 	};
 
-	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.activate_tanh_kernel,2,NULL,globals,locals,0,NULL,NULL) );
+	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.activate_tanh_kernel,2,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"activate_tanh",-1)) );
 };
 
 void cmn_activate_softmax(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &x, cl_mem &y, int width, int height )
@@ -179,7 +180,7 @@ void cmn_activate_softmax(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &
 	     globals[0] = pow;
 	     globals[1] = ROUNDK(height,256/pow);
 
-	     CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.activate_softmax_kernel1,2,NULL,globals,locals,0,NULL,NULL) );
+	     CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.activate_softmax_kernel1,2,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"activate_softmax_kernel1",-1)) );
 	}
 	else {                // let each work group to handle one row of units, each thread handle "DIVUP(width,4)/256" number of units
      	 CL_CHECK( clSetKernelArg(kerns.activate_softmax_kernel2, 0, sizeof(cl_mem), &x) );
@@ -195,7 +196,7 @@ void cmn_activate_softmax(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &
 	     globals[0] = 256;
 	     globals[1] = ROUNDK(height,1);
 
-	     CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.activate_softmax_kernel2,2,NULL,globals,locals,0,NULL,NULL) );
+	     CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.activate_softmax_kernel2,2,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"activate_softmax_kernel2",-1)) );
 	};
 };
 
@@ -203,6 +204,73 @@ void cmn_activate_identity(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem
 {
 };
 
+// slope is 0.0f for ReLU, or the slope of the negative inputs for leaky ReLU
+void cmn_activate_relu(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &x, cl_mem &y, int width, int height, float slope )
+{
+	CL_CHECK( clSetKernelArg(kerns.activate_relu_kernel, 0, sizeof(cl_mem), &x) );
+	CL_CHECK( clSetKernelArg(kerns.activate_relu_kernel, 1, sizeof(cl_mem), &y) );
+	CL_CHECK( clSetKernelArg(kerns.activate_relu_kernel, 2, sizeof(cl_uint), &width) );
+	CL_CHECK( clSetKernelArg(kerns.activate_relu_kernel, 3, sizeof(cl_uint), &height) );
+	CL_CHECK( clSetKernelArg(kerns.activate_relu_kernel, 4, sizeof(cl_float), &slope) );
+
+	size_t locals[2];
+	size_t globals[2];
+
+	if ( DIVUPK(width,4) < 128 ) {   // one work group can cover whole row of units
+		 // let pow be the upper value of DIVUPK(width,4)
+		 int pow=1;
+		 while ( pow < DIVUPK(width,4) )
+			     pow *= 2;
+
+	    locals[0] = pow;
+	    locals[1] = 256/pow;
+	    globals[0] = pow;
+	    globals[1] = ROUNDK(height,256/pow);
+	}
+	else {                // need to split one row into multiple groups
+	    locals[0] = 16;
+	    locals[1] = 16;
+	    globals[0] = ROUNDK(DIVUPK(width,4),16);
+	    globals[1] = ROUNDK(height,16);
+	};
+
+	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.activate_relu_kernel,2,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"activate_relu",-1)) );
+};
+
+// y = relu(x + biases), biases being the vector of "width" biases rather than the expanded matrix
+void cmn_bias_activate_relu(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &x, cl_mem &biases, cl_mem &y, int width, int height, float slope )
+{
+	CL_CHECK( clSetKernelArg(kerns.bias_activate_relu_kernel, 0, sizeof(cl_mem), &x) );
+	CL_CHECK( clSetKernelArg(kerns.bias_activate_relu_kernel, 1, sizeof(cl_mem), &biases) );
+	CL_CHECK( clSetKernelArg(kerns.bias_activate_relu_kernel, 2, sizeof(cl_mem), &y) );
+	CL_CHECK( clSetKernelArg(kerns.bias_activate_relu_kernel, 3, sizeof(cl_uint), &width) );
+	CL_CHECK( clSetKernelArg(kerns.bias_activate_relu_kernel, 4, sizeof(cl_uint), &height) );
+	CL_CHECK( clSetKernelArg(kerns.bias_activate_relu_kernel, 5, sizeof(cl_float), &slope) );
+
+	size_t locals[2];
+	size_t globals[2];
+
+	if ( DIVUPK(width,4) < 128 ) {   // one work group can cover whole row of units
+		 // let pow be the upper value of DIVUPK(width,4)
+		 int pow=1;
+		 while ( pow < DIVUPK(width,4) )
+			     pow *= 2;
+
+	    locals[0] = pow;
+	    locals[1] = 256/pow;
+	    globals[0] = pow;
+	    globals[1] = ROUNDK(height,256/pow);
+	}
+	else {                // need to split one row into multiple groups
+	    locals[0] = 16;
+	    locals[1] = 16;
+	    globals[0] = ROUNDK(DIVUPK(width,4),16);
+	    globals[1] = ROUNDK(height,16);
+	};
+
+	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.bias_activate_relu_kernel,2,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"bias_activate_relu",-1)) );
+};
+
 void cmn_calculateError_SSE(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &output, cl_mem &target, cl_mem &reduceMem, float *reduceBuf, int width, int height, float &ret )
 {
 	if ( DIVUPK(width,4) < 256 ) {  // let each thread to handle 4 units, each row of units can be handled inside one work group
@@ -225,7 +293,7 @@ void cmn_calculateError_SSE(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem
 	     globals[0] = pow;
 	     globals[1] = ROUNDK(height,256/pow);
 
-	     CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.calculateError_SSE_kernel1,2,NULL,globals,locals,0,NULL,NULL) );
+	     CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.calculateError_SSE_kernel1,2,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"calculateError_SSE_kernel1",-1)) );
 	}
 	else {                // let each work group to handle one row of units, each thread handle "DIVUP(width,4)/256" number of units
      	 CL_CHECK( clSetKernelArg(kerns.calculateError_SSE_kernel2, 0, sizeof(cl_mem), &output) );
@@ -242,10 +310,10 @@ void cmn_calculateError_SSE(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem
 	     globals[0] = 256;
 	     globals[1] = ROUNDK(height,1);
 
-	     CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.calculateError_SSE_kernel2,2,NULL,globals,locals,0,NULL,NULL) );
+	     CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.calculateError_SSE_kernel2,2,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"calculateError_SSE_kernel2",-1)) );
 	};
 
-    CL_CHECK(clEnqueueReadBuffer(cmdQueue,reduceMem,CL_TRUE,0,sizeof(cl_float)*height,reduceBuf,0,NULL,NULL ));
+    CL_CHECK(clEnqueueReadBuffer(cmdQueue,reduceMem,CL_TRUE,0,sizeof(cl_float)*height,reduceBuf,0,NULL,MLP_PROF_EVENT(kerns,"read_reduce",-1) ));
 	ret = 0.0f;
 	for (int i=0; i< height; i++)
          ret += reduceBuf[i]/(float)height;  // calculate average error for frames
@@ -273,7 +341,7 @@ void cmn_calculateError_CE(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem
 	     globals[0] = pow;
 	     globals[1] = ROUNDK(height,256/pow);
 
-	     CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.calculateError_CE_kernel1,2,NULL,globals,locals,0,NULL,NULL) );
+	     CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.calculateError_CE_kernel1,2,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"calculateError_CE_kernel1",-1)) );
 	}
 	else {                // let each work group to handle one row of units, each thread handle "DIVUP(width,4)/256" number of units
      	 CL_CHECK( clSetKernelArg(kerns.calculateError_CE_kernel2, 0, sizeof(cl_mem), &output) );
@@ -290,10 +358,10 @@ void cmn_calculateError_CE(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem
 	     globals[0] = 256;
 	     globals[1] = ROUNDK(height,1);
 
-	     CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.calculateError_CE_kernel2,2,NULL,globals,locals,0,NULL,NULL) );
+	     CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.calculateError_CE_kernel2,2,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"calculateError_CE_kernel2",-1)) );
 	};
 
-    CL_CHECK(clEnqueueReadBuffer(cmdQueue,reduceMem,CL_TRUE,0,sizeof(cl_float)*height,reduceBuf,0,NULL,NULL ));
+    CL_CHECK(clEnqueueReadBuffer(cmdQueue,reduceMem,CL_TRUE,0,sizeof(cl_float)*height,reduceBuf,0,NULL,MLP_PROF_EVENT(kerns,"read_reduce",-1) ));
 	ret = 0.0f;
 	for (int i=0; i< height; i++)
 		 ret += reduceBuf[i]/(float)height;  // calculate average error for frames
@@ -329,7 +397,7 @@ void cmn_calculateDelta_SSE_Sigmoid(cl_command_queue &cmdQueue, MLP_Kerns &kerns
 	};
 
 
-	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.calculateDelta_SSE_Sigmoid_kernel,2,NULL,globals,locals,0,NULL,NULL) );
+	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.calculateDelta_SSE_Sigmoid_kernel,2,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"calculateDelta_SSE_Sigmoid",-1)) );
 };
 
 void cmn_calculateDelta_CE_Softmax(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &output, cl_mem &target, cl_mem &delta, int width, int height)
@@ -361,7 +429,7 @@ void cmn_calculateDelta_CE_Softmax(cl_command_queue &cmdQueue, MLP_Kerns &kerns,
 	    globals[1] = ROUNDK(height,16);
 	};
 
-	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.calculateDelta_CE_Softmax_kernel,2,NULL,globals,locals,0,NULL,NULL) );
+	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.calculateDelta_CE_Softmax_kernel,2,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"calculateDelta_CE_Softmax",-1)) );
 };
 
 void cmn_derivative_sigmoid(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &delta1, cl_mem &y, cl_mem &delta2, int width, int height)
@@ -393,7 +461,7 @@ void cmn_derivative_sigmoid(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem
 	    globals[1] = ROUNDK(height,16);
 	};
 
-	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.derivative_sigmoid_kernel,2,NULL,globals,locals,0,NULL,NULL) );
+	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.derivative_sigmoid_kernel,2,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"derivative_sigmoid",-1)) );
 };
 
 void cmn_derivative_tanh(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &delta1, cl_mem &y, cl_mem &delta2, int width, int height)
@@ -425,7 +493,345 @@ void cmn_derivative_tanh(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &d
 	    globals[1] = ROUNDK(height,16);
 	};
 
-	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.derivative_tanh_kernel,2,NULL,globals,locals,0,NULL,NULL) );
+	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.derivative_tanh_kernel,2,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"derivative_tanh",-1)) );
+};
+
+void cmn_derivative_relu(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &delta1, cl_mem &y, cl_mem &delta2, int width, int height, float slope)
+{
+	CL_CHECK( clSetKernelArg(kerns.derivative_relu_kernel, 0, sizeof(cl_mem), &delta1) );
+	CL_CHECK( clSetKernelArg(kerns.derivative_relu_kernel, 1, sizeof(cl_mem), &y) );
+	CL_CHECK( clSetKernelArg(kerns.derivative_relu_kernel, 2, sizeof(cl_mem), &delta2) );
+	CL_CHECK( clSetKernelArg(kerns.derivative_relu_kernel, 3, sizeof(cl_uint), &width) );
+	CL_CHECK( clSetKernelArg(kerns.derivative_relu_kernel, 4, sizeof(cl_uint), &height) );
+	CL_CHECK( clSetKernelArg(kerns.derivative_relu_kernel, 5, sizeof(cl_float), &slope) );
+
+	size_t globals[2];
+	size_t locals[2];
+
+	if ( DIVUPK(width,4) < 128 ) {   // one work group can cover whole row of units
+		 // let pow be the upper value of DIVUPK(width,4)
+		 int pow=1;
+		 while ( pow < DIVUPK(width,4) )
+			     pow *= 2;
+
+	    locals[0] = pow;
+	    locals[1] = 256/pow;
+	    globals[0] = pow;
+	    globals[1] = ROUNDK(height,256/pow);
+	}
+	else {                // need to split one row into multiple groups
+	    locals[0] = 16;
+	    locals[1] = 16;
+	    globals[0] = ROUNDK(DIVUPK(width,4),16);
+	    globals[1] = ROUNDK(height,16);
+	};
+
+	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.derivative_relu_kernel,2,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"derivative_relu",-1)) );
+};
+
+// C = A * B with B holding half precision values, used by the predictor when keeping the weights in half precision on the device
+void cmn_gemm_half_weights(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &A, cl_mem &B, cl_mem &C, int M, int N, int K, bool transB)
+{
+	cl_int trans = transB? 1 : 0;
+
+	CL_CHECK( clSetKernelArg(kerns.gemm_half_weights_kernel, 0, sizeof(cl_mem), &A) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_half_weights_kernel, 1, sizeof(cl_mem), &B) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_half_weights_kernel, 2, sizeof(cl_mem), &C) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_half_weights_kernel, 3, sizeof(cl_int), &M) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_half_weights_kernel, 4, sizeof(cl_int), &N) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_half_weights_kernel, 5, sizeof(cl_int), &K) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_half_weights_kernel, 6, sizeof(cl_int), &trans) );
+
+	size_t locals[2];
+	size_t globals[2];
+
+	locals[0] = 16;
+	locals[1] = 16;
+	globals[0] = ROUNDK(N,16);
+	globals[1] = ROUNDK(M,16);
+
+	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.gemm_half_weights_kernel,2,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"gemm_half_weights",-1)) );
+};
+
+// the block sparse weights are N x K, one work-item for each block row of the weights and each row of A
+void cmn_gemm_bsr(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &A, cl_mem &rowPtrs, cl_mem &colIndices, cl_mem &values, cl_mem &C, int M, int N, int K)
+{
+	CL_CHECK( clSetKernelArg(kerns.gemm_bsr_kernel, 0, sizeof(cl_mem), &A) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_bsr_kernel, 1, sizeof(cl_mem), &rowPtrs) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_bsr_kernel, 2, sizeof(cl_mem), &colIndices) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_bsr_kernel, 3, sizeof(cl_mem), &values) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_bsr_kernel, 4, sizeof(cl_mem), &C) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_bsr_kernel, 5, sizeof(cl_int), &M) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_bsr_kernel, 6, sizeof(cl_int), &N) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_bsr_kernel, 7, sizeof(cl_int), &K) );
+
+	size_t locals[2];
+	size_t globals[2];
+
+	locals[0] = 64;
+	locals[1] = 1;
+	globals[0] = ROUNDK((N+3)/4,64);
+	globals[1] = M;
+
+	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.gemm_bsr_kernel,2,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"gemm_bsr",-1)) );
+};
+
+// quantize each row of X to int8, with fixedScale or the scale calculated for each row when fixedScale is zero
+void cmn_quantize_rows(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &X, cl_mem &Q, cl_mem &rowScales, int width, int height, float fixedScale)
+{
+	CL_CHECK( clSetKernelArg(kerns.quantize_rows_kernel, 0, sizeof(cl_mem), &X) );
+	CL_CHECK( clSetKernelArg(kerns.quantize_rows_kernel, 1, sizeof(cl_mem), &Q) );
+	CL_CHECK( clSetKernelArg(kerns.quantize_rows_kernel, 2, sizeof(cl_mem), &rowScales) );
+	CL_CHECK( clSetKernelArg(kerns.quantize_rows_kernel, 3, sizeof(cl_int), &width) );
+	CL_CHECK( clSetKernelArg(kerns.quantize_rows_kernel, 4, sizeof(cl_float), &fixedScale) );
+
+	size_t locals[1];
+	size_t globals[1];
+
+	locals[0] = 256;
+	globals[0] = 256*height;
+
+	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.quantize_rows_kernel,1,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"quantize_rows",-1)) );
+};
+
+// C = A * B with int8 A and B, restored to float by the scales of the rows of A and the columns of C
+void cmn_gemm_int8(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &A, cl_mem &B, cl_mem &rowScales, cl_mem &colScales, cl_mem &C, int M, int N, int K, bool transB)
+{
+	cl_int trans = transB? 1 : 0;
+
+	CL_CHECK( clSetKernelArg(kerns.gemm_int8_kernel, 0, sizeof(cl_mem), &A) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_int8_kernel, 1, sizeof(cl_mem), &B) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_int8_kernel, 2, sizeof(cl_mem), &rowScales) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_int8_kernel, 3, sizeof(cl_mem), &colScales) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_int8_kernel, 4, sizeof(cl_mem), &C) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_int8_kernel, 5, sizeof(cl_int), &M) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_int8_kernel, 6, sizeof(cl_int), &N) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_int8_kernel, 7, sizeof(cl_int), &K) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_int8_kernel, 8, sizeof(cl_int), &trans) );
+
+	size_t locals[2];
+	size_t globals[2];
+
+	locals[0] = 16;
+	locals[1] = 16;
+	globals[0] = ROUNDK(N,16);
+	globals[1] = ROUNDK(M,16);
+
+	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.gemm_int8_kernel,2,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"gemm_int8",-1)) );
+};
+
+// ranges[idx] = max(ranges[idx], max(abs(X)))
+void cmn_absmax_accumulate(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &X, int num, cl_mem &ranges, int idx)
+{
+	CL_CHECK( clSetKernelArg(kerns.absmax_accumulate_kernel, 0, sizeof(cl_mem), &X) );
+	CL_CHECK( clSetKernelArg(kerns.absmax_accumulate_kernel, 1, sizeof(cl_int), &num) );
+	CL_CHECK( clSetKernelArg(kerns.absmax_accumulate_kernel, 2, sizeof(cl_mem), &ranges) );
+	CL_CHECK( clSetKernelArg(kerns.absmax_accumulate_kernel, 3, sizeof(cl_int), &idx) );
+
+	size_t locals[1];
+	size_t globals[1];
+
+	locals[0] = 256;
+	globals[0] = 256;
+
+	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.absmax_accumulate_kernel,1,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"absmax_accumulate",-1)) );
+};
+
+// the indices and values of the k largest values of each row of X, stored as k consecutive items for each row in indices and scores
+void cmn_topk_rows(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &X, cl_mem &indices, cl_mem &scores, int width, int height, int k)
+{
+	CL_CHECK( clSetKernelArg(kerns.topk_rows_kernel, 0, sizeof(cl_mem), &X) );
+	CL_CHECK( clSetKernelArg(kerns.topk_rows_kernel, 1, sizeof(cl_mem), &indices) );
+	CL_CHECK( clSetKernelArg(kerns.topk_rows_kernel, 2, sizeof(cl_mem), &scores) );
+	CL_CHECK( clSetKernelArg(kerns.topk_rows_kernel, 3, sizeof(cl_int), &width) );
+	CL_CHECK( clSetKernelArg(kerns.topk_rows_kernel, 4, sizeof(cl_int), &k) );
+
+	size_t locals[1];
+	size_t globals[1];
+
+	locals[0] = 256;
+	globals[0] = 256*height;
+
+	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.topk_rows_kernel,1,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"topk_rows",-1)) );
+};
+
+void cmn_gather_rows(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &src, cl_mem &rows, cl_mem &dst, int width, int num)
+{
+	CL_CHECK( clSetKernelArg(kerns.gather_rows_kernel, 0, sizeof(cl_mem), &src) );
+	CL_CHECK( clSetKernelArg(kerns.gather_rows_kernel, 1, sizeof(cl_mem), &rows) );
+	CL_CHECK( clSetKernelArg(kerns.gather_rows_kernel, 2, sizeof(cl_mem), &dst) );
+	CL_CHECK( clSetKernelArg(kerns.gather_rows_kernel, 3, sizeof(cl_int), &width) );
+	CL_CHECK( clSetKernelArg(kerns.gather_rows_kernel, 4, sizeof(cl_int), &num) );
+
+	size_t locals[2];
+	size_t globals[2];
+
+	locals[0] = 16;
+	locals[1] = 16;
+	globals[0] = ROUNDK(width,16);
+	globals[1] = ROUNDK(num,16);
+
+	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.gather_rows_kernel,2,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"gather_rows",-1)) );
+};
+
+void cmn_update_sampled_rows(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &W, cl_mem &V, cl_mem &G, cl_mem &rows, int width, int num, float momentum)
+{
+	CL_CHECK( clSetKernelArg(kerns.update_sampled_rows_kernel, 0, sizeof(cl_mem), &W) );
+	CL_CHECK( clSetKernelArg(kerns.update_sampled_rows_kernel, 1, sizeof(cl_mem), &V) );
+	CL_CHECK( clSetKernelArg(kerns.update_sampled_rows_kernel, 2, sizeof(cl_mem), &G) );
+	CL_CHECK( clSetKernelArg(kerns.update_sampled_rows_kernel, 3, sizeof(cl_mem), &rows) );
+	CL_CHECK( clSetKernelArg(kerns.update_sampled_rows_kernel, 4, sizeof(cl_int), &width) );
+	CL_CHECK( clSetKernelArg(kerns.update_sampled_rows_kernel, 5, sizeof(cl_int), &num) );
+	CL_CHECK( clSetKernelArg(kerns.update_sampled_rows_kernel, 6, sizeof(cl_float), &momentum) );
+
+	size_t locals[2];
+	size_t globals[2];
+
+	locals[0] = 16;
+	locals[1] = 16;
+	globals[0] = ROUNDK(width,16);
+	globals[1] = ROUNDK(num,16);
+
+	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.update_sampled_rows_kernel,2,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"update_sampled_rows",-1)) );
+};
+
+void cmn_gemm_half(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &A, cl_mem &B, cl_mem &C, int M, int N, int K, bool transA, bool transB, float alpha, float beta)
+{
+	cl_int transA_ = transA? 1 : 0;
+	cl_int transB_ = transB? 1 : 0;
+
+	CL_CHECK( clSetKernelArg(kerns.gemm_half_kernel, 0, sizeof(cl_mem), &A) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_half_kernel, 1, sizeof(cl_mem), &B) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_half_kernel, 2, sizeof(cl_mem), &C) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_half_kernel, 3, sizeof(cl_int), &M) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_half_kernel, 4, sizeof(cl_int), &N) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_half_kernel, 5, sizeof(cl_int), &K) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_half_kernel, 6, sizeof(cl_int), &transA_) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_half_kernel, 7, sizeof(cl_int), &transB_) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_half_kernel, 8, sizeof(cl_float), &alpha) );
+	CL_CHECK( clSetKernelArg(kerns.gemm_half_kernel, 9, sizeof(cl_float), &beta) );
+
+	size_t locals[2];
+	size_t globals[2];
+
+	locals[0] = 16;
+	locals[1] = 16;
+	globals[0] = ROUNDK(N,16);
+	globals[1] = ROUNDK(M,16);
+
+	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.gemm_half_kernel,2,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"gemm_half",-1)) );
+};
+
+void cmn_convert_to_half(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &X, cl_mem &Y, int num, float scale)
+{
+	CL_CHECK( clSetKernelArg(kerns.convert_to_half_kernel, 0, sizeof(cl_mem), &X) );
+	CL_CHECK( clSetKernelArg(kerns.convert_to_half_kernel, 1, sizeof(cl_mem), &Y) );
+	CL_CHECK( clSetKernelArg(kerns.convert_to_half_kernel, 2, sizeof(cl_int), &num) );
+	CL_CHECK( clSetKernelArg(kerns.convert_to_half_kernel, 3, sizeof(cl_float), &scale) );
+
+	size_t locals[1];
+	size_t globals[1];
+
+	locals[0] = 256;
+	globals[0] = ROUNDK(num,256);
+
+	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.convert_to_half_kernel,1,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"convert_to_half",-1)) );
+};
+
+void cmn_convert_to_float(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &X, cl_mem &Y, int num)
+{
+	CL_CHECK( clSetKernelArg(kerns.convert_to_float_kernel, 0, sizeof(cl_mem), &X) );
+	CL_CHECK( clSetKernelArg(kerns.convert_to_float_kernel, 1, sizeof(cl_mem), &Y) );
+	CL_CHECK( clSetKernelArg(kerns.convert_to_float_kernel, 2, sizeof(cl_int), &num) );
+
+	size_t locals[1];
+	size_t globals[1];
+
+	locals[0] = 256;
+	globals[0] = ROUNDK(num,256);
+
+	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.convert_to_float_kernel,1,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"convert_to_float",-1)) );
+};
+
+// the flag should be cleared before the first checking
+void cmn_check_finite(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &X, int num, cl_mem &flag)
+{
+	CL_CHECK( clSetKernelArg(kerns.check_finite_kernel, 0, sizeof(cl_mem), &X) );
+	CL_CHECK( clSetKernelArg(kerns.check_finite_kernel, 1, sizeof(cl_int), &num) );
+	CL_CHECK( clSetKernelArg(kerns.check_finite_kernel, 2, sizeof(cl_mem), &flag) );
+
+	size_t locals[1];
+	size_t globals[1];
+
+	locals[0] = 256;
+	globals[0] = ROUNDK(num,256);
+
+	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.check_finite_kernel,1,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"check_finite",-1)) );
+};
+
+void cmn_apply_momentum(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &W, cl_mem &V, cl_mem &G, int num, float momentum)
+{
+	CL_CHECK( clSetKernelArg(kerns.apply_momentum_kernel, 0, sizeof(cl_mem), &W) );
+	CL_CHECK( clSetKernelArg(kerns.apply_momentum_kernel, 1, sizeof(cl_mem), &V) );
+	CL_CHECK( clSetKernelArg(kerns.apply_momentum_kernel, 2, sizeof(cl_mem), &G) );
+	CL_CHECK( clSetKernelArg(kerns.apply_momentum_kernel, 3, sizeof(cl_int), &num) );
+	CL_CHECK( clSetKernelArg(kerns.apply_momentum_kernel, 4, sizeof(cl_float), &momentum) );
+
+	size_t locals[1];
+	size_t globals[1];
+
+	locals[0] = 256;
+	globals[0] = ROUNDK(num,256);
+
+	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.apply_momentum_kernel,1,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"apply_momentum",-1)) );
+};
+
+void cmn_apply_momentum_half(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &W, cl_mem &V, cl_mem &G, cl_mem &Wh, int num, float momentum)
+{
+	CL_CHECK( clSetKernelArg(kerns.apply_momentum_half_kernel, 0, sizeof(cl_mem), &W) );
+	CL_CHECK( clSetKernelArg(kerns.apply_momentum_half_kernel, 1, sizeof(cl_mem), &V) );
+	CL_CHECK( clSetKernelArg(kerns.apply_momentum_half_kernel, 2, sizeof(cl_mem), &G) );
+	CL_CHECK( clSetKernelArg(kerns.apply_momentum_half_kernel, 3, sizeof(cl_mem), &Wh) );
+	CL_CHECK( clSetKernelArg(kerns.apply_momentum_half_kernel, 4, sizeof(cl_int), &num) );
+	CL_CHECK( clSetKernelArg(kerns.apply_momentum_half_kernel, 5, sizeof(cl_float), &momentum) );
+
+	size_t locals[1];
+	size_t globals[1];
+
+	locals[0] = 256;
+	globals[0] = ROUNDK(num,256);
+
+	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.apply_momentum_half_kernel,1,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"apply_momentum_half",-1)) );
+};
+
+void cmn_spmm_csr(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &rowPtrs, cl_mem &colIndices, cl_mem &values, cl_mem &B, cl_mem &C, int M, int N, int K,
+                  bool transB, bool transC, float alpha, float beta)
+{
+	cl_int iTransB = transB? 1 : 0;
+	cl_int iTransC = transC? 1 : 0;
+
+	CL_CHECK( clSetKernelArg(kerns.spmm_csr_kernel, 0, sizeof(cl_mem), &rowPtrs) );
+	CL_CHECK( clSetKernelArg(kerns.spmm_csr_kernel, 1, sizeof(cl_mem), &colIndices) );
+	CL_CHECK( clSetKernelArg(kerns.spmm_csr_kernel, 2, sizeof(cl_mem), &values) );
+	CL_CHECK( clSetKernelArg(kerns.spmm_csr_kernel, 3, sizeof(cl_mem), &B) );
+	CL_CHECK( clSetKernelArg(kerns.spmm_csr_kernel, 4, sizeof(cl_mem), &C) );
+	CL_CHECK( clSetKernelArg(kerns.spmm_csr_kernel, 5, sizeof(cl_int), &M) );
+	CL_CHECK( clSetKernelArg(kerns.spmm_csr_kernel, 6, sizeof(cl_int), &N) );
+	CL_CHECK( clSetKernelArg(kerns.spmm_csr_kernel, 7, sizeof(cl_int), &K) );
+	CL_CHECK( clSetKernelArg(kerns.spmm_csr_kernel, 8, sizeof(cl_int), &iTransB) );
+	CL_CHECK( clSetKernelArg(kerns.spmm_csr_kernel, 9, sizeof(cl_int), &iTransC) );
+	CL_CHECK( clSetKernelArg(kerns.spmm_csr_kernel, 10, sizeof(cl_float), &alpha) );
+	CL_CHECK( clSetKernelArg(kerns.spmm_csr_kernel, 11, sizeof(cl_float), &beta) );
+
+	size_t locals[2];
+	size_t globals[2];
+
+	locals[0] = 256;
+	locals[1] = 1;
+	globals[0] = ROUNDK(N,256);
+	globals[1] = M;
+
+	CL_CHECK( clEnqueueNDRangeKernel(cmdQueue,kerns.spmm_csr_kernel,2,NULL,globals,locals,0,NULL,MLP_PROF_EVENT(kerns,"spmm_csr",-1)) );
 };
 
 
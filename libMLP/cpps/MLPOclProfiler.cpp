@@ -0,0 +1,158 @@
+/*
+ *  COPYRIGHT:  Copyright (c) 2014 Advanced Micro Devices, Inc.  All rights reserved
+ *
+ *   Collects the OpenCL profiling times of the commands enqueued by the MLP engines, each command is tagged by the name of
+ *   the kernel, BLAS routine or transfer and the layer it works on. Only works with the queues created after calling
+ *   set_ocl_queue_profiling(true)
+ */
+
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <utility>
+#include <functional>
+
+#include "MLPUtil.h"
+#include "MLPOclProfiler.h"
+#include "DNNTracer.h"
+
+using namespace std;
+
+
+MLPOclProfiler::MLPOclProfiler()
+{
+	this->pending.reserve(1024);
+	this->steps = 0;
+};
+
+MLPOclProfiler::~MLPOclProfiler()
+{
+	for (size_t k=0; k < this->pending.size(); k++)
+		 if ( this->pending[k].event )
+			  clReleaseEvent(this->pending[k].event);
+};
+
+cl_event *MLPOclProfiler::nextEvent(const char *tag, int layer)
+{
+	if ( this->pending.size() >= MLP_PROF_MAX_PENDING )
+		 this->collect();
+
+	struct prof_event pe;
+
+	pe.tag = tag;
+	pe.layer = layer;
+	pe.event = NULL;         // stays NULL if the enqueue call fails
+	this->pending.push_back(pe);
+
+	return( &this->pending.back().event );
+};
+
+// the times of the commands are accumulated to their tags, and the events are released. With the tracing started, the commands
+// are also recorded as the spans of the device, the device clock is aligned to the host clock by taking the end of the last
+// command as the time it is collected, so the device spans are late by the time the host takes to notice the commands finished
+void MLPOclProfiler::collect()
+{
+	bool tracing = dnn_trace_enabled();
+	vector<cl_ulong> traceTimes;
+	cl_ulong lastEnd = 0;
+
+	for (size_t k=0; k < this->pending.size(); k++) {
+		 struct prof_event &pe = this->pending[k];
+		 cl_ulong queued, submit, start, end;
+
+		 if ( ! pe.event )
+			  continue;
+
+		 CL_CHECK( clWaitForEvents(1, &pe.event) );
+		 CL_CHECK( clGetEventProfilingInfo(pe.event, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &queued, NULL) );
+		 CL_CHECK( clGetEventProfilingInfo(pe.event, CL_PROFILING_COMMAND_SUBMIT, sizeof(cl_ulong), &submit, NULL) );
+		 CL_CHECK( clGetEventProfilingInfo(pe.event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL) );
+		 CL_CHECK( clGetEventProfilingInfo(pe.event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL) );
+		 CL_CHECK( clReleaseEvent(pe.event) );
+
+		 if ( tracing ) {
+			  traceTimes.push_back(start);
+			  traceTimes.push_back(end);
+			  lastEnd = max<cl_ulong>(lastEnd, end);
+		 };
+
+		 ostringstream key;
+
+		 key << pe.tag;
+		 if ( pe.layer >= 0 )
+			  key << "[" << pe.layer << "]";
+
+		 map<string, struct prof_stats>::iterator it = this->stats.find(key.str());
+
+		 if ( it == this->stats.end() ) {
+			  struct prof_stats zero = { 0, 0.0, 0.0, 0.0 };
+
+			  it = this->stats.insert(make_pair(key.str(), zero)).first;
+		 };
+
+		 // the profiling times are in nano-seconds
+		 it->second.count++;
+		 it->second.queued += (submit - queued) * 1.0e-3;
+		 it->second.submitted += (start - submit) * 1.0e-3;
+		 it->second.executed += (end - start) * 1.0e-3;
+	};
+
+	if ( ! traceTimes.empty() ) {
+		 long long offset = dnn_trace_now() - (long long)(lastEnd / 1000);
+		 size_t t = 0;
+
+		 for (size_t k=0; k < this->pending.size(); k++) {
+			  struct prof_event &pe = this->pending[k];
+
+			  if ( ! pe.event )
+				   continue;
+
+			  dnn_trace_record(DNN_TRACE_DEVICE, pe.tag, pe.layer, (long long)(traceTimes[t] / 1000) + offset, (long long)((traceTimes[t+1] - traceTimes[t]) / 1000));
+			  t += 2;
+		 };
+	};
+
+	this->pending.clear();
+};
+
+void MLPOclProfiler::endStep()
+{
+	this->collect();
+	this->steps++;
+};
+
+void MLPOclProfiler::reset()
+{
+	this->collect();
+	this->stats.clear();
+	this->steps = 0;
+};
+
+// the tags are listed by their execution time, the most expensive first
+void MLPOclProfiler::showProfile(ostream &out)
+{
+	vector< pair<double,string> > order;
+	double totalExecuted = 0.0;
+
+	for (map<string, struct prof_stats>::iterator it = this->stats.begin(); it != this->stats.end(); ++it) {
+		 order.push_back(make_pair(it->second.executed, it->first));
+		 totalExecuted += it->second.executed;
+	};
+	sort(order.begin(), order.end(), greater< pair<double,string> >());
+
+	int steps = (this->steps > 0)? this->steps : 1;
+
+	out << "Device profile of " << this->steps << " steps, micro-seconds per step" << endl;
+	out << setw(32) << left << "command" << right << setw(10) << "calls" << setw(14) << "queued" << setw(14) << "submitted"
+		<< setw(14) << "executed" << setw(10) << "%" << endl;
+
+	for (size_t k=0; k < order.size(); k++) {
+		 struct prof_stats &st = this->stats[order[k].second];
+
+		 out << setw(32) << left << order[k].second << right << fixed << setprecision(1)
+			 << setw(10) << (double)st.count/steps << setw(14) << st.queued/steps << setw(14) << st.submitted/steps
+			 << setw(14) << st.executed/steps << setw(10) << ((totalExecuted > 0.0)? st.executed*100.0/totalExecuted : 0.0) << endl;
+	};
+
+	out << setw(32) << left << "total" << right << setw(10) << "" << setw(14) << "" << setw(14) << "" << setw(14) << totalExecuted/steps << endl;
+};
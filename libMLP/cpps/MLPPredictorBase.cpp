@@ -16,6 +16,7 @@ MLPPredictorBase::MLPPredictorBase()
 	this->batchSize = 0;
 
 	this->actFuncs = NULL;
+	this->weightLayout = MLP_WEIGHTS_ROWMAJOR;
 
 	this->initialized = false;
 }
@@ -38,6 +39,8 @@ void MLPPredictorBase::_initialize(MLPConfigProvider & provider, int _batchSize)
 
 	for ( int i = 0; i < this->nLayers; i++ )
 		this->actFuncs[i] = provider.actFuncs[i];
+
+	this->weightLayout = provider.weightLayout;
 }
 
 // only called by the destructor
@@ -19,52 +19,126 @@
 SingleDevClass *MLPPredictorOCL::CLCtx = NULL;
 int MLPPredictorOCL::nInstances = 0;
 
-MLP_Kerns MLPPredictorOCL::mykerns;
-
 MLPPredictorOCL::MLPPredictorOCL()
 {
+	this->devType = DNN_OCL_DI_GPU;    // default OpenCL device
+
 	// class wide set up
 	if ( this->nInstances++ == 0 )  {   // at the first instance
         this->CLCtx = new SingleDevClass(this->devType);
 
 		clAmdBlasSetup();
 
-		this->setup_ocl_kernels();
+		this->setup_ocl_program();
 	}
 
-	this->devType = DNN_OCL_DI_GPU;    // default OpenCL device
+	this->setup_ocl_queue();
+	this->setup_ocl_kernels();
+
+	this->weightType = MLP_DATA_FLOAT32;
+	this->model = NULL;
+	this->reloadBase = NULL;
+	this->reloading = false;
 
 	this->inputs = NULL;
-	this->weights = NULL;
-	this->biases = NULL;
 	this->biasMatrixes = NULL;
+	this->calibrating = false;
+	this->ranges = NULL;
+
+	for (int s = 0; s < MLP_PREDICT_SLOTS; s++) {
+		this->slots[s].inputs = NULL;
+		this->slots[s].ticket = -1;
+	};
+	this->nextTicket = 0;
 
 	this->initialized = false;
 };
 
 
-MLPPredictorOCL::MLPPredictorOCL(MLPConfigProvider & configProvider, DNN_OCL_DEVTYPE dType, int _batchSize)
+// with _weightType being MLP_DATA_FLOAT16, the weights are kept in half precision on the device, the inputs and outputs of each
+// layer are still in float. With _weightType being MLP_DATA_INT8, the inputs of each layer are quantized by the calibrated scales
+// from the configProvider, or by the scales calculated for each frame if not calibrated. With _weightType being MLP_DATA_BSR, only
+// the non-zero blocks of the weights pruned by MLPPruner are kept on the device and computed
+MLPPredictorOCL::MLPPredictorOCL(MLPConfigProvider & configProvider, DNN_OCL_DEVTYPE dType, int _batchSize, MLP_DATA_TYPE _weightType)
 {
   	this->devType = dType;
 
+	if ( (_weightType != MLP_DATA_FLOAT32) && (_weightType != MLP_DATA_FLOAT16) && (_weightType != MLP_DATA_INT8) && (_weightType != MLP_DATA_BSR) ) {
+		 mlp_log("MLPPredictor", "Only float, half precision, int8 and block sparse weights are supported on the device");
+		 MLP_Exception("");
+	};
+	this->weightType = _weightType;
+	this->model = NULL;
+	this->reloadBase = NULL;
+	this->reloading = false;
+	this->calibrating = false;
+	this->ranges = NULL;
+
 	// class wide set up
 	if ( this->nInstances++ == 0 )  {   // at the first instance
         this->CLCtx = new SingleDevClass(this->devType);
 
 		clAmdBlasSetup();
 
-		this->setup_ocl_kernels();
+		this->setup_ocl_program();
 	}
 
+	// each instance has its own command queue and kernel objects, so that different instances can be used by different threads
+	this->setup_ocl_queue();
+	this->setup_ocl_kernels();
+
     this->setupMLP(configProvider, _batchSize);
 }
 
+// Only the buffers for the inputs and outputs of the layers are created for this instance, so serving threads each having one
+// predictor don't need one copy of the model on the device for each thread. The instances should be created and deleted by one thread
+MLPPredictorOCL::MLPPredictorOCL(MLPPredictorOCL &sharedPredictor, int _batchSize)
+{
+	if ( !sharedPredictor.initialized ) {
+		 mlp_log("MLPPredictor", "The Predictor object to share the device model with should be setup first");
+		 MLP_Exception("");
+	};
+
+	this->devType = sharedPredictor.devType;
+	this->weightType = sharedPredictor.weightType;
+	this->reloadBase = NULL;
+	this->reloading = false;
+	this->calibrating = false;
+	this->ranges = NULL;
+
+	// the class wide set up has been done by sharedPredictor
+	this->nInstances++;
+
+	this->setup_ocl_queue();
+	this->setup_ocl_kernels();
+
+	this->netType = sharedPredictor.netType;
+	this->nLayers = sharedPredictor.nLayers;
+	this->batchSize = _batchSize;
+	this->dimensions = new int[this->nLayers];
+	this->actFuncs = new ACT_FUNC[this->nLayers];
+	for (int i = 0; i < this->nLayers; i++) {
+		 this->dimensions[i] = sharedPredictor.dimensions[i];
+		 this->actFuncs[i] = sharedPredictor.actFuncs[i];
+	};
+	this->weightLayout = sharedPredictor.weightLayout;
+
+	this->model = sharedPredictor.model;
+	this->model->retain();
+
+	this->create_ocl_buffers();
+
+	this->initialized = true;
+}
+
 void MLPPredictorOCL::setupMLP(MLPConfigProvider & configProvider, int _batchSize)
 {
 
 	this->_initialize(configProvider, _batchSize);
 
-	this->create_ocl_buffers(configProvider);
+	this->model = new MLPDeviceModelOCL(configProvider, this->CLCtx->m_context, this->queue, this->weightType);
+
+	this->create_ocl_buffers();
 
 	this->initialized = true;
 }
@@ -72,18 +146,30 @@ void MLPPredictorOCL::setupMLP(MLPConfigProvider & configProvider, int _batchSiz
 
 MLPPredictorOCL::~MLPPredictorOCL()
 {
+	if ( this->reloading )
+		 DNN_JOIN_THREAD(this->loader);
+
+    this->release_ocl_buffers();
+
+	// released before the context at the last instance
+	if ( this->model )
+		 this->model->release();
+
+	this->destroy_ocl_kernels();
+	CL_CHECK( clReleaseCommandQueue(this->queue) );
+	CL_CHECK( clReleaseCommandQueue(this->uploadQueue) );
+	CL_CHECK( clReleaseCommandQueue(this->readbackQueue) );
+
 	if ( --this->nInstances == 0 ) {    // at the last instance
-        this->destroy_ocl_kernels();
+        this->destroy_ocl_program();
 
 		delete this->CLCtx;
 
 		clAmdBlasTeardown();
 	}
-
-    this->release_ocl_buffers();
 }
 
-void MLPPredictorOCL::setup_ocl_kernels()
+void MLPPredictorOCL::setup_ocl_program()
 {
  	    cl_int status;
 		char *kernel_src;
@@ -100,6 +186,28 @@ void MLPPredictorOCL::setup_ocl_kernels()
 		CL_CHECK( clBuildProgram(this->CLCtx->m_program,1,&this->CLCtx->m_device, NULL, NULL, NULL) );
 
 		delete [] kernel_src;
+};
+
+void MLPPredictorOCL::destroy_ocl_program()
+{
+		CL_CHECK( clReleaseProgram(this->CLCtx->m_program) );
+};
+
+void MLPPredictorOCL::setup_ocl_queue()
+{
+ 	    cl_int status;
+
+		this->queue = clCreateCommandQueue(this->CLCtx->m_context, this->CLCtx->m_device, 0, &status);
+		CL_CHECK( status );
+		this->uploadQueue = clCreateCommandQueue(this->CLCtx->m_context, this->CLCtx->m_device, 0, &status);
+		CL_CHECK( status );
+		this->readbackQueue = clCreateCommandQueue(this->CLCtx->m_context, this->CLCtx->m_device, 0, &status);
+		CL_CHECK( status );
+};
+
+void MLPPredictorOCL::setup_ocl_kernels()
+{
+ 	    cl_int status;
 
 		this->mykerns.activate_sigmoid_kernel = clCreateKernel(this->CLCtx->m_program,"activate_sigmoid",&status);
 		CL_CHECK( status );
@@ -109,10 +217,30 @@ void MLPPredictorOCL::setup_ocl_kernels()
 		CL_CHECK( status );
 		this->mykerns.activate_tanh_kernel = clCreateKernel(this->CLCtx->m_program,"activate_tanh",&status);
 		CL_CHECK( status );
+		this->mykerns.activate_relu_kernel = clCreateKernel(this->CLCtx->m_program,"activate_relu",&status);
+		CL_CHECK( status );
+		this->mykerns.bias_activate_relu_kernel = clCreateKernel(this->CLCtx->m_program,"bias_activate_relu",&status);
+		CL_CHECK( status );
 
         this->mykerns.expandMatrix_kernel = clCreateKernel(this->CLCtx->m_program,"expandVectorToMatrix",&status);
 	    CL_CHECK( status );
 
+        this->mykerns.gemm_half_weights_kernel = clCreateKernel(this->CLCtx->m_program,"gemm_half_weights",&status);
+	    CL_CHECK( status );
+        this->mykerns.gemm_bsr_kernel = clCreateKernel(this->CLCtx->m_program,"gemm_bsr",&status);
+	    CL_CHECK( status );
+
+        this->mykerns.quantize_rows_kernel = clCreateKernel(this->CLCtx->m_program,"quantize_rows",&status);
+	    CL_CHECK( status );
+        this->mykerns.gemm_int8_kernel = clCreateKernel(this->CLCtx->m_program,"gemm_int8",&status);
+	    CL_CHECK( status );
+        this->mykerns.absmax_accumulate_kernel = clCreateKernel(this->CLCtx->m_program,"absmax_accumulate",&status);
+	    CL_CHECK( status );
+
+        this->mykerns.topk_rows_kernel = clCreateKernel(this->CLCtx->m_program,"topk_rows",&status);
+	    CL_CHECK( status );
+
+		this->mykerns.profiler = NULL;
 };
 
 void MLPPredictorOCL::destroy_ocl_kernels()
@@ -121,19 +249,23 @@ void MLPPredictorOCL::destroy_ocl_kernels()
 	    CL_CHECK( clReleaseKernel(this->mykerns.activate_softmax_kernel1) );
         CL_CHECK( clReleaseKernel(this->mykerns.activate_softmax_kernel2) );
 	    CL_CHECK( clReleaseKernel(this->mykerns.activate_tanh_kernel) );
+	    CL_CHECK( clReleaseKernel(this->mykerns.activate_relu_kernel) );
+	    CL_CHECK( clReleaseKernel(this->mykerns.bias_activate_relu_kernel) );
 
 		CL_CHECK( clReleaseKernel(this->mykerns.expandMatrix_kernel) );
-
-		CL_CHECK( clReleaseProgram(this->CLCtx->m_program) );
+		CL_CHECK( clReleaseKernel(this->mykerns.gemm_half_weights_kernel) );
+		CL_CHECK( clReleaseKernel(this->mykerns.gemm_bsr_kernel) );
+		CL_CHECK( clReleaseKernel(this->mykerns.quantize_rows_kernel) );
+		CL_CHECK( clReleaseKernel(this->mykerns.gemm_int8_kernel) );
+		CL_CHECK( clReleaseKernel(this->mykerns.absmax_accumulate_kernel) );
+		CL_CHECK( clReleaseKernel(this->mykerns.topk_rows_kernel) );
 };
 
-void MLPPredictorOCL::create_ocl_buffers(MLPConfigProvider &provider)
+void MLPPredictorOCL::create_ocl_buffers()
 {
     cl_int status;
 
  	this->inputs = new cl_mem[this->nLayers];         // buffers for storing the input/output for each layers
-	this->weights = new cl_mem[this->nLayers];        // weights for connecting the previous layer and current layer
-	this->biases =  new cl_mem[this->nLayers];        // bias for each layer, added to the input of each layer
 
 	// The Input/Output of layer i is stored in this->inputs[i+1], so this->inputs[1] is for the input layer, this->inputs[2] is for
 	// the first hidden layer, this->inputs[0] is for the output layer
@@ -141,14 +273,6 @@ void MLPPredictorOCL::create_ocl_buffers(MLPConfigProvider &provider)
 	{
 		this->inputs[i] = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*this->dimensions[i-1]*this->batchSize,NULL,&status);
 		CL_CHECK(status);
-
-		this->weights[i] = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE|CL_MEM_COPY_HOST_PTR, sizeof(cl_float)*this->dimensions[i-1]*this->dimensions[i],
-			                               provider.weights[i],&status);
-		CL_CHECK(status);
-
-		this->biases[i] = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE|CL_MEM_COPY_HOST_PTR, sizeof(cl_float)*this->dimensions[i],
-			                               provider.biases[i],&status);
-		CL_CHECK(status);
 	}
 
 	// for output layer
@@ -157,6 +281,29 @@ void MLPPredictorOCL::create_ocl_buffers(MLPConfigProvider &provider)
 
 	this->inputs[0] = this->output;
 
+	// the other slots are only used by submitPredicting(), their buffers are created when first used
+	for (int s = 0; s < MLP_PREDICT_SLOTS; s++) {
+		this->slots[s].inputs = (s == 0)? this->inputs : NULL;
+		this->slots[s].ticket = -1;
+	};
+	this->nextTicket = 0;
+
+	if ( this->weightType == MLP_DATA_INT8 ) {
+		 int maxDim = 0;
+
+		 for (int i = 0; i < this->nLayers-1; i++)
+			  maxDim = max(maxDim, this->dimensions[i]);
+
+		 this->qInputs = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_char)*maxDim*this->batchSize, NULL, &status);
+		 CL_CHECK(status);
+		 this->rowScales = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*this->batchSize, NULL, &status);
+		 CL_CHECK(status);
+	};
+
+	this->topK = 0;
+	this->topIndices = NULL;
+	this->topScores = NULL;
+
 	this->biasMatrixes = new cl_mem[this->nLayers];
 
 	// create bias Matrix buffer for each layer except for the input layer
@@ -164,88 +311,229 @@ void MLPPredictorOCL::create_ocl_buffers(MLPConfigProvider &provider)
  	    this->biasMatrixes[i] = clCreateBuffer(this->CLCtx->m_context,CL_MEM_READ_WRITE,sizeof(cl_float)*this->batchSize*this->dimensions[i],NULL,&status);
         CL_CHECK(status);
 
-		this->expandFloatVectorToMatrix(this->biases[i],this->biasMatrixes[i],this->dimensions[i],this->batchSize);
+		this->expandFloatVectorToMatrix(this->model->biases[i],this->biasMatrixes[i],this->dimensions[i],this->batchSize);
 	};
 };
 
 void MLPPredictorOCL::release_ocl_buffers()
 {
+	this->waitAllPredicting();
+
+	for (int s = 1; s < MLP_PREDICT_SLOTS; s++)
+		this->release_slot_buffers(s);
+
 	for (int i = 1; i < this->nLayers; i++ ) {
 		CL_CHECK( clReleaseMemObject(this->inputs[i]) );
-		CL_CHECK( clReleaseMemObject(this->weights[i]) );
-		CL_CHECK( clReleaseMemObject(this->biases[i]) );
 
 		CL_CHECK( clReleaseMemObject(this->biasMatrixes[i]) );
 	}
 
 	CL_CHECK( clReleaseMemObject(this->output) );
 
+	if ( this->ranges ) {
+		CL_CHECK( clReleaseMemObject(this->ranges) );
+		this->ranges = NULL;
+	}
+
+	if ( this->topK > 0 ) {
+		CL_CHECK( clReleaseMemObject(this->topIndices) );
+		CL_CHECK( clReleaseMemObject(this->topScores) );
+	};
+
+	if ( this->weightType == MLP_DATA_INT8 ) {
+		CL_CHECK( clReleaseMemObject(this->qInputs) );
+		CL_CHECK( clReleaseMemObject(this->rowScales) );
+	};
+
 	if ( this->inputs )
 		delete [] this->inputs;
-	if ( this->weights )
-		delete [] this->weights;
-	if ( this->biases )
-		delete [] this->biases;
 	if ( this->biasMatrixes )
 		delete [] this->biasMatrixes;
 };
 
+void MLPPredictorOCL::create_slot_buffers(int slot)
+{
+    cl_int status;
+
+	cl_mem *layerInputs = new cl_mem[this->nLayers];
+
+	for (int i = 1; i < this->nLayers; i++ ) {
+		layerInputs[i] = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*this->dimensions[i-1]*this->batchSize,NULL,&status);
+		CL_CHECK(status);
+	};
+
+	layerInputs[0] = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*(this->dimensions[this->nLayers-1])*this->batchSize,NULL,&status);
+	CL_CHECK(status);
+
+	this->slots[slot].inputs = layerInputs;
+};
+
+void MLPPredictorOCL::release_slot_buffers(int slot)
+{
+	if ( ! this->slots[slot].inputs )
+		 return;
+
+	for (int i = 0; i < this->nLayers; i++ )
+		CL_CHECK( clReleaseMemObject(this->slots[slot].inputs[i]) );
+
+	delete [] this->slots[slot].inputs;
+	this->slots[slot].inputs = NULL;
+};
+
 // the following interfaces make calls to OpenCL kernels
 
 void MLPPredictorOCL::expandFloatVectorToMatrix(cl_mem  myVector, cl_mem myMatrix, int width, int height)
 {
-	cmn_expandFloatVectorToMatrix(this->CLCtx->m_queues[0],this->mykerns, myVector, myMatrix, width, height);
+	cmn_expandFloatVectorToMatrix(this->queue,this->mykerns, myVector, myMatrix, width, height);
 };
 
 void MLPPredictorOCL::activate(int layer, cl_mem x, cl_mem y, int width, int height )
 {
 	switch (this->actFuncs[layer] ) {
 	case AFUNC_SIGMOID:
-		cmn_activate_sigmoid(this->CLCtx->m_queues[0],this->mykerns,x,y,width,height);
+		cmn_activate_sigmoid(this->queue,this->mykerns,x,y,width,height);
 		return;
 	case AFUNC_SOFTMAX:
-	    cmn_activate_softmax(this->CLCtx->m_queues[0],this->mykerns,x,y,width,height);
+	    cmn_activate_softmax(this->queue,this->mykerns,x,y,width,height);
 		return;
 	case AFUNC_TANH:
-	    cmn_activate_tanh(this->CLCtx->m_queues[0],this->mykerns,x,y,width,height);
+	    cmn_activate_tanh(this->queue,this->mykerns,x,y,width,height);
 		return;
 	case AFUNC_IDENTITY:
-	    cmn_activate_identity(this->CLCtx->m_queues[0],this->mykerns,x,y,width,height);
+	    cmn_activate_identity(this->queue,this->mykerns,x,y,width,height);
         return;
+	case AFUNC_RELU:
+	    cmn_activate_relu(this->queue,this->mykerns,x,y,width,height,0.0f);
+		return;
+	case AFUNC_LEAKY_RELU:
+	    cmn_activate_relu(this->queue,this->mykerns,x,y,width,height,MLP_LEAKY_RELU_SLOPE);
+		return;
 	default:
 		mlp_log("MLPPredictor", "The assigned activation function for this layer is not supported.");
 		MLP_Exception("");
 	};
 };
 
+// Output = activate(Input + Bias) by one kernel reading the biases vector, returns false if the activation function of the layer
+// has no such fused kernel, then the caller adds the biases and calls activate()
+bool MLPPredictorOCL::activateWithBias(int layer, cl_mem x, cl_mem biases, cl_mem y, int width, int height)
+{
+	switch (this->actFuncs[layer] ) {
+	case AFUNC_RELU:
+		cmn_bias_activate_relu(this->queue,this->mykerns,x,biases,y,width,height,0.0f);
+		return(true);
+	case AFUNC_LEAKY_RELU:
+		cmn_bias_activate_relu(this->queue,this->mykerns,x,biases,y,width,height,MLP_LEAKY_RELU_SLOPE);
+		return(true);
+	case AFUNC_IDENTITY:
+		// nothing is left to do for the bottleneck layers without biases, x and y are always the same buffer here
+		return( this->model->zeroBiases[layer] );
+	default:
+		return(false);
+	};
+};
+
+// Input[layer] = Output[layer-1] * Weight[layer] for "height" number of frames, with the layer buffers of the predicting slot
+void MLPPredictorOCL::forward_weights(cl_mem *layerInputs, int layer, int height)
+{
+	int i = layer;
+
+	if ( this->calibrating )
+		 cmn_absmax_accumulate(this->queue,this->mykerns,layerInputs[i],this->dimensions[i-1]*height,this->ranges,i);
+
+	if ( this->weightType == MLP_DATA_INT8 ) {
+		 cmn_quantize_rows(this->queue,this->mykerns,layerInputs[i],this->qInputs,this->rowScales,this->dimensions[i-1],height,this->model->actScales[i]);
+		 cmn_gemm_int8(this->queue,this->mykerns,this->qInputs,this->model->weights[i],this->rowScales,this->model->weightScales[i],layerInputs[(i+1)%this->nLayers],
+			           height,this->dimensions[i],this->dimensions[i-1],this->weightLayout == MLP_WEIGHTS_TRANSPOSED);
+		 return;
+	};
+
+	if ( this->weightType == MLP_DATA_FLOAT16 ) {
+		 cmn_gemm_half_weights(this->queue,this->mykerns,layerInputs[i],this->model->weights[i],layerInputs[(i+1)%this->nLayers],height,this->dimensions[i],this->dimensions[i-1],
+			                   this->weightLayout == MLP_WEIGHTS_TRANSPOSED);
+		 return;
+	};
+
+	if ( this->weightType == MLP_DATA_BSR ) {
+		 cmn_gemm_bsr(this->queue,this->mykerns,layerInputs[i],this->model->blockRowPtrs[i],this->model->blockColIndices[i],this->model->weights[i],
+			          layerInputs[(i+1)%this->nLayers],height,this->dimensions[i],this->dimensions[i-1]);
+		 return;
+	};
+
+	clAmdBlasStatus blasStatus;
+
+	// the weights matrixes could be stored in the transposed format by the trainer
+	if ( height == 1 ) {
+		 // calculated using WeightT[i]*Output[i] to call the library interface
+		 if ( this->weightLayout == MLP_WEIGHTS_TRANSPOSED )
+		      blasStatus=clAmdBlasSgemv(clAmdBlasRowMajor, clAmdBlasNoTrans, this->dimensions[i], this->dimensions[i-1], 1.0f, this->model->weights[i], this->dimensions[i-1], layerInputs[i],
+		 			0, 1, 0.0f, layerInputs[(i+1)%this->nLayers], 0, 1, 1, &this->queue, 0, NULL, NULL);
+		 else
+		      blasStatus=clAmdBlasSgemv(clAmdBlasRowMajor, clAmdBlasTrans, this->dimensions[i-1], this->dimensions[i], 1.0f, this->model->weights[i], this->dimensions[i], layerInputs[i],
+					0, 1, 0.0f, layerInputs[(i+1)%this->nLayers], 0, 1, 1, &this->queue, 0, NULL, NULL);
+	}
+	else {
+		 if ( this->weightLayout == MLP_WEIGHTS_TRANSPOSED )
+		      blasStatus = clAmdBlasSgemm(clAmdBlasRowMajor,clAmdBlasNoTrans,clAmdBlasTrans,height,this->dimensions[i],this->dimensions[i-1],1.0f,layerInputs[i],
+				    this->dimensions[i-1],this->model->weights[i],this->dimensions[i-1],0.0f,layerInputs[(i+1)%this->nLayers],this->dimensions[i],1,&this->queue,0,NULL,NULL);
+		 else
+		      blasStatus = clAmdBlasSgemm(clAmdBlasRowMajor,clAmdBlasNoTrans,clAmdBlasNoTrans,height,this->dimensions[i],this->dimensions[i-1],1.0f,layerInputs[i],
+				    this->dimensions[i-1],this->model->weights[i],this->dimensions[i],0.0f,layerInputs[(i+1)%this->nLayers],this->dimensions[i],1,&this->queue,0,NULL,NULL);
+	};
+	AMDBLAS_CHECK(blasStatus);
+};
+
+// computes the outputs of "height" number of frames in layerInputs[0] from the inputs in layerInputs[1]
+void MLPPredictorOCL::forward(cl_mem *layerInputs, int height)
+{
+	clAmdBlasStatus blasStatus;
+
+	for (int i = 1; i < nLayers; i++) {
+		 // Input[i] = Output[i-1] * Weight[i]
+		 this->forward_weights(layerInputs, i, height);
+
+		 // Output[i] = activate(Input[i] + Bias[i]) by one kernel for the ReLU layers
+		 if ( ! this->activateWithBias(i, layerInputs[(i+1)%this->nLayers], this->model->biases[i], layerInputs[(i+1)%this->nLayers], this->dimensions[i], height) ) {
+			 // Input[i] = Input[i] + 1.0 * Bias[i],   regarding the two Matrixes as  two vectors
+			 blasStatus = clAmdBlasSaxpy(this->dimensions[i]*height, 1.0f, this->biasMatrixes[i], 0, 1, layerInputs[(i+1)%this->nLayers], 0, 1, 1,
+				                        &this->queue, 0, NULL, NULL);
+			 AMDBLAS_CHECK(blasStatus);
+
+			 // Output[i] = activate(Input[i])
+			this->activate(i, layerInputs[(i+1)%this->nLayers], layerInputs[(i+1)%this->nLayers], this->dimensions[i], height);
+		 };
+	}
+};
+
 void MLPPredictorOCL::batchPredicting(float *inVectors, float *outVectors)
+{
+	this->batchPredicting(inVectors, outVectors, this->batchSize);
+};
+
+// the buffers are allocated for batchSize frames, only the first nFrames rows of them are used
+void MLPPredictorOCL::batchPredicting(float *inVectors, float *outVectors, int nFrames)
 {
 	if ( !this->initialized) {
 		 mlp_log("MLPPredictor", "This Predictor object should be setup with NetProvider and DataProvider first");
 		 MLP_Exception("");
 	};
 
-	clAmdBlasStatus blasStatus;
+	if ( (nFrames < 1) || (nFrames > this->batchSize) ) {
+		 mlp_log("MLPPredictor", "The number of frames to predict should be between 1 and the batch size");
+		 MLP_Exception("");
+	};
 
-	CL_CHECK(clEnqueueWriteBuffer(this->CLCtx->m_queues[0],this->inputs[1],CL_TRUE,0,sizeof(cl_float)*this->dimensions[0]*this->batchSize,inVectors,0,NULL,NULL));
+	// the buffers of slots[0] are also used by submitPredicting()
+	this->waitAllPredicting();
 
-	for (int i = 1; i < nLayers; i++) {
-		 // Input[i] = Output[i-1] * Weight[i]
-		 blasStatus = clAmdBlasSgemm(clAmdBlasRowMajor,clAmdBlasNoTrans,clAmdBlasNoTrans,this->batchSize,this->dimensions[i],this->dimensions[i-1],1.0f,this->inputs[i],
-				this->dimensions[i-1],this->weights[i],this->dimensions[i],0.0f,this->inputs[(i+1)%this->nLayers],this->dimensions[i],1,&this->CLCtx->m_queues[0],0,NULL,NULL);
-		 AMDBLAS_CHECK(blasStatus);
+	this->adopt_new_model();
 
-		 // Input[i] = Input[i] + 1.0 * Bias[i],   regarding the two Matrixes as  two vectors
-		 blasStatus = clAmdBlasSaxpy(this->dimensions[i]*this->batchSize, 1.0f, this->biasMatrixes[i], 0, 1, this->inputs[(i+1)%this->nLayers], 0, 1, 1,
-			                        &this->CLCtx->m_queues[0], 0, NULL, NULL);
-		 AMDBLAS_CHECK(blasStatus);
+	CL_CHECK(clEnqueueWriteBuffer(this->queue,this->inputs[1],CL_TRUE,0,sizeof(cl_float)*this->dimensions[0]*nFrames,inVectors,0,NULL,NULL));
 
-		 // Output[i] = activate(Input[i])
-		this->activate(i, this->inputs[(i+1)%this->nLayers], this->inputs[(i+1)%this->nLayers], this->dimensions[i], this->batchSize);
-	}
+	this->forward(this->inputs, nFrames);
 
 	// read the output vectors from the device to the host layer so that they can be checked
-	CL_CHECK(clEnqueueReadBuffer(this->CLCtx->m_queues[0],this->output,CL_TRUE,0,sizeof(cl_float)*this->dimensions[this->nLayers-1]*this->batchSize,outVectors,0,NULL,NULL));
+	CL_CHECK(clEnqueueReadBuffer(this->queue,this->output,CL_TRUE,0,sizeof(cl_float)*this->dimensions[this->nLayers-1]*nFrames,outVectors,0,NULL,NULL));
 };
 
 void MLPPredictorOCL::singlePredicting(float *inVector, float *outVector)
@@ -257,28 +545,286 @@ void MLPPredictorOCL::singlePredicting(float *inVector, float *outVector)
 
 	clAmdBlasStatus blasStatus;
 
-	CL_CHECK(clEnqueueWriteBuffer(this->CLCtx->m_queues[0],this->inputs[1],CL_TRUE,0,sizeof(cl_float)*this->dimensions[0],inVector,0,NULL,NULL));
+	this->waitAllPredicting();
+
+	this->adopt_new_model();
+
+	CL_CHECK(clEnqueueWriteBuffer(this->queue,this->inputs[1],CL_TRUE,0,sizeof(cl_float)*this->dimensions[0],inVector,0,NULL,NULL));
 
 	for (int i = 1; i < nLayers; i++) {
-		 // Input[i] = Output[i-1] * Weight[i], calculated using WeightT[i]*Output[i] to call the library interface
-		 blasStatus=clAmdBlasSgemv(clAmdBlasRowMajor, clAmdBlasTrans, this->dimensions[i-1], this->dimensions[i], 1.0f, this->weights[i], this->dimensions[i], this->inputs[i],
-					0, 1, 0.0f, this->inputs[(i+1)%this->nLayers], 0, 1, 1, &this->CLCtx->m_queues[0], 0, NULL, NULL);
+		 // Input[i] = Output[i-1] * Weight[i]
+		 this->forward_weights(this->inputs, i, 1);
 
-		 // Input[i] = Input[i] + 1.0 * Bias[i]
-		 blasStatus = clAmdBlasSaxpy(this->dimensions[i], 1.0f, this->biases[i], 0, 1, this->inputs[(i+1)%this->nLayers], 0, 1, 1,
-			                        &this->CLCtx->m_queues[0], 0, NULL, NULL);
+		 // Output[i] = activate(Input[i] + Bias[i]) by one kernel for the ReLU layers
+		 if ( ! this->activateWithBias(i, this->inputs[(i+1)%this->nLayers], this->model->biases[i], this->inputs[(i+1)%this->nLayers], this->dimensions[i], 1) ) {
+			 // Input[i] = Input[i] + 1.0 * Bias[i]
+			 blasStatus = clAmdBlasSaxpy(this->dimensions[i], 1.0f, this->model->biases[i], 0, 1, this->inputs[(i+1)%this->nLayers], 0, 1, 1,
+				                        &this->queue, 0, NULL, NULL);
 
 
-		 AMDBLAS_CHECK(blasStatus);
+			 AMDBLAS_CHECK(blasStatus);
 
-		 // Output[i] = activate(Input[i])
-		this->activate(i, this->inputs[(i+1)%this->nLayers], this->inputs[(i+1)%this->nLayers], this->dimensions[i], 1);
+			 // Output[i] = activate(Input[i])
+			this->activate(i, this->inputs[(i+1)%this->nLayers], this->inputs[(i+1)%this->nLayers], this->dimensions[i], 1);
+		 };
 	}
 
 	// read the output vectors from the device to the host layer so that they can be checked
-	CL_CHECK(clEnqueueReadBuffer(this->CLCtx->m_queues[0],this->output,CL_TRUE,0,sizeof(cl_float)*this->dimensions[this->nLayers-1],outVector,0,NULL,NULL));
+	CL_CHECK(clEnqueueReadBuffer(this->queue,this->output,CL_TRUE,0,sizeof(cl_float)*this->dimensions[this->nLayers-1],outVector,0,NULL,NULL));
+};
+
+// The k largest outputs of each frame are selected on the device, so only k indices and scores for each frame are read back instead
+// of all the outputs, which are thousands of floats for the classification of the speech states
+void MLPPredictorOCL::batchPredictingTopK(float *inVectors, int nFrames, int k, int *outIndices, float *outScores)
+{
+	if ( !this->initialized) {
+		 mlp_log("MLPPredictor", "This Predictor object should be setup with NetProvider and DataProvider first");
+		 MLP_Exception("");
+	};
+
+	if ( (nFrames < 1) || (nFrames > this->batchSize) ) {
+		 mlp_log("MLPPredictor", "The number of frames to predict should be between 1 and the batch size");
+		 MLP_Exception("");
+	};
+
+	if ( (k < 1) || (k > this->dimensions[this->nLayers-1]) ) {
+		 mlp_log("MLPPredictor", "The number of the largest outputs should be between 1 and the output vector size");
+		 MLP_Exception("");
+	};
+
+	this->waitAllPredicting();
+
+	this->adopt_new_model();
+
+	if ( k > this->topK ) {
+		 cl_int status;
+
+		 if ( this->topK > 0 ) {
+			  CL_CHECK( clReleaseMemObject(this->topIndices) );
+			  CL_CHECK( clReleaseMemObject(this->topScores) );
+		 };
+
+		 this->topIndices = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_int)*k*this->batchSize, NULL, &status);
+		 CL_CHECK(status);
+		 this->topScores = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*k*this->batchSize, NULL, &status);
+		 CL_CHECK(status);
+
+		 this->topK = k;
+	};
+
+	CL_CHECK(clEnqueueWriteBuffer(this->queue,this->inputs[1],CL_TRUE,0,sizeof(cl_float)*this->dimensions[0]*nFrames,inVectors,0,NULL,NULL));
+
+	this->forward(this->inputs, nFrames);
+
+	cmn_topk_rows(this->queue,this->mykerns,this->output,this->topIndices,this->topScores,this->dimensions[this->nLayers-1],nFrames,k);
+
+	if ( outScores )
+		 CL_CHECK(clEnqueueReadBuffer(this->queue,this->topScores,CL_FALSE,0,sizeof(cl_float)*k*nFrames,outScores,0,NULL,NULL));
+	CL_CHECK(clEnqueueReadBuffer(this->queue,this->topIndices,CL_TRUE,0,sizeof(cl_int)*k*nFrames,outIndices,0,NULL,NULL));
+};
+
+// The input transfer is enqueued on the upload queue, the computing on the computing queue waits for it, and the output
+// transfer on the readback queue waits for the computing, so the transfers of one batch run while the device computes
+// another batch in flight
+int MLPPredictorOCL::submitPredicting(float *inVectors, float *outVectors, int nFrames)
+{
+	if ( !this->initialized) {
+		 mlp_log("MLPPredictor", "This Predictor object should be setup with NetProvider and DataProvider first");
+		 MLP_Exception("");
+	};
+
+	if ( (nFrames < 1) || (nFrames > this->batchSize) ) {
+		 mlp_log("MLPPredictor", "The number of frames to predict should be between 1 and the batch size");
+		 MLP_Exception("");
+	};
+
+	int ticket = this->nextTicket;
+	int slot = ticket % MLP_PREDICT_SLOTS;
+
+	this->nextTicket = (this->nextTicket + 1) & 0x7fffffff;
+
+	if ( this->slots[slot].ticket >= 0 )
+		 this->waitPredicting(this->slots[slot].ticket);
+
+	if ( ! this->slots[slot].inputs )
+		 this->create_slot_buffers(slot);
+
+	this->adopt_new_model();
+
+	struct mlp_predict_slot *sp = &this->slots[slot];
+
+	CL_CHECK(clEnqueueWriteBuffer(this->uploadQueue,sp->inputs[1],CL_FALSE,0,sizeof(cl_float)*this->dimensions[0]*nFrames,inVectors,0,NULL,&sp->writeEvent));
+	CL_CHECK(clFlush(this->uploadQueue));
+
+	// the OpenCL 1.2 barrier and marker order the compute queue after the upload, and the readback after the computing
+	CL_CHECK(clEnqueueBarrierWithWaitList(this->queue,1,&sp->writeEvent,NULL));
+	this->forward(sp->inputs, nFrames);
+	CL_CHECK(clEnqueueMarkerWithWaitList(this->queue,0,NULL,&sp->computeEvent));
+	CL_CHECK(clFlush(this->queue));
+
+	CL_CHECK(clEnqueueReadBuffer(this->readbackQueue,sp->inputs[0],CL_FALSE,0,sizeof(cl_float)*this->dimensions[this->nLayers-1]*nFrames,outVectors,1,&sp->computeEvent,&sp->readEvent));
+	CL_CHECK(clFlush(this->readbackQueue));
+
+	sp->ticket = ticket;
+
+	return(ticket);
+};
+
+// returns at once if the batch of the ticket has been waited for already
+void MLPPredictorOCL::waitPredicting(int ticket)
+{
+	if ( ticket < 0 )
+		 return;
+
+	struct mlp_predict_slot *sp = &this->slots[ticket % MLP_PREDICT_SLOTS];
+
+	if ( sp->ticket != ticket )
+		 return;
+
+	CL_CHECK(clWaitForEvents(1,&sp->readEvent));
+
+	CL_CHECK(clReleaseEvent(sp->writeEvent));
+	CL_CHECK(clReleaseEvent(sp->computeEvent));
+	CL_CHECK(clReleaseEvent(sp->readEvent));
+
+	sp->ticket = -1;
+};
+
+void MLPPredictorOCL::waitAllPredicting()
+{
+	for (int s = 0; s < MLP_PREDICT_SLOTS; s++)
+		 if ( this->slots[s].ticket >= 0 )
+			  this->waitPredicting(this->slots[s].ticket);
+};
+
+void MLPPredictorOCL::startCalibration()
+{
+	if ( !this->initialized) {
+		 mlp_log("MLPPredictor", "This Predictor object should be setup with NetProvider and DataProvider first");
+		 MLP_Exception("");
+	};
+
+	// the ranges buffer is only needed by the calibration, so it is created by the first calibration of the predictor
+	if ( ! this->ranges ) {
+		 cl_int status;
+
+		 this->ranges = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*this->nLayers, NULL, &status);
+		 CL_CHECK(status);
+	};
+
+	float *zeros = new float[this->nLayers];
+
+	for (int i=0; i < this->nLayers; i++)
+		 zeros[i] = 0.0f;
+
+	CL_CHECK(clEnqueueWriteBuffer(this->queue,this->ranges,CL_TRUE,0,sizeof(cl_float)*this->nLayers,zeros,0,NULL,NULL));
+
+	delete [] zeros;
+
+	this->calibrating = true;
 };
 
+void MLPPredictorOCL::getActivationRanges(float *_ranges)
+{
+	if ( !this->calibrating ) {
+		 mlp_log("MLPPredictor", "The calibration of this Predictor object is not started");
+		 MLP_Exception("");
+	};
+
+	CL_CHECK(clEnqueueReadBuffer(this->queue,this->ranges,CL_TRUE,0,sizeof(cl_float)*this->nLayers,_ranges,0,NULL,NULL));
+
+	_ranges[0] = 0.0f;
+};
 
+MLPDeviceModelOCL *MLPPredictorOCL::getDeviceModel()
+{
+	return(this->model);
+};
 
+// Moves to the latest model reloaded, at the start of a batch. The batches in flight keep using the buffers of the old model,
+// since OpenCL only frees the memory objects released after the commands using them are finished, and their bias matrixes,
+// since the new ones are expanded on the computing queue after them
+void MLPPredictorOCL::adopt_new_model()
+{
+	MLPDeviceModelOCL *next = this->model->getSuccessor();
 
+	if ( ! next )
+		 return;
+
+	while ( next ) {
+		next->retain();
+		this->model->release();
+		this->model = next;
+
+		next = this->model->getSuccessor();
+	};
+
+	for (int i = 0; i < this->nLayers; i++)
+		this->actFuncs[i] = this->model->actFuncs[i];
+	this->weightLayout = this->model->weightLayout;
+
+	for (int i = 1; i < this->nLayers; i++)
+		this->expandFloatVectorToMatrix(this->model->biases[i],this->biasMatrixes[i],this->dimensions[i],this->batchSize);
+};
+
+void MLPPredictorOCL::reloadModel(const char *dir, const char *nnetFile)
+{
+	if ( !this->initialized) {
+		 mlp_log("MLPPredictor", "This Predictor object should be setup with NetProvider and DataProvider first");
+		 MLP_Exception("");
+	};
+
+	// one reloading at a time
+	if ( this->reloading ) {
+		 DNN_JOIN_THREAD(this->loader);
+		 this->reloading = false;
+	};
+
+	this->reloadDir = dir;
+	this->reloadFile = nnetFile;
+	this->reloadBase = this->model;
+	this->reloadBase->retain();
+
+	DNN_CREATE_THREAD(&this->loader, loader_fun, this);
+	this->reloading = true;
+};
+
+// The loader thread reads the neural network and uploads it with its own command queue, so the uploading overlaps with
+// the computing of the predictors instead of being queued behind it
+void *MLPPredictorOCL::loader_fun(void *argp)
+{
+	MLPPredictorOCL *objp = (MLPPredictorOCL *)argp;
+	MLPDeviceModelOCL *newModel = NULL;
+	cl_command_queue loadQueue = NULL;
+
+	try {
+		 MLPConfigProvider provider(objp->reloadDir.c_str(), objp->reloadFile.c_str());
+
+		 if ( objp->reloadBase->sameDimensions(provider) ) {
+			  cl_int status;
+
+			  loadQueue = clCreateCommandQueue(objp->CLCtx->m_context, objp->CLCtx->m_device, 0, &status);
+			  CL_CHECK( status );
+
+			  newModel = new MLPDeviceModelOCL(provider, objp->CLCtx->m_context, loadQueue, objp->reloadBase->weightType);
+		 }
+		 else
+			  mlp_log("MLPPredictor", "The layer dimensions of the reloaded neural network are different, the reloading is ignored");
+	}
+	catch (std::exception &e) {
+		 mlp_log("MLPPredictor", "Failed to reload the neural network, the current one is kept");
+	};
+
+	if ( loadQueue )
+		 clReleaseCommandQueue(loadQueue);
+
+	if ( newModel ) {
+		 objp->reloadBase->appendSuccessor(newModel);
+		 newModel->release();
+	};
+
+	objp->reloadBase->release();
+	objp->reloadBase = NULL;
+
+	return(NULL);
+};
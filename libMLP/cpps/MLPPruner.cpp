@@ -0,0 +1,121 @@
+/*
+ *  COPYRIGHT:  Copyright (c) 2014 Advanced Micro Devices, Inc.  All rights reserved
+ *
+ *   Prunes a trained neural network by zeroing the DNN_BSR_BLOCK x DNN_BSR_BLOCK blocks of each weights matrix having the smallest
+ *   magnitudes, and saves the neural network with the weights in the block sparse format used by MLPPredictorOCL with MLP_DATA_BSR
+ */
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+
+#include "MLPUtil.h"
+#include "MLPPruner.h"
+#include "conv_bsr.h"
+
+using namespace std;
+
+
+MLPPruner::MLPPruner(MLPConfigProvider &configProvider)
+{
+	this->configProviderp = &configProvider;
+	this->nLayers = configProvider.nLayers;
+};
+
+MLPPruner::~MLPPruner()
+{
+};
+
+void MLPPruner::checkLayer(int layer)
+{
+	if ( (layer < 1) || (layer >= this->nLayers) ) {
+		 mlp_log("MLPPruner", "Invalid layer number");
+		 MLP_Exception("");
+	};
+};
+
+// the blocks are ranked by the sum of the squares of their values, so the pruned matrix is stored and computed by whole blocks.
+// The weights are pruned on the host copy kept by the MLPConfigProvider
+float MLPPruner::prune(int layer, float sparsity)
+{
+	this->checkLayer(layer);
+
+	if ( (sparsity < 0.0f) || (sparsity >= 1.0f) ) {
+		 mlp_log("MLPPruner", "The sparsity should be in [0, 1)");
+		 MLP_Exception("");
+	};
+
+	MLPConfigProvider *provider = this->configProviderp;
+	bool transposed = (provider->weightLayout == MLP_WEIGHTS_TRANSPOSED);
+	int rows = transposed? provider->dimensions[layer] : provider->dimensions[layer-1];
+	int cols = transposed? provider->dimensions[layer-1] : provider->dimensions[layer];
+	int blockCols = BSRBlocks(cols);
+	float *weights = provider->weights[layer];
+
+	vector< pair<float,int> > norms((size_t)BSRBlocks(rows)*blockCols);
+
+	for (int r=0; r < rows; r++)
+		 for (int c=0; c < cols; c++) {
+			  float w = weights[(size_t)r*cols+c];
+			  pair<float,int> &blockNorm = norms[(size_t)(r/DNN_BSR_BLOCK)*blockCols + c/DNN_BSR_BLOCK];
+
+			  blockNorm.first += w*w;
+		 };
+
+	for (size_t b=0; b < norms.size(); b++)
+		 norms[b].second = (int)b;
+
+	size_t nPruned = (size_t)(sparsity*norms.size());
+
+	// only the nPruned blocks with the smallest norms need to be found, not sorted
+	if ( nPruned > 0 && nPruned < norms.size() )
+		 nth_element(norms.begin(), norms.begin()+nPruned, norms.end());
+
+	for (size_t b=0; b < nPruned; b++) {
+		 int br = norms[b].second / blockCols;
+		 int bc = norms[b].second % blockCols;
+
+		 for (int r=br*DNN_BSR_BLOCK; (r < rows) && (r < (br+1)*DNN_BSR_BLOCK); r++)
+			  for (int c=bc*DNN_BSR_BLOCK; (c < cols) && (c < (bc+1)*DNN_BSR_BLOCK); c++)
+				   weights[(size_t)r*cols+c] = 0.0f;
+	};
+
+	return( this->getSparsity(layer) );
+};
+
+float MLPPruner::pruneAll(float sparsity)
+{
+	MLPConfigProvider *provider = this->configProviderp;
+	double zeroBlocks = 0.0, totalBlocks = 0.0;
+
+	for (int i=1; i < this->nLayers; i++) {
+		 double nBlocks = (double)BSRBlocks(provider->dimensions[i-1])*BSRBlocks(provider->dimensions[i]);
+
+		 zeroBlocks += this->prune(i, sparsity)*nBlocks;
+		 totalBlocks += nBlocks;
+	};
+
+	return( (float)(zeroBlocks/totalBlocks) );
+};
+
+float MLPPruner::getSparsity(int layer)
+{
+	this->checkLayer(layer);
+
+	MLPConfigProvider *provider = this->configProviderp;
+	bool transposed = (provider->weightLayout == MLP_WEIGHTS_TRANSPOSED);
+	int rows = transposed? provider->dimensions[layer] : provider->dimensions[layer-1];
+	int cols = transposed? provider->dimensions[layer-1] : provider->dimensions[layer];
+	size_t nBlocks = (size_t)BSRBlocks(rows)*BSRBlocks(cols);
+
+	return( 1.0f - (float)FloatMatrixBSRBlocks(provider->weights[layer], rows, cols)/nBlocks );
+};
+
+void MLPPruner::savePrunedConfig(const char *dir, const char *trainingConfigFile, const char *nnetDataFile)
+{
+	MLP_DATA_TYPE oldType = this->configProviderp->getStorageType();
+
+	this->configProviderp->setStorageType(MLP_DATA_BSR);
+	this->configProviderp->saveConfig(dir, trainingConfigFile, nnetDataFile);
+	this->configProviderp->setStorageType(oldType);
+};
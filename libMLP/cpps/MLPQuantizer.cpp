@@ -0,0 +1,96 @@
+/*
+ *  COPYRIGHT:  Copyright (c) 2014 Advanced Micro Devices, Inc.  All rights reserved
+ *
+ *   Calibrates the int8 scales for the inputs of each layer by running a dataset through the float neural network,
+ *   and saves the neural network with int8 weights and the calibrated scales
+ */
+
+#include "MLPUtil.h"
+#include "MLPPredictorOCL.h"
+#include "MLPQuantizer.h"
+
+
+MLPQuantizer::MLPQuantizer(MLPConfigProvider &configProvider, DNNDataProvider &dataProvider, DNN_OCL_DEVTYPE _devType, int _batchSize)
+{
+	if ( (dataProvider.getDataMode() != DNN_DATAMODE_TEST) && (dataProvider.getDataMode() != DNN_DATAMODE_PREDICT) ) {
+		 mlp_log("MLPQuantizer", "The DataProvider should be in TEST or PREDICT mode for the calibration");
+		 MLP_Exception("");
+	};
+
+	if ( (dataProvider.getFeatureSize() != configProvider.getInputLayerSize()) || (dataProvider.getBatchSize() != _batchSize) ) {
+		 mlp_log("MLPQuantizer", "The DataProvider does not match the neural network or the batch size");
+		 MLP_Exception("");
+	};
+
+	this->configProviderp = &configProvider;
+	this->dataProviderp = &dataProvider;
+	this->devType = _devType;
+	this->batchSize = _batchSize;
+
+	this->nLayers = configProvider.nLayers;
+	this->ranges = NULL;
+	this->calibrated = false;
+};
+
+MLPQuantizer::~MLPQuantizer()
+{
+	if ( this->ranges )
+		 delete [] this->ranges;
+};
+
+int MLPQuantizer::calibrate(int maxBatches)
+{
+	MLPPredictorOCL predictor(*this->configProviderp, this->devType, this->batchSize);
+
+	float *features;
+	float *outputs = new float[predictor.getOutputVectorSize()*this->batchSize];
+
+	predictor.startCalibration();
+
+	int batches=0;
+	while ( this->dataProviderp->batchAvailable() && ( maxBatches == 0 || batches < maxBatches ) ) {
+		  MLP_CHECK(this->dataProviderp->getBatchData(this->batchSize,features,true));
+
+		  predictor.batchPredicting(features, outputs, this->dataProviderp->getValidFrames());
+
+		  // tell the data provider that I have done with current batch of data, want next batch of data
+		  MLP_CHECK(this->dataProviderp->nextBatch());
+
+		  batches++;
+	};
+
+	delete [] outputs;
+
+	if ( ! this->ranges )
+		 this->ranges = new float[this->nLayers];
+
+	predictor.getActivationRanges(this->ranges);
+
+	this->calibrated = (batches > 0);
+
+	return(batches);
+};
+
+// the int8 inputs of layer i are restored by ranges[i]/127, layers that never saw a non-zero input are left to scale dynamically
+void MLPQuantizer::saveQuantizedConfig(const char *dir, const char *trainingConfigFile, const char *nnetDataFile)
+{
+	if ( ! this->calibrated ) {
+		 mlp_log("MLPQuantizer", "The calibration should be done before saving the quantized neural network");
+		 MLP_Exception("");
+	};
+
+	float *scales = new float[this->nLayers];
+
+	scales[0] = 0.0f;
+	for (int i=1; i < this->nLayers; i++)
+		 scales[i] = this->ranges[i]/127.0f;
+
+	MLP_DATA_TYPE oldType = this->configProviderp->getStorageType();
+
+	this->configProviderp->setActivationScales(scales);
+	this->configProviderp->setStorageType(MLP_DATA_INT8);
+	this->configProviderp->saveConfig(dir, trainingConfigFile, nnetDataFile);
+	this->configProviderp->setStorageType(oldType);
+
+	delete [] scales;
+};
@@ -17,6 +17,7 @@ MLPTesterBase::MLPTesterBase()
 	this->batchSize = 0;
 
 	this->actFuncs = NULL;
+	this->weightLayout = MLP_WEIGHTS_ROWMAJOR;
 
 	this->dataProviderp = NULL;
 	this->initialized = false;
@@ -41,6 +42,8 @@ void MLPTesterBase::_initialize(MLPConfigProvider & provider, int _batchSize)
 	for ( int i = 0; i < this->nLayers; i++ )
 		this->actFuncs[i] = provider.actFuncs[i];
 
+	this->weightLayout = provider.weightLayout;
+
 }
 
 // only called by the destructor
@@ -13,6 +13,7 @@
 #include "MLPUtil.h"
 #include "MLPOclCommon.h"
 #include "MLPTesterOCL.h"
+#include "DNNTracer.h"
 
 
 //Class specific member shared by all instances
@@ -119,10 +120,15 @@ void MLPTesterOCL::setup_ocl_kernels()
 		CL_CHECK( status );
 		this->mykerns.activate_tanh_kernel = clCreateKernel(this->CLCtx->m_program,"activate_tanh",&status);
 		CL_CHECK( status );
+		this->mykerns.activate_relu_kernel = clCreateKernel(this->CLCtx->m_program,"activate_relu",&status);
+		CL_CHECK( status );
+		this->mykerns.bias_activate_relu_kernel = clCreateKernel(this->CLCtx->m_program,"bias_activate_relu",&status);
+		CL_CHECK( status );
 
         this->mykerns.expandMatrix_kernel = clCreateKernel(this->CLCtx->m_program,"expandVectorToMatrix",&status);
 	    CL_CHECK( status );
 
+		this->mykerns.profiler = NULL;
 }
 
 void MLPTesterOCL::destroy_ocl_kernels()
@@ -131,6 +137,8 @@ void MLPTesterOCL::destroy_ocl_kernels()
 	    CL_CHECK( clReleaseKernel(this->mykerns.activate_softmax_kernel1) );
         CL_CHECK( clReleaseKernel(this->mykerns.activate_softmax_kernel2) );
 	    CL_CHECK( clReleaseKernel(this->mykerns.activate_tanh_kernel) );
+	    CL_CHECK( clReleaseKernel(this->mykerns.activate_relu_kernel) );
+	    CL_CHECK( clReleaseKernel(this->mykerns.bias_activate_relu_kernel) );
 		CL_CHECK( clReleaseKernel(this->mykerns.expandMatrix_kernel) );
 
 		CL_CHECK( clReleaseProgram(this->CLCtx->m_program) );
@@ -228,12 +236,34 @@ void MLPTesterOCL::activate(int layer, cl_mem x, cl_mem y, int width, int height
 	case AFUNC_IDENTITY:
 	    cmn_activate_identity(this->CLCtx->m_queues[0],this->mykerns,x,y,width,height);
         return;
+	case AFUNC_RELU:
+	    cmn_activate_relu(this->CLCtx->m_queues[0],this->mykerns,x,y,width,height,0.0f);
+		return;
+	case AFUNC_LEAKY_RELU:
+	    cmn_activate_relu(this->CLCtx->m_queues[0],this->mykerns,x,y,width,height,MLP_LEAKY_RELU_SLOPE);
+		return;
 	default:
 		mlp_log("MLPTester", "The assigned activation function for this layer is not supported.");
 		MLP_Exception("");
 	};
 };
 
+// Output = activate(Input + Bias) by one kernel reading the biases vector, returns false if the activation function of the layer
+// has no such fused kernel, then the caller adds the biases and calls activate()
+bool MLPTesterOCL::activateWithBias(int layer, cl_mem x, cl_mem biases, cl_mem y, int width, int height)
+{
+	switch (this->actFuncs[layer] ) {
+	case AFUNC_RELU:
+		cmn_bias_activate_relu(this->CLCtx->m_queues[0],this->mykerns,x,biases,y,width,height,0.0f);
+		return(true);
+	case AFUNC_LEAKY_RELU:
+		cmn_bias_activate_relu(this->CLCtx->m_queues[0],this->mykerns,x,biases,y,width,height,MLP_LEAKY_RELU_SLOPE);
+		return(true);
+	default:
+		return(false);
+	};
+};
+
 
 void MLPTesterOCL::batchTesting(int maxBatches)
 {
@@ -243,6 +273,10 @@ void MLPTesterOCL::batchTesting(int maxBatches)
 	};
 
 	clAmdBlasStatus blasStatus;
+	clAmdBlasTranspose transW;
+
+	// the weights matrixes could be stored in the transposed format by the trainer
+	transW = (this->weightLayout == MLP_WEIGHTS_TRANSPOSED)? clAmdBlasTrans : clAmdBlasNoTrans;
 
 	// the inputs for the MLP training
 	float *features=NULL;        // buffer for minibatch number of input vectors
@@ -259,31 +293,48 @@ void MLPTesterOCL::batchTesting(int maxBatches)
 	int batches=0;
 	while ( this->dataProviderp->batchAvailable() && ( maxBatches == 0 || batches < maxBatches ) ) {
 
+			DNNTraceSpan span(DNN_TRACE_TESTER, "wait_batch");
+
 			MLP_CHECK(this->dataProviderp->getBatchData(this->batchSize,features,labels,true));
 
-			CL_CHECK(clEnqueueWriteBuffer(this->CLCtx->m_queues[0],this->inputs[1],CL_TRUE,0,sizeof(cl_float)*this->dimensions[0]*this->batchSize,features,0,NULL,NULL));
+			span.next("upload");
+
+			// the padding frames of the last batch are neither computed nor counted
+			int nFrames = this->dataProviderp->getValidFrames();
+
+			CL_CHECK(clEnqueueWriteBuffer(this->CLCtx->m_queues[0],this->inputs[1],CL_TRUE,0,sizeof(cl_float)*this->dimensions[0]*nFrames,features,0,NULL,NULL));
+
+			span.next("forward");
 
 			for (int i = 1; i < nLayers; i++) {
 				// Input[i] = Output[i-1] * Weight[i]
-				blasStatus = clAmdBlasSgemm(clAmdBlasRowMajor,clAmdBlasNoTrans,clAmdBlasNoTrans,this->batchSize,this->dimensions[i],this->dimensions[i-1],1.0f,this->inputs[i],
-					this->dimensions[i-1],this->weights[i],this->dimensions[i],0.0f,this->inputs[(i+1)%this->nLayers],this->dimensions[i],1,&this->CLCtx->m_queues[0],0,NULL,NULL);
+				blasStatus = clAmdBlasSgemm(clAmdBlasRowMajor,clAmdBlasNoTrans,transW,nFrames,this->dimensions[i],this->dimensions[i-1],1.0f,this->inputs[i],
+					this->dimensions[i-1],this->weights[i],(transW==clAmdBlasTrans)? this->dimensions[i-1]:this->dimensions[i],0.0f,this->inputs[(i+1)%this->nLayers],this->dimensions[i],1,&this->CLCtx->m_queues[0],0,NULL,NULL);
 				AMDBLAS_CHECK(blasStatus);
 
-				// Input[i] = Input[i] + 1.0 * Bias[i],   regarding the two Matrixes as  two vectors
-				blasStatus = clAmdBlasSaxpy(this->dimensions[i]*this->batchSize, 1.0f, this->biasMatrixes[i], 0, 1, this->inputs[(i+1)%this->nLayers], 0, 1, 1,
-					                        &this->CLCtx->m_queues[0], 0, NULL, NULL);
-				AMDBLAS_CHECK(blasStatus);
+				// Output[i] = activate(Input[i] + Bias[i]) by one kernel for the ReLU layers
+				if ( ! this->activateWithBias(i, this->inputs[(i+1)%this->nLayers], this->biases[i], this->inputs[(i+1)%this->nLayers], this->dimensions[i], nFrames) ) {
+					// Input[i] = Input[i] + 1.0 * Bias[i],   regarding the two Matrixes as  two vectors
+					blasStatus = clAmdBlasSaxpy(this->dimensions[i]*nFrames, 1.0f, this->biasMatrixes[i], 0, 1, this->inputs[(i+1)%this->nLayers], 0, 1, 1,
+						                        &this->CLCtx->m_queues[0], 0, NULL, NULL);
+					AMDBLAS_CHECK(blasStatus);
 
-				// Output[i] = activate(Input[i])
-				this->activate(i, this->inputs[(i+1)%this->nLayers], this->inputs[(i+1)%this->nLayers], this->dimensions[i], this->batchSize);
+					// Output[i] = activate(Input[i])
+					this->activate(i, this->inputs[(i+1)%this->nLayers], this->inputs[(i+1)%this->nLayers], this->dimensions[i], nFrames);
+				};
 			}
 
+			// the forward span is only the enqueuing of the commands, the readback span also includes waiting for their execution
+			span.next("readback");
+
 			// read the output vectors from the device to the host layer so that they can be checked
-			CL_CHECK(clEnqueueReadBuffer(this->CLCtx->m_queues[0],this->output,CL_TRUE,0,sizeof(cl_float)*this->dimensions[this->nLayers-1]*this->batchSize,outputs,0,NULL,NULL));
+			CL_CHECK(clEnqueueReadBuffer(this->CLCtx->m_queues[0],this->output,CL_TRUE,0,sizeof(cl_float)*this->dimensions[this->nLayers-1]*nFrames,outputs,0,NULL,NULL));
+
+			span.next("matching");
 
-			this->totalTestFrames += this->batchSize;
+			this->totalTestFrames += nFrames;
 			int succCount=0;
-			for (int i=0; i< this->batchSize; i++) {
+			for (int i=0; i< nFrames; i++) {
 				if ( this->dataProviderp->frameMatching(&outputs[i*veclen], &labels[i*veclen], veclen) )  // output vector matches the label vector
 					 succCount++;
 			};
@@ -325,20 +376,27 @@ bool MLPTesterOCL::singleTesting(float *inVector, float *labelVector, VECTOR_MAT
 		 //  this->dimensions[i-1],this->weights[i],this->dimensions[i],0.0f,this->inputs[(i+1)%this->nLayers],this->dimensions[i],1,&this->CLCtx->m_queues[0],0,NULL,NULL);
 
 		 // Input[i] = Output[i-1] * Weight[i], calculated using WeightT[i]*Output[i] to call the library interface
-		 blasStatus=clAmdBlasSgemv(clAmdBlasRowMajor, clAmdBlasTrans, this->dimensions[i-1], this->dimensions[i], 1.0f, this->weights[i], this->dimensions[i], this->inputs[i],
+		 if ( this->weightLayout == MLP_WEIGHTS_TRANSPOSED )
+		      blasStatus=clAmdBlasSgemv(clAmdBlasRowMajor, clAmdBlasNoTrans, this->dimensions[i], this->dimensions[i-1], 1.0f, this->weights[i], this->dimensions[i-1], this->inputs[i],
+		 			0, 1, 0.0f, this->inputs[(i+1)%this->nLayers], 0, 1, 1, &this->CLCtx->m_queues[0], 0, NULL, NULL);
+		 else
+		      blasStatus=clAmdBlasSgemv(clAmdBlasRowMajor, clAmdBlasTrans, this->dimensions[i-1], this->dimensions[i], 1.0f, this->weights[i], this->dimensions[i], this->inputs[i],
 		 			0, 1, 0.0f, this->inputs[(i+1)%this->nLayers], 0, 1, 1, &this->CLCtx->m_queues[0], 0, NULL, NULL);
 
 		 AMDBLAS_CHECK(blasStatus);
 
-		 // Input[i] = Input[i] + 1.0 * Bias[i]
-		 blasStatus = clAmdBlasSaxpy(this->dimensions[i], 1.0f, this->biases[i], 0, 1, this->inputs[(i+1)%this->nLayers], 0, 1, 1,
-			                        &this->CLCtx->m_queues[0], 0, NULL, NULL);
+		 // Output[i] = activate(Input[i] + Bias[i]) by one kernel for the ReLU layers
+		 if ( ! this->activateWithBias(i, this->inputs[(i+1)%this->nLayers], this->biases[i], this->inputs[(i+1)%this->nLayers], this->dimensions[i], 1) ) {
+			 // Input[i] = Input[i] + 1.0 * Bias[i]
+			 blasStatus = clAmdBlasSaxpy(this->dimensions[i], 1.0f, this->biases[i], 0, 1, this->inputs[(i+1)%this->nLayers], 0, 1, 1,
+				                        &this->CLCtx->m_queues[0], 0, NULL, NULL);
 
 
-		 AMDBLAS_CHECK(blasStatus);
+			 AMDBLAS_CHECK(blasStatus);
 
-		 // Output[i] = activate(Input[i])
-		 this->activate(i, this->inputs[(i+1)%this->nLayers], this->inputs[(i+1)%this->nLayers], this->dimensions[i], 1);
+			 // Output[i] = activate(Input[i])
+			 this->activate(i, this->inputs[(i+1)%this->nLayers], this->inputs[(i+1)%this->nLayers], this->dimensions[i], 1);
+		 };
 	}
 
 	// read the output vectors from the device to the host layer so that they can be checked
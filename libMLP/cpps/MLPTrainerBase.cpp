@@ -22,6 +22,8 @@ MLPTrainerBase::MLPTrainerBase()
 	this->actFuncs = NULL;
 
 	this->currBatchNo = 0;
+	this->pendingBatches = 0;
+	this->cpRequest = NULL;
 
 	DNN_LOCK_INIT(&this->chkPointingLock);
 
@@ -59,6 +61,8 @@ void MLPTrainerBase::_initialize(MLPConfigProvider & provider, int _minibatch)
 	this->costFunc = provider.costFunc;
 	this->momentum = provider.momentum;
 	this->epochs = provider.epochs; 
+	this->sampledClasses = provider.sampledClasses;
+	this->accumulateSteps = provider.accumulateSteps;
 }
 
 // only called by the destructor
@@ -98,11 +102,38 @@ void MLPTrainerBase::showNetConfig()
 };
 
 
+// a checkpoint taken inside an accumulation group would lose the variances summed for the group and resume out of step with
+// the groups, so if a group is in progress, the checkpoint is left to the training to take at the end of the group
 void MLPTrainerBase::checkPointing(struct MLPCheckPointState &cpState)
 {
 
 	 DNN_LOCK(&this->chkPointingLock);          // need be lock protected from the Training of MLPTrainer
 
+	 if ( this->pendingBatches == 0 )
+		  this->_takeCheckPoint(cpState);
+	 else {
+		  this->cpRequest = &cpState;
+		  while ( this->cpRequest ) {
+			   DNN_UNLOCK(&this->chkPointingLock);
+			   DNN_SLEEP(1);
+			   DNN_LOCK(&this->chkPointingLock);
+		  };
+	 };
+
+     DNN_UNLOCK(&this->chkPointingLock);
+}
+
+void MLPTrainerBase::_checkPointAtGroupEnd()
+{
+	 if ( this->cpRequest && (this->pendingBatches == 0) ) {
+		  this->_takeCheckPoint(*this->cpRequest);
+		  this->cpRequest = NULL;
+	 };
+}
+
+// should be called with chkPointingLock held
+void MLPTrainerBase::_takeCheckPoint(struct MLPCheckPointState &cpState)
+{
      // Snapshot one value of BatchNo as the state checkpointed from the MLPTrainer
      cpState.cpBatchNo = (unsigned int) this->currBatchNo;
 	 cpState.cpEpoch = (unsigned int) this->currEpoch;
@@ -116,8 +147,6 @@ void MLPTrainerBase::checkPointing(struct MLPCheckPointState &cpState)
      MLPConfigProvider  netProvider(this->nLayers,this->dimensions,false);
      this->synchronizeNetConfig(netProvider);
      netProvider.saveConfig(cpState.netConfPath, cpState.ncTrainingConfigFname, cpState.ncNNetDataFname);
-
-     DNN_UNLOCK(&this->chkPointingLock);
 }
 
 int MLPTrainerBase::batchTraining(int maxBatches)
@@ -0,0 +1,767 @@
+/*
+ *  COPYRIGHT:  Copyright (c) 2014 Advanced Micro Devices, Inc.  All rights reserved
+ *
+ *   Data-parallel training of the MLP network on several OpenCL devices, each device keeps one replica of the network and trains
+ *   its part of each minibatch, the weights variances of all devices are summed on the host and the same update is applied by
+ *   every device, so the replicas stay identical
+ */
+
+#include <algorithm>
+#include <clAmdBlas.h>
+
+#include "MLPUtil.h"
+#include "MLPOclCommon.h"
+#include "MLPTrainerMultiOCL.h"
+#include "MLPChkPointState.h"
+
+
+MLPTrainerMultiOCL::MLPTrainerMultiOCL(MLPConfigProvider & configProvider, DNNDataProvider & dataProvider, DNN_OCL_DEVTYPE dType, int _nDevices, int _minibatch)
+{
+   	this->devType = dType;
+	this->nDevices = _nDevices;
+
+	if ( (_nDevices < 1) || (_nDevices > _minibatch) ) {
+		 mlp_log("MLPTrainer", "The number of devices should be between 1 and the size of the minibatch");
+		 MLP_Exception("");
+	};
+
+	this->CLCtx = new MultiDevClass(this->devType, this->nDevices);
+
+	clAmdBlasSetup();
+
+	this->setup_ocl_kernels();
+
+	this->setupMLP(configProvider, dataProvider, _minibatch);
+}
+
+
+void MLPTrainerMultiOCL::setupMLP(MLPConfigProvider & configProvider, DNNDataProvider & dataProvider, int _minibatch)
+{
+ 	if (  ( configProvider.getInputLayerSize() != dataProvider.getFeatureSize() ) ||
+		  ( configProvider.getOutputLayerSize() != dataProvider.getLabelSize() )   ) {
+		   mlp_log("MLPTrainer", "The setting provided from MLPDataProvider doesn't match those of the MLPConfigProvider");
+		   MLP_Exception("");
+	};
+
+	if (  (_minibatch != dataProvider.getBatchSize()) || dataProvider.getDataMode() != DNN_DATAMODE_SP_TRAIN) {
+		   mlp_log("MLPTrainer", "The setting of the MLPDataProvider doesn't match the need of the MLPTrainer");
+		   MLP_Exception("");
+	};
+
+	this->_initialize(configProvider, _minibatch);
+
+	// the setting is kept for saving the configuration, but the replicas always train with the full softmax
+	if ( this->sampledClasses > 0 )
+		 mlp_log("MLPTrainer", "Sampled Softmax is not supported by the multi-device training, the full softmax is used");
+
+	// the frames of each minibatch are split evenly, the first devices take one more frame when not divisible
+	int offset = 0;
+	for (int d = 0; d < this->nDevices; d++) {
+		 this->replicas[d].frames = this->minibatch / this->nDevices + ((d < this->minibatch % this->nDevices)? 1 : 0);
+		 this->replicas[d].offset = offset;
+		 offset += this->replicas[d].frames;
+	};
+
+	this->create_ocl_buffers(configProvider);
+
+    this->dataProviderp = &dataProvider;
+
+	this->initialized = true;
+}
+
+
+MLPTrainerMultiOCL::~MLPTrainerMultiOCL()
+{
+    this->release_ocl_buffers();
+
+	this->destroy_ocl_kernels();
+
+	delete this->CLCtx;
+
+	clAmdBlasTeardown();
+}
+
+int MLPTrainerMultiOCL::getNumDevices()
+{
+	return(this->nDevices);
+};
+
+void MLPTrainerMultiOCL::setup_ocl_kernels()
+{
+        cl_int status;
+
+ 		char *kernel_src;
+	    if ( read_srcfile("kernels.cl", kernel_src) < 0 ) {
+		     mlp_log("MLPTrainerMultiOCL", "Failed to read kernel source file\n");
+		     MLP_Exception("");
+		     return;
+	    };
+
+		this->CLCtx->m_program = clCreateProgramWithSource(this->CLCtx->m_context, 1, (const char**)&kernel_src,NULL,&status);
+		CL_CHECK( status );
+
+		// built for all the devices of the context
+		CL_CHECK( clBuildProgram(this->CLCtx->m_program,this->CLCtx->numDevices,this->CLCtx->m_devices, NULL, NULL, NULL) );
+
+		delete [] kernel_src;
+
+		this->mykerns.activate_sigmoid_kernel = clCreateKernel(this->CLCtx->m_program,"activate_sigmoid",&status);
+		CL_CHECK( status );
+		this->mykerns.activate_softmax_kernel1 = clCreateKernel(this->CLCtx->m_program,"activate_softmax1",&status);
+		CL_CHECK( status );
+		this->mykerns.activate_softmax_kernel2 = clCreateKernel(this->CLCtx->m_program,"activate_softmax2",&status);
+		CL_CHECK( status );
+		this->mykerns.activate_tanh_kernel = clCreateKernel(this->CLCtx->m_program,"activate_tanh",&status);
+		CL_CHECK( status );
+		this->mykerns.activate_relu_kernel = clCreateKernel(this->CLCtx->m_program,"activate_relu",&status);
+		CL_CHECK( status );
+		this->mykerns.bias_activate_relu_kernel = clCreateKernel(this->CLCtx->m_program,"bias_activate_relu",&status);
+		CL_CHECK( status );
+
+		this->mykerns.derivative_sigmoid_kernel = clCreateKernel(this->CLCtx->m_program,"derivative_sigmoid",&status);
+		CL_CHECK( status );
+		this->mykerns.derivative_tanh_kernel = clCreateKernel(this->CLCtx->m_program,"derivative_tanh",&status);
+		CL_CHECK( status );
+		this->mykerns.derivative_relu_kernel = clCreateKernel(this->CLCtx->m_program,"derivative_relu",&status);
+		CL_CHECK( status );
+
+		this->mykerns.calculateError_SSE_kernel1 = clCreateKernel(this->CLCtx->m_program,"calculateError_SSE1",&status);
+		CL_CHECK( status );
+		this->mykerns.calculateError_SSE_kernel2 = clCreateKernel(this->CLCtx->m_program,"calculateError_SSE2",&status);
+		CL_CHECK( status );
+		this->mykerns.calculateError_CE_kernel1 = clCreateKernel(this->CLCtx->m_program,"calculateError_CE1",&status);
+		CL_CHECK( status );
+		this->mykerns.calculateError_CE_kernel2 = clCreateKernel(this->CLCtx->m_program,"calculateError_CE2",&status);
+		CL_CHECK( status );
+
+		this->mykerns.calculateDelta_SSE_Sigmoid_kernel = clCreateKernel(this->CLCtx->m_program,"calculateDelta_SSE_Sigmoid",&status);
+		CL_CHECK( status );
+		this->mykerns.calculateDelta_CE_Softmax_kernel = clCreateKernel(this->CLCtx->m_program,"calculateDelta_CE_Softmax",&status);
+		CL_CHECK( status );
+
+        this->mykerns.transpose_sim_kernel = clCreateKernel(this->CLCtx->m_program,"transpose_simple",&status);
+	    CL_CHECK( status );
+        this->mykerns.transpose_kernel4 = clCreateKernel(this->CLCtx->m_program,"transpose_f4",&status);
+	    CL_CHECK( status );
+        this->mykerns.transpose_kernel32 = clCreateKernel(this->CLCtx->m_program,"transpose_32x32",&status);
+	    CL_CHECK( status );
+
+        this->mykerns.expandMatrix_kernel = clCreateKernel(this->CLCtx->m_program,"expandVectorToMatrix",&status);
+	    CL_CHECK( status );
+
+        this->mykerns.apply_momentum_kernel = clCreateKernel(this->CLCtx->m_program,"apply_momentum",&status);
+	    CL_CHECK( status );
+
+		this->mykerns.profiler = NULL;
+};
+
+void MLPTrainerMultiOCL::destroy_ocl_kernels()
+{
+		CL_CHECK( clReleaseKernel(this->mykerns.activate_sigmoid_kernel) );
+	    CL_CHECK( clReleaseKernel(this->mykerns.activate_softmax_kernel1) );
+        CL_CHECK( clReleaseKernel(this->mykerns.activate_softmax_kernel2) );
+	    CL_CHECK( clReleaseKernel(this->mykerns.activate_tanh_kernel) );
+	    CL_CHECK( clReleaseKernel(this->mykerns.activate_relu_kernel) );
+	    CL_CHECK( clReleaseKernel(this->mykerns.bias_activate_relu_kernel) );
+
+		CL_CHECK( clReleaseKernel(this->mykerns.derivative_sigmoid_kernel) );
+		CL_CHECK( clReleaseKernel(this->mykerns.derivative_tanh_kernel) );
+		CL_CHECK( clReleaseKernel(this->mykerns.derivative_relu_kernel) );
+
+		CL_CHECK( clReleaseKernel(this->mykerns.calculateError_SSE_kernel1) );
+	    CL_CHECK( clReleaseKernel(this->mykerns.calculateError_SSE_kernel2) );
+	    CL_CHECK( clReleaseKernel(this->mykerns.calculateError_CE_kernel1) );
+        CL_CHECK( clReleaseKernel(this->mykerns.calculateError_CE_kernel2) );
+
+		CL_CHECK( clReleaseKernel(this->mykerns.calculateDelta_SSE_Sigmoid_kernel) );
+	    CL_CHECK( clReleaseKernel(this->mykerns.calculateDelta_CE_Softmax_kernel) );
+
+	    CL_CHECK( clReleaseKernel(this->mykerns.transpose_sim_kernel) );
+	    CL_CHECK( clReleaseKernel(this->mykerns.transpose_kernel4) );
+	    CL_CHECK( clReleaseKernel(this->mykerns.transpose_kernel32) );
+
+		CL_CHECK( clReleaseKernel(this->mykerns.expandMatrix_kernel) );
+
+		CL_CHECK( clReleaseKernel(this->mykerns.apply_momentum_kernel) );
+
+		CL_CHECK( clReleaseProgram(this->CLCtx->m_program) );
+};
+
+void MLPTrainerMultiOCL::create_ocl_buffers(MLPConfigProvider &provider)
+{
+	cl_int status;
+
+	// the variances of each layer are read back from all devices into one host buffer for each device
+	this->varOffsets = new size_t[this->nLayers];
+	this->varOffsets[0] = 0;
+
+	size_t totalVars = 0;
+	for (int i = 1; i < this->nLayers; i++) {
+		 this->varOffsets[i] = totalVars;
+		 totalVars += (size_t)this->dimensions[i-1]*this->dimensions[i] + this->dimensions[i];
+	};
+
+	for (int d = 0; d < this->nDevices; d++)
+		 this->hostVars[d] = new float[totalVars];
+
+	size_t maxWeights = 0;
+	for (int i = 1; i < this->nLayers; i++)
+		 maxWeights = std::max<size_t>(maxWeights, (size_t)this->dimensions[i-1]*this->dimensions[i]);
+
+	float *zeros = new float[maxWeights];
+	for (size_t k = 0; k < maxWeights; k++)
+		 zeros[k] = 0.0f;
+
+	for (int d = 0; d < this->nDevices; d++) {
+		struct mlp_replica *rp = &this->replicas[d];
+
+		rp->inputs = new cl_mem[this->nLayers];         // buffers for storing the input/output for each layers
+		rp->weightT = new cl_mem[this->nLayers];        // weights for connecting the previous layer and current layer
+		rp->biases =  new cl_mem[this->nLayers];        // bias for each layer, added to the input of each layer
+		rp->delta = new cl_mem[this->nLayers];          // delta for each layer, used by back propagation
+		rp->deltaT = new cl_mem[this->nLayers];
+		rp->biasesMatrix = new cl_mem[this->nLayers];
+		rp->curVarWeight = new cl_mem[this->nLayers];
+		rp->varWeight = new cl_mem[this->nLayers];
+		rp->curVarBias = new cl_mem[this->nLayers];
+		rp->varBias = new cl_mem[this->nLayers];
+
+		// The Input/Output of layer i is stored in inputs[i+1], so inputs[1] is for the input layer, inputs[2] is for the first
+		// hidden layer, inputs[0] is for the output layer
+		for (int i = 1; i < this->nLayers; i++ )
+		{
+			size_t wSize = sizeof(cl_float)*this->dimensions[i-1]*this->dimensions[i];
+
+			rp->inputs[i] = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*this->dimensions[i-1]*rp->frames,NULL,&status);
+			CL_CHECK(status);
+
+			// the buffers are filled on the queue of the device, so that each device starts with its own copy of them
+			rp->weightT[i] = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, wSize, NULL,&status);
+			CL_CHECK(status);
+
+			if ( provider.weightLayout == MLP_WEIGHTS_TRANSPOSED )
+				 CL_CHECK( clEnqueueWriteBuffer(this->CLCtx->m_queues[d], rp->weightT[i], CL_TRUE, 0, wSize, provider.weights[i], 0, NULL, NULL) );
+			else {
+				 cl_mem tmpBuff;
+
+				 tmpBuff = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_ONLY, wSize, NULL, &status);
+				 CL_CHECK(status);
+				 CL_CHECK( clEnqueueWriteBuffer(this->CLCtx->m_queues[d], tmpBuff, CL_TRUE, 0, wSize, provider.weights[i], 0, NULL, NULL) );
+
+				 transpose_float_matrix(d, tmpBuff, rp->weightT[i], this->dimensions[i], this->dimensions[i-1]);  // make weightT[i] in transposed format
+				 CL_CHECK( clFinish(this->CLCtx->m_queues[d]) );
+				 clReleaseMemObject(tmpBuff);
+			};
+
+			rp->biases[i] = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*this->dimensions[i], NULL, &status);
+			CL_CHECK(status);
+			CL_CHECK( clEnqueueWriteBuffer(this->CLCtx->m_queues[d], rp->biases[i], CL_TRUE, 0, sizeof(cl_float)*this->dimensions[i], provider.biases[i], 0, NULL, NULL) );
+
+			rp->delta[i] = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*this->dimensions[i]*rp->frames,NULL,&status);
+			CL_CHECK(status);
+			rp->deltaT[i] = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*this->dimensions[i]*rp->frames,NULL,&status);
+			CL_CHECK(status);
+
+			rp->biasesMatrix[i] = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*this->dimensions[i]*rp->frames,NULL,&status);
+			CL_CHECK(status);
+
+			// the <last buffers> for the variances are initialized to all zeroes
+			rp->varWeight[i] = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, wSize, NULL, &status);
+			CL_CHECK(status);
+			CL_CHECK( clEnqueueWriteBuffer(this->CLCtx->m_queues[d], rp->varWeight[i], CL_TRUE, 0, wSize, zeros, 0, NULL, NULL) );
+			rp->curVarWeight[i] = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, wSize, NULL, &status);
+			CL_CHECK(status);
+
+			rp->varBias[i] = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*this->dimensions[i], NULL, &status);
+			CL_CHECK(status);
+			CL_CHECK( clEnqueueWriteBuffer(this->CLCtx->m_queues[d], rp->varBias[i], CL_TRUE, 0, sizeof(cl_float)*this->dimensions[i], zeros, 0, NULL, NULL) );
+			rp->curVarBias[i] = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*this->dimensions[i], NULL, &status);
+			CL_CHECK(status);
+		}
+
+		// for output layer
+		rp->output = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*(this->dimensions[this->nLayers-1])*rp->frames,NULL,&status);
+		CL_CHECK(status);
+
+		rp->inputs[0] = rp->output;
+
+		rp->target = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*this->dimensions[this->nLayers-1]*rp->frames,NULL,&status);
+		CL_CHECK(status);
+
+		// a (1,1,...1) vector of length frames, it is used for updating the bias of each layer
+		float *ones = new float[rp->frames];
+		for (int k = 0; k < rp->frames; k++)
+			 ones[k] = 1.0f;
+
+		rp->onesVector = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_ONLY, sizeof(cl_float)*rp->frames, NULL, &status);
+		CL_CHECK(status);
+		CL_CHECK( clEnqueueWriteBuffer(this->CLCtx->m_queues[d], rp->onesVector, CL_TRUE, 0, sizeof(cl_float)*rp->frames, ones, 0, NULL, NULL) );
+
+		delete [] ones;
+
+		rp->reduceMem = clCreateBuffer(this->CLCtx->m_context, CL_MEM_WRITE_ONLY, sizeof(cl_float)*rp->frames, NULL, &status);
+		CL_CHECK(status);
+		rp->reduceBuff = new float[rp->frames];
+	};
+
+	delete [] zeros;
+}
+
+void MLPTrainerMultiOCL::release_ocl_buffers()
+{
+	for (int d = 0; d < this->nDevices; d++) {
+		struct mlp_replica *rp = &this->replicas[d];
+
+		for (int i = 1; i < this->nLayers; i++ )
+		{
+			CL_CHECK( clReleaseMemObject(rp->inputs[i]) );
+			CL_CHECK( clReleaseMemObject(rp->weightT[i]) );
+			CL_CHECK( clReleaseMemObject(rp->biases[i]) );
+			CL_CHECK( clReleaseMemObject(rp->delta[i]) );
+			CL_CHECK( clReleaseMemObject(rp->deltaT[i]) );
+			CL_CHECK( clReleaseMemObject(rp->biasesMatrix[i]) );
+			CL_CHECK( clReleaseMemObject(rp->curVarWeight[i]) );
+			CL_CHECK( clReleaseMemObject(rp->varWeight[i]) );
+			CL_CHECK( clReleaseMemObject(rp->curVarBias[i]) );
+			CL_CHECK( clReleaseMemObject(rp->varBias[i]) );
+		}
+
+		CL_CHECK( clReleaseMemObject(rp->output) );
+		CL_CHECK( clReleaseMemObject(rp->target) );
+		CL_CHECK( clReleaseMemObject(rp->onesVector) );
+		CL_CHECK( clReleaseMemObject(rp->reduceMem) );
+
+		delete [] rp->inputs;
+		delete [] rp->weightT;
+		delete [] rp->biases;
+		delete [] rp->delta;
+		delete [] rp->deltaT;
+		delete [] rp->biasesMatrix;
+		delete [] rp->curVarWeight;
+		delete [] rp->varWeight;
+		delete [] rp->curVarBias;
+		delete [] rp->varBias;
+		delete [] rp->reduceBuff;
+
+		delete [] this->hostVars[d];
+	};
+
+	delete [] this->varOffsets;
+};
+
+// the replicas are identical, so the network is read back from the first device
+void MLPTrainerMultiOCL::synchronizeNetConfig(MLPConfigProvider &configProvider)
+{
+	cl_int status;
+
+	for ( int i = 0; i < this->nLayers; i++ )
+		 configProvider.etas[i] = this->etas[i];
+
+	for ( int i = 0; i < this->nLayers; i++ )
+		 configProvider.actFuncs[i] = this->actFuncs[i];
+
+	configProvider.netType = this->netType;
+	configProvider.costFunc = this->costFunc;
+	configProvider.momentum = this->momentum;
+	configProvider.epochs = this->epochs;
+	configProvider.sampledClasses = this->sampledClasses;
+	configProvider.accumulateSteps = this->accumulateSteps;
+
+	configProvider.weightLayout = MLP_WEIGHTS_TRANSPOSED;
+
+	for (int i = 1; i < this->nLayers; i++ )
+	{
+		status = clEnqueueReadBuffer(this->CLCtx->m_queues[0], this->replicas[0].weightT[i], CL_TRUE, 0,sizeof(cl_float)*this->dimensions[i-1]*this->dimensions[i],
+			                         configProvider.weights[i], 0, NULL, NULL);
+		CL_CHECK(status);
+
+		status = clEnqueueReadBuffer(this->CLCtx->m_queues[0], this->replicas[0].biases[i], CL_TRUE, 0,sizeof(cl_float)*this->dimensions[i],
+			                         configProvider.biases[i], 0, NULL, NULL);
+		CL_CHECK(status);
+	}
+};
+
+
+// the following interfaces make calls to OpenCL kernels on the queue of device "dev"
+
+// use three different method to implement transposition depending on the size of the width and height
+void MLPTrainerMultiOCL::transpose_float_matrix(int dev, cl_mem src, cl_mem dst, cl_int width, cl_int height)
+{
+	if  ( (width % 32 == 0) && (height % 32 == 0) )
+            cmn_transpose_matrix_32x32(this->CLCtx->m_queues[dev],this->mykerns,src,dst,width,height);
+	else
+	    if (width % 4 == 0)
+		    cmn_transpose_matrix_f4(this->CLCtx->m_queues[dev],this->mykerns,src,dst,width,height);
+		else
+			cmn_transpose_matrix_simple(this->CLCtx->m_queues[dev],this->mykerns,src,dst,width,height);
+};
+
+void MLPTrainerMultiOCL::activate(int dev, int layer, cl_mem x, cl_mem y, int width, int height )
+{
+	switch (this->actFuncs[layer] ) {
+	case AFUNC_SIGMOID:
+		cmn_activate_sigmoid(this->CLCtx->m_queues[dev],this->mykerns,x,y,width,height);
+		return;
+	case AFUNC_SOFTMAX:
+	    cmn_activate_softmax(this->CLCtx->m_queues[dev],this->mykerns,x,y,width,height);
+		return;
+	case AFUNC_TANH:
+	    cmn_activate_tanh(this->CLCtx->m_queues[dev],this->mykerns,x,y,width,height);
+		return;
+	case AFUNC_IDENTITY:
+	    cmn_activate_identity(this->CLCtx->m_queues[dev],this->mykerns,x,y,width,height);
+        return;
+	case AFUNC_RELU:
+	    cmn_activate_relu(this->CLCtx->m_queues[dev],this->mykerns,x,y,width,height,0.0f);
+		return;
+	case AFUNC_LEAKY_RELU:
+	    cmn_activate_relu(this->CLCtx->m_queues[dev],this->mykerns,x,y,width,height,MLP_LEAKY_RELU_SLOPE);
+		return;
+	default:
+		mlp_log("MLPTrainer", "The assigned activation function for this layer is not supported.");
+		MLP_Exception("");
+	};
+};
+
+// Output = activate(Input + Bias) by one kernel reading the biases vector, returns false if the activation function of the layer
+// has no such fused kernel, then the caller adds the biases and calls activate()
+bool MLPTrainerMultiOCL::activateWithBias(int dev, int layer, cl_mem x, cl_mem biases, cl_mem y, int width, int height)
+{
+	switch (this->actFuncs[layer] ) {
+	case AFUNC_RELU:
+		cmn_bias_activate_relu(this->CLCtx->m_queues[dev],this->mykerns,x,biases,y,width,height,0.0f);
+		return(true);
+	case AFUNC_LEAKY_RELU:
+		cmn_bias_activate_relu(this->CLCtx->m_queues[dev],this->mykerns,x,biases,y,width,height,MLP_LEAKY_RELU_SLOPE);
+		return(true);
+	default:
+		return(false);
+	};
+};
+
+void MLPTrainerMultiOCL::calculateError(int dev, cl_mem output, cl_mem target, int width, int height, float &ret )
+{
+	struct mlp_replica *rp = &this->replicas[dev];
+
+	switch (this->costFunc) {
+	case CFUNC_SSE:
+		cmn_calculateError_SSE(this->CLCtx->m_queues[dev],this->mykerns,output,target,rp->reduceMem,rp->reduceBuff,width,height,ret);
+		return;
+	case CFUNC_CE:
+		cmn_calculateError_CE(this->CLCtx->m_queues[dev],this->mykerns,output,target,rp->reduceMem,rp->reduceBuff,width,height,ret);
+		return;
+	default:
+		mlp_log("MLPTrainer", "The assigned cost function for this neural network is not supported.");
+		MLP_Exception("");
+	};
+	return;
+};
+
+void MLPTrainerMultiOCL::calculateDelta(int dev, cl_mem output, cl_mem target, cl_mem delta, int width, int height)
+{
+	if ( (this->costFunc == CFUNC_CE) && (this->actFuncs[this->nLayers-1] == AFUNC_SOFTMAX) ) {
+		 cmn_calculateDelta_CE_Softmax(this->CLCtx->m_queues[dev],this->mykerns,output,target,delta,width,height);
+		 return;
+	};
+	if ( (this->costFunc == CFUNC_SSE) && (this->actFuncs[this->nLayers-1] == AFUNC_SIGMOID) ) {
+		 cmn_calculateDelta_SSE_Sigmoid(this->CLCtx->m_queues[dev],this->mykerns,output,target,delta,width,height);
+		 return;
+	};
+
+	mlp_log("MLPTrainer", "The configuration for this neural network is not supported");
+	MLP_Exception("");
+	return;
+};
+
+void MLPTrainerMultiOCL::derivative(int dev, int layer, cl_mem delta1, cl_mem y, cl_mem delta2, int width, int height )
+{
+	switch (this->actFuncs[layer] ) {
+	case AFUNC_SIGMOID:
+		cmn_derivative_sigmoid(this->CLCtx->m_queues[dev],this->mykerns,delta1,y,delta2,width,height);
+		return;
+	case AFUNC_TANH:
+		cmn_derivative_tanh(this->CLCtx->m_queues[dev],this->mykerns,delta1,y,delta2,width,height);
+		return;
+	case AFUNC_RELU:
+		cmn_derivative_relu(this->CLCtx->m_queues[dev],this->mykerns,delta1,y,delta2,width,height,0.0f);
+		return;
+	case AFUNC_LEAKY_RELU:
+		cmn_derivative_relu(this->CLCtx->m_queues[dev],this->mykerns,delta1,y,delta2,width,height,MLP_LEAKY_RELU_SLOPE);
+		return;
+	default:
+		mlp_log("MLPTrainer", "The assigned activation function for this layer is not supported.");
+		MLP_Exception("");
+	};
+};
+
+// Enqueues the back propagation of the frames of device "dev", ending with the weights and biases variances computed from these
+// frames added to beta times curVarWeight and curVarBias. The delta of the output layer is already enqueued by the forward propagation
+void MLPTrainerMultiOCL::backward(int dev, float beta)
+{
+	struct mlp_replica *rp = &this->replicas[dev];
+	cl_command_queue *queuep = &this->CLCtx->m_queues[dev];
+	clAmdBlasStatus blasStatus;
+
+	this->transpose_float_matrix(dev, rp->delta[this->nLayers-1], rp->deltaT[this->nLayers-1], this->dimensions[this->nLayers-1], rp->frames);
+
+	for ( int i = this->nLayers - 2; i > 0; i-- ) {
+		 // Delta[i] = Delta[i+1] * WeightT[i+1],
+		 blasStatus = clAmdBlasSgemm( clAmdBlasRowMajor, clAmdBlasNoTrans, clAmdBlasNoTrans, rp->frames, this->dimensions[i], this->dimensions[i+1],1.0f, rp->delta[i+1],
+			this->dimensions[i+1], rp->weightT[i+1], this->dimensions[i],  0.0f, rp->delta[i], this->dimensions[i], 1, queuep,0,NULL,NULL );
+		 AMDBLAS_CHECK(blasStatus);
+
+		 // Delta[i] = derivative(Delta[i],Output[i])
+		 this->derivative(dev, i, rp->delta[i],rp->inputs[i+1], rp->delta[i],this->dimensions[i], rp->frames );
+
+         this->transpose_float_matrix(dev, rp->delta[i], rp->deltaT[i], this->dimensions[i], rp->frames);
+	}
+
+	for ( int i = nLayers-1; i > 0; i-- ) {
+		  float coef = this->etas[i];
+
+		  // curVarWeightT[i] = DeltaT[i] * Output[i-1] + beta * curVarWeightT[i], here curVarWeight[i] is in transposed form
+		  blasStatus = clAmdBlasSgemm( clAmdBlasRowMajor,clAmdBlasNoTrans,clAmdBlasNoTrans, this->dimensions[i], this->dimensions[i-1], rp->frames, coef,
+			  rp->deltaT[i], rp->frames, rp->inputs[i],this->dimensions[i-1],beta,rp->curVarWeight[i],this->dimensions[i-1],1,queuep,0,NULL,NULL);
+		  AMDBLAS_CHECK(blasStatus);
+
+		  // curVarBias[i] = DeltaT[i] * (1,1, ... 1)T + beta * curVarBias[i]
+          blasStatus=clAmdBlasSgemv(clAmdBlasRowMajor, clAmdBlasNoTrans, this->dimensions[i], rp->frames, coef, rp->deltaT[i], rp->frames, rp->onesVector,
+			  0, 1, beta, rp->curVarBias[i], 0, 1, 1, queuep, 0, NULL, NULL);
+		  AMDBLAS_CHECK(blasStatus);
+	};
+
+	CL_CHECK( clFlush(*queuep) );
+};
+
+// Sums the weights and biases variances of all devices and writes the sum back to every device. The variances are staged in the
+// host memory and summed in the order of the devices, so all devices get exactly the same values. The reading of each layer is
+// started for all devices before summing any of them, so the summing of one layer overlaps with the reading of the next ones
+void MLPTrainerMultiOCL::allreduce_variances()
+{
+	if ( this->nDevices == 1 )
+		 return;
+
+	cl_event *readEvents = new cl_event[this->nLayers*this->nDevices];
+	cl_event *writeEvents = new cl_event[2*this->nLayers*this->nDevices];
+	int nWrites = 0;
+
+	for ( int i = this->nLayers-1; i > 0; i-- ) {
+		  size_t wSize = (size_t)this->dimensions[i-1]*this->dimensions[i];
+
+		  for (int d = 0; d < this->nDevices; d++) {
+			   float *hostp = this->hostVars[d] + this->varOffsets[i];
+
+			   CL_CHECK( clEnqueueReadBuffer(this->CLCtx->m_queues[d], this->replicas[d].curVarWeight[i], CL_FALSE, 0, sizeof(cl_float)*wSize, hostp, 0, NULL, NULL) );
+			   CL_CHECK( clEnqueueReadBuffer(this->CLCtx->m_queues[d], this->replicas[d].curVarBias[i], CL_FALSE, 0, sizeof(cl_float)*this->dimensions[i], hostp+wSize, 0, NULL,
+				                             &readEvents[i*this->nDevices+d]) );
+			   CL_CHECK( clFlush(this->CLCtx->m_queues[d]) );
+		  };
+	};
+
+	for ( int i = this->nLayers-1; i > 0; i-- ) {
+		  size_t wSize = (size_t)this->dimensions[i-1]*this->dimensions[i];
+		  size_t layerVars = wSize + this->dimensions[i];
+		  float *sump = this->hostVars[0] + this->varOffsets[i];
+
+		  CL_CHECK( clWaitForEvents(this->nDevices, &readEvents[i*this->nDevices]) );
+
+		  for (int d = 1; d < this->nDevices; d++) {
+			   float *hostp = this->hostVars[d] + this->varOffsets[i];
+
+			   for (size_t k = 0; k < layerVars; k++)
+					sump[k] += hostp[k];
+		  };
+
+		  for (int d = 0; d < this->nDevices; d++) {
+			   CL_CHECK( clEnqueueWriteBuffer(this->CLCtx->m_queues[d], this->replicas[d].curVarWeight[i], CL_FALSE, 0, sizeof(cl_float)*wSize, sump, 0, NULL, &writeEvents[nWrites++]) );
+			   CL_CHECK( clEnqueueWriteBuffer(this->CLCtx->m_queues[d], this->replicas[d].curVarBias[i], CL_FALSE, 0, sizeof(cl_float)*this->dimensions[i], sump+wSize, 0, NULL,
+				                              &writeEvents[nWrites++]) );
+			   CL_CHECK( clFlush(this->CLCtx->m_queues[d]) );
+		  };
+
+		  for (int d = 0; d < this->nDevices; d++)
+			   CL_CHECK( clReleaseEvent(readEvents[i*this->nDevices+d]) );
+	};
+
+	// hostVars[0] is read by the writes of all devices, it can only be reused after all of them are done
+	CL_CHECK( clWaitForEvents(nWrites, writeEvents) );
+	for (int k = 0; k < nWrites; k++)
+		 CL_CHECK( clReleaseEvent(writeEvents[k]) );
+
+	delete [] readEvents;
+	delete [] writeEvents;
+};
+
+
+int MLPTrainerMultiOCL::batchTrainingWithCheckPointing(int maxBatches, int startBatch, int startEpoch,  bool doChkPointing)
+{
+	if ( !this->initialized ) {
+		 mlp_log("MLPTrainer", "This Trainer object should be setup with NetProvider and DataProvider first");
+		 MLP_Exception("");
+	};
+
+	clAmdBlasStatus blasStatus;
+
+	// the inputs for the MLP training
+	float *l_features=NULL;
+	float *l_labels=NULL;
+
+	for (int d = 0; d < this->nDevices; d++) {
+		 struct mlp_replica *rp = &this->replicas[d];
+
+		 for (int i = 1; i < this->nLayers; i++)
+			  cmn_expandFloatVectorToMatrix(this->CLCtx->m_queues[d],this->mykerns,rp->biases[i],rp->biasesMatrix[i],this->dimensions[i],rp->frames);
+
+		 CL_CHECK(clFinish(this->CLCtx->m_queues[d]));
+	};
+
+	int myBatch;
+	int myEpoch;
+	int accStep = 0;          // number of the batches whose variances have been summed since the last update of the weights
+	int epochBatches = (maxBatches == 0)? this->dataProviderp->getTotalBatches() : std::min<int>(this->dataProviderp->getTotalBatches(), maxBatches);
+
+	this->currBatchNo = startBatch;
+	this->currEpoch = startEpoch;
+	this->pendingBatches = 0;
+
+	myBatch = this->currBatchNo;
+	myEpoch = this->currEpoch;
+
+	while ( myEpoch < this->epochs ) {
+
+	    while (  this->dataProviderp->batchAvailable() && (maxBatches == 0 || myBatch < maxBatches) ) {
+
+			 MLP_CHECK(this->dataProviderp->getBatchData(this->minibatch,l_features,l_labels,true));  // blocking method
+
+			 // each device gets its own rows of the minibatch and computes its forward propagation, the devices run concurrently
+			 for (int d = 0; d < this->nDevices; d++) {
+				  struct mlp_replica *rp = &this->replicas[d];
+				  cl_command_queue *queuep = &this->CLCtx->m_queues[d];
+
+				  CL_CHECK(clEnqueueWriteBuffer(*queuep,rp->inputs[1],CL_FALSE,0,sizeof(cl_float)*this->dimensions[0]*rp->frames,
+					                            l_features+(size_t)rp->offset*this->dimensions[0],0,NULL,NULL ));
+				  CL_CHECK(clEnqueueWriteBuffer(*queuep,rp->target,CL_FALSE,0,sizeof(cl_float)*this->dimensions[this->nLayers-1]*rp->frames,
+					                            l_labels+(size_t)rp->offset*this->dimensions[this->nLayers-1],0,NULL,NULL ));
+
+				  for (int i = 1; i < this->nLayers; i++) {
+
+			 		   // Input[i] = Output[i-1] * Weight[i]     , here Weight[i] is in transposed form
+					   blasStatus = clAmdBlasSgemm(clAmdBlasRowMajor,clAmdBlasNoTrans,clAmdBlasTrans,rp->frames,this->dimensions[i],this->dimensions[i-1],1.0f,rp->inputs[i],
+						  this->dimensions[i-1],rp->weightT[i],this->dimensions[i-1],0.0f,rp->inputs[(i+1)%this->nLayers],this->dimensions[i],1,queuep,0,NULL,NULL);
+					   AMDBLAS_CHECK(blasStatus);
+
+					   // Output[i] = activate(Input[i] + Bias[i]) by one kernel for the ReLU layers
+					   if ( ! this->activateWithBias(d, i, rp->inputs[(i+1)%this->nLayers], rp->biases[i], rp->inputs[(i+1)%this->nLayers], this->dimensions[i], rp->frames) ) {
+						   // Input[i] = Input[i] + 1.0 * Bias[i],   regarding the two Matrixes as  two vectors
+						   blasStatus = clAmdBlasSaxpy(this->dimensions[i]*rp->frames, 1.0f, rp->biasesMatrix[i], 0, 1, rp->inputs[(i+1)%this->nLayers], 0, 1, 1,
+							                          queuep, 0, NULL, NULL);
+						   AMDBLAS_CHECK(blasStatus);
+
+						   // Output[i] = activate(Input[i])
+						   this->activate(d, i, rp->inputs[(i+1)%this->nLayers], rp->inputs[(i+1)%this->nLayers], this->dimensions[i], rp->frames);
+					   };
+				  }
+
+				  this->calculateDelta(d, rp->output, rp->target, rp->delta[this->nLayers-1], this->dimensions[this->nLayers-1], rp->frames);
+
+				  CL_CHECK( clFlush(*queuep) );
+			 };
+
+			 // the variances of accumulateSteps successive batches are summed on each device, and only reduced and applied by the last one
+			 float beta = (accStep > 0)? 1.0f : 0.0f;
+			 bool doUpdate = (++accStep == this->accumulateSteps) || (myBatch+1 >= epochBatches);
+
+			 // the error of the minibatch is the average of the errors of the devices weighted by their frames
+			 float costval=0.0f;
+
+			 for (int d = 0; d < this->nDevices; d++) {
+				  float devCost=0.0f;
+
+				  this->calculateError(d, this->replicas[d].output, this->replicas[d].target, this->dimensions[this->nLayers-1], this->replicas[d].frames, devCost);
+				  costval += devCost * this->replicas[d].frames / this->minibatch;
+
+				  this->backward(d, beta);
+			 };
+
+			 cout.precision(8);
+			 cout << std::showpoint << std::fixed << endl;
+			 cout << "Error Value for Batch  " << myBatch << " of Epoch " << myEpoch << ": " << costval << endl;
+
+			 if ( doUpdate ) {
+				 accStep = 0;
+
+				 this->allreduce_variances();
+
+				 if ( doChkPointing)
+				      DNN_LOCK(&this->chkPointingLock);
+
+				 // every device applies the same summed variances to its replica
+				 for (int d = 0; d < this->nDevices; d++) {
+					  struct mlp_replica *rp = &this->replicas[d];
+					  cl_command_queue *queuep = &this->CLCtx->m_queues[d];
+
+					  for ( int i = nLayers-1; i > 0; i-- ) {
+						   float mm = this->momentum;
+
+						   // varWeightT[i] = curVarWeightT[i] + mm * varWeightT[i],  WeightT[i] = WeightT[i] + varWeightT[i]
+						   cmn_apply_momentum(*queuep, this->mykerns, rp->weightT[i], rp->varWeight[i], rp->curVarWeight[i], this->dimensions[i]*this->dimensions[i-1], mm);
+
+						   // varBias[i] = curVarBias[i] + mm * varBias[i],  Bias[i] = Bias[i] + varBias[i]
+						   cmn_apply_momentum(*queuep, this->mykerns, rp->biases[i], rp->varBias[i], rp->curVarBias[i], this->dimensions[i], mm);
+
+						   cmn_expandFloatVectorToMatrix(*queuep,this->mykerns,rp->biases[i],rp->biasesMatrix[i],this->dimensions[i],rp->frames);
+					  };
+
+					  CL_CHECK( clFlush(*queuep) );
+				 };
+
+				 for (int d = 0; d < this->nDevices; d++)
+					  CL_CHECK( clFinish(this->CLCtx->m_queues[d]) );
+
+				 if ( doChkPointing )
+				     DNN_UNLOCK(&this->chkPointingLock);
+			 }
+			 else {
+				  // the features and labels of the batch are still read by the non-blocking writes until the devices finish
+				  for (int d = 0; d < this->nDevices; d++)
+					   CL_CHECK( clFinish(this->CLCtx->m_queues[d]) );
+			 };
+
+             // tell the data provider that I have done with current batch of data, want next batch of data
+			 MLP_CHECK(this->dataProviderp->nextBatch());
+
+			 myBatch++;
+
+			 if ( doChkPointing ) {
+                  DNN_LOCK(&this->chkPointingLock);
+			      this->currBatchNo = myBatch;
+				  this->currEpoch = myEpoch;
+				  this->pendingBatches = accStep;
+				  this->_checkPointAtGroupEnd();
+                  DNN_UNLOCK(&this->chkPointingLock);
+			 };
+	    } // end of all baches
+
+		myEpoch++;
+		myBatch = 0;
+		this->dataProviderp->resetDataProvider();
+
+		if ( doChkPointing ) {
+             DNN_LOCK(&this->chkPointingLock);
+			 this->currBatchNo = myBatch;
+		     this->currEpoch = myEpoch;
+			 this->pendingBatches = accStep;
+			 this->_checkPointAtGroupEnd();
+             DNN_UNLOCK(&this->chkPointingLock);
+		};
+	};  // end of all epoches
+
+	if ( maxBatches == 0 )
+		 return(myEpoch * this->dataProviderp->getTotalBatches() + myBatch);
+	else {
+	     int realBatches;
+
+	     realBatches = std::min<int>(this->dataProviderp->getTotalBatches(), maxBatches);
+		 return(myEpoch * realBatches + myBatch);
+	};
+}
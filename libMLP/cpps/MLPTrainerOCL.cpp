@@ -6,11 +6,15 @@
  *   Written by  Junli Gu@amd.com ( Dec 2013 )
  */
 
+#include <cmath>
 #include <algorithm>
 #include <clAmdBlas.h>
 
 #include "MLPUtil.h"
+#include "oclUtil.h"
 #include "MLPOclCommon.h"
+#include "MLPOclProfiler.h"
+#include "DNNTracer.h"
 #include "MLPTrainerOCL.h"
 #include "MLPChkPointState.h"
 
@@ -35,18 +39,27 @@ MLPTrainerOCL::MLPTrainerOCL()
 	}
 
 	this->devType = DNN_OCL_DI_GPU;    // default OpenCL device
+	this->actType = MLP_DATA_FLOAT32;
 
 	this->inputs = NULL;
 	this->weightT = NULL;
+	this->weightHalf = NULL;
 	this->output = NULL;
 	this->target = NULL;
 
 	this->initialized = false;
 };
 
-MLPTrainerOCL::MLPTrainerOCL(MLPConfigProvider & configProvider, DNNDataProvider & dataProvider, DNN_OCL_DEVTYPE dType, int _minibatch)
+// with _actType being MLP_DATA_FLOAT16, the training is done in mixed precision, see batchTrainingHalf()
+MLPTrainerOCL::MLPTrainerOCL(MLPConfigProvider & configProvider, DNNDataProvider & dataProvider, DNN_OCL_DEVTYPE dType, int _minibatch, MLP_DATA_TYPE _actType)
 {
+	if ( (_actType != MLP_DATA_FLOAT32) && (_actType != MLP_DATA_FLOAT16) ) {
+		 mlp_log("MLPTrainer", "Only float and half precision are supported for the training");
+		 MLP_Exception("");
+	};
+
    	this->devType = dType;
+	this->actType = _actType;
 
 	// class wide set up
 	if ( this->nInstances++ == 0 )  // first instance
@@ -78,6 +91,9 @@ void MLPTrainerOCL::setupMLP(MLPConfigProvider & configProvider, DNNDataProvider
 
 	this->_initialize(configProvider, _minibatch);
 
+	if ( (this->actType == MLP_DATA_FLOAT16) && (this->sampledClasses > 0) )
+		 mlp_log("MLPTrainer", "Sampled Softmax is not supported by the half precision training, the full softmax is used");
+
 	this->create_ocl_buffers(configProvider);
 
     this->dataProviderp = &dataProvider;
@@ -126,11 +142,17 @@ void MLPTrainerOCL::setup_ocl_kernels()
 		CL_CHECK( status );
 		this->mykerns.activate_tanh_kernel = clCreateKernel(this->CLCtx->m_program,"activate_tanh",&status);
 		CL_CHECK( status );
+		this->mykerns.activate_relu_kernel = clCreateKernel(this->CLCtx->m_program,"activate_relu",&status);
+		CL_CHECK( status );
+		this->mykerns.bias_activate_relu_kernel = clCreateKernel(this->CLCtx->m_program,"bias_activate_relu",&status);
+		CL_CHECK( status );
 
 		this->mykerns.derivative_sigmoid_kernel = clCreateKernel(this->CLCtx->m_program,"derivative_sigmoid",&status);
 		CL_CHECK( status );
 		this->mykerns.derivative_tanh_kernel = clCreateKernel(this->CLCtx->m_program,"derivative_tanh",&status);
 		CL_CHECK( status );
+		this->mykerns.derivative_relu_kernel = clCreateKernel(this->CLCtx->m_program,"derivative_relu",&status);
+		CL_CHECK( status );
 
 		this->mykerns.calculateError_SSE_kernel1 = clCreateKernel(this->CLCtx->m_program,"calculateError_SSE1",&status);
 		CL_CHECK( status );
@@ -156,6 +178,30 @@ void MLPTrainerOCL::setup_ocl_kernels()
         this->mykerns.expandMatrix_kernel = clCreateKernel(this->CLCtx->m_program,"expandVectorToMatrix",&status);
 	    CL_CHECK( status );
 
+        this->mykerns.gather_rows_kernel = clCreateKernel(this->CLCtx->m_program,"gather_rows",&status);
+	    CL_CHECK( status );
+        this->mykerns.update_sampled_rows_kernel = clCreateKernel(this->CLCtx->m_program,"update_sampled_rows",&status);
+	    CL_CHECK( status );
+
+        this->mykerns.gemm_half_kernel = clCreateKernel(this->CLCtx->m_program,"gemm_half",&status);
+	    CL_CHECK( status );
+        this->mykerns.convert_to_half_kernel = clCreateKernel(this->CLCtx->m_program,"convert_to_half",&status);
+	    CL_CHECK( status );
+        this->mykerns.convert_to_float_kernel = clCreateKernel(this->CLCtx->m_program,"convert_to_float",&status);
+	    CL_CHECK( status );
+        this->mykerns.check_finite_kernel = clCreateKernel(this->CLCtx->m_program,"check_finite",&status);
+	    CL_CHECK( status );
+
+        this->mykerns.apply_momentum_kernel = clCreateKernel(this->CLCtx->m_program,"apply_momentum",&status);
+	    CL_CHECK( status );
+        this->mykerns.apply_momentum_half_kernel = clCreateKernel(this->CLCtx->m_program,"apply_momentum_half",&status);
+	    CL_CHECK( status );
+
+        this->mykerns.spmm_csr_kernel = clCreateKernel(this->CLCtx->m_program,"spmm_csr",&status);
+	    CL_CHECK( status );
+
+		// the commands are only profiled when the queue is created with profiling enabled, see set_ocl_queue_profiling()
+		this->mykerns.profiler = get_ocl_queue_profiling()? new MLPOclProfiler() : NULL;
 };
 
 void MLPTrainerOCL::destroy_ocl_kernels()
@@ -164,9 +210,12 @@ void MLPTrainerOCL::destroy_ocl_kernels()
 	    CL_CHECK( clReleaseKernel(this->mykerns.activate_softmax_kernel1) );
         CL_CHECK( clReleaseKernel(this->mykerns.activate_softmax_kernel2) );
 	    CL_CHECK( clReleaseKernel(this->mykerns.activate_tanh_kernel) );
+	    CL_CHECK( clReleaseKernel(this->mykerns.activate_relu_kernel) );
+	    CL_CHECK( clReleaseKernel(this->mykerns.bias_activate_relu_kernel) );
 
 		CL_CHECK( clReleaseKernel(this->mykerns.derivative_sigmoid_kernel) );
 		CL_CHECK( clReleaseKernel(this->mykerns.derivative_tanh_kernel) );
+		CL_CHECK( clReleaseKernel(this->mykerns.derivative_relu_kernel) );
 
 		CL_CHECK( clReleaseKernel(this->mykerns.calculateError_SSE_kernel1) );
 	    CL_CHECK( clReleaseKernel(this->mykerns.calculateError_SSE_kernel2) );
@@ -182,12 +231,31 @@ void MLPTrainerOCL::destroy_ocl_kernels()
 
 		CL_CHECK( clReleaseKernel(this->mykerns.expandMatrix_kernel) );
 
+		CL_CHECK( clReleaseKernel(this->mykerns.gather_rows_kernel) );
+		CL_CHECK( clReleaseKernel(this->mykerns.update_sampled_rows_kernel) );
+
+		CL_CHECK( clReleaseKernel(this->mykerns.gemm_half_kernel) );
+		CL_CHECK( clReleaseKernel(this->mykerns.convert_to_half_kernel) );
+		CL_CHECK( clReleaseKernel(this->mykerns.convert_to_float_kernel) );
+		CL_CHECK( clReleaseKernel(this->mykerns.check_finite_kernel) );
+
+		CL_CHECK( clReleaseKernel(this->mykerns.apply_momentum_kernel) );
+		CL_CHECK( clReleaseKernel(this->mykerns.apply_momentum_half_kernel) );
+
+		CL_CHECK( clReleaseKernel(this->mykerns.spmm_csr_kernel) );
+
+		if ( this->mykerns.profiler ) {
+			 delete this->mykerns.profiler;
+			 this->mykerns.profiler = NULL;
+		};
+
 		CL_CHECK( clReleaseProgram(this->CLCtx->m_program) );
 };
 
 void MLPTrainerOCL::create_ocl_buffers(MLPConfigProvider &provider)
 {
 	cl_int status;
+	size_t actSize = (this->actType == MLP_DATA_FLOAT16)? sizeof(cl_half) : sizeof(cl_float);
 
 	this->inputs = new cl_mem[this->nLayers];         // buffers for storing the input/output for each layers
 	this->weightT = new cl_mem[this->nLayers];        // weights for connecting the previous layer and current layer
@@ -198,29 +266,61 @@ void MLPTrainerOCL::create_ocl_buffers(MLPConfigProvider &provider)
 	// the first hidden layer, this->inputs[0] is for the output layer
 	for (int i = 1; i < this->nLayers; i++ )
 	{
-		this->inputs[i] = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*this->dimensions[i-1]*this->minibatch,NULL,&status);
+		this->inputs[i] = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, actSize*this->dimensions[i-1]*this->minibatch,NULL,&status);
 		CL_CHECK(status);
 
-		this->weightT[i] = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*this->dimensions[i-1]*this->dimensions[i], NULL,&status);
-		CL_CHECK(status);
+		if ( provider.weightLayout == MLP_WEIGHTS_TRANSPOSED ) {
+			 // the weights are already in the transposed format used by the trainer
+		     this->weightT[i] = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE|CL_MEM_COPY_HOST_PTR, sizeof(cl_float)*this->dimensions[i-1]*this->dimensions[i],
+			                               provider.weights[i], &status);
+		     CL_CHECK(status);
+		}
+		else {
+		     this->weightT[i] = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*this->dimensions[i-1]*this->dimensions[i], NULL,&status);
+		     CL_CHECK(status);
 
-		cl_mem tmpBuff;
+		     cl_mem tmpBuff;
 
-		tmpBuff = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_ONLY|CL_MEM_COPY_HOST_PTR, sizeof(cl_float)*this->dimensions[i-1]*this->dimensions[i],
+		     tmpBuff = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_ONLY|CL_MEM_COPY_HOST_PTR, sizeof(cl_float)*this->dimensions[i-1]*this->dimensions[i],
 			                               provider.weights[i],&status);
-		CL_CHECK(status);
-		transpose_float_matrix(tmpBuff, this->weightT[i], this->dimensions[i], this->dimensions[i-1]);  // make this->weightT[i] in transposed format
-		clReleaseMemObject(tmpBuff);
+		     CL_CHECK(status);
+		     transpose_float_matrix(tmpBuff, this->weightT[i], this->dimensions[i], this->dimensions[i-1]);  // make this->weightT[i] in transposed format
+		     clReleaseMemObject(tmpBuff);
+		};
 
 
 		this->biases[i] = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE|CL_MEM_COPY_HOST_PTR, sizeof(cl_float)*this->dimensions[i],
 			                               provider.biases[i],&status);
 		CL_CHECK(status);
 
-		this->delta[i] = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*this->dimensions[i]*this->minibatch,NULL,&status);
+		this->delta[i] = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, actSize*this->dimensions[i]*this->minibatch,NULL,&status);
 		CL_CHECK(status);
 	}
 
+	this->weightHalf = NULL;
+	if ( this->actType == MLP_DATA_FLOAT16 ) {
+		 int maxDim = 0;
+
+		 this->weightHalf = new cl_mem[this->nLayers];
+		 for (int i = 1; i < this->nLayers; i++ ) {
+			  this->weightHalf[i] = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_half)*this->dimensions[i-1]*this->dimensions[i], NULL, &status);
+			  CL_CHECK(status);
+
+			  cmn_convert_to_half(this->CLCtx->m_queues[0], this->mykerns, this->weightT[i], this->weightHalf[i], this->dimensions[i-1]*this->dimensions[i], 1.0f);
+		 };
+
+		 for (int i = 0; i < this->nLayers; i++ )
+			  maxDim = std::max<int>(maxDim, this->dimensions[i]);
+
+		 this->floatMem1 = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*maxDim*this->minibatch, NULL, &status);
+		 CL_CHECK(status);
+		 this->floatMem2 = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*maxDim*this->minibatch, NULL, &status);
+		 CL_CHECK(status);
+
+		 this->lossScale = 32768.0f;
+		 this->goodSteps = 0;
+	};
+
 	// for output layer
 	this->output = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*(this->dimensions[this->nLayers-1])*this->minibatch,NULL,&status);
 	CL_CHECK(status);
@@ -244,6 +344,16 @@ void MLPTrainerOCL::release_ocl_buffers()
 	CL_CHECK( clReleaseMemObject(this->output) );
 	CL_CHECK( clReleaseMemObject(this->target) );
 
+	if ( this->weightHalf ) {
+		 for (int i = 1; i < this->nLayers; i++ )
+			  CL_CHECK( clReleaseMemObject(this->weightHalf[i]) );
+
+		 CL_CHECK( clReleaseMemObject(this->floatMem1) );
+		 CL_CHECK( clReleaseMemObject(this->floatMem2) );
+
+		 delete [] this->weightHalf;
+	};
+
 	if ( this->inputs )
 		delete [] this->inputs;
 	if ( this->weightT )
@@ -254,6 +364,214 @@ void MLPTrainerOCL::release_ocl_buffers()
 		delete [] this->biases;
 };
 
+// the buffers are only needed by batchTrainingWithCheckPointing() with sampled softmax. Each batch uses the target classes of its
+// frames and at least sampledClasses classes in total
+void MLPTrainerOCL::create_sampled_buffers()
+{
+	cl_int status;
+	int outDim = this->dimensions[this->nLayers-1];
+	int inDim = this->dimensions[this->nLayers-2];
+
+	this->maxSampled = std::max<int>(this->sampledClasses, std::min<int>(this->minibatch, outDim));
+
+	this->samples = new int[this->maxSampled];
+	this->sampleMap = new int[outDim];
+	this->corrections = new float[this->maxSampled];
+	this->sampledLabels = new float[this->maxSampled*this->minibatch];
+	this->sampleSeed = 0;
+
+	for (int k=0; k < outDim; k++)
+		 this->sampleMap[k] = -1;
+
+	this->samplesMem = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_ONLY, sizeof(cl_int)*this->maxSampled, NULL, &status);
+	CL_CHECK(status);
+	this->correctionsMem = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_ONLY, sizeof(cl_float)*this->maxSampled, NULL, &status);
+	CL_CHECK(status);
+
+	this->sampledWeightT = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*this->maxSampled*inDim, NULL, &status);
+	CL_CHECK(status);
+	this->sampledBiases = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*this->maxSampled, NULL, &status);
+	CL_CHECK(status);
+	this->sampledBiasesMatrix = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*this->maxSampled*this->minibatch, NULL, &status);
+	CL_CHECK(status);
+
+	this->sampledOutput = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*this->maxSampled*this->minibatch, NULL, &status);
+	CL_CHECK(status);
+	this->sampledTarget = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_ONLY, sizeof(cl_float)*this->maxSampled*this->minibatch, NULL, &status);
+	CL_CHECK(status);
+	this->sampledDelta = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*this->maxSampled*this->minibatch, NULL, &status);
+	CL_CHECK(status);
+	this->sampledDeltaT = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*this->maxSampled*this->minibatch, NULL, &status);
+	CL_CHECK(status);
+
+	this->sampledVarWeight = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*this->maxSampled*inDim, NULL, &status);
+	CL_CHECK(status);
+	this->sampledVarBias = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*this->maxSampled, NULL, &status);
+	CL_CHECK(status);
+};
+
+void MLPTrainerOCL::release_sampled_buffers()
+{
+	CL_CHECK( clReleaseMemObject(this->samplesMem) );
+	CL_CHECK( clReleaseMemObject(this->correctionsMem) );
+	CL_CHECK( clReleaseMemObject(this->sampledWeightT) );
+	CL_CHECK( clReleaseMemObject(this->sampledBiases) );
+	CL_CHECK( clReleaseMemObject(this->sampledBiasesMatrix) );
+	CL_CHECK( clReleaseMemObject(this->sampledOutput) );
+	CL_CHECK( clReleaseMemObject(this->sampledTarget) );
+	CL_CHECK( clReleaseMemObject(this->sampledDelta) );
+	CL_CHECK( clReleaseMemObject(this->sampledDeltaT) );
+	CL_CHECK( clReleaseMemObject(this->sampledVarWeight) );
+	CL_CHECK( clReleaseMemObject(this->sampledVarBias) );
+
+	delete [] this->samples;
+	delete [] this->sampleMap;
+	delete [] this->corrections;
+	delete [] this->sampledLabels;
+};
+
+// the buffers are only needed by batchTrainingWithCheckPointing() with a data provider providing the CSR format of the batches, they
+// are allocated for the batches without any zero input
+void MLPTrainerOCL::create_sparse_buffers()
+{
+	cl_int status;
+	int inDim = this->dimensions[0];
+
+	this->cscColPtrs = new int[inDim+1];
+	this->cscRowIndices = new int[inDim*this->minibatch];
+	this->cscValues = new float[inDim*this->minibatch];
+
+	this->csrRowPtrsMem = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_ONLY, sizeof(cl_int)*(this->minibatch+1), NULL, &status);
+	CL_CHECK(status);
+	this->csrColIndicesMem = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_ONLY, sizeof(cl_int)*inDim*this->minibatch, NULL, &status);
+	CL_CHECK(status);
+	this->csrValuesMem = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_ONLY, sizeof(cl_float)*inDim*this->minibatch, NULL, &status);
+	CL_CHECK(status);
+
+	this->cscColPtrsMem = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_ONLY, sizeof(cl_int)*(inDim+1), NULL, &status);
+	CL_CHECK(status);
+	this->cscRowIndicesMem = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_ONLY, sizeof(cl_int)*inDim*this->minibatch, NULL, &status);
+	CL_CHECK(status);
+	this->cscValuesMem = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_ONLY, sizeof(cl_float)*inDim*this->minibatch, NULL, &status);
+	CL_CHECK(status);
+};
+
+void MLPTrainerOCL::release_sparse_buffers()
+{
+	CL_CHECK( clReleaseMemObject(this->csrRowPtrsMem) );
+	CL_CHECK( clReleaseMemObject(this->csrColIndicesMem) );
+	CL_CHECK( clReleaseMemObject(this->csrValuesMem) );
+	CL_CHECK( clReleaseMemObject(this->cscColPtrsMem) );
+	CL_CHECK( clReleaseMemObject(this->cscRowIndicesMem) );
+	CL_CHECK( clReleaseMemObject(this->cscValuesMem) );
+
+	delete [] this->cscColPtrs;
+	delete [] this->cscRowIndices;
+	delete [] this->cscValues;
+};
+
+// transfers the current batch in the CSR and CSC formats to the device, returns false without any transfer if the batch is not sparse
+// enough, then the dense inputs should be used
+bool MLPTrainerOCL::load_sparse_batch()
+{
+	int *rowPtrs;
+	int *colIndices;
+	float *values;
+	int nnz;
+	int inDim = this->dimensions[0];
+
+	MLP_CHECK(this->dataProviderp->getSparseBatchData(rowPtrs, colIndices, values, nnz));
+
+	if ( (float)nnz >= MLP_SPARSE_INPUT_DENSITY * inDim * this->minibatch )
+		 return(false);
+
+	// count the non-zeroes of each column into cscColPtrs[col+1], then cscColPtrs[col] is used as the position for the next non-zero
+	// of the column, which ends up as the start of the next column, so the offsets are shifted back at last
+	for (int k=0; k <= inDim; k++)
+		 this->cscColPtrs[k] = 0;
+
+	for (int n=0; n < nnz; n++)
+		 this->cscColPtrs[colIndices[n]+1]++;
+
+	for (int k=0; k < inDim; k++)
+		 this->cscColPtrs[k+1] += this->cscColPtrs[k];
+
+	for (int b=0; b < this->minibatch; b++)
+		 for (int n=rowPtrs[b]; n < rowPtrs[b+1]; n++) {
+			  int pos = this->cscColPtrs[colIndices[n]]++;
+
+			  this->cscRowIndices[pos] = b;
+			  this->cscValues[pos] = values[n];
+		 };
+
+	for (int k=inDim; k > 0; k--)
+		 this->cscColPtrs[k] = this->cscColPtrs[k-1];
+	this->cscColPtrs[0] = 0;
+
+	CL_CHECK(clEnqueueWriteBuffer(this->CLCtx->m_queues[0],this->csrRowPtrsMem,CL_TRUE,0,sizeof(cl_int)*(this->minibatch+1),rowPtrs,0,NULL,MLP_PROF_EVENT(this->mykerns,"write_sparse",-1) ));
+	CL_CHECK(clEnqueueWriteBuffer(this->CLCtx->m_queues[0],this->cscColPtrsMem,CL_TRUE,0,sizeof(cl_int)*(inDim+1),this->cscColPtrs,0,NULL,MLP_PROF_EVENT(this->mykerns,"write_sparse",-1) ));
+
+	if ( nnz > 0 ) {
+		 CL_CHECK(clEnqueueWriteBuffer(this->CLCtx->m_queues[0],this->csrColIndicesMem,CL_TRUE,0,sizeof(cl_int)*nnz,colIndices,0,NULL,MLP_PROF_EVENT(this->mykerns,"write_sparse",-1) ));
+		 CL_CHECK(clEnqueueWriteBuffer(this->CLCtx->m_queues[0],this->csrValuesMem,CL_TRUE,0,sizeof(cl_float)*nnz,values,0,NULL,MLP_PROF_EVENT(this->mykerns,"write_sparse",-1) ));
+		 CL_CHECK(clEnqueueWriteBuffer(this->CLCtx->m_queues[0],this->cscRowIndicesMem,CL_TRUE,0,sizeof(cl_int)*nnz,this->cscRowIndices,0,NULL,MLP_PROF_EVENT(this->mykerns,"write_sparse",-1) ));
+		 CL_CHECK(clEnqueueWriteBuffer(this->CLCtx->m_queues[0],this->cscValuesMem,CL_TRUE,0,sizeof(cl_float)*nnz,this->cscValues,0,NULL,MLP_PROF_EVENT(this->mykerns,"write_sparse",-1) ));
+	};
+
+	return(true);
+};
+
+// choose the output classes used by the current batch and upload them with their corrections and labels, returns the number of
+// the classes. The target class of each frame is always used, the other classes are sampled uniformly without replacement, so
+// each sampled class stands for (outDim-nTargets)/nNegatives classes and its logit is corrected by the log of this ratio
+int MLPTrainerOCL::sample_classes(float *labels)
+{
+	int outDim = this->dimensions[this->nLayers-1];
+	int num = 0;
+
+	for (int b=0; b < this->minibatch; b++) {
+		 float *frameLabels = &labels[b*outDim];
+		 int target = (int)(std::max_element(frameLabels, frameLabels+outDim) - frameLabels);
+
+		 if ( this->sampleMap[target] < 0 ) {
+			  this->sampleMap[target] = num;
+			  this->samples[num++] = target;
+		 };
+	};
+
+	int nTargets = num;
+	int nSampled = std::max<int>(this->sampledClasses, nTargets);
+
+	while ( num < nSampled ) {
+		 this->sampleSeed += 0x9e3779b97f4a7c15ULL;
+		 int cls = (int)( mixBits(this->sampleSeed) % (unsigned long long)outDim );
+
+		 if ( this->sampleMap[cls] < 0 ) {
+			  this->sampleMap[cls] = num;
+			  this->samples[num++] = cls;
+		 };
+	};
+
+	float correction = (nSampled > nTargets)? logf( (float)(outDim-nTargets) / (float)(nSampled-nTargets) ) : 0.0f;
+
+	for (int k=0; k < nSampled; k++)
+		 this->corrections[k] = (k < nTargets)? 0.0f : correction;
+
+	for (int b=0; b < this->minibatch; b++)
+		 for (int k=0; k < nSampled; k++)
+			  this->sampledLabels[b*nSampled+k] = labels[b*outDim+this->samples[k]];
+
+	// clear the map for the next batch
+	for (int k=0; k < nSampled; k++)
+		 this->sampleMap[this->samples[k]] = -1;
+
+	CL_CHECK(clEnqueueWriteBuffer(this->CLCtx->m_queues[0],this->samplesMem,CL_TRUE,0,sizeof(cl_int)*nSampled,this->samples,0,NULL,MLP_PROF_EVENT(this->mykerns,"write_samples",-1) ));
+	CL_CHECK(clEnqueueWriteBuffer(this->CLCtx->m_queues[0],this->correctionsMem,CL_TRUE,0,sizeof(cl_float)*nSampled,this->corrections,0,NULL,MLP_PROF_EVENT(this->mykerns,"write_samples",-1) ));
+	CL_CHECK(clEnqueueWriteBuffer(this->CLCtx->m_queues[0],this->sampledTarget,CL_TRUE,0,sizeof(cl_float)*nSampled*this->minibatch,this->sampledLabels,0,NULL,MLP_PROF_EVENT(this->mykerns,"write_samples",-1) ));
+
+	return(nSampled);
+};
+
 void MLPTrainerOCL::synchronizeNetConfig(MLPConfigProvider &configProvider)
 {
 	cl_int status;
@@ -268,19 +586,20 @@ void MLPTrainerOCL::synchronizeNetConfig(MLPConfigProvider &configProvider)
 	configProvider.costFunc = this->costFunc;
 	configProvider.momentum = this->momentum;
 	configProvider.epochs = this->epochs; 
+	configProvider.sampledClasses = this->sampledClasses;
+	configProvider.accumulateSteps = this->accumulateSteps;
 
 	// The Input/Output of layer i is stored in this->inputs[i+1], so this->inputs[1] is for the input layer, this->inputs[2] is for
 	// the first hidden layer, this->inputs[0] is for the output layer
+	// the weights are read back in the transposed format used by the trainer, so no transposition is needed on the device,
+	// the MLPTester and MLPPredictor can use the weights in either format
+	configProvider.weightLayout = MLP_WEIGHTS_TRANSPOSED;
+
 	for (int i = 1; i < this->nLayers; i++ )
 	{
-		cl_mem tmpBuff;
-
-	    tmpBuff = clCreateBuffer(this->CLCtx->m_context, CL_MEM_READ_WRITE, sizeof(cl_float)*this->dimensions[i-1]*this->dimensions[i], NULL,&status);
-		this->transpose_float_matrix(this->weightT[i], tmpBuff, this->dimensions[i-1], this->dimensions[i]);    // make tmpBuff in original format
-		status = clEnqueueReadBuffer(this->CLCtx->m_queues[0], tmpBuff, CL_TRUE, 0,sizeof(cl_float)*this->dimensions[i-1]*this->dimensions[i],
+		status = clEnqueueReadBuffer(this->CLCtx->m_queues[0], this->weightT[i], CL_TRUE, 0,sizeof(cl_float)*this->dimensions[i-1]*this->dimensions[i],
 			                         configProvider.weights[i], 0, NULL, NULL);
 		CL_CHECK(status);
-        clReleaseMemObject(tmpBuff);
 
 		status = clEnqueueReadBuffer(this->CLCtx->m_queues[0], this->biases[i], CL_TRUE, 0,sizeof(cl_float)*this->dimensions[i],
 			                         configProvider.biases[i], 0, NULL, NULL);
@@ -324,12 +643,34 @@ void MLPTrainerOCL::activate(int layer, cl_mem x, cl_mem y, int width, int heigh
 	case AFUNC_IDENTITY:
 	    cmn_activate_identity(this->CLCtx->m_queues[0],this->mykerns,x,y,width,height);
         return;
+	case AFUNC_RELU:
+	    cmn_activate_relu(this->CLCtx->m_queues[0],this->mykerns,x,y,width,height,0.0f);
+		return;
+	case AFUNC_LEAKY_RELU:
+	    cmn_activate_relu(this->CLCtx->m_queues[0],this->mykerns,x,y,width,height,MLP_LEAKY_RELU_SLOPE);
+		return;
 	default:
 		mlp_log("MLPTrainer", "The assigned activation function for this layer is not supported.");
 		MLP_Exception("");
 	};
 };
 
+// Output = activate(Input + Bias) by one kernel reading the biases vector, returns false if the activation function of the layer
+// has no such fused kernel, then the caller adds the biases and calls activate()
+bool MLPTrainerOCL::activateWithBias(int layer, cl_mem x, cl_mem biases, cl_mem y, int width, int height)
+{
+	switch (this->actFuncs[layer] ) {
+	case AFUNC_RELU:
+		cmn_bias_activate_relu(this->CLCtx->m_queues[0],this->mykerns,x,biases,y,width,height,0.0f);
+		return(true);
+	case AFUNC_LEAKY_RELU:
+		cmn_bias_activate_relu(this->CLCtx->m_queues[0],this->mykerns,x,biases,y,width,height,MLP_LEAKY_RELU_SLOPE);
+		return(true);
+	default:
+		return(false);
+	};
+};
+
 
 void MLPTrainerOCL::calculateError(cl_mem output, cl_mem target, int width, int height, float &ret )
 {
@@ -374,6 +715,12 @@ void MLPTrainerOCL::derivative(int layer, cl_mem delta1, cl_mem y, cl_mem delta2
 	case AFUNC_TANH:
 		cmn_derivative_tanh(this->CLCtx->m_queues[0],this->mykerns,delta1,y,delta2,width,height);
 		return;
+	case AFUNC_RELU:
+		cmn_derivative_relu(this->CLCtx->m_queues[0],this->mykerns,delta1,y,delta2,width,height,0.0f);
+		return;
+	case AFUNC_LEAKY_RELU:
+		cmn_derivative_relu(this->CLCtx->m_queues[0],this->mykerns,delta1,y,delta2,width,height,MLP_LEAKY_RELU_SLOPE);
+		return;
 	default:
 		mlp_log("MLPTrainer", "The assigned activation function for this layer is not supported.");
 		MLP_Exception("");
@@ -388,6 +735,9 @@ int MLPTrainerOCL::batchTrainingWithCheckPointing(int maxBatches, int startBatch
 		 MLP_Exception("");
 	};
 
+	if ( this->actType == MLP_DATA_FLOAT16 )
+		 return( this->batchTrainingHalf(maxBatches, startBatch, startEpoch, doChkPointing) );
+
 	cl_int status;
 	clAmdBlasStatus blasStatus;
 
@@ -398,14 +748,8 @@ int MLPTrainerOCL::batchTrainingWithCheckPointing(int maxBatches, int startBatch
 	cl_mem OnesVector;     // in length of this->minibatch
 	cl_mem *deltaT = new cl_mem[this->nLayers];
 	cl_mem *biasesMatrix = new cl_mem[this->nLayers];
-	cl_mem *varWeight1 = new cl_mem[this->nLayers];
-	cl_mem *varWeight2 = new cl_mem[this->nLayers];
-	cl_mem *lastVarWeight = varWeight1;
-	cl_mem *curVarWeight = varWeight2;
-	cl_mem *varBias1 = new cl_mem[this->nLayers];
-	cl_mem *varBias2 = new cl_mem[this->nLayers];
-	cl_mem *lastVarBias = varBias1;
-	cl_mem *curVarBias = varBias2;
+	cl_mem *varWeight = new cl_mem[this->nLayers];
+	cl_mem *varBias = new cl_mem[this->nLayers];
 
 
 	// create deltaT buffer for each layer except for the input layer
@@ -437,30 +781,20 @@ int MLPTrainerOCL::batchTrainingWithCheckPointing(int maxBatches, int startBatch
 	};
 
 
-	// create last and current buffers for the variance of weights for each layer except for the input layer
-	// initialize each <last buffer> for the variance of weights to all zeroes
+	// create the buffers for the variance of weights and biases of each layer except for the input layer, initialized to all zeroes.
+	// The variance is kept as a velocity, the Sgemm computing the variance of a batch blends it with momentum times the variance of
+	// the last update in place, so no separate buffer for the last variance is needed
 	for (int i = 1; i < this->nLayers; i++) {
 		float *tmpHostBuff;
 
 		tmpHostBuff = new float[this->dimensions[i-1]*this->dimensions[i]];
 		for (int k=0; k < this->dimensions[i-1]*this->dimensions[i]; k++ )
 			 tmpHostBuff[k] = 0.0f;
- 	    lastVarWeight[i] = clCreateBuffer(this->CLCtx->m_context,CL_MEM_READ_WRITE|CL_MEM_COPY_HOST_PTR,sizeof(cl_float)*this->dimensions[i-1]*this->dimensions[i],
+ 	    varWeight[i] = clCreateBuffer(this->CLCtx->m_context,CL_MEM_READ_WRITE|CL_MEM_COPY_HOST_PTR,sizeof(cl_float)*this->dimensions[i-1]*this->dimensions[i],
 			                               tmpHostBuff,&status);
         CL_CHECK(status);
 
- 	    curVarWeight[i] = clCreateBuffer(this->CLCtx->m_context,CL_MEM_READ_WRITE,sizeof(cl_float)*this->dimensions[i-1]*this->dimensions[i],NULL,&status);
-        CL_CHECK(status);
-
-		delete [] tmpHostBuff;
-
-		tmpHostBuff = new float[this->dimensions[i]];
-	    for (int k=0; k < this->dimensions[i]; k++ )
-			 tmpHostBuff[k] = 0.0f;
-		lastVarBias[i] = clCreateBuffer(this->CLCtx->m_context,CL_MEM_READ_WRITE|CL_MEM_COPY_HOST_PTR,sizeof(cl_float)*this->dimensions[i], tmpHostBuff,&status);
-        CL_CHECK(status);
-
-	    curVarBias[i] = clCreateBuffer(this->CLCtx->m_context,CL_MEM_READ_WRITE,sizeof(cl_float)*this->dimensions[i],NULL,&status);
+		varBias[i] = clCreateBuffer(this->CLCtx->m_context,CL_MEM_READ_WRITE|CL_MEM_COPY_HOST_PTR,sizeof(cl_float)*this->dimensions[i], tmpHostBuff,&status);
         CL_CHECK(status);
 
 		delete [] tmpHostBuff;
@@ -471,6 +805,14 @@ int MLPTrainerOCL::batchTrainingWithCheckPointing(int maxBatches, int startBatch
 	CL_CHECK(status);
 	this->reduceBuff = new float[this->minibatch];
 
+	if ( this->sampledClasses > 0 )
+		 this->create_sampled_buffers();
+
+	// with sampled softmax and no hidden layer, the first layer is the sampled output layer, which uses the dense inputs
+	bool sparseInput = this->dataProviderp->haveSparseFeatures() && ( (this->sampledClasses == 0) || (this->nLayers > 2) );
+	if ( sparseInput )
+		 this->create_sparse_buffers();
+
     CL_CHECK(clFinish(this->CLCtx->m_queues[0]));
 
 	//ofstream outfile;
@@ -479,9 +821,12 @@ int MLPTrainerOCL::batchTrainingWithCheckPointing(int maxBatches, int startBatch
 
 	int myBatch;
 	int myEpoch;
+	int accStep = 0;          // number of the batches whose variances have been summed since the last update of the weights
+	int epochBatches = (maxBatches == 0)? this->dataProviderp->getTotalBatches() : std::min<int>(this->dataProviderp->getTotalBatches(), maxBatches);
 
 	this->currBatchNo = startBatch;
 	this->currEpoch = startEpoch;
+	this->pendingBatches = 0;
 
 	myBatch = this->currBatchNo;
 	myEpoch = this->currEpoch;
@@ -490,32 +835,90 @@ int MLPTrainerOCL::batchTrainingWithCheckPointing(int maxBatches, int startBatch
 
 	    while (  this->dataProviderp->batchAvailable() && (maxBatches == 0 || myBatch < maxBatches) ) {
 
+			 DNNTraceSpan span(DNN_TRACE_TRAINER, "wait_batch");
+
 			 MLP_CHECK(this->dataProviderp->getBatchData(this->minibatch,l_features,l_labels,true));  // blocking method
 
-			 CL_CHECK(clEnqueueWriteBuffer(this->CLCtx->m_queues[0],this->inputs[1],CL_TRUE,0,sizeof(cl_float)*this->dimensions[0]*this->minibatch,l_features,0,NULL,NULL ));
-			 CL_CHECK(clEnqueueWriteBuffer(this->CLCtx->m_queues[0],this->target,CL_TRUE,0,sizeof(cl_float)*this->dimensions[this->nLayers-1]*this->minibatch,l_labels,0,NULL,NULL ));
+			 span.next("upload");
+
+			 // the dense inputs are not needed by the batch using the sparse kernel
+			 bool sparseBatch = sparseInput && this->load_sparse_batch();
+			 if ( !sparseBatch )
+			      CL_CHECK(clEnqueueWriteBuffer(this->CLCtx->m_queues[0],this->inputs[1],CL_TRUE,0,sizeof(cl_float)*this->dimensions[0]*this->minibatch,l_features,0,NULL,MLP_PROF_EVENT(this->mykerns,"write_inputs",-1) ));
+
+			 // with sampled softmax, the output layer only has the nSampled classes chosen for this batch
+			 int nSampled = 0;
+			 if ( this->sampledClasses > 0 )
+				  nSampled = this->sample_classes(l_labels);
+			 else
+			      CL_CHECK(clEnqueueWriteBuffer(this->CLCtx->m_queues[0],this->target,CL_TRUE,0,sizeof(cl_float)*this->dimensions[this->nLayers-1]*this->minibatch,l_labels,0,NULL,MLP_PROF_EVENT(this->mykerns,"write_labels",-1) ));
+
+			 span.next("forward");
 
 			 for (int i = 1; i < this->nLayers; i++) {
 
-			 	 // Input[i] = Output[i-1] * Weight[i]     , here Weight[i] is in transposed form
-				 blasStatus = clAmdBlasSgemm(clAmdBlasRowMajor,clAmdBlasNoTrans,clAmdBlasTrans,this->minibatch,this->dimensions[i],this->dimensions[i-1],1.0f,this->inputs[i],
-					this->dimensions[i-1],this->weightT[i],this->dimensions[i-1],0.0f,this->inputs[(i+1)%this->nLayers],this->dimensions[i],1,&this->CLCtx->m_queues[0],0,NULL,NULL);
-				 AMDBLAS_CHECK(blasStatus);
+				 if ( (i == this->nLayers-1) && (nSampled > 0) ) {
+					  cmn_gather_rows(this->CLCtx->m_queues[0], this->mykerns, this->weightT[i], this->samplesMem, this->sampledWeightT, this->dimensions[i-1], nSampled);
+					  cmn_gather_rows(this->CLCtx->m_queues[0], this->mykerns, this->biases[i], this->samplesMem, this->sampledBiases, 1, nSampled);
+
+					  // the corrections of the sampled classes are added to their biases
+					  blasStatus = clAmdBlasSaxpy(nSampled, 1.0f, this->correctionsMem, 0, 1, this->sampledBiases, 0, 1, 1, &this->CLCtx->m_queues[0], 0, NULL,MLP_PROF_EVENT(this->mykerns,"saxpy_corrections",i));
+					  AMDBLAS_CHECK(blasStatus);
+
+					  this->expandFloatVectorToMatrix(this->sampledBiases, this->sampledBiasesMatrix, nSampled, this->minibatch);
+
+					  // sampledOutput = Output[i-1] * sampledWeight
+				      blasStatus = clAmdBlasSgemm(clAmdBlasRowMajor,clAmdBlasNoTrans,clAmdBlasTrans,this->minibatch,nSampled,this->dimensions[i-1],1.0f,this->inputs[i],
+					     this->dimensions[i-1],this->sampledWeightT,this->dimensions[i-1],0.0f,this->sampledOutput,nSampled,1,&this->CLCtx->m_queues[0],0,NULL,MLP_PROF_EVENT(this->mykerns,"sgemm_forward",i));
+				      AMDBLAS_CHECK(blasStatus);
+
+				      blasStatus = clAmdBlasSaxpy(nSampled*this->minibatch, 1.0f, this->sampledBiasesMatrix, 0, 1, this->sampledOutput, 0, 1, 1,
+					                        &this->CLCtx->m_queues[0], 0, NULL,MLP_PROF_EVENT(this->mykerns,"saxpy_bias",i));
+				      AMDBLAS_CHECK(blasStatus);
+
+				      this->activate(i, this->sampledOutput, this->sampledOutput, nSampled, this->minibatch);
+					  continue;
+				 };
+
+				 if ( (i == 1) && sparseBatch )
+					  // Input[1] = Output[0] * Weight[1], with Output[0] in the CSR format
+					  cmn_spmm_csr(this->CLCtx->m_queues[0], this->mykerns, this->csrRowPtrsMem, this->csrColIndicesMem, this->csrValuesMem, this->weightT[1],
+						           this->inputs[2%this->nLayers], this->minibatch, this->dimensions[1], this->dimensions[0], true, false, 1.0f, 0.0f);
+				 else {
+			 	      // Input[i] = Output[i-1] * Weight[i]     , here Weight[i] is in transposed form
+				      blasStatus = clAmdBlasSgemm(clAmdBlasRowMajor,clAmdBlasNoTrans,clAmdBlasTrans,this->minibatch,this->dimensions[i],this->dimensions[i-1],1.0f,this->inputs[i],
+					     this->dimensions[i-1],this->weightT[i],this->dimensions[i-1],0.0f,this->inputs[(i+1)%this->nLayers],this->dimensions[i],1,&this->CLCtx->m_queues[0],0,NULL,MLP_PROF_EVENT(this->mykerns,"sgemm_forward",i));
+				      AMDBLAS_CHECK(blasStatus);
+				 };
+
+				 // Output[i] = activate(Input[i] + Bias[i]) by one kernel for the ReLU layers
+				 if ( this->activateWithBias(i, this->inputs[(i+1)%this->nLayers], this->biases[i], this->inputs[(i+1)%this->nLayers], this->dimensions[i], this->minibatch) )
+					  continue;
 
 				 // Input[i] = Input[i] + 1.0 * Bias[i],   regarding the two Matrixes as  two vectors
 				 blasStatus = clAmdBlasSaxpy(this->dimensions[i]*this->minibatch, 1.0f, biasesMatrix[i], 0, 1, this->inputs[(i+1)%this->nLayers], 0, 1, 1,
-					                        &this->CLCtx->m_queues[0], 0, NULL, NULL);
+					                        &this->CLCtx->m_queues[0], 0, NULL,MLP_PROF_EVENT(this->mykerns,"saxpy_bias",i));
 				 AMDBLAS_CHECK(blasStatus);
 
 				 // Output[i] = activate(Input[i])
 				 this->activate(i, this->inputs[(i+1)%this->nLayers], this->inputs[(i+1)%this->nLayers], this->dimensions[i], this->minibatch);
 			 }
 
+			 // the output layer used by the error and delta
+			 cl_mem myOutput = (nSampled > 0)? this->sampledOutput : this->output;
+			 cl_mem myTarget = (nSampled > 0)? this->sampledTarget : this->target;
+			 cl_mem myDelta = (nSampled > 0)? this->sampledDelta : this->delta[this->nLayers-1];
+			 cl_mem myDeltaT = (nSampled > 0)? this->sampledDeltaT : deltaT[this->nLayers-1];
+			 int outWidth = (nSampled > 0)? nSampled : this->dimensions[this->nLayers-1];
+
+			 // the enqueued forward commands are only waited for by the blocking readback of the error
+			 span.next("loss_readback");
+
 			 float costval=0.0f;
 
 			 //check_memory("Output", this->CLCtx->m_queues[0], this->output, this->dimensions[this->nLayers-1]*this->minibatch, check_zero);
 
- 			 this->calculateError(this->output, this->target, this->dimensions[this->nLayers-1], this->minibatch, costval);
+ 			 this->calculateError(myOutput, myTarget, outWidth, this->minibatch, costval);
 
 			 cout.precision(8);
 			 cout << std::showpoint << std::fixed << endl;
@@ -523,16 +926,21 @@ int MLPTrainerOCL::batchTrainingWithCheckPointing(int maxBatches, int startBatch
 
              CL_CHECK(clFinish(this->CLCtx->m_queues[0]));
 
-		     this->calculateDelta(this->output, this->target, this->delta[this->nLayers-1], this->dimensions[this->nLayers-1], this->minibatch);
+			 span.next("backward");
+
+		     this->calculateDelta(myOutput, myTarget, myDelta, outWidth, this->minibatch);
 
 			 CL_CHECK(clFinish(this->CLCtx->m_queues[0]));
 
-			 this->transpose_float_matrix(this->delta[this->nLayers-1], deltaT[this->nLayers-1], this->dimensions[this->nLayers-1], this->minibatch);
+			 this->transpose_float_matrix(myDelta, myDeltaT, outWidth, this->minibatch);
 
 			 for ( int i = this->nLayers - 2; i > 0; i-- ) {
-				 // Delta[i] = Delta[i+1] * WeightT[i+1],
-				 blasStatus = clAmdBlasSgemm( clAmdBlasRowMajor, clAmdBlasNoTrans, clAmdBlasNoTrans, this->minibatch, this->dimensions[i], this->dimensions[i+1],1.0f, this->delta[i+1],
-					this->dimensions[i+1], this->weightT[i+1], this->dimensions[i],  0.0f, this->delta[i], this->dimensions[i], 1, &this->CLCtx->m_queues[0],0,NULL,NULL );
+				 bool nextSampled = (i+1 == this->nLayers-1) && (nSampled > 0);
+
+				 // Delta[i] = Delta[i+1] * WeightT[i+1],  only the rows of the sampled classes with sampled softmax
+				 blasStatus = clAmdBlasSgemm( clAmdBlasRowMajor, clAmdBlasNoTrans, clAmdBlasNoTrans, this->minibatch, this->dimensions[i], nextSampled? nSampled : this->dimensions[i+1],1.0f,
+					nextSampled? this->sampledDelta : this->delta[i+1], nextSampled? nSampled : this->dimensions[i+1], nextSampled? this->sampledWeightT : this->weightT[i+1],
+					this->dimensions[i],  0.0f, this->delta[i], this->dimensions[i], 1, &this->CLCtx->m_queues[0],0,NULL,MLP_PROF_EVENT(this->mykerns,"sgemm_delta",i) );
 				 AMDBLAS_CHECK(blasStatus);
 
 				 // Delta[i] = derivative(Delta[i],Output[i])
@@ -543,6 +951,15 @@ int MLPTrainerOCL::batchTrainingWithCheckPointing(int maxBatches, int startBatch
 
 	         CL_CHECK( clFinish(this->CLCtx->m_queues[0]) );
 
+			 span.next("update");
+
+			 // the variance of the first batch after an update is blended with momentum times the variance of the last update. With
+			 // accumulateSteps > 1, the variances of the successive batches are summed in varWeight and varBias, the weights are only
+			 // updated by the last batch of each group of accumulateSteps batches, or by the last batch of the epoch. Since the variances
+			 // of one batch are summed over its frames, this is the same as training with a minibatch accumulateSteps times larger
+			 float beta = (accStep > 0)? 1.0f : this->momentum;
+			 bool doUpdate = (++accStep == this->accumulateSteps) || (myBatch+1 >= epochBatches);
+
 			 if ( doChkPointing)
 			      DNN_LOCK(&this->chkPointingLock);
 
@@ -550,30 +967,49 @@ int MLPTrainerOCL::batchTrainingWithCheckPointing(int maxBatches, int startBatch
 				  float coef = this->etas[i];
 				  float mm = this->momentum;
 
-				  // curVarWeightT[i] = DeltaT[i] * Output[i-1] , here curVarWeight[i] is in transposed form
-				  blasStatus = clAmdBlasSgemm( clAmdBlasRowMajor,clAmdBlasNoTrans,clAmdBlasNoTrans, this->dimensions[i], this->dimensions[i-1], this->minibatch, coef,
-					  deltaT[i], this->minibatch, this->inputs[i],this->dimensions[i-1],0.0f,curVarWeight[i],this->dimensions[i-1],1,&this->CLCtx->m_queues[0],0,NULL,NULL);
+				  if ( (i == this->nLayers-1) && (nSampled > 0) ) {
+					   // sampledVarWeight = sampledDeltaT * Output[i-1], then the weights and variance rows of the sampled classes are updated in place
+				       blasStatus = clAmdBlasSgemm( clAmdBlasRowMajor,clAmdBlasNoTrans,clAmdBlasNoTrans, nSampled, this->dimensions[i-1], this->minibatch, coef,
+					       this->sampledDeltaT, this->minibatch, this->inputs[i],this->dimensions[i-1],0.0f,this->sampledVarWeight,this->dimensions[i-1],1,&this->CLCtx->m_queues[0],0,NULL,MLP_PROF_EVENT(this->mykerns,"sgemm_gradient",i));
+				       AMDBLAS_CHECK(blasStatus);
+
+					   cmn_update_sampled_rows(this->CLCtx->m_queues[0], this->mykerns, this->weightT[i], varWeight[i], this->sampledVarWeight, this->samplesMem,
+						                       this->dimensions[i-1], nSampled, mm);
+
+				       // sampledVarBias = sampledDeltaT * (1,1, ... 1)T
+                       blasStatus=clAmdBlasSgemv(clAmdBlasRowMajor, clAmdBlasNoTrans, nSampled, this->minibatch, coef, this->sampledDeltaT, this->minibatch, OnesVector,
+					       0, 1, 0.0f, this->sampledVarBias, 0, 1, 1, &this->CLCtx->m_queues[0], 0, NULL,MLP_PROF_EVENT(this->mykerns,"sgemv_bias_gradient",i));
+				       AMDBLAS_CHECK(blasStatus);
+
+					   cmn_update_sampled_rows(this->CLCtx->m_queues[0], this->mykerns, this->biases[i], varBias[i], this->sampledVarBias, this->samplesMem, 1, nSampled, mm);
+					   continue;
+				  };
+
+				  if ( (i == 1) && sparseBatch )
+					   // varWeightT[1] = (Output[0]T * Delta[1])T + beta * varWeightT[1], with Output[0]T in the CSR format, which is Output[0] in the CSC format
+					   cmn_spmm_csr(this->CLCtx->m_queues[0], this->mykerns, this->cscColPtrsMem, this->cscRowIndicesMem, this->cscValuesMem, this->delta[1], varWeight[1],
+						            this->dimensions[0], this->dimensions[1], this->minibatch, false, true, coef, beta);
+				  else {
+				       // varWeightT[i] = DeltaT[i] * Output[i-1] + beta * varWeightT[i], here varWeight[i] is in transposed form
+				       blasStatus = clAmdBlasSgemm( clAmdBlasRowMajor,clAmdBlasNoTrans,clAmdBlasNoTrans, this->dimensions[i], this->dimensions[i-1], this->minibatch, coef,
+					       deltaT[i], this->minibatch, this->inputs[i],this->dimensions[i-1],beta,varWeight[i],this->dimensions[i-1],1,&this->CLCtx->m_queues[0],0,NULL,MLP_PROF_EVENT(this->mykerns,"sgemm_gradient",i));
+				       AMDBLAS_CHECK(blasStatus);
+				  };
+
+				  // varBias[i] = DeltaT[i] * (1,1, ... 1)T + beta * varBias[i]
+                  blasStatus=clAmdBlasSgemv(clAmdBlasRowMajor, clAmdBlasNoTrans, this->dimensions[i], this->minibatch, coef, deltaT[i], this->minibatch, OnesVector,
+					  0, 1, beta, varBias[i], 0, 1, 1, &this->CLCtx->m_queues[0], 0, NULL,MLP_PROF_EVENT(this->mykerns,"sgemv_bias_gradient",i));
 				  AMDBLAS_CHECK(blasStatus);
 
-				  // curVarWeightT[i] = curVarWeightT[i] + mm * lastVarWeightT[i], regarding the two Matrixes as two vectors
-				  blasStatus = clAmdBlasSaxpy(this->dimensions[i]*this->dimensions[i-1],mm,lastVarWeight[i],0,1,curVarWeight[i],0,1,1,&this->CLCtx->m_queues[0],0,NULL,NULL);
-                  AMDBLAS_CHECK(blasStatus);
-
-				  // WeightT[i] = WeightT[i] + 1.0 * curVarWeightT[i],  regarding the two Matrixes as two vectors
-				  blasStatus = clAmdBlasSaxpy(this->dimensions[i]*this->dimensions[i-1],1.0f,curVarWeight[i],0,1,this->weightT[i],0,1,1,&this->CLCtx->m_queues[0],0,NULL,NULL);
-                  AMDBLAS_CHECK(blasStatus);
-
-				  // curVarBias[i] = DeltaT[i] * (1,1, ... 1)T
-                  blasStatus=clAmdBlasSgemv(clAmdBlasRowMajor, clAmdBlasNoTrans, this->dimensions[i], this->minibatch, coef, deltaT[i], this->minibatch, OnesVector,
-					  0, 1, 0.0f, curVarBias[i], 0, 1, 1, &this->CLCtx->m_queues[0], 0, NULL, NULL);
+				  if ( !doUpdate )
+					   continue;
 
-                  // curVarBias[i] = curVarBias[i] + mm * lastVarBias[i]
-				  blasStatus = clAmdBlasSaxpy(this->dimensions[i],mm,lastVarBias[i],0,1,curVarBias[i],0,1,1,&this->CLCtx->m_queues[0],0,NULL,NULL);
+				  // WeightT[i] = WeightT[i] + 1.0 * varWeightT[i],  regarding the two Matrixes as two vectors
+				  blasStatus = clAmdBlasSaxpy(this->dimensions[i]*this->dimensions[i-1],1.0f,varWeight[i],0,1,this->weightT[i],0,1,1,&this->CLCtx->m_queues[0],0,NULL,MLP_PROF_EVENT(this->mykerns,"saxpy_update",i));
                   AMDBLAS_CHECK(blasStatus);
 
-
-				  // Bias[i] = Bias[i] + 1.0 * curVarBias[i]
-				  blasStatus = clAmdBlasSaxpy(this->dimensions[i],1.0f,curVarBias[i],0,1,this->biases[i],0,1,1,&this->CLCtx->m_queues[0],0,NULL,NULL);
+				  // Bias[i] = Bias[i] + 1.0 * varBias[i]
+				  blasStatus = clAmdBlasSaxpy(this->dimensions[i],1.0f,varBias[i],0,1,this->biases[i],0,1,1,&this->CLCtx->m_queues[0],0,NULL,MLP_PROF_EVENT(this->mykerns,"saxpy_update_bias",i));
                   AMDBLAS_CHECK(blasStatus);
 
 				  this->expandFloatVectorToMatrix(this->biases[i], biasesMatrix[i], this->dimensions[i], this->minibatch);
@@ -583,17 +1019,14 @@ int MLPTrainerOCL::batchTrainingWithCheckPointing(int maxBatches, int startBatch
 			 if ( doChkPointing )
 			     DNN_UNLOCK(&this->chkPointingLock);
 
-			 // swap the curVarWeight and lastVarWeight pointers
-			 cl_mem *tmpPointer;
-			 tmpPointer = curVarWeight;
-			 curVarWeight = lastVarWeight;
-			 lastVarWeight = tmpPointer;
+			 if ( doUpdate )
+				  accStep = 0;
 
-             // swap the curVarBias and lastVarBias pointers
-		     tmpPointer = curVarBias;
-			 curVarBias = lastVarBias;
-			 lastVarBias = tmpPointer;
+			 span.end();
 
+			 // the device times of the enqueued commands are summed up once per batch
+			 if ( this->mykerns.profiler )
+				  this->mykerns.profiler->endStep();
 
              // tell the data provider that I have done with current batch of data, want next batch of data
 			 MLP_CHECK(this->dataProviderp->nextBatch());
@@ -604,6 +1037,8 @@ int MLPTrainerOCL::batchTrainingWithCheckPointing(int maxBatches, int startBatch
                   DNN_LOCK(&this->chkPointingLock);
 			      this->currBatchNo = myBatch;
 				  this->currEpoch = myEpoch;
+				  this->pendingBatches = accStep;
+				  this->_checkPointAtGroupEnd();
                   DNN_UNLOCK(&this->chkPointingLock);
 			 };
 	    } // end of all baches
@@ -616,6 +1051,8 @@ int MLPTrainerOCL::batchTrainingWithCheckPointing(int maxBatches, int startBatch
              DNN_LOCK(&this->chkPointingLock);
 			 this->currBatchNo = myBatch;
 		     this->currEpoch = myEpoch;
+			 this->pendingBatches = accStep;
+			 this->_checkPointAtGroupEnd();
              DNN_UNLOCK(&this->chkPointingLock);
 		};
 	};  // end of all epoches
@@ -623,22 +1060,24 @@ int MLPTrainerOCL::batchTrainingWithCheckPointing(int maxBatches, int startBatch
 	for (int i = 1; i < this->nLayers; i++) {
 		CL_CHECK( clReleaseMemObject(deltaT[i]) );
 	    CL_CHECK( clReleaseMemObject(biasesMatrix[i]) );
-		CL_CHECK( clReleaseMemObject(varWeight1[i]) );
-	    CL_CHECK( clReleaseMemObject(varWeight2[i]) );
-		CL_CHECK( clReleaseMemObject(varBias1[i]) );
-	    CL_CHECK( clReleaseMemObject(varBias2[i]) );
+		CL_CHECK( clReleaseMemObject(varWeight[i]) );
+		CL_CHECK( clReleaseMemObject(varBias[i]) );
 	};
 
 	CL_CHECK( clReleaseMemObject(OnesVector) );
 	CL_CHECK( clReleaseMemObject(this->reduceMem) );
 	delete [] this->reduceBuff;
 
+	if ( this->sampledClasses > 0 )
+		 this->release_sampled_buffers();
+
+	if ( sparseInput )
+		 this->release_sparse_buffers();
+
 	delete [] deltaT;
 	delete [] biasesMatrix;
-	delete [] varWeight1;
-	delete [] varWeight2;
-	delete [] varBias1;
-	delete [] varBias2;
+	delete [] varWeight;
+	delete [] varBias;
 
 	if ( maxBatches == 0 )
 		 return(myEpoch * this->dataProviderp->getTotalBatches() + myBatch);
@@ -651,4 +1090,291 @@ int MLPTrainerOCL::batchTrainingWithCheckPointing(int maxBatches, int startBatch
 }
 
 
+// Mixed precision training, the inputs/outputs and delta of the layers are kept in half precision, which halves their device memory,
+// and the GEMMs read half precision operands and accumulate in float. The outputs of the output layer, the weights, biases and their
+// variances are kept in float. The delta is multiplied by lossScale before being stored in half precision, and the variances are
+// divided by it again. The update is skipped and lossScale is halved when the variances overflow, lossScale is doubled after 2000
+// successive updates without overflow. Only the conversions between float and half of the OpenCL core are used, so the training
+// can also run on the OpenCL CPU device, which does not support the cl_khr_fp16 extension usually
+int MLPTrainerOCL::batchTrainingHalf(int maxBatches, int startBatch, int startEpoch, bool doChkPointing)
+{
+	cl_int status;
+	clAmdBlasStatus blasStatus;
+
+	// the inputs for the MLP training
+	float *l_features=NULL;
+	float *l_labels=NULL;
+
+	cl_mem OnesVector;     // in length of this->minibatch, in half precision
+	cl_mem flagMem;        // set by cmn_check_finite()
+	cl_mem *biasesMatrix = new cl_mem[this->nLayers];
+	cl_mem *varWeight = new cl_mem[this->nLayers];
+	cl_mem *varBias = new cl_mem[this->nLayers];
+	cl_mem *gradWeight = new cl_mem[this->nLayers];
+	cl_mem *gradBias = new cl_mem[this->nLayers];
+
+	for (int i = 1; i < this->nLayers; i++) {
+ 	    biasesMatrix[i] = clCreateBuffer(this->CLCtx->m_context,CL_MEM_READ_WRITE,sizeof(cl_float)*this->minibatch*this->dimensions[i],NULL,&status);
+        CL_CHECK(status);
+
+		this->expandFloatVectorToMatrix(this->biases[i],biasesMatrix[i],this->dimensions[i],this->minibatch);
+	};
+
+	{
+ 		cl_half *tmpHostBuff;
+
+		tmpHostBuff = new cl_half[this->minibatch];
+		for (int k=0; k < this->minibatch; k++ )
+			 tmpHostBuff[k] = 0x3c00;       // 1.0 in half precision
+
+        OnesVector = clCreateBuffer(this->CLCtx->m_context,CL_MEM_READ_ONLY|CL_MEM_COPY_HOST_PTR,sizeof(cl_half)*this->minibatch,tmpHostBuff,&status);
+        CL_CHECK(status);
+
+	    delete [] tmpHostBuff;
+	};
+
+	flagMem = clCreateBuffer(this->CLCtx->m_context,CL_MEM_READ_WRITE,sizeof(cl_int),NULL,&status);
+	CL_CHECK(status);
 
+	// the variances are updated in place, so only one buffer is needed for each layer, initialized to all zeroes
+	for (int i = 1; i < this->nLayers; i++) {
+		float *tmpHostBuff;
+
+		tmpHostBuff = new float[this->dimensions[i-1]*this->dimensions[i]];
+		for (int k=0; k < this->dimensions[i-1]*this->dimensions[i]; k++ )
+			 tmpHostBuff[k] = 0.0f;
+ 	    varWeight[i] = clCreateBuffer(this->CLCtx->m_context,CL_MEM_READ_WRITE|CL_MEM_COPY_HOST_PTR,sizeof(cl_float)*this->dimensions[i-1]*this->dimensions[i],
+			                               tmpHostBuff,&status);
+        CL_CHECK(status);
+		varBias[i] = clCreateBuffer(this->CLCtx->m_context,CL_MEM_READ_WRITE|CL_MEM_COPY_HOST_PTR,sizeof(cl_float)*this->dimensions[i],tmpHostBuff,&status);
+        CL_CHECK(status);
+
+		delete [] tmpHostBuff;
+
+ 	    gradWeight[i] = clCreateBuffer(this->CLCtx->m_context,CL_MEM_READ_WRITE,sizeof(cl_float)*this->dimensions[i-1]*this->dimensions[i],NULL,&status);
+        CL_CHECK(status);
+ 	    gradBias[i] = clCreateBuffer(this->CLCtx->m_context,CL_MEM_READ_WRITE,sizeof(cl_float)*this->dimensions[i],NULL,&status);
+        CL_CHECK(status);
+	};
+
+	// create reducing buffers on the host and device
+	this->reduceMem = clCreateBuffer(this->CLCtx->m_context,CL_MEM_WRITE_ONLY,sizeof(cl_float)*this->minibatch,NULL,&status);
+	CL_CHECK(status);
+	this->reduceBuff = new float[this->minibatch];
+
+    CL_CHECK(clFinish(this->CLCtx->m_queues[0]));
+
+	int myBatch;
+	int myEpoch;
+	int accStep = 0;          // number of the batches whose variances have been summed since the last update of the weights
+	int epochBatches = (maxBatches == 0)? this->dataProviderp->getTotalBatches() : std::min<int>(this->dataProviderp->getTotalBatches(), maxBatches);
+
+	this->currBatchNo = startBatch;
+	this->currEpoch = startEpoch;
+	this->pendingBatches = 0;
+
+	myBatch = this->currBatchNo;
+	myEpoch = this->currEpoch;
+
+	while ( myEpoch < this->epochs ) {
+
+	    while (  this->dataProviderp->batchAvailable() && (maxBatches == 0 || myBatch < maxBatches) ) {
+
+			 DNNTraceSpan span(DNN_TRACE_TRAINER, "wait_batch");
+
+			 MLP_CHECK(this->dataProviderp->getBatchData(this->minibatch,l_features,l_labels,true));  // blocking method
+
+			 span.next("upload");
+
+			 CL_CHECK(clEnqueueWriteBuffer(this->CLCtx->m_queues[0],this->floatMem1,CL_TRUE,0,sizeof(cl_float)*this->dimensions[0]*this->minibatch,l_features,0,NULL,MLP_PROF_EVENT(this->mykerns,"write_inputs",-1) ));
+			 CL_CHECK(clEnqueueWriteBuffer(this->CLCtx->m_queues[0],this->target,CL_TRUE,0,sizeof(cl_float)*this->dimensions[this->nLayers-1]*this->minibatch,l_labels,0,NULL,MLP_PROF_EVENT(this->mykerns,"write_labels",-1) ));
+
+			 span.next("forward");
+
+			 cmn_convert_to_half(this->CLCtx->m_queues[0], this->mykerns, this->floatMem1, this->inputs[1], this->dimensions[0]*this->minibatch, 1.0f);
+
+			 for (int i = 1; i < this->nLayers; i++) {
+				 cl_mem layerOut = (i == this->nLayers-1)? this->output : this->floatMem1;
+
+			 	 // Input[i] = Output[i-1] * Weight[i]     , here Weight[i] is in transposed form
+				 cmn_gemm_half(this->CLCtx->m_queues[0], this->mykerns, this->inputs[i], this->weightHalf[i], layerOut, this->minibatch, this->dimensions[i], this->dimensions[i-1],
+					           false, true, 1.0f, 0.0f);
+
+				 // Output[i] = activate(Input[i] + Bias[i]) by one kernel for the ReLU layers
+				 if ( ! this->activateWithBias(i, layerOut, this->biases[i], layerOut, this->dimensions[i], this->minibatch) ) {
+					  // Input[i] = Input[i] + 1.0 * Bias[i],   regarding the two Matrixes as  two vectors
+					  blasStatus = clAmdBlasSaxpy(this->dimensions[i]*this->minibatch, 1.0f, biasesMatrix[i], 0, 1, layerOut, 0, 1, 1, &this->CLCtx->m_queues[0], 0, NULL,MLP_PROF_EVENT(this->mykerns,"saxpy_bias",i));
+					  AMDBLAS_CHECK(blasStatus);
+
+					  // Output[i] = activate(Input[i])
+					  this->activate(i, layerOut, layerOut, this->dimensions[i], this->minibatch);
+				 };
+
+				 if ( i < this->nLayers-1 )
+					  cmn_convert_to_half(this->CLCtx->m_queues[0], this->mykerns, layerOut, this->inputs[i+1], this->dimensions[i]*this->minibatch, 1.0f);
+			 }
+
+			 // the enqueued forward commands are only waited for by the blocking readback of the error
+			 span.next("loss_readback");
+
+			 float costval=0.0f;
+
+ 			 this->calculateError(this->output, this->target, this->dimensions[this->nLayers-1], this->minibatch, costval);
+
+			 cout.precision(8);
+			 cout << std::showpoint << std::fixed << endl;
+			 cout << "Error Value for Batch  " << myBatch << " of Epoch " << myEpoch << ": " << costval << endl;
+
+			 span.next("backward");
+
+		     this->calculateDelta(this->output, this->target, this->floatMem1, this->dimensions[this->nLayers-1], this->minibatch);
+
+			 cmn_convert_to_half(this->CLCtx->m_queues[0], this->mykerns, this->floatMem1, this->delta[this->nLayers-1], this->dimensions[this->nLayers-1]*this->minibatch,
+				                 this->lossScale);
+
+			 for ( int i = this->nLayers - 2; i > 0; i-- ) {
+				 // Delta[i] = Delta[i+1] * WeightT[i+1],
+				 cmn_gemm_half(this->CLCtx->m_queues[0], this->mykerns, this->delta[i+1], this->weightHalf[i+1], this->floatMem1, this->minibatch, this->dimensions[i],
+					           this->dimensions[i+1], false, false, 1.0f, 0.0f);
+
+				 // Delta[i] = derivative(Delta[i],Output[i])
+				 cmn_convert_to_float(this->CLCtx->m_queues[0], this->mykerns, this->inputs[i+1], this->floatMem2, this->dimensions[i]*this->minibatch);
+				 this->derivative(i, this->floatMem1, this->floatMem2, this->floatMem1, this->dimensions[i], this->minibatch);
+
+				 cmn_convert_to_half(this->CLCtx->m_queues[0], this->mykerns, this->floatMem1, this->delta[i], this->dimensions[i]*this->minibatch, 1.0f);
+			 }
+
+			 span.next("update");
+
+			 // the gradients of the weights and biases with the loss scale removed, summed over accumulateSteps batches as the float training
+			 float beta = (accStep > 0)? 1.0f : 0.0f;
+			 bool doUpdate = (++accStep == this->accumulateSteps) || (myBatch+1 >= epochBatches);
+
+			 for ( int i = nLayers-1; i > 0; i-- ) {
+				  float coef = this->etas[i] / this->lossScale;
+
+				  // gradWeightT[i] = DeltaT[i] * Output[i-1] + beta * gradWeightT[i], here gradWeight[i] is in transposed form
+				  cmn_gemm_half(this->CLCtx->m_queues[0], this->mykerns, this->delta[i], this->inputs[i], gradWeight[i], this->dimensions[i], this->dimensions[i-1],
+					            this->minibatch, true, false, coef, beta);
+
+				  // gradBias[i] = DeltaT[i] * (1,1, ... 1)T + beta * gradBias[i]
+				  cmn_gemm_half(this->CLCtx->m_queues[0], this->mykerns, this->delta[i], OnesVector, gradBias[i], this->dimensions[i], 1, this->minibatch, true, false, coef, beta);
+			 };
+
+			 if ( doUpdate ) {
+				  cl_int zero = 0;
+				  cl_int overflow;
+
+				  accStep = 0;
+
+				  CL_CHECK(clEnqueueWriteBuffer(this->CLCtx->m_queues[0],flagMem,CL_TRUE,0,sizeof(cl_int),&zero,0,NULL,MLP_PROF_EVENT(this->mykerns,"write_flag",-1) ));
+
+				  for ( int i = nLayers-1; i > 0; i-- ) {
+					   cmn_check_finite(this->CLCtx->m_queues[0], this->mykerns, gradWeight[i], this->dimensions[i]*this->dimensions[i-1], flagMem);
+					   cmn_check_finite(this->CLCtx->m_queues[0], this->mykerns, gradBias[i], this->dimensions[i], flagMem);
+				  };
+
+				  CL_CHECK(clEnqueueReadBuffer(this->CLCtx->m_queues[0],flagMem,CL_TRUE,0,sizeof(cl_int),&overflow,0,NULL,MLP_PROF_EVENT(this->mykerns,"read_flag",-1) ));
+
+				  if ( overflow ) {
+					   this->lossScale = std::max<float>(this->lossScale/2.0f, 1.0f);
+					   this->goodSteps = 0;
+
+					   cout << "Overflow with Batch " << myBatch << " of Epoch " << myEpoch << ", the update is skipped and the loss scale is reduced to " << this->lossScale << endl;
+				  }
+				  else {
+					   if ( doChkPointing)
+						    DNN_LOCK(&this->chkPointingLock);
+
+					   for ( int i = nLayers-1; i > 0; i-- ) {
+						    float mm = this->momentum;
+
+							// varWeightT[i] = gradWeightT[i] + mm * varWeightT[i],  WeightT[i] = WeightT[i] + varWeightT[i], and the half precision copy refreshed
+							cmn_apply_momentum_half(this->CLCtx->m_queues[0], this->mykerns, this->weightT[i], varWeight[i], gradWeight[i], this->weightHalf[i],
+								                    this->dimensions[i-1]*this->dimensions[i], mm);
+
+							// varBias[i] = gradBias[i] + mm * varBias[i],  Bias[i] = Bias[i] + varBias[i]
+							cmn_apply_momentum(this->CLCtx->m_queues[0], this->mykerns, this->biases[i], varBias[i], gradBias[i], this->dimensions[i], mm);
+
+							this->expandFloatVectorToMatrix(this->biases[i], biasesMatrix[i], this->dimensions[i], this->minibatch);
+					   };
+
+					   if ( doChkPointing )
+						    DNN_UNLOCK(&this->chkPointingLock);
+
+					   if ( ++this->goodSteps == 2000 ) {
+						    this->lossScale *= 2.0f;
+							this->goodSteps = 0;
+					   };
+				  };
+			 };
+
+			 span.end();
+
+			 // the device times of the enqueued commands are summed up once per batch
+			 if ( this->mykerns.profiler )
+				  this->mykerns.profiler->endStep();
+
+             // tell the data provider that I have done with current batch of data, want next batch of data
+			 MLP_CHECK(this->dataProviderp->nextBatch());
+
+			 myBatch++;
+
+			 if ( doChkPointing ) {
+                  DNN_LOCK(&this->chkPointingLock);
+			      this->currBatchNo = myBatch;
+				  this->currEpoch = myEpoch;
+				  this->pendingBatches = accStep;
+				  this->_checkPointAtGroupEnd();
+                  DNN_UNLOCK(&this->chkPointingLock);
+			 };
+	    } // end of all baches
+
+		myEpoch++;
+		myBatch = 0;
+		this->dataProviderp->resetDataProvider();
+
+		if ( doChkPointing ) {
+             DNN_LOCK(&this->chkPointingLock);
+			 this->currBatchNo = myBatch;
+		     this->currEpoch = myEpoch;
+			 this->pendingBatches = accStep;
+			 this->_checkPointAtGroupEnd();
+             DNN_UNLOCK(&this->chkPointingLock);
+		};
+	};  // end of all epoches
+
+	for (int i = 1; i < this->nLayers; i++) {
+	    CL_CHECK( clReleaseMemObject(biasesMatrix[i]) );
+		CL_CHECK( clReleaseMemObject(varWeight[i]) );
+		CL_CHECK( clReleaseMemObject(varBias[i]) );
+		CL_CHECK( clReleaseMemObject(gradWeight[i]) );
+		CL_CHECK( clReleaseMemObject(gradBias[i]) );
+	};
+
+	CL_CHECK( clReleaseMemObject(OnesVector) );
+	CL_CHECK( clReleaseMemObject(flagMem) );
+	CL_CHECK( clReleaseMemObject(this->reduceMem) );
+	delete [] this->reduceBuff;
+
+	delete [] biasesMatrix;
+	delete [] varWeight;
+	delete [] varBias;
+	delete [] gradWeight;
+	delete [] gradBias;
+
+	if ( maxBatches == 0 )
+		 return(myEpoch * this->dataProviderp->getTotalBatches() + myBatch);
+	else {
+	     int realBatches;
+
+	     realBatches = std::min<int>(this->dataProviderp->getTotalBatches(), maxBatches);
+		 return(myEpoch * realBatches + myBatch);
+	};
+}
+
+// NULL unless set_ocl_queue_profiling(true) was called before the trainer is created
+MLPOclProfiler *MLPTrainerOCL::getProfiler()
+{
+	return(this->mykerns.profiler);
+};
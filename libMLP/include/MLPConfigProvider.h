@@ -24,10 +24,13 @@ enum  ACT_FUNC
    AFUNC_TANH,              // hyperbolic tangent
    AFUNC_RELU,
    AFUNC_SOFTMAX,
-   AFUNC_IDENTITY,          // only meaningful for the output layer
+   AFUNC_IDENTITY,          // for the output layer, or the bottleneck layers from MLPFactorizer
+   AFUNC_LEAKY_RELU,        // ReLU with the negative inputs scaled by MLP_LEAKY_RELU_SLOPE
    ANOFUNC
 };
 
+#define MLP_LEAKY_RELU_SLOPE 0.01f
+
 enum COST_FUNC
 {
    CFUNC_SSE,
@@ -35,18 +38,74 @@ enum COST_FUNC
    CNOFUNC
 };
 
-#define MLP_NNET_MAX_LAYERS 16
+// layout of the weights matrix connecting layer i-1 and layer i in memory and in the nnet data file
+enum MLP_WEIGHT_LAYOUT
+{
+   MLP_WEIGHTS_ROWMAJOR = 0,      // dimensions[i-1] rows of dimensions[i] values
+   MLP_WEIGHTS_TRANSPOSED = 1     // dimensions[i] rows of dimensions[i-1] values, as used by the trainer on the device
+};
+
+// encoding of the weights and biases in the nnet data file, always converted to host float when loaded
+enum MLP_DATA_TYPE
+{
+   MLP_DATA_FLOAT32 = 0,
+   MLP_DATA_FLOAT16 = 1,          // IEEE 754 half precision
+   MLP_DATA_BFLOAT16 = 2,         // upper 16 bits of the IEEE 754 single precision
+   MLP_DATA_INT8 = 3,             // symmetric int8 weights with one float scale for each output neuron, the biases are still float
+   MLP_DATA_BSR = 4               // float weights in the block compressed sparse row format (conv_bsr.h), the biases are still float
+};
+
+// schemes for initializing the weights matrixes, the biases are always initialized to zero
+enum MLP_WEIGHT_INIT
+{
+   WINIT_UNIFORM_LEGACY,          // uniform in [-0.5, 0.5)
+   WINIT_UNIFORM_FANIN,           // uniform in [-sqrt(3/fanIn), sqrt(3/fanIn)), variance is 1/fanIn
+   WINIT_NORMAL_FANIN             // normal with mean 0 and variance 1/fanIn
+};
+
+#define MLP_NNET_MAX_LAYERS 16     // only for the version 1 nnet data file
 
+// version 1 of the nnet data file, tagged by "NNET", only read but not written now
 struct mlp_nnet_layer_desc {
     unsigned int dimension;         // the number of neurons of this layer
     char activation[16];            // the name of the activation function used by this layer
 };
 
+struct dnn_file_map;
+
 struct mlp_nnet_data_header {
     char  nnet_type[32];                               // a typename describing the neural network, might not be used right now, but reserved
     unsigned int  nLayers;                             // the total number of layers of the neural network including the input layer
     struct mlp_nnet_layer_desc layers[MLP_NNET_MAX_LAYERS];
     unsigned int weight_offsets[MLP_NNET_MAX_LAYERS];  // offset of the weights matrix and bias vector for each layer(at 1024-byte boundary)
+    unsigned int weight_layout;                        // MLP_WEIGHT_LAYOUT of all weights matrixes, zero for files of older version
+    unsigned int data_type;                            // MLP_DATA_TYPE of all weights and biases, zero for files of older version
+};
+
+// version 2 of the nnet data file, tagged by "NNV2", the header is followed by one descriptor for each layer, all
+// the fields are in Little Endian bytes sequence, and all offsets are from the beginning of the file
+#define MLP_NNET_VERSION 2
+
+struct mlp_nnet_v2_header {
+    unsigned int version;                              // MLP_NNET_VERSION
+    unsigned int header_size;                          // size of this header, allows new fields to be appended
+    unsigned int layer_desc_size;                      // size of each layer descriptor, allows new fields to be appended
+    unsigned int nLayers;                              // the total number of layers of the neural network including the input layer
+    unsigned long long desc_offset;                    // offset of the descriptor of layer 0
+    char  nnet_type[32];                               // a typename describing the neural network
+};
+
+struct mlp_nnet_v2_layer_desc {
+    unsigned long long weight_offset;                  // offset of the weights matrix connecting layer i-1 and layer i, zero for layer 0
+    unsigned long long bias_offset;                    // offset of the bias vector, zero for layer 0
+    unsigned int dimension;                            // the number of neurons of this layer
+    unsigned int data_type;                            // MLP_DATA_TYPE of the weights and biases of this layer
+    unsigned int weight_layout;                        // MLP_WEIGHT_LAYOUT of the weights matrix of this layer
+    unsigned int nnz_blocks;                           // MLP_DATA_BSR only, number of the non-zero blocks of the weights matrix
+    char activation[32];                               // the name of the activation function used by this layer
+    unsigned long long scale_offset;                   // MLP_DATA_INT8 only, offset of the float scales for the output neurons of this layer
+    float act_scale;                                   // MLP_DATA_INT8 only, scale of the int8 inputs of this layer, zero for scaling dynamically
+    unsigned int reserved2;
 };
 
 
@@ -57,12 +116,19 @@ class MLPConfigProvider
 	friend class MLPTesterBase;
 	friend class MLPPredictorBase;
 	friend class MLPTrainerOCL;
+	friend class MLPTrainerMultiOCL;
 	friend class MLPTesterOCL;
 	friend class MLPPredictorOCL;
+	friend class MLPQuantizer;
+	friend class MLPPruner;
+	friend class MLPFactorizer;
+	friend class MLPDeviceModelOCL;
 private:
 	MLP_NETTYPE netType;
 	int nLayers;
 	int epochs; 
+	int sampledClasses;             // output classes sampled for each batch by the sampled softmax of the training, zero for the full softmax
+	int accumulateSteps;            // batches whose variances are summed by the training before each update of the weights
 	int *dimensions;
 	float *etas;
 	float **biases;
@@ -70,8 +136,14 @@ private:
 	float momentum;
 	ACT_FUNC *actFuncs;
 	COST_FUNC costFunc;
+	MLP_WEIGHT_LAYOUT weightLayout;
+	MLP_DATA_TYPE storageType;      // encoding used by saveConfig() for the nnet data file
+	MLP_DATA_TYPE fileDataType;     // encoding of the loaded nnet data file, not used for saving
+	struct dnn_file_map *nnetMap;   // not NULL when the weights and biases point into the mapped nnet data file
+	float *actScales;               // calibrated scales of the int8 inputs of each layer, NULL if not calibrated
 
 private:
+	void loadNNetData(const char *fileName, bool checkConfig);
 	void biasesInitialize();
 	void weightsInitialize();
 	void etasInitialize();
@@ -97,6 +169,20 @@ public:
 	LIBDNNAPI int getLayerSize(int layer); 
 	LIBDNNAPI void setLayerWeights(int layer, int layerSize, int lowerLayerSize, float *weights); 
 	LIBDNNAPI void setLayerBiases(int layer, int layerSize, float *biases); 
+
+	LIBDNNAPI MLP_WEIGHT_LAYOUT getWeightLayout();
+	LIBDNNAPI void setWeightLayout(MLP_WEIGHT_LAYOUT layout);     // re-arrange the weights matrixes on the host
+
+	LIBDNNAPI void initializeWeights(MLP_WEIGHT_INIT scheme, unsigned int seed);   // the same seed always produces the same weights
+
+	LIBDNNAPI MLP_DATA_TYPE getStorageType();
+	LIBDNNAPI MLP_DATA_TYPE getFileDataType();
+	LIBDNNAPI void setStorageType(MLP_DATA_TYPE dataType);
+
+	LIBDNNAPI void setAccumulateSteps(int nSteps);             // the same as <Accumulate Steps> of the training config file
+
+	LIBDNNAPI float getActivationScale(int layer);             // zero if the layer is not calibrated
+	LIBDNNAPI void setActivationScales(float *scales);         // scales[i] for the inputs of layer i, scales[0] not used
 };
 
 #define MLP_CP_TRAINING_CONF "mlp_training.conf"
@@ -0,0 +1,70 @@
+/*
+ *  COPYRIGHT:  Copyright (c) 2014 Advanced Micro Devices, Inc.  All rights reserved
+ *
+ *   The weights and biases of a neural network kept on the OpenCL device, shared read-only by the MLPPredictorOCL instances
+ *   created from each other, and released by the last of them. A model reloaded by MLPPredictorOCL::reloadModel() is chained
+ *   as the successor of the model it replaces, each predictor moves to the successor at its next batch
+ */
+
+
+#ifndef _MLP_DEVICE_MODEL_OCL_H_
+#define _MLP_DEVICE_MODEL_OCL_H_
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include <CL/cl.h>
+#include <CL/cl_ext.h>
+
+#include "DNNApiExport.h"
+#include "DNNConstants.h"
+#include "MLPConfigProvider.h"
+
+
+class MLPDeviceModelOCL
+{
+	friend class MLPPredictorOCL;
+private:
+	int refCount;                  // number of predictors using this model, and one more if it is the successor of another model
+	MLPDeviceModelOCL *successor;  // the model reloaded to replace this one, NULL if not yet reloaded
+#ifdef _WIN32
+	CRITICAL_SECTION modelLock;    // for refCount and successor, changed by the predicting threads and the loading thread
+#else
+	pthread_mutex_t modelLock;
+#endif
+
+	MLP_DATA_TYPE weightType;      // type of the weights kept on the device, MLP_DATA_FLOAT32, MLP_DATA_FLOAT16, MLP_DATA_INT8 or MLP_DATA_BSR
+	int nLayers;
+	int *dimensions;
+	ACT_FUNC *actFuncs;
+	MLP_WEIGHT_LAYOUT weightLayout;
+
+	cl_mem *weights;
+	cl_mem *biases;
+	bool *zeroBiases;              // the biases of the layer are all zeroes, as those of the bottleneck layers from MLPFactorizer
+	cl_mem *weightScales;          // MLP_DATA_INT8 only, scales for the output neurons of each layer
+	float *actScales;              // MLP_DATA_INT8 only, calibrated scales for the inputs of each layer, zero for scaling dynamically
+	cl_mem *blockRowPtrs;          // MLP_DATA_BSR only, the weights are kept as dimensions[i] x dimensions[i-1] in blocks, with the
+	cl_mem *blockColIndices;       // values of the non-zero blocks in weights[i]
+	size_t *nnzBlocks;
+
+private:
+	MLPDeviceModelOCL(MLPConfigProvider &provider, cl_context context, cl_command_queue queue, MLP_DATA_TYPE _weightType);
+	~MLPDeviceModelOCL();
+
+	void retain();
+	void release();                // the model is deleted when the last predictor releases it
+
+	MLPDeviceModelOCL *getSuccessor();
+	void appendSuccessor(MLPDeviceModelOCL *newModel);      // newModel replaces the last model of the chain starting from this one
+	bool sameDimensions(MLPConfigProvider &provider);
+
+public:
+	LIBDNNAPI MLP_DATA_TYPE getWeightType();
+	LIBDNNAPI size_t getDeviceMemSize();       // bytes of the device memory used by the weights, biases and scales
+};
+
+#endif
@@ -0,0 +1,51 @@
+/*
+ *  COPYRIGHT:  Copyright (c) 2014 Advanced Micro Devices, Inc.  All rights reserved
+ *
+ *   Factorizes the weights matrixes of the selected layers of a trained neural network into two thinner matrixes by the truncated
+ *   SVD, each factorized layer becomes a bottleneck layer of identity activation without biases followed by the original layer,
+ *   which cuts the computation of the large layers of the neural network
+ */
+
+
+#ifndef _MLP_FACTORIZER_H_
+#define _MLP_FACTORIZER_H_
+
+#include "DNNApiExport.h"
+#include "DNNConstants.h"
+#include "DNNDataProvider.h"
+#include "MLPConfigProvider.h"
+
+#define MLP_SVD_OVERSAMPLES 10     // extra columns of the random projection used by the randomized SVD
+#define MLP_SVD_POWER_ITERS 2      // power iterations of the randomized SVD, for the slowly decaying singular values
+
+
+class MLPFactorizer
+{
+private:
+	MLPConfigProvider *configProviderp;
+	int nLayers;
+
+	int *ranks;                       // rank of the factorized weights matrix of each layer, 0 for the layers not factorized
+	float *errors;                    // relative Frobenius norm of the error of the factorized weights matrix of each layer
+	MLPConfigProvider *factorizedp;   // the factorized neural network, built by factorize()
+
+	void checkLayer(int layer);
+	float *getRowMajorWeights(int layer);
+	float factorizeMatrix(const float *W, int m, int n, int rank, float *A, float *B);
+
+public:
+	LIBDNNAPI MLPFactorizer(MLPConfigProvider &configProvider);
+	LIBDNNAPI ~MLPFactorizer();
+
+	LIBDNNAPI void setRank(int layer, int rank);           // rank 0 leaves the layer not factorized
+
+	LIBDNNAPI MLPConfigProvider *factorize();              // the returned neural network is owned by the MLPFactorizer
+	LIBDNNAPI float getError(int layer);                   // only valid after factorize()
+
+	// success ratio of the factorized neural network tested with all batches of the dataProvider in TEST mode
+	LIBDNNAPI float testFactorized(DNNDataProvider &dataProvider, DNN_OCL_DEVTYPE devType, int batchSize);
+
+	LIBDNNAPI void saveFactorizedConfig(const char *dir, const char *trainingConfigFile, const char *nnetDataFile);
+};
+
+#endif
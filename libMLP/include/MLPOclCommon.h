@@ -14,14 +14,19 @@
 
 using namespace std;
 
+class MLPOclProfiler;
+
 typedef struct kernels {
 	cl_kernel activate_sigmoid_kernel;
 	cl_kernel activate_softmax_kernel1;
 	cl_kernel activate_softmax_kernel2;
 	cl_kernel activate_tanh_kernel;
+	cl_kernel activate_relu_kernel;
+	cl_kernel bias_activate_relu_kernel;
 
 	cl_kernel derivative_sigmoid_kernel;
 	cl_kernel derivative_tanh_kernel;
+	cl_kernel derivative_relu_kernel;
 
 	cl_kernel calculateError_SSE_kernel1;
 	cl_kernel calculateError_SSE_kernel2;
@@ -36,6 +41,30 @@ typedef struct kernels {
     cl_kernel transpose_sim_kernel;
 
     cl_kernel expandMatrix_kernel;
+
+    cl_kernel gemm_half_weights_kernel;
+    cl_kernel gemm_bsr_kernel;
+
+    cl_kernel quantize_rows_kernel;
+    cl_kernel gemm_int8_kernel;
+    cl_kernel absmax_accumulate_kernel;
+
+    cl_kernel topk_rows_kernel;
+
+    cl_kernel gather_rows_kernel;
+    cl_kernel update_sampled_rows_kernel;
+
+    cl_kernel gemm_half_kernel;
+    cl_kernel convert_to_half_kernel;
+    cl_kernel convert_to_float_kernel;
+    cl_kernel check_finite_kernel;
+
+    cl_kernel apply_momentum_kernel;
+    cl_kernel apply_momentum_half_kernel;
+
+    cl_kernel spmm_csr_kernel;
+
+    MLPOclProfiler *profiler;          // tags the commands enqueued by the cmn_* functions when not NULL
 } MLP_Kerns;
 
 extern void cmn_transpose_matrix_simple(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &A_cl, cl_mem &At_cl, int width, int height);
@@ -47,6 +76,8 @@ extern void cmn_activate_sigmoid(cl_command_queue &cmdQueue, MLP_Kerns &kerns, c
 extern void cmn_activate_tanh(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &x, cl_mem &y, int width, int height );
 extern void cmn_activate_softmax(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &x, cl_mem &y, int width, int height );
 extern void cmn_activate_identity(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &x, cl_mem &y, int width, int height );
+extern void cmn_activate_relu(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &x, cl_mem &y, int width, int height, float slope );
+extern void cmn_bias_activate_relu(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &x, cl_mem &biases, cl_mem &y, int width, int height, float slope );
 
 extern void cmn_calculateError_SSE(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &output, cl_mem &target, cl_mem &reduceMem, float *reduceBuf, int width, int height, float &ret );
 extern void cmn_calculateError_CE(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &output, cl_mem &target, cl_mem &reduceMem, float *reduceBuf, int width, int height, float &ret );
@@ -56,6 +87,30 @@ extern void cmn_calculateDelta_CE_Softmax(cl_command_queue &cmdQueue, MLP_Kerns
 
 extern void cmn_derivative_sigmoid(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &delta1, cl_mem &y, cl_mem &delta2, int width, int height);
 extern void cmn_derivative_tanh(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &delta1, cl_mem &y, cl_mem &delta2, int width, int height);
+extern void cmn_derivative_relu(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &delta1, cl_mem &y, cl_mem &delta2, int width, int height, float slope);
+
+extern void cmn_gemm_half_weights(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &A, cl_mem &B, cl_mem &C, int M, int N, int K, bool transB);
+extern void cmn_gemm_bsr(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &A, cl_mem &rowPtrs, cl_mem &colIndices, cl_mem &values, cl_mem &C, int M, int N, int K);
+
+extern void cmn_quantize_rows(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &X, cl_mem &Q, cl_mem &rowScales, int width, int height, float fixedScale);
+extern void cmn_gemm_int8(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &A, cl_mem &B, cl_mem &rowScales, cl_mem &colScales, cl_mem &C, int M, int N, int K, bool transB);
+extern void cmn_absmax_accumulate(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &X, int num, cl_mem &ranges, int idx);
+
+extern void cmn_topk_rows(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &X, cl_mem &indices, cl_mem &scores, int width, int height, int k);
+
+extern void cmn_gather_rows(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &src, cl_mem &rows, cl_mem &dst, int width, int num);
+extern void cmn_update_sampled_rows(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &W, cl_mem &V, cl_mem &G, cl_mem &rows, int width, int num, float momentum);
+
+extern void cmn_gemm_half(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &A, cl_mem &B, cl_mem &C, int M, int N, int K, bool transA, bool transB, float alpha, float beta);
+extern void cmn_convert_to_half(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &X, cl_mem &Y, int num, float scale);
+extern void cmn_convert_to_float(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &X, cl_mem &Y, int num);
+extern void cmn_check_finite(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &X, int num, cl_mem &flag);
+
+extern void cmn_apply_momentum(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &W, cl_mem &V, cl_mem &G, int num, float momentum);
+extern void cmn_apply_momentum_half(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &W, cl_mem &V, cl_mem &G, cl_mem &Wh, int num, float momentum);
+
+extern void cmn_spmm_csr(cl_command_queue &cmdQueue, MLP_Kerns &kerns, cl_mem &rowPtrs, cl_mem &colIndices, cl_mem &values, cl_mem &B, cl_mem &C, int M, int N, int K,
+                         bool transB, bool transC, float alpha, float beta);
 
 
 extern void print_dev_data(char *header, cl_command_queue &cmdQueue, cl_mem devBuf, int width, int height);
@@ -0,0 +1,61 @@
+/*
+ *  COPYRIGHT:  Copyright (c) 2014 Advanced Micro Devices, Inc.  All rights reserved
+ *
+ *   Collects the OpenCL profiling times of the commands enqueued by the MLP engines, each command is tagged by the name of
+ *   the kernel, BLAS routine or transfer and the layer it works on. Only works with the queues created after calling
+ *   set_ocl_queue_profiling(true)
+ */
+
+
+#ifndef _MLP_OCL_PROFILER_H_
+#define _MLP_OCL_PROFILER_H_
+
+#include <CL/cl.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "DNNApiExport.h"
+
+#define MLP_PROF_MAX_PENDING 65536     // the pending events are collected when this many commands are enqueued in one step
+
+// the event argument of an enqueue call, NULL when profiling is not enabled for the kernels
+#define MLP_PROF_EVENT(kerns,tag,layer)  ( (kerns).profiler? (kerns).profiler->nextEvent(tag,layer) : NULL )
+
+class MLPOclProfiler
+{
+private:
+	struct prof_event {
+		const char *tag;
+		int layer;                     // -1 for the commands not working on a layer
+		cl_event event;
+	};
+
+	struct prof_stats {
+		long long count;
+		double queued;                 // micro-seconds from being enqueued to being submitted to the device
+		double submitted;              // micro-seconds from being submitted to starting
+		double executed;               // micro-seconds from starting to ending
+	};
+
+	std::vector<struct prof_event> pending;
+	std::map<std::string, struct prof_stats> stats;
+	int steps;
+
+	void collect();
+
+public:
+	LIBDNNAPI MLPOclProfiler();
+	LIBDNNAPI ~MLPOclProfiler();
+
+	// the returned event is filled by the next enqueue call, and is only valid until nextEvent() is called again
+	cl_event *nextEvent(const char *tag, int layer);
+
+	LIBDNNAPI void endStep();                          // waits for the commands of the step and accumulates their times
+	LIBDNNAPI void reset();
+	LIBDNNAPI void showProfile(std::ostream &out);     // the times for each tag averaged over the steps
+};
+
+#endif
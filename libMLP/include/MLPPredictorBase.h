@@ -26,6 +26,7 @@ protected:
 	int   batchSize;
 	int  *dimensions;
 	ACT_FUNC *actFuncs;
+	MLP_WEIGHT_LAYOUT weightLayout;
 
 protected:
 	void _initialize(MLPConfigProvider & configProvider, int minibatch);
@@ -41,8 +42,13 @@ public:
 	LIBDNNAPI virtual void setupMLP(MLPConfigProvider & configProvider, int batchSize)=0;
 
 	LIBDNNAPI virtual void batchPredicting(float *inVectors, float *outVectors)=0;
+	LIBDNNAPI virtual void batchPredicting(float *inVectors, float *outVectors, int nFrames)=0;     // only the first nFrames ( <= batchSize ) frames
 	LIBDNNAPI virtual void singlePredicting(float *inVector, float *outVector)=0;
 
+	// only the indices and scores of the k largest outputs of each frame, k for each frame in outIndices and outScores in descending
+	// order of the scores. outScores can be NULL if only the indices are needed
+	LIBDNNAPI virtual void batchPredictingTopK(float *inVectors, int nFrames, int k, int *outIndices, float *outScores)=0;
+
 	LIBDNNAPI int getInputVectorSize();
 	LIBDNNAPI int getOutputVectorSize();
 	LIBDNNAPI int getBatchSize();
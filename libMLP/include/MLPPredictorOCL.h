@@ -10,6 +10,7 @@
 #ifndef _MPL_PREDICTOR_OCL_H_
 #define _MPL_PREDICTOR_OCL_H_
 
+#include <string>
 #include <CL/cl.h>
 #include <CL/cl_ext.h>
 
@@ -21,46 +22,117 @@
 #include "SingleDevClass.h"
 #include "MLPConfigProvider.h"
 #include "MLPPredictorBase.h"
+#include "MLPDeviceModelOCL.h"
 
 
+#define MLP_PREDICT_SLOTS 2           // number of batches which can be in flight with submitPredicting()
+
+// the device buffers and events of one batch submitted by submitPredicting()
+struct mlp_predict_slot {
+	cl_mem *inputs;                   // buffers for the input/output of each layer like MLPPredictorOCL::inputs, NULL until first used
+	int ticket;                       // the ticket of the batch in flight using this slot, -1 if no batch is in flight
+	cl_event writeEvent;
+	cl_event computeEvent;
+	cl_event readEvent;
+};
+
 class MLPPredictorOCL:public MLPPredictorBase
 {
 private:
 	DNN_OCL_DEVTYPE devType;
+	MLP_DATA_TYPE weightType;      // type of the weights kept on the device, MLP_DATA_FLOAT32, MLP_DATA_FLOAT16, MLP_DATA_INT8 or MLP_DATA_BSR
+	MLPDeviceModelOCL *model;      // the weights and biases on the device, may be shared with other instances
 
 	cl_mem *inputs;
-	cl_mem *weights;
-	cl_mem *biases;
 	cl_mem output;
 
 	cl_mem *biasMatrixes;
 
+	cl_mem qInputs;                // MLP_DATA_INT8 only, the quantized inputs of the current layer
+	cl_mem rowScales;              // MLP_DATA_INT8 only, scales for the rows of qInputs
+
+	bool calibrating;              // collecting the maximum absolute values of the inputs of each layer
+	cl_mem ranges;                 // created by the first startCalibration(), NULL until then
+
+	int topK;                      // the largest k used by batchPredictingTopK(), zero if not used yet
+	cl_mem topIndices;             // batchSize*topK indices of the largest outputs, created when first used
+	cl_mem topScores;
+
+	struct mlp_predict_slot slots[MLP_PREDICT_SLOTS];     // slots[0] uses the buffers of the blocking interfaces
+	int nextTicket;
+
+	MLPDeviceModelOCL *reloadBase;       // the model to be replaced by the one being reloaded
+	std::string reloadDir;
+	std::string reloadFile;
+	bool reloading;                      // the loader thread has been started and not joined
+#ifdef _WIN32
+	HANDLE loader;
+#else
+	pthread_t loader;
+#endif
+
 private:
-	static MLP_Kerns mykerns;
+	MLP_Kerns mykerns;                  // kernel arguments are per kernel object, so not shared by the instances
+	cl_command_queue queue;              // for the computing, and for the transfers of the blocking interfaces
+	cl_command_queue uploadQueue;        // for the transfers of submitPredicting() to overlap with the computing
+	cl_command_queue readbackQueue;
 
 	static SingleDevClass * CLCtx;
 	static int nInstances;
 
 private:
+	void setup_ocl_program();
+	void destroy_ocl_program();
+	void setup_ocl_queue();
 	void setup_ocl_kernels();
 	void destroy_ocl_kernels();
-	void create_ocl_buffers(MLPConfigProvider & configProvider);
+	void create_ocl_buffers();
 	void release_ocl_buffers();
+	void create_slot_buffers(int slot);
+	void release_slot_buffers(int slot);
 
 private:
     void expandFloatVectorToMatrix(cl_mem  myVector, cl_mem myMatrix, int width, int height);  // helper
 	void activate(int layer, cl_mem x, cl_mem y, int width, int height);
+	bool activateWithBias(int layer, cl_mem x, cl_mem biases, cl_mem y, int width, int height);
+	void forward_weights(cl_mem *layerInputs, int layer, int height);
+	void forward(cl_mem *layerInputs, int height);
+	void waitAllPredicting();
+	void adopt_new_model();
+
+private:
+	static void * loader_fun(void *argp);
 
 public:
 	LIBDNNAPI MLPPredictorOCL();
-	LIBDNNAPI MLPPredictorOCL(MLPConfigProvider &configProvider, DNN_OCL_DEVTYPE devType, int _batchSize);
+	LIBDNNAPI MLPPredictorOCL(MLPConfigProvider &configProvider, DNN_OCL_DEVTYPE devType, int _batchSize, MLP_DATA_TYPE _weightType=MLP_DATA_FLOAT32);
+	LIBDNNAPI MLPPredictorOCL(MLPPredictorOCL &sharedPredictor, int _batchSize);    // shares the weights and biases on the device with sharedPredictor
 	~MLPPredictorOCL();
 
 public:
 	void setupMLP(MLPConfigProvider &configProvider, int batchSize);
 
 	void batchPredicting(float *inVectors, float *outVectors);
+	void batchPredicting(float *inVectors, float *outVectors, int nFrames);
 	void singlePredicting(float *inVector, float *outVector);
+	void batchPredictingTopK(float *inVectors, int nFrames, int k, int *outIndices, float *outScores);
+
+	// Non-blocking predicting of nFrames frames, the transfers of a batch overlap with the computing of the batch submitted
+	// before it. Returns a ticket for waitPredicting(), the outputs are in outVectors only after waitPredicting() returns,
+	// and inVectors and outVectors should not be touched until then. Submitting more than MLP_PREDICT_SLOTS batches waits
+	// for the oldest batch in flight
+	LIBDNNAPI int submitPredicting(float *inVectors, float *outVectors, int nFrames);
+	LIBDNNAPI void waitPredicting(int ticket);
+
+	LIBDNNAPI void startCalibration();                     // start collecting the ranges of the inputs of each layer by the following predicting
+	LIBDNNAPI void getActivationRanges(float *_ranges);    // _ranges[i] for the inputs of layer i, _ranges[0] not used
+
+	LIBDNNAPI MLPDeviceModelOCL *getDeviceModel();
+
+	// Loads and uploads the neural network of dir/nnetFile in the background, it is used from the first batch started after
+	// it is ready, by this predictor and all predictors sharing the device model with it. The neural network should have the
+	// same layer dimensions, otherwise it is ignored. Should be called by the thread using this predictor
+	LIBDNNAPI void reloadModel(const char *dir, const char *nnetFile);
 };
 
 #endif // __MPL_PREDICTOR_OCL_H
@@ -0,0 +1,36 @@
+/*
+ *  COPYRIGHT:  Copyright (c) 2014 Advanced Micro Devices, Inc.  All rights reserved
+ *
+ *   Prunes a trained neural network by zeroing the DNN_BSR_BLOCK x DNN_BSR_BLOCK blocks of each weights matrix having the smallest
+ *   magnitudes, and saves the neural network with the weights in the block sparse format used by MLPPredictorOCL with MLP_DATA_BSR
+ */
+
+
+#ifndef _MLP_PRUNER_H_
+#define _MLP_PRUNER_H_
+
+#include "DNNApiExport.h"
+#include "DNNConstants.h"
+#include "MLPConfigProvider.h"
+
+
+class MLPPruner
+{
+private:
+	MLPConfigProvider *configProviderp;
+	int nLayers;
+
+	void checkLayer(int layer);
+
+public:
+	LIBDNNAPI MLPPruner(MLPConfigProvider &configProvider);
+	LIBDNNAPI ~MLPPruner();
+
+	LIBDNNAPI float prune(int layer, float sparsity);    // sparsity is the fraction of the blocks to be zeroed, returns the sparsity reached
+	LIBDNNAPI float pruneAll(float sparsity);            // prunes all layers to the same sparsity, returns the sparsity of all the weights
+	LIBDNNAPI float getSparsity(int layer);              // fraction of the blocks of the weights matrix of the layer being all zeroes
+
+	LIBDNNAPI void savePrunedConfig(const char *dir, const char *trainingConfigFile, const char *nnetDataFile);
+};
+
+#endif
@@ -0,0 +1,39 @@
+/*
+ *  COPYRIGHT:  Copyright (c) 2014 Advanced Micro Devices, Inc.  All rights reserved
+ *
+ *   Calibrates the int8 scales for the inputs of each layer by running a dataset through the float neural network,
+ *   and saves the neural network with int8 weights and the calibrated scales
+ */
+
+
+#ifndef _MLP_QUANTIZER_H_
+#define _MLP_QUANTIZER_H_
+
+#include "DNNApiExport.h"
+#include "DNNConstants.h"
+#include "DNNDataProvider.h"
+#include "MLPConfigProvider.h"
+
+
+class MLPQuantizer
+{
+private:
+	MLPConfigProvider *configProviderp;
+	DNNDataProvider *dataProviderp;
+	DNN_OCL_DEVTYPE devType;
+	int batchSize;
+
+	int nLayers;
+	float *ranges;           // maximum absolute values of the inputs of each layer from the calibration
+	bool calibrated;
+
+public:
+	LIBDNNAPI MLPQuantizer(MLPConfigProvider &configProvider, DNNDataProvider &dataProvider, DNN_OCL_DEVTYPE devType, int _batchSize);
+	LIBDNNAPI ~MLPQuantizer();
+
+	LIBDNNAPI int calibrate(int maxBatches);        // returns the number of batches used, all available batches are used if maxBatches is 0
+
+	LIBDNNAPI void saveQuantizedConfig(const char *dir, const char *trainingConfigFile, const char *nnetDataFile);
+};
+
+#endif
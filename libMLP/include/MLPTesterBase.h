@@ -28,6 +28,7 @@ protected:
 	int   batchSize;
 	int  *dimensions;
 	ACT_FUNC *actFuncs;
+	MLP_WEIGHT_LAYOUT weightLayout;
 
 	DNNDataProvider *dataProviderp;
 
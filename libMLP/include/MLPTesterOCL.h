@@ -50,6 +50,7 @@ private:
 private:
     void expandFloatVectorToMatrix(cl_mem  myVector, cl_mem myMatrix, int width, int height);  // helper
 	void activate(int layer, cl_mem x, cl_mem y, int width, int height);
+	bool activateWithBias(int layer, cl_mem x, cl_mem biases, cl_mem y, int width, int height);
 
 public:
 	LIBDNNAPI MLPTesterOCL();
@@ -38,11 +38,15 @@ protected:
 	ACT_FUNC *actFuncs;          // Activation function used by all layers,  usually all hidden layers use same activation function, the output uses different one
 	COST_FUNC costFunc;          // Cost function used to measure the error value of the input batch got on the current MLP network
 	int epochs; 
+	int sampledClasses;          // Number of output classes used by each batch with sampled softmax, zero for using the full softmax
+	int accumulateSteps;         // Number of batches whose variances of weights are summed before each update of the weights
 
 	DNNDataProvider *dataProviderp;
 
 	int currBatchNo;             // Indicate the current batchNo the training is on, need be saved when doing checkpointing
 	int currEpoch;               // Indicate the current epoch the training is on, need be saved when doing checkpointing
+	int pendingBatches;          // Number of batches whose variances are summed but not applied to the weights yet
+	struct MLPCheckPointState *cpRequest;   // checkpoint asked inside an accumulation group, taken by the training at the end of the group
 
 #ifdef WIN32                       // for Windows
 	CRITICAL_SECTION chkPointingLock;
@@ -52,8 +56,11 @@ protected:
 
 protected:
 	void _initialize(MLPConfigProvider & NetProvider, int minibatch);
+	void _checkPointAtGroupEnd();      // called by the training with chkPointingLock held, after pendingBatches is updated
 
 private:
+	void _takeCheckPoint(struct MLPCheckPointState &state);
+
 	void _dispose();
 
 public:
@@ -76,7 +83,7 @@ public:
 
 	LIBDNNAPI int getEpochs(); 
 
-	void checkPointing(struct MLPCheckPointState &state);
+	LIBDNNAPI void checkPointing(struct MLPCheckPointState &state);
 };
 
 
@@ -0,0 +1,97 @@
+/*
+ *  COPYRIGHT:  Copyright (c) 2014 Advanced Micro Devices, Inc.  All rights reserved
+ *
+ *   Data-parallel training of the MLP network on several OpenCL devices, each device keeps one replica of the network and trains
+ *   its part of each minibatch, the weights variances of all devices are summed on the host and the same update is applied by
+ *   every device, so the replicas stay identical
+ */
+
+
+#ifndef _MLP_TRAINER_MULTI_OCL_H_
+#define _MLP_TRAINER_MULTI_OCL_H_
+
+#include <CL/cl.h>
+#include <CL/cl_ext.h>
+
+#include "DNNApiExport.h"
+#include "DNNConstants.h"
+#include "DNNDataProvider.h"
+
+#include "MLPOclCommon.h"
+#include "MultiDevClass.h"
+#include "MLPConfigProvider.h"
+#include "MLPChkPointState.h"
+#include "MLPTrainerBase.h"
+
+// the buffers of the replica of the network on one device
+struct mlp_replica {
+	int frames;                  // number of the frames of each minibatch trained on this device
+	int offset;                  // index of the first of these frames in the minibatch
+
+	cl_mem *inputs;
+	cl_mem *weightT;
+	cl_mem *biases;
+	cl_mem output;
+	cl_mem target;
+	cl_mem *delta;
+	cl_mem *deltaT;
+	cl_mem *biasesMatrix;
+	cl_mem *curVarWeight;        // the variance of the weights from the frames of this device, then summed from all devices
+	cl_mem *varWeight;           // the variance of the weights applied by the last update, blended into the next one with the momentum
+	cl_mem *curVarBias;
+	cl_mem *varBias;
+	cl_mem onesVector;           // in length of frames
+
+	cl_mem reduceMem;
+	float *reduceBuff;
+};
+
+class MLPTrainerMultiOCL:public MLPTrainerBase
+{
+private:
+	DNN_OCL_DEVTYPE devType;
+	int nDevices;
+
+	struct mlp_replica replicas[DNN_MAX_DEVICES];
+
+	float *hostVars[DNN_MAX_DEVICES];  // the weights and biases variances of all layers read from each device, summed into hostVars[0]
+	size_t *varOffsets;                // offset of the variances of each layer in hostVars[], the weights followed by the biases
+
+private:
+	MLP_Kerns mykerns;                 // the kernels are built for all the devices of the context
+
+	MultiDevClass *CLCtx;
+
+private:
+	void setup_ocl_kernels();
+	void destroy_ocl_kernels();
+	void create_ocl_buffers(MLPConfigProvider &provider);
+	void release_ocl_buffers();
+
+private:
+	void transpose_float_matrix(int dev, cl_mem src, cl_mem dst, cl_int width, cl_int height);          // helper
+	void activate(int dev, int layer, cl_mem x, cl_mem y, int width, int height);
+	bool activateWithBias(int dev, int layer, cl_mem x, cl_mem biases, cl_mem y, int width, int height);
+	void calculateError(int dev, cl_mem output, cl_mem target, int width, int height, float &ret);
+	void calculateDelta(int dev, cl_mem output, cl_mem target, cl_mem delta, int width, int height);
+	void derivative(int dev, int layer, cl_mem delta1, cl_mem y, cl_mem delta2, int width, int height);
+
+	void backward(int dev, float beta);
+	void allreduce_variances();
+
+public:
+	// nDevices discrete GPUs with devType being DNN_OCL_DGPU, or nDevices sub-devices of the CPU with devType being DNN_OCL_CPU
+	LIBDNNAPI MLPTrainerMultiOCL(MLPConfigProvider & configProvider, DNNDataProvider & dataProvider, DNN_OCL_DEVTYPE devType, int nDevices, int _minibatch);
+    ~MLPTrainerMultiOCL();
+
+public:
+	void setupMLP(MLPConfigProvider & configProvider, DNNDataProvider & dataProvider, int _minibatch);
+
+	int batchTrainingWithCheckPointing(int maxBatches, int startBatch, int startEpoch, bool doChkPointing);
+	void synchronizeNetConfig(MLPConfigProvider &configProvider);
+
+	LIBDNNAPI int getNumDevices();
+};
+
+
+#endif // _MLP_TRAINER_MULTI_OCL_H_
@@ -23,11 +23,14 @@
 #include "MLPChkPointState.h"
 #include "MLPTrainerBase.h"
 
+#define MLP_SPARSE_INPUT_DENSITY 0.25f     // the sparse kernel is only faster than the dense GEMM for quite sparse inputs
+
 // Implement the interfaces for training the MLP network
 class MLPTrainerOCL:public MLPTrainerBase
 {
 private:
 	DNN_OCL_DEVTYPE devType;
+	MLP_DATA_TYPE actType;       // MLP_DATA_FLOAT16 for keeping the inputs/outputs and delta of the layers in half precision
 
 	cl_mem *inputs;              // Device buffers to store input/output data calculated on various layers of the MLP network
 	cl_mem *weightT;             // Device buffers to store weights matrix of various layers of the MLP network
@@ -39,6 +42,50 @@ private:
 	float *reduceBuff;           // Dynamically allocated host buffer used by some reducing operations (eg.  calculateError )
 	cl_mem reduceMem;            // Dynamically allocated device memory used by some reducing operations (eg. calculateError )
 
+	// with sampled softmax, each batch computes the output layer only for the target classes of its frames and some classes sampled
+	// uniformly from the others, the logits of the sampled classes are corrected by the log of their sampling probability
+	int maxSampled;              // Maximum number of the output classes used by one batch
+	int *samples;                // Output classes used by the current batch, the target classes first
+	int *sampleMap;              // Position of each output class in samples, -1 for the classes not used by the current batch
+	float *corrections;          // Correction added to the logit of each class in samples
+	float *sampledLabels;        // Labels of the current batch for the classes in samples
+	unsigned long long sampleSeed;
+
+	// with half precision training, the GEMMs use half precision copies of the weights and the layer inputs/outputs and delta, which
+	// are converted from the float results through two float buffers shared by all layers. The weights, biases and their variances
+	// are kept in float, the delta is multiplied by lossScale to keep the small values from underflowing the half precision
+	cl_mem *weightHalf;
+	cl_mem floatMem1;
+	cl_mem floatMem2;
+	float lossScale;
+	int goodSteps;               // number of the successive updates without overflow, used for increasing lossScale
+
+	cl_mem samplesMem;
+	cl_mem correctionsMem;
+	cl_mem sampledWeightT;       // Rows of weightT of the output layer for the classes in samples
+	cl_mem sampledBiases;
+	cl_mem sampledBiasesMatrix;
+	cl_mem sampledOutput;
+	cl_mem sampledTarget;
+	cl_mem sampledDelta;
+	cl_mem sampledDeltaT;
+	cl_mem sampledVarWeight;
+	cl_mem sampledVarBias;
+
+	// with the data provider also providing the CSR format of the batches, the forward and the weights variance of the first layer use
+	// the sparse kernel for the batches whose density of the non-zero inputs is below MLP_SPARSE_INPUT_DENSITY. The variance needs the
+	// transposed inputs, which are the inputs in the CSC format, built on the host
+	int *cscColPtrs;
+	int *cscRowIndices;
+	float *cscValues;
+
+	cl_mem csrRowPtrsMem;
+	cl_mem csrColIndicesMem;
+	cl_mem csrValuesMem;
+	cl_mem cscColPtrsMem;
+	cl_mem cscRowIndicesMem;
+	cl_mem cscValuesMem;
+
 
 private:
 	static MLP_Kerns mykerns;
@@ -51,18 +98,27 @@ private:
 	void destroy_ocl_kernels();
 	void create_ocl_buffers(MLPConfigProvider &provider);
 	void release_ocl_buffers();
+	void create_sampled_buffers();
+	void release_sampled_buffers();
+	int sample_classes(float *labels);
+	void create_sparse_buffers();
+	void release_sparse_buffers();
+	bool load_sparse_batch();
+
+	int batchTrainingHalf(int maxBatches, int startBatch, int startEpoch, bool doChkPointing);
 
 private:
 	void transpose_float_matrix(cl_mem src, cl_mem dst, cl_int width, cl_int height);          // helper
     void expandFloatVectorToMatrix(cl_mem  myVector, cl_mem myMatrix, int width, int height);  // helper
 	void activate(int layer, cl_mem x, cl_mem y, int width, int height);
+	bool activateWithBias(int layer, cl_mem x, cl_mem biases, cl_mem y, int width, int height);
 	void calculateError(cl_mem output, cl_mem target, int width, int height, float &ret);
 	void calculateDelta(cl_mem output, cl_mem target, cl_mem delta, int width, int height);
 	void derivative(int layer, cl_mem delta1, cl_mem y, cl_mem delta2, int width, int height);
 
 public:
 	LIBDNNAPI MLPTrainerOCL();
-	LIBDNNAPI MLPTrainerOCL(MLPConfigProvider & configProvider, DNNDataProvider & dataProvider, DNN_OCL_DEVTYPE devType, int _minibatch);
+	LIBDNNAPI MLPTrainerOCL(MLPConfigProvider & configProvider, DNNDataProvider & dataProvider, DNN_OCL_DEVTYPE devType, int _minibatch, MLP_DATA_TYPE _actType=MLP_DATA_FLOAT32);
     ~MLPTrainerOCL();
 
 public:
@@ -71,6 +127,7 @@ public:
 	int batchTrainingWithCheckPointing(int maxBatches, int startBatch, int startEpoch, bool doChkPointing);
 	void synchronizeNetConfig(MLPConfigProvider &configProvider);
 
+	LIBDNNAPI MLPOclProfiler *getProfiler();
 };
 
 
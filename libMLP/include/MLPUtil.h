@@ -9,6 +9,8 @@
 #ifndef _MLP_UTIL_H_
 #define _MLP_UTIL_H_
 
+#include <cmath>
+
 #include "DNNUtil.h"
 
 #define MLP_CHECK(flag)                                                                                           \
@@ -29,6 +31,24 @@
 #define MLP_Exception(info) DNN_Exception(info)
 #define MLP_BadAlloc(info)  DNN_BadAlloc(info)
 
+// the SplitMix64 finalizer, hashing a counter or key to 64 well mixed random bits
+static inline unsigned long long mixBits(unsigned long long z)
+{
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return( z ^ (z >> 31) );
+};
+
+// a standard normal number by the Box-Muller transform with two 24-bit uniform numbers from the same random bits
+static inline float normalFromBits(unsigned long long bits)
+{
+	const float scale24 = 1.0f/16777216.0f;
+	float u1 = ((unsigned int)(bits >> 40) + 1) * scale24;
+	float u2 = (unsigned int)(bits & 0xffffff) * scale24;
+
+	return( sqrtf(-2.0f*logf(u1)) * cosf(6.2831853f*u2) );
+};
+
 #endif   // end of _MLP_UTIL_H
 
 
@@ -627,3 +627,528 @@ __kernel void calculateDelta_SSE_Sigmoid(global float* output,global float* targ
     };  
 }; 
 
+
+
+// C = A * B, where B is stored as half precision values and converted to float when loaded, the products are accumulated in float.
+// A is a M x K matrix, C is a M x N matrix, B is a K x N matrix (transB == 0) or a N x K matrix (transB != 0).
+// Each 16x16 work group calculates one 16x16 block of C by going through the 16x16 blocks of A and B staged in the local memory
+__kernel void gemm_half_weights(global const float *A, global const half *B, global float *C, int M, int N, int K, int transB)
+{
+	int lidx = get_local_id(0); 
+	int lidy = get_local_id(1); 
+	int col = get_group_id(0)*16 + lidx; 
+	int row = get_group_id(1)*16 + lidy; 
+
+	local float Atile[16][16]; 
+	local float Btile[16][17];     // one more column to avoid bank conflicts when stored transposed
+
+	float mysum = 0.0f; 
+
+	for (int k0=0; k0 < K; k0 += 16) {
+	     int ka = k0 + lidx; 
+
+	     Atile[lidy][lidx] = ( (row < M) && (ka < K) )? A[row*K+ka] : 0.0f; 
+
+	     if ( transB ) {     // let the neighbouring threads read the neighbouring values of one row of B
+	          int bn = get_group_id(0)*16 + lidy; 
+	          int bk = k0 + lidx; 
+
+	          Btile[lidx][lidy] = ( (bn < N) && (bk < K) )? vload_half(bn*K+bk, B) : 0.0f; 
+	     }
+	     else {
+	          int bk = k0 + lidy; 
+
+	          Btile[lidy][lidx] = ( (bk < K) && (col < N) )? vload_half(bk*N+col, B) : 0.0f; 
+	     }; 
+
+	     barrier(CLK_LOCAL_MEM_FENCE); 
+
+	     for (int k=0; k < 16; k++) 
+	          mysum += Atile[lidy][k] * Btile[k][lidx]; 
+
+	     barrier(CLK_LOCAL_MEM_FENCE); 
+	}; 
+
+	if ( (row < M) && (col < N) ) 
+	     C[row*N+col] = mysum; 
+}; 
+
+// quantize each row of X to int8 with a scale for each row, which is fixedScale if it is positive, or else calculated from the 
+// maximum absolute value of the row. One work-group of 256 threads for each row
+__kernel void quantize_rows(global const float *X, global char *Q, global float *rowScales, int width, float fixedScale)
+{
+	int row = get_group_id(0); 
+	int lidx = get_local_id(0); 
+	int lsize0 = get_local_size(0); 
+
+	local float ltmpvals[256]; 
+
+	float scale = fixedScale; 
+
+	if ( scale <= 0.0f ) {
+	     float mymax = 0.0f; 
+
+	     for (int k=lidx; k < width; k += lsize0) 
+	          mymax = fmax(mymax, fabs(X[row*width+k])); 
+
+	     ltmpvals[lidx] = mymax; 
+
+	     barrier(CLK_LOCAL_MEM_FENCE);
+
+	     int idx_size = lsize0/2; 
+	     while ( idx_size ) {
+	           if ( lidx < idx_size ) 
+	                ltmpvals[lidx] = fmax(ltmpvals[lidx], ltmpvals[lidx+idx_size]); 
+	           idx_size = idx_size >> 1; 
+	           barrier(CLK_LOCAL_MEM_FENCE);
+	     }; 
+
+	     scale = (ltmpvals[0] > 0.0f)? ltmpvals[0]/127.0f : 1.0f; 
+	}; 
+
+	float invScale = 1.0f/scale; 
+
+	for (int k=lidx; k < width; k += lsize0) 
+	     Q[row*width+k] = convert_char_sat_rte(clamp(X[row*width+k]*invScale, -127.0f, 127.0f)); 
+
+	if ( lidx == 0 ) 
+	     rowScales[row] = scale; 
+};
+
+// C = A * B with int8 A and B, where A is M x K and B is K x N, or N x K when transB is set. The products are accumulated in
+// int and restored to float by the scale of each row of A and the scale of each column of C
+__kernel void gemm_int8(global const char *A, global const char *B, global const float *rowScales, global const float *colScales, 
+	                    global float *C, int M, int N, int K, int transB)
+{
+	int lidx = get_local_id(0); 
+	int lidy = get_local_id(1); 
+	int col = get_group_id(0)*16 + lidx; 
+	int row = get_group_id(1)*16 + lidy; 
+
+	local int Atile[16][16]; 
+	local int Btile[16][17];     // one more column to avoid bank conflicts when stored transposed
+
+	int mysum = 0; 
+
+	for (int k0=0; k0 < K; k0 += 16) {
+	     int ka = k0 + lidx; 
+
+	     Atile[lidy][lidx] = ( (row < M) && (ka < K) )? A[row*K+ka] : 0; 
+
+	     if ( transB ) {     // let the neighbouring threads read the neighbouring values of one row of B
+	          int bn = get_group_id(0)*16 + lidy; 
+	          int bk = k0 + lidx; 
+
+	          Btile[lidx][lidy] = ( (bn < N) && (bk < K) )? B[bn*K+bk] : 0; 
+	     }
+	     else {
+	          int bk = k0 + lidy; 
+
+	          Btile[lidy][lidx] = ( (bk < K) && (col < N) )? B[bk*N+col] : 0; 
+	     }; 
+
+	     barrier(CLK_LOCAL_MEM_FENCE); 
+
+	     for (int k=0; k < 16; k++) 
+	          mysum += Atile[lidy][k] * Btile[k][lidx]; 
+
+	     barrier(CLK_LOCAL_MEM_FENCE); 
+	}; 
+
+	if ( (row < M) && (col < N) ) 
+	     C[row*N+col] = (float)mysum * rowScales[row] * colScales[col]; 
+};
+
+// ranges[idx] = max(ranges[idx], the maximum absolute value of X), used to calibrate the int8 scales. One work-group of 256 threads
+__kernel void absmax_accumulate(global const float *X, int num, global float *ranges, int idx)
+{
+	int lidx = get_local_id(0); 
+	int lsize0 = get_local_size(0); 
+
+	local float ltmpvals[256]; 
+
+	float mymax = 0.0f; 
+
+	for (int k=lidx; k < num; k += lsize0) 
+	     mymax = fmax(mymax, fabs(X[k])); 
+
+	ltmpvals[lidx] = mymax; 
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	int idx_size = lsize0/2; 
+	while ( idx_size ) {
+	      if ( lidx < idx_size ) 
+	           ltmpvals[lidx] = fmax(ltmpvals[lidx], ltmpvals[lidx+idx_size]); 
+	      idx_size = idx_size >> 1; 
+	      barrier(CLK_LOCAL_MEM_FENCE);
+	}; 
+
+	if ( lidx == 0 ) 
+	     ranges[idx] = fmax(ranges[idx], ltmpvals[0]); 
+};
+
+// the k largest values of each row of X and their column indices, in descending order, the smaller index first for equal values.
+// Each of the k passes selects the largest value ranking after the one selected by the previous pass, which is cheap for the
+// small k used by decoding. One work-group of 256 threads for each row
+__kernel void topk_rows(global const float *X, global int *indices, global float *scores, int width, int k)
+{
+	int row = get_group_id(0); 
+	int lidx = get_local_id(0); 
+	int lsize0 = get_local_size(0); 
+
+	local float ltmpvals[256]; 
+	local int ltmpidxs[256]; 
+
+	float lastVal = INFINITY; 
+	int lastIdx = -1; 
+
+	for (int j=0; j < k; j++) {
+	     float myval = -INFINITY; 
+	     int myidx = -1; 
+
+	     for (int col=lidx; col < width; col += lsize0) {
+	          float val = X[row*width+col]; 
+
+	          if ( ( (val < lastVal) || ((val == lastVal) && (col > lastIdx)) ) && ( (myidx < 0) || (val > myval) ) ) {
+	               myval = val; 
+	               myidx = col; 
+	          }; 
+	     }; 
+
+	     ltmpvals[lidx] = myval; 
+	     ltmpidxs[lidx] = myidx; 
+
+	     barrier(CLK_LOCAL_MEM_FENCE);
+
+	     int idx_size = lsize0/2; 
+	     while ( idx_size ) {
+	           if ( lidx < idx_size ) {
+	                float val = ltmpvals[lidx+idx_size]; 
+	                int col = ltmpidxs[lidx+idx_size]; 
+
+	                if ( (col >= 0) && ( (ltmpidxs[lidx] < 0) || (val > ltmpvals[lidx]) || ((val == ltmpvals[lidx]) && (col < ltmpidxs[lidx])) ) ) {
+	                     ltmpvals[lidx] = val; 
+	                     ltmpidxs[lidx] = col; 
+	                }; 
+	           }; 
+	           idx_size = idx_size >> 1; 
+	           barrier(CLK_LOCAL_MEM_FENCE);
+	     }; 
+
+	     lastVal = ltmpvals[0]; 
+	     lastIdx = ltmpidxs[0]; 
+
+	     if ( lidx == 0 ) {
+	          indices[row*k+j] = lastIdx; 
+	          scores[row*k+j] = (lastIdx >= 0)? lastVal : 0.0f; 
+	     }; 
+
+	     barrier(CLK_LOCAL_MEM_FENCE);       // ltmpvals[0] is read by all threads before the next pass
+	}; 
+};
+
+// dst[r,:] = src[rows[r],:] for the num rows listed in rows, used to gather the output weights and biases of the sampled classes
+__kernel void gather_rows(global const float *src, global const int *rows, global float *dst, int width, int num)
+{
+	int gidx = get_global_id(0); 
+	int gidy = get_global_id(1); 
+
+	if ( (gidx < width) && (gidy < num) ) 
+	     dst[gidy*width+gidx] = src[rows[gidy]*width+gidx]; 
+};
+
+// V[rows[r],:] = G[r,:] + momentum * V[rows[r],:] and W[rows[r],:] += V[rows[r],:], only the rows listed in rows are updated, so the
+// variance of the classes not sampled by this batch is kept rather than decayed
+__kernel void update_sampled_rows(global float *W, global float *V, global const float *G, global const int *rows, int width, int num, float momentum)
+{
+	int gidx = get_global_id(0); 
+	int gidy = get_global_id(1); 
+
+	if ( (gidx < width) && (gidy < num) ) {
+	     int idx = rows[gidy]*width+gidx; 
+	     float var = G[gidy*width+gidx] + momentum * V[idx]; 
+
+	     V[idx] = var; 
+	     W[idx] += var; 
+	}; 
+};
+
+// C = alpha * op(A) * op(B) + beta * C, where A and B are stored as half precision values and converted to float when loaded, the products are
+// accumulated in float. op(A) is M x K, stored as a M x K matrix (transA == 0) or a K x M matrix (transA != 0), op(B) is K x N, stored
+// as a K x N matrix (transB == 0) or a N x K matrix (transB != 0). Each 16x16 work group calculates one 16x16 block of C
+__kernel void gemm_half(global const half *A, global const half *B, global float *C, int M, int N, int K, int transA, int transB, float alpha, float beta)
+{
+	int lidx = get_local_id(0); 
+	int lidy = get_local_id(1); 
+	int col = get_group_id(0)*16 + lidx; 
+	int row = get_group_id(1)*16 + lidy; 
+
+	local float Atile[16][17]; 
+	local float Btile[16][17];     // one more column to avoid bank conflicts when stored transposed
+
+	float mysum = 0.0f; 
+
+	for (int k0=0; k0 < K; k0 += 16) {
+	     if ( transA ) {     // let the neighbouring threads read the neighbouring values of one row of A
+	          int am = get_group_id(1)*16 + lidx; 
+	          int ak = k0 + lidy; 
+
+	          Atile[lidx][lidy] = ( (am < M) && (ak < K) )? vload_half(ak*M+am, A) : 0.0f; 
+	     }
+	     else {
+	          int ak = k0 + lidx; 
+
+	          Atile[lidy][lidx] = ( (row < M) && (ak < K) )? vload_half(row*K+ak, A) : 0.0f; 
+	     }; 
+
+	     if ( transB ) {
+	          int bn = get_group_id(0)*16 + lidy; 
+	          int bk = k0 + lidx; 
+
+	          Btile[lidx][lidy] = ( (bn < N) && (bk < K) )? vload_half(bn*K+bk, B) : 0.0f; 
+	     }
+	     else {
+	          int bk = k0 + lidy; 
+
+	          Btile[lidy][lidx] = ( (bk < K) && (col < N) )? vload_half(bk*N+col, B) : 0.0f; 
+	     }; 
+
+	     barrier(CLK_LOCAL_MEM_FENCE); 
+
+	     for (int k=0; k < 16; k++) 
+	          mysum += Atile[lidy][k] * Btile[k][lidx]; 
+
+	     barrier(CLK_LOCAL_MEM_FENCE); 
+	}; 
+
+	if ( (row < M) && (col < N) ) 
+	     C[row*N+col] = (beta == 0.0f)? alpha * mysum : alpha * mysum + beta * C[row*N+col];     // C is not read when beta is zero
+};
+
+// Y = scale * X stored in half precision, rounded to the nearest, the values out of the half range become infinite
+__kernel void convert_to_half(global const float *X, global half *Y, int num, float scale)
+{
+	int gid = get_global_id(0); 
+
+	if ( gid < num ) 
+	     vstore_half_rte(scale * X[gid], gid, Y); 
+};
+
+__kernel void convert_to_float(global const half *X, global float *Y, int num)
+{
+	int gid = get_global_id(0); 
+
+	if ( gid < num ) 
+	     Y[gid] = vload_half(gid, X); 
+};
+
+// flag[0] is set to 1 if any value of X is infinite or NaN
+__kernel void check_finite(global const float *X, int num, global int *flag)
+{
+	int gid = get_global_id(0); 
+
+	if ( (gid < num) && !isfinite(X[gid]) ) 
+	     flag[0] = 1; 
+};
+
+// V = G + momentum * V and W += V in one pass, each of W, V and G is read once and W and V are written once
+__kernel void apply_momentum(global float *W, global float *V, global const float *G, int num, float momentum)
+{
+	int gid = get_global_id(0); 
+
+	if ( gid < num ) {
+	     float var = G[gid] + momentum * V[gid]; 
+
+	     V[gid] = var; 
+	     W[gid] += var; 
+	}; 
+};
+
+// same as apply_momentum, also refreshes Wh, the half precision copy of W used by gemm_half
+__kernel void apply_momentum_half(global float *W, global float *V, global const float *G, global half *Wh, int num, float momentum)
+{
+	int gid = get_global_id(0); 
+
+	if ( gid < num ) {
+	     float var = G[gid] + momentum * V[gid]; 
+	     float w = W[gid] + var; 
+
+	     V[gid] = var; 
+	     W[gid] = w; 
+	     vstore_half_rte(w, gid, Wh); 
+	}; 
+};
+
+// y = max(x, slope*x), slope being 0 for ReLU and a small positive value for leaky ReLU
+__kernel void activate_relu(global const float *x, global float *y, int width, int height, float slope)
+{	
+    int gidx = get_global_id(0); 
+	int gidy = get_global_id(1); 
+
+	if ( (gidx < DIVUPK(width,4)) && (gidy < height) ) {
+	      if ( gidx < width/4  ) {
+		       float4 xx4; 
+
+			   xx4 = vload4(0, (global float *)&x[gidy*width+gidx*4]); 
+			   vstore4(fmax(xx4, slope*xx4), 0, (global float *)&y[gidy*width+gidx*4]); 
+		  }
+		  else {   // usually we need not go here since width is a multiple of 4
+		       int left = width % 4; 
+               
+			   for (int i=0; i< left; i++) {
+			        float xx; 
+
+					xx = x[gidy*width+gidx*4+i];
+					y[gidy*width+gidx*4+i] = fmax(xx, slope*xx); 
+			   }; 
+		  }; 
+    };  
+}
+
+// same as activate_relu on x + biases, the biases vector is added to each row, so the expanded biases matrix and the Saxpy are not needed
+__kernel void bias_activate_relu(global const float *x, global const float *biases, global float *y, int width, int height, float slope)
+{	
+    int gidx = get_global_id(0); 
+	int gidy = get_global_id(1); 
+
+	if ( (gidx < DIVUPK(width,4)) && (gidy < height) ) {
+	      if ( gidx < width/4  ) {
+		       float4 xx4; 
+
+			   xx4 = vload4(0, (global float *)&x[gidy*width+gidx*4]) + vload4(0, (global float *)&biases[gidx*4]); 
+			   vstore4(fmax(xx4, slope*xx4), 0, (global float *)&y[gidy*width+gidx*4]); 
+		  }
+		  else {   // usually we need not go here since width is a multiple of 4
+		       int left = width % 4; 
+               
+			   for (int i=0; i< left; i++) {
+			        float xx; 
+
+					xx = x[gidy*width+gidx*4+i] + biases[gidx*4+i];
+					y[gidy*width+gidx*4+i] = fmax(xx, slope*xx); 
+			   }; 
+		  }; 
+    };  
+}
+
+// the derivative is taken from the output y, which has the same sign as the input since slope is not negative
+__kernel void derivative_relu(global float *delta1, global const float *y, global float *delta2, int width, int height, float slope)
+{	
+	int gidx = get_global_id(0);
+	int gidy = get_global_id(1); 
+
+	if ( (gidx < DIVUPK(width,4)) && (gidy < height) ) {
+	      if ( gidx < width/4  ) {
+		       float4 dd4, yy4;  
+
+			   dd4 = vload4(0, (global float *)&delta1[gidy*width+gidx*4]); 
+			   yy4 = vload4(0, (global float *)&y[gidy*width+gidx*4]); 
+			   dd4 = dd4 * select((float4)slope, (float4)1.0f, yy4 > 0.0f); 
+
+			   vstore4(dd4, 0, (global float *)&delta2[gidy*width+gidx*4]); 
+		  }
+		  else {   // usually we need not go here since width is a multiple of 4
+		       int left = width % 4; 
+               
+			   for (int i=0; i< left; i++) {
+			        float dd,yy; 
+
+					dd = delta1[gidy*width+gidx*4+i];
+					yy = y[gidy*width+gidx*4+i];
+					
+					delta2[gidy*width+gidx*4+i] = (yy > 0.0f)? dd : dd*slope; 
+			   }; 
+		  }; 
+    };  
+}
+
+// C = alpha * A * B + beta * C, A being M x K in the CSR format, B being K x N (or N x K with transB), C being M x N (or N x M with
+// transC). Each work group computes 256 columns of one row of C, the non-zeroes of the row of A are staged in the local memory and
+// shared by the work group, so A is read once for each 256 columns. C is not read when beta is 0
+__kernel void spmm_csr(global const int *rowPtrs, global const int *colIndices, global const float *values, global const float *B, global float *C,
+                       int M, int N, int K, int transB, int transC, float alpha, float beta)
+{
+	local int lcols[256];
+	local float lvals[256];
+
+	int col = get_global_id(0);
+	int row = get_group_id(1);
+	int lid = get_local_id(0);
+
+	int start = rowPtrs[row];
+	int end = rowPtrs[row+1];
+	float sum = 0.0f;
+
+	for (int base = start; base < end; base += 256) {
+	     int cnt = min(256, end-base);
+
+		 if ( lid < cnt ) {
+		      lcols[lid] = colIndices[base+lid];
+		      lvals[lid] = values[base+lid];
+		 };
+		 barrier(CLK_LOCAL_MEM_FENCE);
+
+		 if ( col < N ) {
+		      if ( transB )
+			       for (int i=0; i < cnt; i++)
+			            sum += lvals[i] * B[col*K+lcols[i]];
+		      else
+			       for (int i=0; i < cnt; i++)
+			            sum += lvals[i] * B[lcols[i]*N+col];
+		 };
+		 barrier(CLK_LOCAL_MEM_FENCE);
+	};
+
+	if ( col < N ) {
+	     int idx = transC? col*M+row : row*N+col;
+
+	     C[idx] = (beta == 0.0f)? alpha*sum : alpha*sum + beta*C[idx];
+	};
+};
+
+// C = A * transpose(W), A being M x K, C being M x N, W being N x K in the block compressed sparse row format with 4x4 blocks (conv_bsr.h).
+// Each work-item computes the 4 columns of one row of C from one block row of W, only the non-zero blocks are read
+__kernel void gemm_bsr(global const float *A, global const uint *rowPtrs, global const uint *colIndices, global const float *values, global float *C,
+                       int M, int N, int K)
+{
+	int br = get_global_id(0);
+	int row = get_global_id(1);
+
+	if ( (br*4 >= N) || (row >= M) )
+	     return;
+
+	global const float *arow = A + row*K;
+	float4 sum = (float4)(0.0f);
+
+	for (uint b = rowPtrs[br]; b < rowPtrs[br+1]; b++) {
+	     int k = colIndices[b]*4;
+		 float4 a;
+
+		 if ( k+4 <= K )
+		      a = vload4(0, arow+k);
+		 else {   // the last block column of W is padded with zeroes when K is not a multiple of 4
+		      a.x = arow[k];
+		      a.y = (k+1 < K)? arow[k+1] : 0.0f;
+		      a.z = (k+2 < K)? arow[k+2] : 0.0f;
+		      a.w = 0.0f;
+		 };
+
+		 sum.x += dot(vload4(0, values+b*16), a);
+		 sum.y += dot(vload4(1, values+b*16), a);
+		 sum.z += dot(vload4(2, values+b*16), a);
+		 sum.w += dot(vload4(3, values+b*16), a);
+	};
+
+	int col = br*4;
+
+	if ( col+4 <= N )
+	     vstore4(sum, 0, C+row*N+col);
+	else {
+	     C[row*N+col] = sum.x;
+		 if ( col+1 < N )
+		      C[row*N+col+1] = sum.y;
+		 if ( col+2 < N )
+		      C[row*N+col+2] = sum.z;
+	};
+};
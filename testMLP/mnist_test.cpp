@@ -7,14 +7,24 @@
  */
 
 #include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
 
 #include "MLPUtil.h"
 #include "MLPTrainerOCL.h"
+#include "MLPTrainerMultiOCL.h"
 #include "MLPTesterOCL.h"
 #include "MLPPredictorOCL.h"
 #include "MLPConfigProvider.h"
 #include "DNNMNistDataProvider.h"
 #include "MLPChkPointingMgr.h"
+#include "MLPQuantizer.h"
+#include "MLPPruner.h"
+#include "MLPFactorizer.h"
+#include "MLPOclProfiler.h"
+#include "oclUtil.h"
+#include "DNNTracer.h"
 
 using namespace std;
 
@@ -24,9 +34,17 @@ using namespace std;
 void mnist_training();
 void mnist_training2();
 void mnist_training3();     // training with checkpointing support
+void mnist_training4();     // training on multiple devices with checkpointing support
+void mnist_training5();     // mixed precision training on the OpenCL CPU device
+void mnist_training6();     // training with the sparse inputs of the first layer
+void mnist_training7();     // training with the device time of each kernel profiled and the timeline traced
+void mnist_training8();     // checking that the training resumed from a checkpoint gets the same weights as the uninterrupted one
 void mnist_batch_testing();
 void mnist_single_testing();
 void mnist_predicting();
+void mnist_quantizing();
+void mnist_pruning();
+void mnist_factorizing();
 
 void test_cp_cleanup();
 
@@ -207,6 +225,325 @@ void mnist_training3()
 	delete trainerp;
 };
 
+// doing MNIST training on multiple devices with checkpointing support, use DNN_OCL_CPU to run it with the sub-devices of the CPU
+void mnist_training4()
+{
+	struct dnn_tv startv, endv;
+
+	int minibatch = 1024;
+	int shuffleBatches = 20;
+	int nDevices = 2;
+	int batches;
+	int totalbatches;
+
+	MLPCheckPointManager cpManager;
+	MLPConfigProvider *configProviderp=NULL;
+    DNNDataProvider *dataProviderp=NULL;
+
+	configProviderp = new MLPConfigProvider("./", "mlp_training_init.conf", "mlp_nnet_init.dat");
+
+	dataProviderp = new DNNMNistDataProvider(MNIST_PATH, false, DNN_DATAMODE_SP_TRAIN, minibatch, shuffleBatches);
+	dataProviderp->setupDataProvider(0, true);
+
+	// Training the neural network using MNist labelled dataset, each device trains minibatch/nDevices frames of each minibatch
+    MLPTrainerBase *trainerp;
+
+    trainerp = new MLPTrainerMultiOCL(*configProviderp,*dataProviderp, DNN_OCL_DGPU, nDevices, minibatch);
+
+	cpManager.enableCheckPointing(*trainerp, "./tmp/");
+	MLP_CHECK( cpManager.startCheckPointing() );
+
+	totalbatches = dataProviderp->getTotalBatches();
+
+	cout << totalbatches << " batches of data to be trained on " << nDevices << " devices with " << trainerp->getEpochs() << " epoches, just waiting..." << endl;
+
+	getCurrentTime(&startv);
+	batches = trainerp->batchTrainingWithCheckPointing(0, 0, 0, true);
+	getCurrentTime(&endv);
+
+	MLP_CHECK( cpManager.endCheckPointing() );
+
+	cout << batches << " batches of data were trained actually" << endl;
+    cout << "Training duration: " << diff_msec(&startv, &endv) << " mill-seconds" << endl;
+
+    // Finalize the result from the training work, so that the Tester or Predictor can be set up based on it
+	trainerp->saveNetConfig("./");
+
+	cpManager.cpCleanUp("./tmp/");
+
+	delete configProviderp;
+	delete dataProviderp;
+	delete trainerp;
+};
+
+// doing MNIST training with the inputs/outputs and delta of the layers kept in half precision, the OpenCL CPU device is used so that
+// the result can be compared with that of the float training without a GPU
+void mnist_training5()
+{
+	struct dnn_tv startv, endv;
+
+	int minibatch = 1024;
+	int shuffleBatches = 20;
+	int batches;
+	int totalbatches;
+
+	MLPConfigProvider *configProviderp=NULL;
+    DNNDataProvider *dataProviderp=NULL;
+
+    MLPTrainerBase *trainerp;
+
+	dataProviderp = new DNNMNistDataProvider(MNIST_PATH, false, DNN_DATAMODE_SP_TRAIN, minibatch, shuffleBatches);
+	dataProviderp->setupDataProvider();                            // set up the data provider
+
+	totalbatches = dataProviderp->getTotalBatches();
+
+	configProviderp = new MLPConfigProvider("./", "mlp_training_init.conf", "mlp_nnet_init.dat");
+
+    trainerp = new MLPTrainerOCL(*configProviderp,*dataProviderp, DNN_OCL_CPU, minibatch, MLP_DATA_FLOAT16);    // set up the trainer
+
+	cout << totalbatches << " batches of data to be trained in mixed precision with " << trainerp->getEpochs() << " epoches, just waiting..." << endl;
+
+	getCurrentTime(&startv);
+	batches = trainerp->batchTraining(0);                                       // do the training
+	getCurrentTime(&endv);
+
+	cout << batches << " batches of data were trained actually" << endl;
+    cout << "Training duration: " << diff_msec(&startv, &endv) << " mill-seconds" << endl;
+
+	trainerp->saveNetConfig("./");
+
+	delete configProviderp;
+	delete dataProviderp;
+	delete trainerp;
+};
+
+// doing MNIST training with the batches also provided in the CSR format, so the first layer is computed by the sparse kernel
+void mnist_training6()
+{
+	struct dnn_tv startv, endv;
+
+	int minibatch = 1024;
+	int shuffleBatches = 20;
+	int batches;
+	int totalbatches;
+
+	MLPConfigProvider *configProviderp=NULL;
+    DNNDataProvider *dataProviderp=NULL;
+
+    MLPTrainerBase *trainerp;
+
+	// most pixels of the MNist images are background, so the batches are also provided in the CSR format for the first layer
+	dataProviderp = new DNNMNistDataProvider(MNIST_PATH, false, DNN_DATAMODE_SP_TRAIN, minibatch, shuffleBatches);
+	dataProviderp->setSparseFeatures(true);
+	dataProviderp->setupDataProvider();                            // set up the data provider
+
+	totalbatches = dataProviderp->getTotalBatches();
+
+	configProviderp = new MLPConfigProvider("./", "mlp_training_init.conf", "mlp_nnet_init.dat");
+
+    trainerp = new MLPTrainerOCL(*configProviderp,*dataProviderp, DNN_OCL_DI_GPU, minibatch);    // set up the trainer
+
+	cout << totalbatches << " batches of data to be trained with sparse inputs with " << trainerp->getEpochs() << " epoches, just waiting..." << endl;
+
+	getCurrentTime(&startv);
+	batches = trainerp->batchTraining(0);                                       // do the training
+	getCurrentTime(&endv);
+
+	cout << batches << " batches of data were trained actually" << endl;
+    cout << "Training duration: " << diff_msec(&startv, &endv) << " mill-seconds" << endl;
+
+	trainerp->saveNetConfig("./");
+
+	delete configProviderp;
+	delete dataProviderp;
+	delete trainerp;
+};
+
+// doing MNIST training with the device time of each kernel profiled and the timeline of the host threads and the device commands
+// saved as a Chrome trace
+void mnist_training7()
+{
+	struct dnn_tv startv, endv;
+
+	int minibatch = 1024;
+	int shuffleBatches = 20;
+	int batches;
+	int totalbatches;
+
+	MLPConfigProvider *configProviderp=NULL;
+    DNNDataProvider *dataProviderp=NULL;
+
+    MLPTrainerOCL *trainerp;
+
+	// the spans of the data provider worker are recorded from its first batch
+	dnn_trace_start();
+
+	dataProviderp = new DNNMNistDataProvider(MNIST_PATH, false, DNN_DATAMODE_SP_TRAIN, minibatch, shuffleBatches);
+	dataProviderp->setupDataProvider();                            // set up the data provider
+
+	totalbatches = dataProviderp->getTotalBatches();
+
+	configProviderp = new MLPConfigProvider("./", "mlp_training_init.conf", "mlp_nnet_init.dat");
+
+	// the command queue must be created with profiling enabled, so this is set before the trainer is created
+	set_ocl_queue_profiling(true);
+
+    trainerp = new MLPTrainerOCL(*configProviderp,*dataProviderp, DNN_OCL_DI_GPU, minibatch);    // set up the trainer
+
+	cout << totalbatches << " batches of data to be trained with profiling with " << trainerp->getEpochs() << " epoches, just waiting..." << endl;
+
+	getCurrentTime(&startv);
+	batches = trainerp->batchTraining(0);                                       // do the training
+	getCurrentTime(&endv);
+
+	cout << batches << " batches of data were trained actually" << endl;
+    cout << "Training duration: " << diff_msec(&startv, &endv) << " mill-seconds" << endl;
+
+	trainerp->getProfiler()->showProfile(cout);
+
+	dnn_trace_stop();
+	if ( dnn_trace_save("mnist_training_trace.json") == 0 )
+		 cout << "The timeline of the training was saved to mnist_training_trace.json" << endl;
+
+	set_ocl_queue_profiling(false);
+
+	delete configProviderp;
+	delete dataProviderp;
+	delete trainerp;
+};
+
+struct mnist_cp_request {
+	MLPTrainerBase *trainerp;
+	struct MLPCheckPointState state;
+};
+
+// asks for one checkpoint a second after the training started, which usually lands inside an accumulation group
+static void *mnist_cp_fun(void *argp)
+{
+	struct mnist_cp_request *reqp = (struct mnist_cp_request *) argp;
+
+	DNN_SLEEP(1);
+	reqp->trainerp->checkPointing(reqp->state);
+
+	return(NULL);
+};
+
+static void mnist_save_trained(MLPTrainerBase *trainerp, int layers, int dimensions[], const char *nnetDataFile)
+{
+	MLPConfigProvider netProvider(layers, dimensions, false);
+
+	trainerp->synchronizeNetConfig(netProvider);
+	netProvider.saveConfig("./", "mlp_training_cmp.conf", nnetDataFile);
+};
+
+// doing MNIST training with accumulateSteps batches summed for each update, once uninterrupted and once resumed from a checkpoint
+// taken during the first one, the outputs of the two neural networks on the testing set should be the same. The momentum is zero
+// since the velocity of the weights is not saved with the checkpoint, and each batch is shuffled alone so it has the same frames
+// in both trainings
+void mnist_training8()
+{
+	int minibatch = 1024;
+	int shuffleBatches = 1;
+	int accumulateSteps = 4;
+
+	int layers = 4;
+	int dimensions[] = { 784, 512, 256, 10 };
+	float etas[] = { 0.0f, 0.01f, 0.01f, 0.01f };
+	ACT_FUNC actFuncs[] = { ANOFUNC, AFUNC_RELU, AFUNC_RELU, AFUNC_SOFTMAX };
+
+	MLPConfigProvider *configProviderp=NULL;
+    DNNDataProvider *dataProviderp=NULL;
+    MLPTrainerBase *trainerp;
+
+	struct mnist_cp_request request;
+
+#ifdef _WIN32
+	HANDLE cpThread;
+#else
+	pthread_t cpThread;
+#endif
+
+	// the uninterrupted training, with the checkpoint taken by another thread on the way
+	configProviderp = new MLPConfigProvider(NETTYPE_MULTI_CLASSIFICATION, layers, dimensions, etas, 0.0f, actFuncs, CFUNC_CE, 2, true);
+	configProviderp->setAccumulateSteps(accumulateSteps);
+
+	dataProviderp = new DNNMNistDataProvider(MNIST_PATH, false, DNN_DATAMODE_SP_TRAIN, minibatch, shuffleBatches);
+	dataProviderp->setupDataProvider(0, true);
+
+    trainerp = new MLPTrainerOCL(*configProviderp,*dataProviderp, DNN_OCL_DI_GPU, minibatch);
+
+	request.trainerp = trainerp;
+	strcpy(request.state.netConfPath, "./");
+	strcpy(request.state.ncTrainingConfigFname, "mlp_training_cp.conf");
+	strcpy(request.state.ncNNetDataFname, "mlp_nnet_cp.dat");
+
+	DNN_CREATE_THREAD(&cpThread, mnist_cp_fun, &request);
+
+	trainerp->batchTrainingWithCheckPointing(0, 0, 0, true);
+
+	DNN_JOIN_THREAD(cpThread);
+
+	mnist_save_trained(trainerp, layers, dimensions, "mlp_nnet_full.dat");
+
+	cout << "Checkpoint taken at batch " << request.state.cpBatchNo << " of epoch " << request.state.cpEpoch << endl;
+
+	delete configProviderp;
+	delete dataProviderp;
+	delete trainerp;
+
+	// the training resumed from the checkpoint
+	configProviderp = new MLPConfigProvider(request.state.netConfPath, request.state.ncTrainingConfigFname, request.state.ncNNetDataFname);
+
+	dataProviderp = new DNNMNistDataProvider(MNIST_PATH, false, DNN_DATAMODE_SP_TRAIN, minibatch, shuffleBatches);
+	dataProviderp->setupDataProvider(request.state.cpFrameNo, true);
+
+    trainerp = new MLPTrainerOCL(*configProviderp,*dataProviderp, DNN_OCL_DI_GPU, minibatch);
+
+	trainerp->batchTrainingWithCheckPointing(0, request.state.cpBatchNo, request.state.cpEpoch, true);
+
+	mnist_save_trained(trainerp, layers, dimensions, "mlp_nnet_resumed.dat");
+
+	delete configProviderp;
+	delete dataProviderp;
+	delete trainerp;
+
+	// the frames are summed in a different order by the two trainings, so the outputs are only compared within a tolerance
+	MLPConfigProvider fullProvider("./", "mlp_nnet_full.dat");
+	MLPConfigProvider resumedProvider("./", "mlp_nnet_resumed.dat");
+	MLPPredictorOCL fullPredictor(fullProvider, DNN_OCL_DI_GPU, minibatch);
+	MLPPredictorOCL resumedPredictor(resumedProvider, DNN_OCL_DI_GPU, minibatch);
+
+	int outSize = fullPredictor.getOutputVectorSize();
+	float *inputVectors;
+	float *fullOutputs = new float[outSize*minibatch];
+	float *resumedOutputs = new float[outSize*minibatch];
+	float maxDiff = 0.0f;
+
+	dataProviderp =	new DNNMNistDataProvider(MNIST_PATH, false, DNN_DATAMODE_TEST, minibatch, shuffleBatches);
+	dataProviderp->setupDataProvider();
+
+	while ( dataProviderp->batchAvailable() ) {
+		    MLP_CHECK(dataProviderp->getBatchData(minibatch,inputVectors,true));
+
+			int validFrames = dataProviderp->getValidFrames();
+
+			fullPredictor.batchPredicting(inputVectors,fullOutputs,validFrames);
+			resumedPredictor.batchPredicting(inputVectors,resumedOutputs,validFrames);
+
+			for (int k=0; k < validFrames*outSize; k++)
+				 maxDiff = max(maxDiff, (float)fabs(fullOutputs[k]-resumedOutputs[k]));
+
+			MLP_CHECK(dataProviderp->nextBatch());
+	};
+
+	cout << "Maximum difference of the outputs of the uninterrupted and the resumed training: " << maxDiff << endl;
+	cout << ( (maxDiff < 1.0e-3f)? "The resumed training reproduces the weights" : "The resumed training does not reproduce the weights" ) << endl;
+
+	delete [] fullOutputs;
+	delete [] resumedOutputs;
+	delete dataProviderp;
+};
+
 void mnist_batch_testing()
 {
 	struct dnn_tv startv, endv;
@@ -304,7 +641,7 @@ void mnist_single_testing()
 
 		    MLP_CHECK(dataProviderp->getBatchData(testerp->getBatchSize(),inputVectors, labelVectors, true));
 
-			for (int i=0; i< testerp->getBatchSize(); i++) {
+			for (int i=0; i< dataProviderp->getValidFrames(); i++) {
 				 if ( testerp->singleTesting(&inputVectors[i*inVecLen], &labelVectors[i*outVecLen], mnist_output_matching) )
                        succNum++;
 				 frames++;
@@ -362,7 +699,7 @@ void mnist_predicting()
 
 		    MLP_CHECK(dataProviderp->getBatchData(predictorp->getBatchSize(),inputVectors,true));
 
-			predictorp->batchPredicting(inputVectors,outputVectors);
+			predictorp->batchPredicting(inputVectors,outputVectors,dataProviderp->getValidFrames());
 
             // tell the data provider that I have done with current batch of data, want next batch of data
 			MLP_CHECK(dataProviderp->nextBatch());
@@ -375,6 +712,49 @@ void mnist_predicting()
 	cout << "Predicting duration: " << diff_msec(&startv, &endv) << " mill-seconds" << endl;
 	cout << "Batch size:" << predictorp->getBatchSize() << ", " << batches << " batches predicted" << endl;
 
+	dataProviderp->resetDataProvider();
+
+	// Only the best classes of each frame are read back, they should be the ones found from all the outputs
+	int topk = 3;
+	int outSize = predictorp->getOutputVectorSize();
+	int *topIndices = new int[topk*minibatch];
+	float *topScores = new float[topk*minibatch];
+	int sameFrames=0;
+
+	getCurrentTime(&startv);
+
+	batches=0;
+	frames=0;
+	while ( dataProviderp->batchAvailable() ) {
+
+		    MLP_CHECK(dataProviderp->getBatchData(predictorp->getBatchSize(),inputVectors,true));
+
+			int validFrames = dataProviderp->getValidFrames();
+
+			predictorp->batchPredictingTopK(inputVectors,validFrames,topk,topIndices,topScores);
+			predictorp->batchPredicting(inputVectors,outputVectors,validFrames);
+
+			for (int k=0; k < validFrames; k++) {
+				 float *out = &outputVectors[k*outSize];
+
+				 if ( max_element(out, out+outSize) - out == topIndices[k*topk] )
+					  sameFrames++;
+				 frames++;
+			};
+
+			MLP_CHECK(dataProviderp->nextBatch());
+
+			batches++;
+	}
+
+    getCurrentTime(&endv);
+
+	cout << "Top-" << topk << " predicting duration (with the full predicting for checking): " << diff_msec(&startv, &endv) << " mill-seconds" << endl;
+	cout << sameFrames << " of " << frames << " frames have the same best class from the top-" << topk << " predicting" << endl;
+
+	delete [] topIndices;
+	delete [] topScores;
+
 	delete [] outputVectors;
 
 
@@ -424,4 +804,169 @@ void mnist_predicting()
 	delete predictorp;
 };
 
+// predicting with the float neural network in baseFile and its variant in variantFile, whose weights are kept on the device as
+// variantType, the time of both and the frames classified to the same class by both are shown, label names the variant
+static void compare_predictors(DNNDataProvider &dataProvider, int minibatch, const char *baseFile, const char *variantFile, MLP_DATA_TYPE variantType,
+	                           const char *label)
+{
+	struct dnn_tv startv, endv;
 
+	MLPConfigProvider *configProviderp;
+	MLPConfigProvider *variantConfigProviderp;
+	MLPPredictorBase *predictorp=NULL;
+	MLPPredictorBase *variantPredictorp=NULL;
+	float *inputVectors;
+	float *outputVectors;
+	float *variantOutputVectors;
+
+	configProviderp = new MLPConfigProvider("./", baseFile);
+	variantConfigProviderp = new MLPConfigProvider("./", variantFile);
+
+	predictorp = new MLPPredictorOCL(*configProviderp, DNN_OCL_DI_GPU, minibatch);
+	variantPredictorp = new MLPPredictorOCL(*variantConfigProviderp, DNN_OCL_DI_GPU, minibatch, variantType);
+
+	int outSize = predictorp->getOutputVectorSize();
+
+	outputVectors = new float[outSize*minibatch];
+	variantOutputVectors = new float[outSize*minibatch];
+
+	long floatTime=0, variantTime=0;
+	int frames=0, sameFrames=0;
+
+	int batches=0;
+	while ( dataProvider.batchAvailable() ) {
+
+		    MLP_CHECK(dataProvider.getBatchData(minibatch,inputVectors,true));
+
+			int validFrames = dataProvider.getValidFrames();
+
+			getCurrentTime(&startv);
+			predictorp->batchPredicting(inputVectors,outputVectors,validFrames);
+			getCurrentTime(&endv);
+			floatTime += diff_usec(&startv, &endv);
+
+			getCurrentTime(&startv);
+			variantPredictorp->batchPredicting(inputVectors,variantOutputVectors,validFrames);
+			getCurrentTime(&endv);
+			variantTime += diff_usec(&startv, &endv);
+
+			// count the frames classified to the same class by the two neural networks
+			for (int k=0; k < validFrames; k++) {
+				 float *out1 = &outputVectors[k*outSize];
+				 float *out2 = &variantOutputVectors[k*outSize];
+
+				 if ( max_element(out1, out1+outSize) - out1 == max_element(out2, out2+outSize) - out2 )
+					  sameFrames++;
+				 frames++;
+			};
+
+            // tell the data provider that I have done with current batch of data, want next batch of data
+			MLP_CHECK(dataProvider.nextBatch());
+
+			batches++;
+	}
+
+	cout << batches << " batches predicted, float duration: " << floatTime << " micro-seconds, " << label << " duration: " << variantTime << " micro-seconds" << endl;
+	cout << sameFrames << " of " << frames << " frames classified same by the float and the " << label << " neural network" << endl;
+
+	delete [] outputVectors;
+	delete [] variantOutputVectors;
+
+	delete predictorp;
+	delete variantPredictorp;
+	delete configProviderp;
+	delete variantConfigProviderp;
+};
+
+// calibrate the int8 scales with the MNist testing dataset, then compare the int8 predicting with the float predicting
+void mnist_quantizing()
+{
+	int minibatch = 1024;
+	int shuffleBatches = 4;
+	int batches;
+
+	MLPConfigProvider *configProviderp=NULL;
+	DNNDataProvider *dataProviderp=NULL;
+	MLPQuantizer *quantizerp=NULL;
+
+	configProviderp = new MLPConfigProvider("./", MLP_CP_TRAINING_CONF_NEW, MLP_CP_NNET_DATA_NEW);
+	dataProviderp =	new DNNMNistDataProvider(MNIST_PATH, false, DNN_DATAMODE_TEST, minibatch, shuffleBatches);
+	dataProviderp->setupDataProvider();                              // set up the data provider
+
+	quantizerp = new MLPQuantizer(*configProviderp, *dataProviderp, DNN_OCL_DI_GPU, minibatch);
+
+	batches = quantizerp->calibrate(0);
+	cout << batches << " batches of data used for the calibration" << endl;
+
+	quantizerp->saveQuantizedConfig("./", "mlp_training_int8.conf", "mlp_nnet_int8.dat");
+
+	delete quantizerp;
+	delete configProviderp;
+
+	// predicting with the float and the int8 neural network
+	dataProviderp->resetDataProvider();
+
+	compare_predictors(*dataProviderp, minibatch, MLP_CP_NNET_DATA_NEW, "mlp_nnet_int8.dat", MLP_DATA_INT8, "int8");
+
+	delete dataProviderp;
+};
+
+
+void mnist_pruning()
+{
+	int minibatch = 1024;
+	int shuffleBatches = 4;
+
+	MLPConfigProvider *configProviderp=NULL;
+	DNNDataProvider *dataProviderp=NULL;
+	MLPPruner *prunerp=NULL;
+
+	configProviderp = new MLPConfigProvider("./", MLP_CP_TRAINING_CONF_NEW, MLP_CP_NNET_DATA_NEW);
+
+	prunerp = new MLPPruner(*configProviderp);
+
+	cout << "The weights pruned to sparsity " << prunerp->pruneAll(0.8f) << endl;
+
+	prunerp->savePrunedConfig("./", "mlp_training_bsr.conf", "mlp_nnet_bsr.dat");
+
+	delete prunerp;
+	delete configProviderp;
+
+	// predicting with the dense and the block sparse neural network
+	dataProviderp =	new DNNMNistDataProvider(MNIST_PATH, false, DNN_DATAMODE_TEST, minibatch, shuffleBatches);
+	dataProviderp->setupDataProvider();                              // set up the data provider
+
+	compare_predictors(*dataProviderp, minibatch, MLP_CP_NNET_DATA_NEW, "mlp_nnet_bsr.dat", MLP_DATA_BSR, "block sparse");
+
+	delete dataProviderp;
+};
+
+void mnist_factorizing()
+{
+	int minibatch = 500;
+	int shuffleBatches = 10;
+
+	MLPConfigProvider *configProviderp=NULL;
+	DNNDataProvider *dataProviderp=NULL;
+	MLPFactorizer *factorizerp=NULL;
+
+	configProviderp = new MLPConfigProvider("./", MLP_CP_TRAINING_CONF_NEW, MLP_CP_NNET_DATA_NEW);
+	dataProviderp =	new DNNMNistDataProvider(MNIST_PATH, false, DNN_DATAMODE_TEST, minibatch, shuffleBatches);
+	dataProviderp->setupDataProvider();                              // set up the data provider
+
+	factorizerp = new MLPFactorizer(*configProviderp);
+
+	// the first layer connecting the input images has the largest weights matrix of the MNist neural network
+	factorizerp->setRank(1, 64);
+	factorizerp->factorize();
+	cout << "The weights of layer 1 factorized to rank 64 with relative error " << factorizerp->getError(1) << endl;
+
+	float ratio = factorizerp->testFactorized(*dataProviderp, DNN_OCL_DI_GPU, minibatch);
+	cout << "Success ratio of the factorized neural network is " << ratio*100.0f << "%" << endl;
+
+	factorizerp->saveFactorizedConfig("./", "mlp_training_svd.conf", "mlp_nnet_svd.dat");
+
+	delete factorizerp;
+	delete dataProviderp;
+	delete configProviderp;
+};
@@ -17,9 +17,17 @@ extern void simple_predicting();
 extern void mnist_training();
 extern void mnist_training2();
 extern void mnist_training3();     // training with checkpointing support
+extern void mnist_training4();     // training on multiple devices with checkpointing support
+extern void mnist_training5();     // mixed precision training on the OpenCL CPU device
+extern void mnist_training6();     // training with the sparse inputs of the first layer
+extern void mnist_training7();     // training with the device time of each kernel profiled and the timeline traced
+extern void mnist_training8();     // checking that the training resumed from a checkpoint gets the same weights as the uninterrupted one
 extern void mnist_batch_testing();
 extern void mnist_single_testing();
 extern void mnist_predicting();
+extern void mnist_quantizing();      // int8 calibration and predicting
+extern void mnist_pruning();         // block pruning and predicting with the block sparse weights
+extern void mnist_factorizing();     // low-rank factorization and testing
 
 extern void ptc_uppercase_training();
 extern void ptc_uppercase_training2();
@@ -78,6 +86,11 @@ int main()
        iflytek_training2();
 	//mnist_training();
 	//mnist_training3();
+	//mnist_training4();
+	//mnist_training5();
+	//mnist_training6();
+	//mnist_training7();
+	//mnist_training8();
 	//ptc_ch_training3();
 	//ptc_uppercase_training2();
 	//ptc_lowercase_training();
@@ -102,6 +115,9 @@ int main()
 	//vlp_ch_batch_testing();
 	//simple_batch_testing();
 	//mnist_predicting();
+	//mnist_quantizing();
+	//mnist_pruning();
+	//mnist_factorizing();
 
 	cout << "Press any key to end ..." << endl;
 
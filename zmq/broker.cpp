@@ -1,171 +1,483 @@
+/*
+ *  MLP inference server based on the LRU broker pattern
+ *
+ *  Clients send requests (see mlp_server_proto.h) with REQ sockets to the frontend. The broker queues the requests and
+ *  coalesces them into batches of up to maxbatch frames, a batch is routed to the least recently used worker thread once it
+ *  is full or its oldest request has waited for maxdelay micro-seconds. Each worker thread owns one MLPPredictorOCL, predicts
+ *  the frames of all requests of the batch together and sends one reply for each request back through the broker
+ *
+ *  Usage: broker [-d cpu|gpu] [-w workers] [-b batchsize] [-m maxbatch] [-t maxdelay] [-e endpoint]... [dir [nnetfile]]
+ *
+ *       dir/nnetfile defaults to ./mlp_nnet_new.dat, the frontend is bound to ipc://frontend.ipc and to tcp port 5672 of all
+ *       interfaces by default (only the tcp port on Windows), use "-d cpu" to run the predictors on an OpenCL CPU device.
+ *       maxbatch defaults to the batch size of the predictors and maxdelay to 1000 micro-seconds, the batch sizes chosen
+ *       are printed when the server stops and can be asked for by a stats request. Sending SIGHUP to the server reloads
+ *       dir/nnetfile in the background, the new weights are used from the next batches without stopping the service
+ */
+
 #include "zhelpers.hpp"
-#include <pthread.h>
 #include <queue>
-
-/*MLP related hpp files*/
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <sstream>
 #include <iostream>
+#include <cstdlib>
+#include <csignal>
 
+/*MLP related hpp files*/
+#include "DNNUtil.h"
 #include "MLPUtil.h"
-#include "MLPTrainerOCL.h"
-#include "MLPTesterOCL.h"
 #include "MLPPredictorOCL.h"
 #include "MLPConfigProvider.h"
-#include "DNNIFlyDataProvider.h"
-#include "MLPChkPointingMgr.h"
+#include "conv_endian.h"
+#include "mlp_server_proto.h"
 
-const int client_num =1;
-const int worker_num =2;
-/*MLP related hpp files*/
+#define BACKEND_ENDPOINT "inproc://mlp_backend"
+#define WORKER_STOP      "STOP"
+#define WORKER_RELOAD    "RELOAD"
+
+struct worker_arg {
+    zmq::context_t *context;
+    MLPPredictorOCL *predictorp;
+    int id;
+    const char *dir;
+    const char *nnetFile;
+};
+
+static volatile sig_atomic_t stopping = 0;
+static volatile sig_atomic_t reload_requested = 0;
+
+static void stop_handler(int sig)
+{
+    stopping = 1;
+}
+
+static void reload_handler(int sig)
+{
+    reload_requested = 1;
+}
+
+// A request waiting in the broker to be batched
+struct pending_request {
+    std::string client_addr;
+    std::string request;
+    unsigned int nFrames;
+    struct dnn_tv arrival;
+};
+
+static std::string
+make_reply(unsigned int status, unsigned int nFrames, unsigned int inputSize, unsigned int outputSize)
+{
+    struct mlp_srv_header reply;
+    std::string msg;
 
-/*initiate MLP related class instances*/
- static void *
-init(){
-  
- }
-//  Basic request-reply client using REQ socket
+    memcpy(reply.tag, MLP_SRV_REPLY_TAG, 4);
+    reply.status = status;
+    reply.nFrames = nFrames;
+    reply.inputSize = inputSize;
+    reply.outputSize = outputSize;
+    mlp_srv_pack_header(reply, msg);
+
+    return (msg);
+}
+
+//  Check that the request is well formed and its frames fit the input layer, returns the MLP_SRV_STATUS
 //
-static void *
-client_thread(void *arg) {
-    zmq::context_t context(1);
-    zmq::socket_t client(context, ZMQ_REQ);
+static unsigned int
+check_request(const std::string &request, unsigned int inputSize, struct mlp_srv_header &header)
+{
+    if ( !mlp_srv_unpack_header(request, MLP_SRV_REQUEST_TAG, header) || (request.length() - sizeof(header)) % sizeof(float) != 0 ||
+         (request.length() - sizeof(header)) / sizeof(float) != (size_t)header.nFrames*header.inputSize )
+        return (MLP_SRV_BAD_REQUEST);
 
-#if (defined (WIN32))
-    s_set_id(client, (intptr_t)arg);
-    client.connect("tcp://localhost:5672"); // frontend
-#else
-    s_set_id(client); // Set a printable identity
-    client.connect("ipc://frontend.ipc");
-#endif
+    if ( header.nFrames > 0 && header.inputSize != inputSize )
+        return (MLP_SRV_BAD_SIZE);
+
+    return (MLP_SRV_OK);
+}
+
+//  One "<frames> <batches>" line for each batch size used, the last counter also has the single requests beyond maxbatch frames
+//
+static std::string
+format_batch_stats(const std::vector<unsigned long> &batchCounts)
+{
+    std::ostringstream stats;
+
+    for (size_t frames=1; frames < batchCounts.size(); frames++)
+         if (batchCounts[frames] > 0)
+             stats << frames << " " << batchCounts[frames] << "\n";
+
+    return (stats.str());
+}
+
+//  Predict the frames of all requests of a batch together by batches of the predictor, the frames of one request may be
+//  split over two predictor batches, only the frames filled are computed for the last predictor batch. The predictor
+//  batches are double buffered, the inputs of one predictor batch are converted and submitted while the previous one
+//  is computed. The requests have been checked by the broker
+//
+static void
+serve_batch(MLPPredictorOCL *predictorp, const std::vector<std::string> &requests, std::vector<std::string> &replies, float *inBatch[2], float *outBatch[2])
+{
+    int batchSize = predictorp->getBatchSize();
+    int inputSize = predictorp->getInputVectorSize();
+    int outputSize = predictorp->getOutputVectorSize();
+    size_t nRequests = requests.size();
+
+    std::vector<unsigned int> nFrames(nRequests);
+    std::vector<std::string> outputs(nRequests);
+    size_t totalFrames = 0;
+
+    for (size_t i=0; i < nRequests; i++) {
+        struct mlp_srv_header header;
+
+        mlp_srv_unpack_header(requests[i], MLP_SRV_REQUEST_TAG, header);
+        nFrames[i] = header.nFrames;
+        outputs[i].assign((size_t)nFrames[i]*outputSize*sizeof(float), '\0');
+        totalFrames += nFrames[i];
+    }
+
+    replies.resize(nRequests);
+
+    // the request and the frame within the request to read the next input from and to write the next output to
+    size_t inReq = 0, inFrame = 0;
+    size_t outReq = 0, outFrame = 0;
+
+    size_t batches = (totalFrames + batchSize - 1) / batchSize;
+    int tickets[2];
+    int batchFrames[2];
 
-/*MLP init*/
+    try {
+        for (size_t k=0; k <= batches; k++) {
+            if (k < batches) {
+                int b = k % 2;
+                int frames = (int)std::min<size_t>(batchSize, totalFrames - k*batchSize);
 
-        int minibatch = 1024;
-        int batches;
-        int totalbatches;
-        int frames;
+                for (int frame=0; frame < frames; ) {
+                    while (inFrame == nFrames[inReq]) {
+                        inReq++;
+                        inFrame = 0;
+                    }
+                    int count = (int)std::min<size_t>(frames-frame, nFrames[inReq]-inFrame);
+
+                    BytesToFloatArray(requests[inReq].data() + sizeof(struct mlp_srv_header) + inFrame*inputSize*sizeof(float),
+                                      inBatch[b] + (size_t)frame*inputSize, (size_t)count*inputSize);
+                    frame += count;
+                    inFrame += count;
+                }
+
+                batchFrames[b] = frames;
+                tickets[b] = predictorp->submitPredicting(inBatch[b], outBatch[b], frames);
+            }
 
-        MLPConfigProvider *configProviderp=NULL;
-        configProviderp = new MLPConfigProvider("./", MLP_CP_NNET_DATA_NEW);
+            if (k > 0) {
+                int b = (k-1) % 2;
 
-        // Using MNist testing dataset to do batch predicting on the trained neural network
+                predictorp->waitPredicting(tickets[b]);
 
-        DNNDataProvider **dataProviderp;
-        float **inputVectors;
-        for( int i=0; i< client_num; i++){
-          *dataProviderp[i] = new DNNIFlyDataProvider(".", DNN_DATAMODE_PREDICT, minibatch, 0);
-          *dataProviderp[i]->setupDataProvider();                              // set up the data provider
+                for (int frame=0; frame < batchFrames[b]; ) {
+                    while (outFrame == nFrames[outReq]) {
+                        outReq++;
+                        outFrame = 0;
+                    }
+                    int count = (int)std::min<size_t>(batchFrames[b]-frame, nFrames[outReq]-outFrame);
+
+                    FloatArrayToBytes(outBatch[b] + (size_t)frame*outputSize, &outputs[outReq][outFrame*outputSize*sizeof(float)], (size_t)count*outputSize);
+                    frame += count;
+                    outFrame += count;
+                }
+            }
         }
-/*MLP init*/
- /*
-     while ( dataProviderp->batchAvailable() && (batches < totalbatches) ) 
-            MLP_CHECK(dataProviderp->getBatchData(predictorp->getBatchSize(),inputVectors,true));
-            socket_sent(worker, inputVectors);
-            std::string reply = s_recv(client);
-            std::cout << "Client: " << reply << std::endl;
-            MLP_CHECK(dataProviderp->nextBatch());
-            batches++;
-         }
-*/
-    //  Send request, get reply
-    s_send(client, "HELLO");
-    std::string reply = s_recv(client);
-    std::cout << "Client: " << reply << std::endl;
-    return (NULL);
+    }
+    catch (std::exception &e) {
+        for (size_t i=0; i < nRequests; i++)
+            replies[i] = make_reply(MLP_SRV_FAILED, 0, inputSize, outputSize);
+        return;
+    }
+
+    for (size_t i=0; i < nRequests; i++) {
+        replies[i] = make_reply(MLP_SRV_OK, nFrames[i], inputSize, outputSize);
+        replies[i].append(outputs[i]);
+    }
 }
 
 //  Worker using REQ socket to do LRU routing
 //
 static void *
-worker_thread(void *arg) {
-    zmq::context_t context(1);
-    zmq::socket_t worker(context, ZMQ_REQ);
+worker_thread(void *argp) {
+    struct worker_arg *arg = (struct worker_arg *)argp;
+    zmq::socket_t worker(*arg->context, ZMQ_REQ);
 
-#if (defined (WIN32))
-    s_set_id(worker, (intptr_t)arg);
-    worker.connect("tcp://localhost:5673"); // backend
-#else
-    s_set_id(worker);
-    worker.connect("ipc://backend.ipc");
-#endif
+    std::ostringstream identity;
+    identity << "worker-" << arg->id;
+    worker.setsockopt(ZMQ_IDENTITY, identity.str().c_str(), identity.str().length());
+    worker.connect(BACKEND_ENDPOINT);
 
-/*MLP*/
+    MLPPredictorOCL *predictorp = arg->predictorp;
+    float *inBatch[2], *outBatch[2];
 
-        MLPPrediictorBase **predictorp;
-        float **outputVectors;
-        for (int i=0; i < worker_num; i++){
-         *predictorp[i] = new MLPPredictorOCL(*configProviderp,DNN_OCL_DI_GPU, minibatch);
-         *outputVectors[i] = new float[predictorp->getOutputVectorSize()*minibatch];
-/*MLP*/
+    for (int b=0; b < 2; b++) {
+        inBatch[b] = new float[predictorp->getInputVectorSize()*predictorp->getBatchSize()];
+        outBatch[b] = new float[predictorp->getOutputVectorSize()*predictorp->getBatchSize()];
+    }
 
     //  Tell backend we're ready for work
     s_send(worker, "READY");
 
     while (1) {
-        //  Read and save all frames until we get an empty frame
-        //  In this example there is only 1 but it could be more
-        std::string address = s_recv(worker);
-        {
-            std::string empty = s_recv(worker);
-            assert(empty.size() == 0);
+        //  A batch is [count][address][request]...[address][request], the broker sends a single STOP frame to shut down
+        std::string count = s_recv(worker);
+        if (count.compare(WORKER_STOP) == 0)
+            break;
+
+        //  The predictors share the device model, reloading it by one worker is enough for all of them
+        if (count.compare(WORKER_RELOAD) == 0) {
+            try {
+                predictorp->reloadModel(arg->dir, arg->nnetFile);
+            }
+            catch (std::exception &e) {
+                std::cerr << "MLP server: failed to start reloading the neural network" << std::endl;
+            }
+            s_send(worker, "READY");
+            continue;
         }
 
-        //  Get request, send reply
-        std::string request = s_recv(worker);
-        std::cout << "Worker: " << request << std::endl;
+        int nRequests = atoi(count.c_str());
+        std::vector<std::string> addresses(nRequests);
+        std::vector<std::string> requests(nRequests);
+        std::vector<std::string> replies;
+
+        for (int i=0; i < nRequests; i++) {
+            addresses[i] = s_recv(worker);
+            requests[i] = s_recv(worker);
+        }
 
-       /*MLP*/
-       // predictorp->batchPredicting(inputVectors,outputVectors);
-       //s_sendmore(worker, address);
-        s_sendmore(worker, address);
-        s_sendmore(worker, "");
-        s_send(worker, "OK");
+        serve_batch(predictorp, requests, replies, inBatch, outBatch);
+
+        //  The replies are sent back in the same form
+        s_sendmore(worker, count);
+        for (int i=0; i < nRequests; i++) {
+            s_sendmore(worker, addresses[i]);
+            if (i < nRequests-1)
+                s_sendmore(worker, replies[i]);
+            else
+                s_send(worker, replies[i]);
+        }
     }
+
+    for (int b=0; b < 2; b++) {
+        delete [] inBatch[b];
+        delete [] outBatch[b];
+    }
+
     return (NULL);
 }
 
 int main(int argc, char *argv[])
 {
+    DNN_OCL_DEVTYPE devType = DNN_OCL_DI_GPU;
+    int worker_num = 2;
+    int batchSize = 256;
+    int maxBatch = 0;
+    long maxDelay = 1000;
+    std::vector<std::string> endpoints;
+    std::string dir("./");
+    std::string nnetFile(MLP_CP_NNET_DATA_NEW);
+    int positionals = 0;
+
+    for (int i=1; i < argc; i++) {
+        std::string arg(argv[i]);
+
+        if (arg == "-d" && i+1 < argc)
+            devType = (std::string(argv[++i]) == "cpu")? DNN_OCL_CPU : DNN_OCL_DI_GPU;
+        else if (arg == "-w" && i+1 < argc)
+            worker_num = atoi(argv[++i]);
+        else if (arg == "-b" && i+1 < argc)
+            batchSize = atoi(argv[++i]);
+        else if (arg == "-m" && i+1 < argc)
+            maxBatch = atoi(argv[++i]);
+        else if (arg == "-t" && i+1 < argc)
+            maxDelay = atol(argv[++i]);
+        else if (arg == "-e" && i+1 < argc)
+            endpoints.push_back(argv[++i]);
+        else if (arg[0] != '-' && positionals == 0) {
+            dir = (arg[arg.length()-1] == '/')? arg : arg + "/";
+            positionals++;
+        }
+        else if (arg[0] != '-' && positionals == 1) {
+            nnetFile = arg;
+            positionals++;
+        }
+        else {
+            std::cerr << "Usage: broker [-d cpu|gpu] [-w workers] [-b batchsize] [-m maxbatch] [-t maxdelay] [-e endpoint]... [dir [nnetfile]]" << std::endl;
+            return 1;
+        }
+    }
+
+    if (maxBatch == 0)
+        maxBatch = batchSize;
+
+    if (worker_num < 1 || batchSize < 1 || maxBatch < 1 || maxDelay < 0) {
+        std::cerr << "The number of workers and the batch sizes should be positive" << std::endl;
+        return 1;
+    }
+
+    if (endpoints.empty()) {
+#if (!defined (WIN32))
+        endpoints.push_back("ipc://frontend.ipc");
+#endif
+        endpoints.push_back("tcp://*:5672");
+    }
+
+    // The predictors are created here rather than by the worker threads, since the class wide OpenCL set up of the
+    // MLPPredictorOCL is not thread-safe. Each predictor has its own command queue, kernels and layer buffers, so it can
+    // be used by one worker thread while the other predictors are used by other threads, the weights on the device are
+    // shared by all predictors
+    MLPConfigProvider configProvider(dir.c_str(), nnetFile.c_str());
+    std::vector<MLPPredictorOCL *> predictors;
+
+    MLPPredictorOCL *firstPredictor = new MLPPredictorOCL(configProvider, devType, batchSize);
+    predictors.push_back(firstPredictor);
+    for (int i=1; i < worker_num; i++)
+        predictors.push_back(new MLPPredictorOCL(*firstPredictor, batchSize));
 
     //  Prepare our context and sockets
     zmq::context_t context(1);
     zmq::socket_t frontend(context, ZMQ_ROUTER);
     zmq::socket_t backend(context, ZMQ_ROUTER);
 
-#if (defined (WIN32))
-    frontend.bind("tcp://*:5672"); // frontend
-    backend.bind("tcp://*:5673"); // backend
+    for (size_t i=0; i < endpoints.size(); i++)
+        frontend.bind(endpoints[i].c_str());
+    backend.bind(BACKEND_ENDPOINT);
+
+    std::vector<struct worker_arg> worker_args(worker_num);
+#ifdef _WIN32
+    std::vector<HANDLE> workers(worker_num);
 #else
-    frontend.bind("ipc://frontend.ipc");
-    backend.bind("ipc://backend.ipc");
+    std::vector<pthread_t> workers(worker_num);
 #endif
 
-    int client_nbr;
-    for (client_nbr = 0; client_nbr < client_num; client_nbr++) {
-        pthread_t client;
-        pthread_create(&client, NULL, client_thread, (void *)(intptr_t)client_nbr);
-    }
-    int worker_nbr;
-    for (worker_nbr = 0; worker_nbr < worker_num; worker_nbr++) {
-        pthread_t worker;
-        pthread_create(&worker, NULL, worker_thread, (void *)(intptr_t)worker_nbr);
+    for (int worker_nbr = 0; worker_nbr < worker_num; worker_nbr++) {
+        worker_args[worker_nbr].context = &context;
+        worker_args[worker_nbr].predictorp = predictors[worker_nbr];
+        worker_args[worker_nbr].id = worker_nbr;
+        worker_args[worker_nbr].dir = dir.c_str();
+        worker_args[worker_nbr].nnetFile = nnetFile.c_str();
+        DNN_CREATE_THREAD(&workers[worker_nbr], worker_thread, &worker_args[worker_nbr]);
     }
 
+    signal(SIGINT, stop_handler);
+    signal(SIGTERM, stop_handler);
+#ifdef SIGHUP
+    signal(SIGHUP, reload_handler);
+#endif
+
+    unsigned int inputSize = configProvider.getInputLayerSize();
+    unsigned int outputSize = configProvider.getOutputLayerSize();
+
+    std::cout << "MLP server: " << worker_num << " workers, input size " << inputSize << ", output size " << outputSize
+              << ", batches of up to " << maxBatch << " frames or " << maxDelay << " micro-seconds" << std::endl;
 
     std::queue<std::string> worker_queue;
+    int running_workers = worker_num;
 
-    while (1) {
+    //  Requests waiting to be batched, new requests are not read once enough frames are waiting to keep all workers busy
+    std::deque<struct pending_request> pending;
+    size_t pendingFrames = 0;
+    size_t maxPendingFrames = (size_t)2*maxBatch*worker_num;
+
+    //  batchCounts[n] is the number of batches of n frames routed to the workers
+    std::vector<unsigned long> batchCounts(maxBatch+1, 0);
+
+    while (running_workers > 0) {
+        struct dnn_tv now;
+
+        //  Route batches to the idle workers, a batch is routed once it is full, once its first request has waited for
+        //  maxDelay or when stopping
+        while (worker_queue.size() && pending.size()) {
+            size_t nRequests = 0;
+            size_t frames = 0;
+
+            while (nRequests < pending.size() && (nRequests == 0 || frames + pending[nRequests].nFrames <= (size_t)maxBatch))
+                frames += pending[nRequests++].nFrames;
+
+            getCurrentTime(&now);
+            if ( frames < (size_t)maxBatch && nRequests == pending.size() && !stopping &&
+                 diff_usec(&pending.front().arrival, &now) < maxDelay )
+                break;
+
+            std::ostringstream count;
+            count << nRequests;
+
+            s_sendmore(backend, worker_queue.front());
+            s_sendmore(backend, "");
+            s_sendmore(backend, count.str());
+            for (size_t i=0; i < nRequests; i++) {
+                s_sendmore(backend, pending.front().client_addr);
+                if (i < nRequests-1)
+                    s_sendmore(backend, pending.front().request);
+                else
+                    s_send(backend, pending.front().request);
+                pending.pop_front();
+            }
+            worker_queue.pop();
+            pendingFrames -= frames;
+
+            batchCounts[std::min<size_t>(frames, maxBatch)]++;
+        }
+
+        //  An idle worker starts reloading the neural network
+        if (reload_requested && worker_queue.size() && !stopping) {
+            reload_requested = 0;
+
+            s_sendmore(backend, worker_queue.front());
+            s_sendmore(backend, "");
+            s_send(backend, WORKER_RELOAD);
+            worker_queue.pop();
+
+            std::cout << "MLP server: reloading " << dir << nnetFile << std::endl;
+        }
+
+        //  Once stopping and all requests are routed, tell every idle worker to stop, the busy ones are stopped after
+        //  sending their replies
+        if (stopping && pending.empty()) {
+            while (worker_queue.size()) {
+                s_sendmore(backend, worker_queue.front());
+                s_sendmore(backend, "");
+                s_send(backend, WORKER_STOP);
+                worker_queue.pop();
+                running_workers--;
+            }
+            if (running_workers == 0)
+                break;
+        }
 
         //  Initialize poll set
         zmq::pollitem_t items[] = {
             //  Always poll for worker activity on backend
                 { backend, 0, ZMQ_POLLIN, 0 },
-                //  Poll front-end only if we have available workers
+                //  Poll front-end only if there is room for more requests
                 { frontend, 0, ZMQ_POLLIN, 0 }
         };
-        if (worker_queue.size())
-            zmq::poll(&items[0], 2, -1);
-        else
-            zmq::poll(&items[0], 1, -1);
+
+        //  Wake up regularly to check for stopping, or when the first waiting request reaches maxDelay
+        long timeout = 500;
+        if (worker_queue.size() && pending.size()) {
+            getCurrentTime(&now);
+            long remaining = maxDelay - diff_usec(&pending.front().arrival, &now);
+            timeout = std::max<long>(std::min<long>((remaining + 999)/1000, timeout), 0);
+        }
+
+        try {
+            if (pendingFrames < maxPendingFrames && !stopping)
+                zmq::poll(&items[0], 2, timeout);
+            else
+                zmq::poll(&items[0], 1, timeout);
+        }
+        catch (zmq::error_t &e) {
+            continue;              //  interrupted by the signal
+        }
 
         //  Handle worker activity on backend
         if (items[0].revents & ZMQ_POLLIN) {
@@ -179,29 +491,26 @@ int main(int argc, char *argv[])
                 assert(empty.size() == 0);
             }
 
-            //  Third frame is READY or else a client reply address
-            std::string client_addr = s_recv(backend);
+            //  Third frame is READY or else the number of replies
+            std::string count = s_recv(backend);
 
-            //  If client reply, send rest back to frontend
-            if (client_addr.compare("READY") != 0) {
+            //  If client replies, send each one back to frontend
+            if (count.compare("READY") != 0) {
+                int nReplies = atoi(count.c_str());
 
-                    {
-                        std::string empty = s_recv(backend);
-                        assert(empty.size() == 0);
-                    }
-
-                std::string reply = s_recv(backend);
-                s_sendmore(frontend, client_addr);
-                s_sendmore(frontend, "");
-                s_send(frontend, reply);
+                for (int i=0; i < nReplies; i++) {
+                    std::string client_addr = s_recv(backend);
+                    std::string reply = s_recv(backend);
 
-                if (--client_nbr == 0)
-                    break;
+                    s_sendmore(frontend, client_addr);
+                    s_sendmore(frontend, "");
+                    s_send(frontend, reply);
+                }
             }
         }
         if (items[1].revents & ZMQ_POLLIN) {
 
-            //  Now get next client request, route to LRU worker
+            //  Now get next client request
             //  Client request is [address][empty][request]
             std::string client_addr = s_recv(frontend);
 
@@ -211,15 +520,45 @@ int main(int argc, char *argv[])
             }
 
             std::string request = s_recv(frontend);
-            std::string worker_addr = worker_queue.front();//worker_queue [0];
-            worker_queue.pop();
+            struct mlp_srv_header header;
 
-            s_sendmore(backend, worker_addr);
-            s_sendmore(backend, "");
-            s_sendmore(backend, client_addr);
-            s_sendmore(backend, "");
-            s_send(backend, request);
+            //  The statistics, the sizes of the frames and the invalid requests are replied by the broker, the other
+            //  requests wait to be batched
+            if (request.length() >= sizeof(header) && memcmp(request.data(), MLP_SRV_STATS_TAG, 4) == 0) {
+                s_sendmore(frontend, client_addr);
+                s_sendmore(frontend, "");
+                s_send(frontend, make_reply(MLP_SRV_OK, 0, inputSize, outputSize) + format_batch_stats(batchCounts));
+            }
+            else {
+                unsigned int status = check_request(request, inputSize, header);
+
+                if (status != MLP_SRV_OK || header.nFrames == 0) {
+                    s_sendmore(frontend, client_addr);
+                    s_sendmore(frontend, "");
+                    s_send(frontend, make_reply(status, 0, inputSize, outputSize));
+                }
+                else {
+                    struct pending_request pr;
+
+                    pr.client_addr = client_addr;
+                    pr.request = request;
+                    pr.nFrames = header.nFrames;
+                    getCurrentTime(&pr.arrival);
+
+                    pending.push_back(pr);
+                    pendingFrames += pr.nFrames;
+                }
+            }
         }
     }
+
+    for (int worker_nbr = 0; worker_nbr < worker_num; worker_nbr++)
+        DNN_JOIN_THREAD(workers[worker_nbr]);
+
+    for (int i=0; i < worker_num; i++)
+        delete predictors[i];
+
+    std::cout << "MLP server stopped, batches routed (frames batches):" << std::endl << format_batch_stats(batchCounts);
+
     return 0;
 }
@@ -0,0 +1,141 @@
+/*
+ *  Test client of the MLP inference server (broker.cpp)
+ *
+ *  Usage: client [endpoint [requests [frames]]]
+ *
+ *       endpoint defaults to ipc://frontend.ipc (tcp://localhost:5672 on Windows), each request carries the given number of
+ *       random frames, the first request is sent again at the end to check that the server gives the same result, then the
+ *       batch sizes chosen by the server are shown
+ */
+
+#include "zhelpers.hpp"
+#include <vector>
+#include <string>
+#include <iostream>
+#include <cstdlib>
+
+#include "DNNUtil.h"
+#include "conv_endian.h"
+#include "mlp_server_proto.h"
+
+static std::string
+make_request(unsigned int nFrames, unsigned int inputSize, unsigned int seed)
+{
+    struct mlp_srv_header header;
+    std::string msg;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.tag, MLP_SRV_REQUEST_TAG, 4);
+    header.nFrames = nFrames;
+    header.inputSize = inputSize;
+    mlp_srv_pack_header(header, msg);
+
+    std::vector<float> frames((size_t)nFrames*inputSize + 1);
+
+    srand(seed);
+    for (size_t i=0; i < (size_t)nFrames*inputSize; i++)
+        frames[i] = (float)rand()/((float)RAND_MAX+1.0f)-0.5f;
+
+    std::string payload((size_t)nFrames*inputSize*sizeof(float), '\0');
+    FloatArrayToBytes(&frames[0], &payload[0], (size_t)nFrames*inputSize);
+    msg.append(payload);
+
+    return (msg);
+}
+
+//  Send one request and check the reply header, returns the reply
+//
+static std::string
+send_request(zmq::socket_t &client, const std::string &request, unsigned int nFrames, struct mlp_srv_header &header)
+{
+    s_send(client, request);
+    std::string reply = s_recv(client);
+
+    if (!mlp_srv_unpack_header(reply, MLP_SRV_REPLY_TAG, header)) {
+        std::cerr << "Client: invalid reply" << std::endl;
+        exit(1);
+    }
+    if (header.status != MLP_SRV_OK || header.nFrames != nFrames ||
+        reply.length() != sizeof(header) + (size_t)nFrames*header.outputSize*sizeof(float)) {
+        std::cerr << "Client: request failed with status " << header.status << std::endl;
+        exit(1);
+    }
+
+    return (reply);
+}
+
+int main(int argc, char *argv[])
+{
+#if (defined (WIN32))
+    std::string endpoint("tcp://localhost:5672");
+#else
+    std::string endpoint("ipc://frontend.ipc");
+#endif
+    int requests = 100;
+    int frames = 16;
+
+    if (argc > 1)
+        endpoint = argv[1];
+    if (argc > 2)
+        requests = atoi(argv[2]);
+    if (argc > 3)
+        frames = atoi(argv[3]);
+
+    zmq::context_t context(1);
+    zmq::socket_t client(context, ZMQ_REQ);
+    client.connect(endpoint.c_str());
+
+    //  A request without frames gets the sizes of the input and output frames
+    struct mlp_srv_header header;
+    send_request(client, make_request(0, 0, 0), 0, header);
+
+    unsigned int inputSize = header.inputSize;
+    std::cout << "Client: input size " << inputSize << ", output size " << header.outputSize << std::endl;
+
+    struct dnn_tv startv, endv;
+    long totalUsec = 0, maxUsec = 0;
+    std::string first;
+
+    for (int i=0; i < requests; i++) {
+        std::string request = make_request(frames, inputSize, i+1);
+
+        getCurrentTime(&startv);
+        std::string reply = send_request(client, request, frames, header);
+        getCurrentTime(&endv);
+
+        long usec = diff_usec(&startv, &endv);
+        totalUsec += usec;
+        maxUsec = (usec > maxUsec)? usec : maxUsec;
+
+        if (i == 0)
+            first = reply;
+    }
+
+    std::cout << "Client: " << requests << " requests of " << frames << " frames, average latency " << (requests? totalUsec/requests : 0)
+              << " micro-seconds, maximum " << maxUsec << " micro-seconds" << std::endl;
+
+    //  The same frames should give the same outputs, whichever worker serves them
+    if (requests > 0) {
+        std::string again = send_request(client, make_request(frames, inputSize, 1), frames, header);
+
+        if (again != first) {
+            std::cerr << "Client: different outputs for the same request" << std::endl;
+            return 1;
+        }
+        std::cout << "Client: outputs are consistent" << std::endl;
+    }
+
+    //  Show how the server has batched the requests so far
+    memset(&header, 0, sizeof(header));
+    memcpy(header.tag, MLP_SRV_STATS_TAG, 4);
+
+    std::string stats;
+    mlp_srv_pack_header(header, stats);
+    s_send(client, stats);
+    stats = s_recv(client);
+
+    if (mlp_srv_unpack_header(stats, MLP_SRV_REPLY_TAG, header))
+        std::cout << "Client: batches of the server (frames batches):" << std::endl << stats.substr(sizeof(header));
+
+    return 0;
+}
@@ -0,0 +1,67 @@
+/*
+ *  COPYRIGHT:  Copyright (c) 2014 Advanced Micro Devices, Inc.  All rights reserved
+ *
+ *   Messages between the clients and the MLP inference server (broker.cpp). A request is one message of a header followed by
+ *   nFrames*inputSize floats, the reply is one message of a header followed by nFrames*outputSize floats. All fields and floats
+ *   are in Little Endian bytes sequence. A request with zero frames just asks for the sizes of the input and output frames.
+ *   A header with the MLP_SRV_STATS_TAG asks for the batch sizes chosen by the server, the reply header is followed by one
+ *   "<frames> <batches>" text line for each batch size used so far
+ */
+
+#ifndef _MLP_SERVER_PROTO_H_
+#define _MLP_SERVER_PROTO_H_
+
+#include <cstring>
+#include <string>
+
+#include "conv_endian.h"
+
+#define MLP_SRV_REQUEST_TAG "MLPQ"
+#define MLP_SRV_REPLY_TAG   "MLPA"
+#define MLP_SRV_STATS_TAG   "MLPS"          // header only request for the statistics of the server, replied with text lines
+
+enum MLP_SRV_STATUS
+{
+   MLP_SRV_OK = 0,
+   MLP_SRV_BAD_REQUEST = 1,         // the message is not a request or its length does not match the header
+   MLP_SRV_BAD_SIZE = 2,            // inputSize does not match the input layer of the neural network
+   MLP_SRV_FAILED = 3               // predicting failed on the server
+};
+
+struct mlp_srv_header {
+    char tag[4];
+    unsigned int status;            // MLP_SRV_STATUS, only for replies
+    unsigned int nFrames;
+    unsigned int inputSize;         // the number of floats of each input frame
+    unsigned int outputSize;        // the number of floats of each output frame, only for replies
+};
+
+static inline void mlp_srv_pack_header(const struct mlp_srv_header &header, std::string &msg)
+{
+    struct mlp_srv_header tmp = header;
+
+    HostToLEl(tmp.status);
+    HostToLEl(tmp.nFrames);
+    HostToLEl(tmp.inputSize);
+    HostToLEl(tmp.outputSize);
+
+    msg.assign(reinterpret_cast<const char*>(&tmp), sizeof(tmp));
+};
+
+// returns false if the message is too short for the header or does not have the expected tag
+static inline bool mlp_srv_unpack_header(const std::string &msg, const char *tag, struct mlp_srv_header &header)
+{
+    if ( msg.length() < sizeof(header) )
+         return(false);
+
+    memcpy(&header, msg.data(), sizeof(header));
+
+    LEtoHostl(header.status);
+    LEtoHostl(header.nFrames);
+    LEtoHostl(header.inputSize);
+    LEtoHostl(header.outputSize);
+
+    return( memcmp(header.tag, tag, 4) == 0 );
+};
+
+#endif